@@ -0,0 +1,597 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+// Benchmark
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "hmat/hmat.h"
+#include "common/chrono.h"
+
+/** Performance benchmark of the HMatrix library.
+
+    The matrices are those of the cylinder example (1 / r, or the Helmholtz
+    kernel in the complex case) and of the kriging example (exp(-r / l)), on
+    points of a cylinder. For each kernel, scalar type and size, it measures:
+    - the assembly time and the compression ratio of each compression method,
+    - the gemv time and GFLOP/s with one and several right-hand sides,
+    - the iterations and the time per phase of the iterative solvers, without
+      preconditioner and with a coarse LU preconditioner,
+    - the factorization and solve times of each factorization, and for the
+      double precision types of its mixed precision variant.
+
+    Results are written in JSON so that they can be compared between two
+    versions of the library. Run without argument for the default sweep, or
+    see usage() for the options.
+ */
+
+/** Kernels of the examples */
+enum { KERNEL_CYLINDER, KERNEL_KRIGING };
+
+typedef struct {
+  int kernel;
+  double* points;
+  /** wave number of the cylinder kernel */
+  double k;
+  /** correlation length of the kriging kernel */
+  double l;
+} problem_data_t;
+
+typedef struct {
+  int row_start;
+  int col_start;
+  int* row_hmat2client;
+  int* col_hmat2client;
+  problem_data_t* user_context;
+} block_data_t;
+
+/** Options of the benchmark */
+typedef struct {
+  int sizes[32];
+  int sizes_count;
+  const char* types;
+  int kernels[2];
+  int kernels_count;
+  int methods[8];
+  int methods_count;
+  int nrhs;
+  int threads;
+  /** Minimum duration of a timed measurement, short operations are repeated */
+  double min_time;
+  const char* output;
+} options_t;
+
+static const char* method_names[] = {
+  "svd", "aca_full", "aca_partial", "aca_plus", "rand_svd", "aca_blocked"
+};
+static const int method_count = sizeof(method_names) / sizeof(method_names[0]);
+/** Method used for the gemv and factorization measurements */
+static const int default_method = hmat_compress_aca_plus;
+
+static const char* factorization_names[] = { "lu", "ldlt", "llt" };
+static const char* iterative_names[] = { "gmres", "bicgstab", "cg" };
+/** Maximum number of iterations of the iterative solvers */
+static const int iterative_max_iterations = 300;
+
+/** Create an open cylinder point cloud, as in the cylinder example. */
+static double* createCylinder(double radius, double step, int n) {
+  double* result = (double*) malloc(3 * n * sizeof(double));
+  double length = 2 * M_PI * radius;
+  int pointsPerCircle = length / step;
+  double angleStep = 2 * M_PI / pointsPerCircle;
+  int i;
+  for (i = 0; i < n; i++) {
+    result[3*i+0] = radius * cos(angleStep * i);
+    result[3*i+1] = radius * sin(angleStep * i),
+    result[3*i+2] = (step * i) / pointsPerCircle;
+  }
+  return result;
+}
+
+/** Correlation length of the kriging example */
+static double correlationLength(double* points, int n) {
+  int i, d;
+  double l = 0;
+  for (d = 0; d < 3; d++) {
+    double pMin = points[d], pMax = points[d];
+    for (i = 0; i < n; i++) {
+      if (points[3*i+d] < pMin) pMin = points[3*i+d];
+      if (points[3*i+d] > pMax) pMax = points[3*i+d];
+    }
+    if (pMax - pMin > l) l = pMax - pMin;
+  }
+  return 0.1 * l;
+}
+
+/** Compute the interaction between two points, in re and im. */
+static void interaction(problem_data_t* pdata, int i, int j, double* re, double* im) {
+  double* points = pdata->points;
+  double dx = points[3*i+0] - points[3*j+0];
+  double dy = points[3*i+1] - points[3*j+1];
+  double dz = points[3*i+2] - points[3*j+2];
+  double r = sqrt(dx*dx + dy*dy + dz*dz);
+  if (pdata->kernel == KERNEL_KRIGING) {
+    *re = exp(-r / pdata->l);
+    if (im)
+      *im = 0;
+  } else if (im == NULL) {
+    *re = 1. / (r + 1e-10);
+  } else {
+    r += 1e-10;
+    *re = cos(pdata->k * r) / (4 * M_PI * r);
+    *im = sin(pdata->k * r) / (4 * M_PI * r);
+  }
+}
+
+static void free_hmat(void *data) {
+  free((block_data_t*) data);
+}
+
+static void prepare_hmat(int row_start, int row_count, int col_start, int col_count,
+                         int *row_hmat2client, int *row_client2hmat,
+                         int *col_hmat2client, int *col_client2hmat,
+                         void *user_context, hmat_block_info_t * block_info) {
+  block_data_t* bdata;
+  (void) row_count; (void) col_count; (void) row_client2hmat; (void) col_client2hmat;
+  block_info->user_data = calloc(1, sizeof(block_data_t));
+  block_info->release_user_data = free_hmat;
+  bdata = (block_data_t*) block_info->user_data;
+  bdata->row_start = row_start;
+  bdata->col_start = col_start;
+  bdata->row_hmat2client = row_hmat2client;
+  bdata->col_hmat2client = col_hmat2client;
+  bdata->user_context = (problem_data_t*) user_context;
+}
+
+/* Values are always computed in double precision, real or complex */
+static void compute_real(void *data, int rowBlockBegin, int rowBlockCount,
+                         int colBlockBegin, int colBlockCount, void *values) {
+  block_data_t* bdata = (block_data_t*) data;
+  double* dValues = (double*) values;
+  int i, j, pos = 0;
+  for (j = 0; j < colBlockCount; ++j) {
+    int col = bdata->col_hmat2client[j + colBlockBegin + bdata->col_start];
+    for (i = 0; i < rowBlockCount; ++i, ++pos)
+      interaction(bdata->user_context, bdata->row_hmat2client[i + rowBlockBegin + bdata->row_start],
+                  col, &dValues[pos], NULL);
+  }
+}
+
+static void compute_complex(void *data, int rowBlockBegin, int rowBlockCount,
+                            int colBlockBegin, int colBlockCount, void *values) {
+  block_data_t* bdata = (block_data_t*) data;
+  double* zValues = (double*) values;
+  int i, j, pos = 0;
+  for (j = 0; j < colBlockCount; ++j) {
+    int col = bdata->col_hmat2client[j + colBlockBegin + bdata->col_start];
+    for (i = 0; i < rowBlockCount; ++i, ++pos)
+      interaction(bdata->user_context, bdata->row_hmat2client[i + rowBlockBegin + bdata->row_start],
+                  col, &zValues[2*pos], &zValues[2*pos+1]);
+  }
+}
+
+static int is_complex(hmat_value_t type) {
+  return type == HMAT_SIMPLE_COMPLEX || type == HMAT_DOUBLE_COMPLEX;
+}
+
+static size_t scalar_size(hmat_value_t type) {
+  switch (type) {
+  case HMAT_SIMPLE_PRECISION: return sizeof(float);
+  case HMAT_DOUBLE_PRECISION: return sizeof(double);
+  case HMAT_SIMPLE_COMPLEX: return 2 * sizeof(float);
+  default: return 2 * sizeof(double);
+  }
+}
+
+/** Set the i-th value of an array of the given scalar type. */
+static void set_value(hmat_value_t type, void* array, size_t i, double re) {
+  switch (type) {
+  case HMAT_SIMPLE_PRECISION: ((float*) array)[i] = re; break;
+  case HMAT_DOUBLE_PRECISION: ((double*) array)[i] = re; break;
+  case HMAT_SIMPLE_COMPLEX: ((float*) array)[2*i] = re; ((float*) array)[2*i+1] = 0; break;
+  default: ((double*) array)[2*i] = re; ((double*) array)[2*i+1] = 0; break;
+  }
+}
+
+/** Allocate count vectors of size n filled with a smooth pattern. */
+static void* create_vectors(hmat_value_t type, int n, int count) {
+  size_t i, size = ((size_t) n) * count;
+  void* result = malloc(size * scalar_size(type));
+  for (i = 0; i < size; i++)
+    set_value(type, result, i, sin(0.37 * i) + 0.1);
+  return result;
+}
+
+typedef struct {
+  hmat_interface_t* hmat;
+  hmat_value_t type;
+  hmat_cluster_tree_t* cluster_tree;
+  problem_data_t* problem;
+  int n;
+} context_t;
+
+/** Create and assemble a matrix with the given compression method, return the assembly time. */
+static hmat_matrix_t* assemble(context_t* ctx, int method, int symmetric, double* time) {
+  hmat_settings_t settings;
+  hmat_admissibility_t* admissibility = hmat_create_admissibility_standard(3.0);
+  hmat_matrix_t* hmatrix;
+  Time start;
+  hmat_get_parameters(&settings);
+  settings.compressionMethod = method;
+  hmat_set_parameters(&settings);
+  hmatrix = ctx->hmat->create_empty_hmatrix_admissibility(ctx->cluster_tree, ctx->cluster_tree,
+                                                          symmetric, admissibility);
+  hmat_delete_admissibility(admissibility);
+  start = now();
+  ctx->hmat->assemble(hmatrix, ctx->problem, prepare_hmat,
+                      is_complex(ctx->type) ? compute_complex : compute_real, symmetric);
+  *time = time_diff(start, now());
+  return hmatrix;
+}
+
+/** Average time of gemv with nrhs right-hand sides */
+static double time_gemv(context_t* ctx, hmat_matrix_t* hmatrix, int nrhs, double min_time) {
+  double alpha[2] = { 0, 0 }, beta[2] = { 0, 0 };
+  void* x = create_vectors(ctx->type, ctx->n, nrhs);
+  void* y = create_vectors(ctx->type, ctx->n, nrhs);
+  int count = 0;
+  double elapsed;
+  Time start;
+  set_value(ctx->type, alpha, 0, 1.);
+  start = now();
+  do {
+    ctx->hmat->gemv('N', alpha, hmatrix, x, beta, y, nrhs);
+    count++;
+    elapsed = time_diff(start, now());
+  } while (elapsed < min_time);
+  free(x);
+  free(y);
+  return elapsed / count;
+}
+
+/** Average time of the solve with nrhs right-hand sides */
+static double time_solve(context_t* ctx, hmat_matrix_t* hmatrix, int nrhs, double min_time) {
+  void* b = create_vectors(ctx->type, ctx->n, nrhs);
+  int count = 0;
+  double elapsed;
+  Time start = now();
+  do {
+    ctx->hmat->solve_systems(hmatrix, b, nrhs);
+    count++;
+    elapsed = time_diff(start, now());
+  } while (elapsed < min_time);
+  free(b);
+  return elapsed / count;
+}
+
+/** Solve with an iterative method and print its statistics */
+static void print_iterative(FILE* out, context_t* ctx, hmat_matrix_t* hmatrix,
+                            hmat_iterative_method_t method, hmat_factorization_t preconditioner) {
+  const int double_precision = ctx->type == HMAT_DOUBLE_PRECISION || ctx->type == HMAT_DOUBLE_COMPLEX;
+  void* b = create_vectors(ctx->type, ctx->n, 1);
+  hmat_iterative_solver_context_t ictx;
+  hmat_iterative_solver_context_init(&ictx);
+  ictx.method = method;
+  ictx.preconditioner = preconditioner;
+  ictx.tolerance = double_precision ? 1e-8 : 1e-4;
+  ictx.max_iterations = iterative_max_iterations;
+  ctx->hmat->solve_iterative(hmatrix, b, 1, &ictx);
+  fprintf(out, "{\"method\": \"%s\", \"preconditioner\": \"%s\", \"iterations\": %d, "
+          "\"residual\": %e, \"converged\": %s, \"preconditioner_setup_time\": %e, "
+          "\"product_time\": %e, \"preconditioner_apply_time\": %e, \"total_time\": %e}",
+          iterative_names[method],
+          preconditioner == hmat_factorization_none ? "none" : factorization_names[preconditioner],
+          ictx.iterations, ictx.residual, ictx.converged ? "true" : "false",
+          ictx.preconditioner_setup_time, ictx.product_time, ictx.preconditioner_apply_time,
+          ictx.total_time);
+  free(b);
+}
+
+static double compression_ratio(hmat_info_t* info) {
+  return info->uncompressed_size ? ((double) info->compressed_size) / info->uncompressed_size : 0;
+}
+
+/** Print the statistics of a gemv measurement */
+static void print_gemv(FILE* out, context_t* ctx, hmat_info_t* info, int nrhs, double time) {
+  /* A multiply-add is 2 flops in real arithmetic, 8 in complex arithmetic */
+  double flops = (is_complex(ctx->type) ? 8. : 2.) * info->compressed_size * nrhs;
+  fprintf(out, "{\"nrhs\": %d, \"time\": %e, \"gflops\": %e, \"rhs_per_second\": %e}",
+          nrhs, time, flops / time * 1e-9, nrhs / time);
+}
+
+static void benchmark(FILE* out, context_t* ctx, options_t* options) {
+  hmat_matrix_t* hmatrix;
+  hmat_info_t info;
+  double time;
+  int i, t, mixed;
+  const int spd = ctx->problem->kernel == KERNEL_KRIGING;
+  const int double_precision = ctx->type == HMAT_DOUBLE_PRECISION || ctx->type == HMAT_DOUBLE_COMPLEX;
+  int first = 1;
+
+  fprintf(out, "    \"compression\": [");
+  for (i = 0; i < options->methods_count; i++) {
+    const int method = options->methods[i];
+    hmatrix = assemble(ctx, method, 0, &time);
+    ctx->hmat->get_info(hmatrix, &info);
+    fprintf(out, "%s\n      {\"method\": \"%s\", \"assembly_time\": %e, \"compression_ratio\": %e, "
+            "\"compressed_size\": %lu, \"rk_count\": %lu, \"full_count\": %lu, \"assembly_cost\": %e}",
+            i ? "," : "", method_names[method], time, compression_ratio(&info),
+            (unsigned long) info.compressed_size, (unsigned long) info.rk_count,
+            (unsigned long) info.full_count, info.assembly_cost);
+    ctx->hmat->destroy(hmatrix);
+    fflush(out);
+  }
+  fprintf(out, "\n    ],\n");
+
+  hmatrix = assemble(ctx, default_method, 0, &time);
+  ctx->hmat->get_info(hmatrix, &info);
+  fprintf(out, "    \"gemv\": {\"method\": \"%s\", \"assembly_time\": %e, \"compression_ratio\": %e,\n",
+          method_names[default_method], time, compression_ratio(&info));
+  fprintf(out, "      \"single\": ");
+  print_gemv(out, ctx, &info, 1, time_gemv(ctx, hmatrix, 1, options->min_time));
+  fprintf(out, ",\n      \"multi\": ");
+  print_gemv(out, ctx, &info, options->nrhs, time_gemv(ctx, hmatrix, options->nrhs, options->min_time));
+  fprintf(out, "\n    },\n");
+  fflush(out);
+
+  fprintf(out, "    \"iterative\": [");
+  for (i = 0; i < 4; i++) {
+    /* GMRES and BiCGStab, without and with preconditioner */
+    fprintf(out, "%s\n      ", i ? "," : "");
+    print_iterative(out, ctx, hmatrix, i < 2 ? hmat_iterative_gmres : hmat_iterative_bicgstab,
+                    i % 2 ? hmat_factorization_lu : hmat_factorization_none);
+    fflush(out);
+  }
+  fprintf(out, "\n    ],\n");
+  ctx->hmat->destroy(hmatrix);
+  fflush(out);
+
+  fprintf(out, "    \"factorization\": [");
+  for (t = hmat_factorization_lu; t <= hmat_factorization_llt; t++) {
+    /* The cylinder matrices are not positive definite */
+    const int symmetric = t != hmat_factorization_lu;
+    if (t == hmat_factorization_llt && !spd)
+      continue;
+    /* Single precision factors with iterative refinement, for the double precision types */
+    for (mixed = 0; mixed <= double_precision; mixed++) {
+      hmat_factorization_context_t fctx;
+      Time start;
+      hmat_factorization_context_init(&fctx);
+      fctx.factorization = (hmat_factorization_t) t;
+      fctx.mixed_precision = mixed;
+      hmatrix = assemble(ctx, default_method, symmetric, &time);
+      start = now();
+      ctx->hmat->factorize_generic(hmatrix, &fctx);
+      time = time_diff(start, now());
+      fprintf(out, "%s\n      {\"type\": \"%s\", \"mixed_precision\": %s, \"time\": %e, "
+              "\"solve_time\": %e, \"solve_multi_time\": %e, \"nrhs\": %d}",
+              first ? "" : ",", factorization_names[t], mixed ? "true" : "false", time,
+              time_solve(ctx, hmatrix, 1, options->min_time),
+              time_solve(ctx, hmatrix, options->nrhs, options->min_time), options->nrhs);
+      first = 0;
+      ctx->hmat->destroy(hmatrix);
+      fflush(out);
+    }
+  }
+  fprintf(out, "\n    ]\n");
+}
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [-n sizes] [-t types] [-k kernels] [-c methods] [-r nrhs] [-j threads] [-m seconds] [-o file]\n"
+          "  -n  comma separated list of sizes (default 1000,2000,4000)\n"
+          "  -t  scalar types among SDCZ (default SDCZ)\n"
+          "  -k  comma separated list of kernels among cylinder,kriging (default both)\n"
+          "  -c  comma separated list of compression methods among svd,aca_full,aca_partial,\n"
+          "      aca_plus,rand_svd,aca_blocked (default all but svd)\n"
+          "  -r  number of right-hand sides of the multiple gemv and solve (default 16)\n"
+          "  -j  number of threads, 0 for all the processors (default 0)\n"
+          "  -m  minimum duration of the gemv and solve measurements (default 0.2)\n"
+          "  -o  output JSON file (default standard output)\n", program);
+}
+
+/** Index of name in names, or -1 */
+static int find_name(const char* name, size_t length, const char** names, int count) {
+  int i;
+  for (i = 0; i < count; i++)
+    if (strlen(names[i]) == length && strncmp(name, names[i], length) == 0)
+      return i;
+  return -1;
+}
+
+/** Parse a comma separated list of names, return the number of items or -1 */
+static int parse_names(const char* list, const char** names, int count, int* result, int max) {
+  int n = 0;
+  while (*list) {
+    size_t length = strcspn(list, ",");
+    int i = find_name(list, length, names, count);
+    if (i < 0 || n >= max)
+      return -1;
+    result[n++] = i;
+    list += length;
+    if (*list == ',')
+      list++;
+  }
+  return n;
+}
+
+static int parse_options(int argc, char** argv, options_t* options) {
+  static const char* kernel_names[] = { "cylinder", "kriging" };
+  int i;
+  options->sizes[0] = 1000;
+  options->sizes[1] = 2000;
+  options->sizes[2] = 4000;
+  options->sizes_count = 3;
+  options->types = "SDCZ";
+  options->kernels[0] = KERNEL_CYLINDER;
+  options->kernels[1] = KERNEL_KRIGING;
+  options->kernels_count = 2;
+  /* SVD is much slower than the other methods, it is only done on demand */
+  options->methods_count = 0;
+  for (i = hmat_compress_aca_full; i < method_count; i++)
+    options->methods[options->methods_count++] = i;
+  options->nrhs = 16;
+  options->threads = 0;
+  options->min_time = 0.2;
+  options->output = NULL;
+
+  for (i = 1; i < argc; i += 2) {
+    const char* value = argv[i + 1];
+    if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i + 1 >= argc)
+      return 1;
+    switch (argv[i][1]) {
+    case 'n': {
+      char* end;
+      options->sizes_count = 0;
+      do {
+        if (options->sizes_count >= 32)
+          return 1;
+        options->sizes[options->sizes_count] = strtol(value, &end, 10);
+        if (end == value || options->sizes[options->sizes_count++] <= 0)
+          return 1;
+        value = *end == ',' ? end + 1 : end;
+      } while (*end);
+      break;
+    }
+    case 't':
+      if (strlen(value) == 0 || strspn(value, "SDCZ") != strlen(value))
+        return 1;
+      options->types = value;
+      break;
+    case 'k':
+      options->kernels_count = parse_names(value, kernel_names, 2, options->kernels, 2);
+      if (options->kernels_count <= 0)
+        return 1;
+      break;
+    case 'c':
+      options->methods_count = parse_names(value, method_names, method_count, options->methods, 8);
+      if (options->methods_count <= 0)
+        return 1;
+      break;
+    case 'r':
+      options->nrhs = atoi(value);
+      if (options->nrhs <= 0)
+        return 1;
+      break;
+    case 'j':
+      options->threads = atoi(value);
+      if (options->threads < 0)
+        return 1;
+      break;
+    case 'm':
+      options->min_time = atof(value);
+      break;
+    case 'o':
+      options->output = value;
+      break;
+    default:
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  static const char* kernel_names[] = { "cylinder", "kriging" };
+  options_t options;
+  hmat_settings_t settings;
+  FILE* out = stdout;
+  int first = 1;
+  const char* type_code;
+  int i, j;
+
+  if (parse_options(argc, argv, &options)) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (options.output) {
+    out = fopen(options.output, "w");
+    if (out == NULL) {
+      fprintf(stderr, "Cannot open %s\n", options.output);
+      return 1;
+    }
+  }
+
+  hmat_get_parameters(&settings);
+  settings.nbThreads = options.threads;
+  hmat_set_parameters(&settings);
+
+  fprintf(out, "{\n  \"version\": \"%s\",\n  \"build_date\": \"%s\",\n  \"threads\": %d,\n"
+          "  \"assembly_epsilon\": %e,\n  \"results\": [",
+          hmat_get_version(), hmat_get_build_date(), options.threads, settings.assemblyEpsilon);
+
+  for (type_code = options.types; *type_code; type_code++) {
+    hmat_interface_t hmat;
+    hmat_value_t type = HMAT_DOUBLE_COMPLEX;
+    switch (*type_code) {
+    case 'S': type = HMAT_SIMPLE_PRECISION; break;
+    case 'D': type = HMAT_DOUBLE_PRECISION; break;
+    case 'C': type = HMAT_SIMPLE_COMPLEX; break;
+    }
+    hmat_init_parallel_interface(&hmat, type);
+    if (0 != hmat.init()) {
+      fprintf(stderr, "Unable to initialize HMat library\n");
+      return 1;
+    }
+    for (i = 0; i < options.kernels_count; i++) {
+      for (j = 0; j < options.sizes_count; j++) {
+        const int n = options.sizes[j];
+        const double radius = 1.;
+        const double step = 1.75 * M_PI * radius / sqrt((double) n);
+        hmat_clustering_algorithm_t* clustering_algo = hmat_create_clustering_median();
+        hmat_clustering_algorithm_t* clustering = hmat_create_clustering_max_dof(clustering_algo, 80);
+        problem_data_t problem;
+        context_t ctx;
+
+        problem.kernel = options.kernels[i];
+        problem.points = createCylinder(radius, step, n);
+        problem.k = 2 * M_PI / (10. * step); /* 10 points / lambda */
+        problem.l = correlationLength(problem.points, n);
+        ctx.hmat = &hmat;
+        ctx.type = type;
+        ctx.problem = &problem;
+        ctx.n = n;
+        ctx.cluster_tree = hmat_create_cluster_tree(problem.points, 3, n, clustering);
+        hmat_delete_clustering(clustering);
+        hmat_delete_clustering(clustering_algo);
+
+        fprintf(stderr, "Benchmarking %s %c n=%d\n", kernel_names[problem.kernel], *type_code, n);
+        fprintf(out, "%s\n   {\n    \"kernel\": \"%s\", \"type\": \"%c\", \"n\": %d,\n",
+                first ? "" : ",", kernel_names[problem.kernel], *type_code, n);
+        first = 0;
+        benchmark(out, &ctx, &options);
+        fprintf(out, "   }");
+        fflush(out);
+
+        hmat_delete_cluster_tree(ctx.cluster_tree);
+        free(problem.points);
+      }
+    }
+    hmat.finalize();
+  }
+  fprintf(out, "\n  ]\n}\n");
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
@@ -224,8 +224,8 @@ int main(int argc, char **argv) {
   float  *frhs, *frhsCopy1, *frhsCopy2, *frhsCopy3, ferr;
   double diffNorm;
 
-  if (argc != 3) {
-      fprintf(stderr, "Usage: %s n_points (S|D)\n", argv[0]);
+  if (argc != 3 && argc != 4) {
+      fprintf(stderr, "Usage: %s n_points (S|D) [n_threads]\n", argv[0]);
       return 1;
   }
 
@@ -244,7 +244,13 @@ int main(int argc, char **argv) {
   }
 
   hmat_get_parameters(&settings);
-  hmat_init_default_interface(&hmat, type);
+  if (argc == 4) {
+      /* interaction_real is thread safe, so the parallel interface can be used */
+      settings.nbThreads = atoi(argv[3]);
+      hmat_init_parallel_interface(&hmat, type);
+  } else {
+      hmat_init_default_interface(&hmat, type);
+  }
 
   settings.compressionMethod = hmat_compress_aca_plus;
   /*settings->recompress = 0;*/
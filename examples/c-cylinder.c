@@ -22,6 +22,7 @@
 
 // Cylinder
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #ifdef __cplusplus
 #include <complex>
@@ -223,8 +224,8 @@ int main(int argc, char **argv) {
   problem_data_t problem_data;
   hmat_admissibility_t * admissibilityCondition = hmat_create_admissibility_standard(3.0);
 
-  if (argc != 3) {
-    fprintf(stderr, "Usage: %s n_points (S|D|C|Z)\n", argv[0]);
+  if (argc != 3 && argc != 4) {
+    fprintf(stderr, "Usage: %s n_points (S|D|C|Z) [median|sfc]\n", argv[0]);
     return 1;
   }
 
@@ -276,7 +277,15 @@ int main(int argc, char **argv) {
   problem_data.k = k;
   problem_data.type = scalar_type;
 
-  clustering_algo = hmat_create_clustering_median();
+  if (argc == 3 || 0 == strcmp(argv[3], "median")) {
+    clustering_algo = hmat_create_clustering_median();
+  } else if (0 == strcmp(argv[3], "sfc")) {
+    clustering_algo = hmat_create_clustering_sfc();
+  } else {
+    fprintf(stderr, "Unknown clustering %s\n", argv[3]);
+    hmat.finalize();
+    return 1;
+  }
   clustering = hmat_create_clustering_max_dof(clustering_algo, 80);
   cluster_tree = hmat_create_cluster_tree(points, 3, n, clustering);
   hmat_delete_clustering(clustering);
@@ -0,0 +1,223 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "hmat/hmat.h"
+
+/** This example writes an assembled matrix with write_file, reads it back
+    with read_file, and checks that the products are identical and that the
+    loaded matrix can be factorized.  */
+
+/** Create an open cylinder point cloud.
+
+    \param radius Radius of the cylinder
+    \param step distance between two neighboring points
+    \param n number of points
+    \return a vector of points.
+ */
+double* createCylinder(double radius, double step, int n) {
+  double* result = (double*) malloc(3 * n * sizeof(double));
+  double length = 2 * M_PI * radius;
+  int pointsPerCircle = length / step;
+  double angleStep = 2 * M_PI / pointsPerCircle;
+  int i;
+  for (i = 0; i < n; i++) {
+    result[3*i+0] = radius * cos(angleStep * i);
+    result[3*i+1] = radius * sin(angleStep * i),
+    result[3*i+2] = (step * i) / pointsPerCircle;
+  }
+  return result;
+}
+
+typedef struct {
+  int n;
+  double* points;
+  double l;
+} problem_data_t;
+
+/**
+  Define interaction between 2 degrees of freedoms  (real case)
+ */
+void interaction_real(void* data, int i, int j, void* result)
+{
+  problem_data_t* pdata = (problem_data_t*) data;
+  double* points = pdata->points;
+  double r = sqrt((points[3*i] - points[3*j])*(points[3*i] - points[3*j]) +
+                  (points[3*i+1] - points[3*j+1])*(points[3*i+1] - points[3*j+1]) +
+                  (points[3*i+2] - points[3*j+2])*(points[3*i+2] - points[3*j+2]));
+  *((double*)result) = exp(-r / pdata->l);
+}
+
+/** Relative norm of A x - b, with A computed from interaction_real */
+double residual(problem_data_t* pdata, const double* x, const double* b)
+{
+  int i, j;
+  double a, diff, diffNorm = 0., bNorm = 0.;
+  for (i = 0; i < pdata->n; i++) {
+    diff = b[i];
+    for (j = 0; j < pdata->n; j++) {
+      interaction_real(pdata, i, j, &a);
+      diff -= a * x[j];
+    }
+    diffNorm += diff * diff;
+    bNorm += b[i] * b[i];
+  }
+  return sqrt(diffNorm / bNorm);
+}
+
+int main(int argc, char **argv) {
+  const char* filename = "c-file-io.hmat";
+  int i, nrhs = 2;
+  double radius, step;
+  double* points;
+  double *x, *y1, *y2, *b;
+  double pone = 1., zero = 0.;
+  double err;
+  int n;
+  hmat_interface_t hmat;
+  hmat_settings_t settings;
+  hmat_clustering_algorithm_t* clustering;
+  hmat_cluster_tree_t* cluster_tree;
+  hmat_matrix_t *hmatrix, *loaded;
+  problem_data_t problem_data;
+  int rc, failed = 0;
+
+  if (argc != 2) {
+      fprintf(stderr, "Usage: %s n_points\n", argv[0]);
+      return 1;
+  }
+  n = atoi(argv[1]);
+
+  hmat_get_parameters(&settings);
+  hmat_init_default_interface(&hmat, HMAT_DOUBLE_PRECISION);
+  settings.compressionMethod = hmat_compress_aca_plus;
+  hmat_set_parameters(&settings);
+  if (0 != hmat.init())
+  {
+    fprintf(stderr, "Unable to initialize HMat library\n");
+    return 1;
+  }
+
+  radius = 1.;
+  step = 1.75 * M_PI * radius / sqrt((double)n);
+  points = createCylinder(radius, step, n);
+  problem_data.n = n;
+  problem_data.points = points;
+  problem_data.l = 0.5 * radius;
+
+  clustering = hmat_create_clustering_median();
+  cluster_tree = hmat_create_cluster_tree(points, 3, n, clustering);
+  hmat_delete_clustering(clustering);
+  hmatrix = hmat.create_empty_hmatrix(cluster_tree, cluster_tree, 0);
+  rc = hmat.assemble_simple_interaction(hmatrix, &problem_data, interaction_real, 0);
+  if (rc) {
+    fprintf(stderr, "Error in assembly, return code is %d, exiting...\n", rc);
+    hmat.finalize();
+    return rc;
+  }
+
+  x = (double*) malloc(n * nrhs * sizeof(double));
+  y1 = (double*) malloc(n * nrhs * sizeof(double));
+  y2 = (double*) malloc(n * nrhs * sizeof(double));
+  b = (double*) malloc(n * nrhs * sizeof(double));
+  for (i = 0; i < n * nrhs; i++)
+    x[i] = sin(1. + 0.37 * i);
+
+  fprintf(stdout, "Write and read %s...", filename);
+  rc = hmat.write_file(hmatrix, filename);
+  if (rc) {
+    fprintf(stderr, "Error in write_file, return code is %d, exiting...\n", rc);
+    hmat.finalize();
+    return rc;
+  }
+  loaded = hmat.read_file(filename);
+  fprintf(stdout, "done.\n");
+
+  /* The blocks are stored bit for bit, so must be the products */
+  hmat.gemv('N', &pone, hmatrix, x, &zero, y1, nrhs);
+  hmat.gemv('N', &pone, loaded, x, &zero, y2, nrhs);
+  for (i = 0; i < n * nrhs; i++) {
+    if (y1[i] != y2[i]) {
+      fprintf(stderr, "gemv('N') differs at %d: %.17e != %.17e\n", i, y1[i], y2[i]);
+      failed = 1;
+      break;
+    }
+  }
+  hmat.gemv('T', &pone, hmatrix, x, &zero, y1, nrhs);
+  hmat.gemv('T', &pone, loaded, x, &zero, y2, nrhs);
+  for (i = 0; i < n * nrhs; i++) {
+    if (y1[i] != y2[i]) {
+      fprintf(stderr, "gemv('T') differs at %d: %.17e != %.17e\n", i, y1[i], y2[i]);
+      failed = 1;
+      break;
+    }
+  }
+
+  /* The loaded blocks are private mappings of the file, which the
+     factorization overwrites */
+  fprintf(stdout, "LU factorization of the loaded matrix...");
+  rc = hmat.factorize(loaded, hmat_factorization_lu);
+  if (rc) {
+    fprintf(stderr, "Error in factorisation, return code is %d, exiting...\n", rc);
+    hmat.finalize();
+    return rc;
+  }
+  fprintf(stdout, "done.\n");
+  hmat.gemv('N', &pone, hmatrix, x, &zero, b, nrhs);
+  for (i = 0; i < n * nrhs; i++)
+    y2[i] = b[i];
+  hmat.solve_systems(loaded, y2, nrhs);
+  for (i = 0; i < nrhs; i++) {
+    err = residual(&problem_data, &y2[i * n], &b[i * n]);
+    fprintf(stdout, "||Ax - b|| / ||b|| = %e\n", err);
+    if (!(err < 1e-3)) {
+      fprintf(stderr, "Solve with the loaded matrix is not accurate\n");
+      failed = 1;
+    }
+  }
+
+  /* The factorization must not have modified the file */
+  hmat.destroy(loaded);
+  loaded = hmat.read_file(filename);
+  hmat.gemv('T', &pone, loaded, x, &zero, y2, nrhs);
+  for (i = 0; i < n * nrhs; i++) {
+    if (y1[i] != y2[i]) {
+      fprintf(stderr, "The file was modified by the factorization\n");
+      failed = 1;
+      break;
+    }
+  }
+
+  hmat.destroy(loaded);
+  hmat.destroy(hmatrix);
+  hmat_delete_cluster_tree(cluster_tree);
+  hmat.finalize();
+  remove(filename);
+  free(points);
+  free(x);
+  free(y1);
+  free(y2);
+  free(b);
+  return failed;
+}
@@ -0,0 +1,184 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hmat/hmat.h"
+
+/** This example solves a symmetric positive definite system with the
+    iterative solvers of solve_iterative, with and without preconditioner,
+    and checks the convergence, the residual and the solution.  */
+
+/** Create an open cylinder point cloud.
+
+    \param radius Radius of the cylinder
+    \param step distance between two neighboring points
+    \param n number of points
+    \return a vector of points.
+ */
+double* createCylinder(double radius, double step, int n) {
+  double* result = (double*) malloc(3 * n * sizeof(double));
+  double length = 2 * M_PI * radius;
+  int pointsPerCircle = length / step;
+  double angleStep = 2 * M_PI / pointsPerCircle;
+  int i;
+  for (i = 0; i < n; i++) {
+    result[3*i+0] = radius * cos(angleStep * i);
+    result[3*i+1] = radius * sin(angleStep * i),
+    result[3*i+2] = (step * i) / pointsPerCircle;
+  }
+  return result;
+}
+
+typedef struct {
+  int n;
+  double* points;
+  double l;
+} problem_data_t;
+
+/**
+  Exponential covariance, which is symmetric positive definite. A short
+  correlation length keeps it well conditioned.
+ */
+void interaction_real(void* data, int i, int j, void* result)
+{
+  problem_data_t* pdata = (problem_data_t*) data;
+  double* points = pdata->points;
+  double r = sqrt((points[3*i] - points[3*j])*(points[3*i] - points[3*j]) +
+                  (points[3*i+1] - points[3*j+1])*(points[3*i+1] - points[3*j+1]) +
+                  (points[3*i+2] - points[3*j+2])*(points[3*i+2] - points[3*j+2]));
+  *((double*)result) = exp(-r / pdata->l);
+}
+
+/** Relative norm of x - y */
+double relativeError(const double* x, const double* y, int size)
+{
+  int i;
+  double diffNorm = 0., yNorm = 0.;
+  for (i = 0; i < size; i++) {
+    diffNorm += (x[i] - y[i]) * (x[i] - y[i]);
+    yNorm += y[i] * y[i];
+  }
+  return sqrt(diffNorm / yNorm);
+}
+
+int main(int argc, char **argv) {
+  const char* names[] = { "GMRES", "BiCGStab", "CG" };
+  const hmat_iterative_method_t methods[] = { hmat_iterative_gmres, hmat_iterative_bicgstab, hmat_iterative_cg };
+  int i, m, p, nrhs = 2;
+  double radius, step;
+  double* points;
+  double *x, *b, *y, *ay;
+  double pone = 1., zero = 0.;
+  double residual, error;
+  int n;
+  hmat_interface_t hmat;
+  hmat_settings_t settings;
+  hmat_clustering_algorithm_t* clustering;
+  hmat_cluster_tree_t* cluster_tree;
+  hmat_matrix_t* hmatrix;
+  hmat_iterative_solver_context_t context;
+  problem_data_t problem_data;
+  int rc, failed = 0;
+
+  if (argc != 2) {
+      fprintf(stderr, "Usage: %s n_points\n", argv[0]);
+      return 1;
+  }
+  n = atoi(argv[1]);
+
+  hmat_get_parameters(&settings);
+  hmat_init_default_interface(&hmat, HMAT_DOUBLE_PRECISION);
+  settings.compressionMethod = hmat_compress_aca_plus;
+  hmat_set_parameters(&settings);
+  if (0 != hmat.init())
+  {
+    fprintf(stderr, "Unable to initialize HMat library\n");
+    return 1;
+  }
+
+  radius = 1.;
+  step = 1.75 * M_PI * radius / sqrt((double)n);
+  points = createCylinder(radius, step, n);
+  problem_data.n = n;
+  problem_data.points = points;
+  problem_data.l = 0.1 * radius;
+
+  clustering = hmat_create_clustering_median();
+  cluster_tree = hmat_create_cluster_tree(points, 3, n, clustering);
+  hmat_delete_clustering(clustering);
+  hmatrix = hmat.create_empty_hmatrix(cluster_tree, cluster_tree, 1);
+  rc = hmat.assemble_simple_interaction(hmatrix, &problem_data, interaction_real, 1);
+  if (rc) {
+    fprintf(stderr, "Error in assembly, return code is %d, exiting...\n", rc);
+    hmat.finalize();
+    return rc;
+  }
+
+  x = (double*) malloc(n * nrhs * sizeof(double));
+  b = (double*) malloc(n * nrhs * sizeof(double));
+  y = (double*) malloc(n * nrhs * sizeof(double));
+  ay = (double*) malloc(n * nrhs * sizeof(double));
+  for (i = 0; i < n * nrhs; i++)
+    x[i] = sin(1. + 0.37 * i);
+  hmat.gemv('N', &pone, hmatrix, x, &zero, b, nrhs);
+
+  for (m = 0; m < 3; m++) {
+    for (p = 0; p < 2; p++) {
+      hmat_iterative_solver_context_init(&context);
+      context.method = methods[m];
+      /* The preconditioner must be symmetric positive definite for CG */
+      context.preconditioner = p ? hmat_factorization_llt : hmat_factorization_none;
+      memcpy(y, b, n * nrhs * sizeof(double));
+      rc = hmat.solve_iterative(hmatrix, y, nrhs, &context);
+      if (rc) {
+        fprintf(stderr, "Error in solve_iterative, return code is %d, exiting...\n", rc);
+        hmat.finalize();
+        return rc;
+      }
+      error = relativeError(y, x, n * nrhs);
+      /* Residual of the solution, computed again */
+      hmat.gemv('N', &pone, hmatrix, y, &zero, ay, nrhs);
+      residual = relativeError(ay, b, n * nrhs);
+      printf("%s%s: %d iterations, residual %e, computed again %e, error %e\n",
+             names[m], p ? " with preconditioner" : "", context.iterations,
+             context.residual, residual, error);
+      if (!context.converged || context.residual > context.tolerance
+          || residual > 10 * context.tolerance || error > 1e-6) {
+        fprintf(stderr, "%s%s failed\n", names[m], p ? " with preconditioner" : "");
+        failed = 1;
+      }
+    }
+  }
+
+  hmat.destroy(hmatrix);
+  hmat_delete_cluster_tree(cluster_tree);
+  hmat.finalize();
+  free(points);
+  free(x);
+  free(b);
+  free(y);
+  free(ay);
+  return failed;
+}
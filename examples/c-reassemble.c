@@ -0,0 +1,181 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hmat/hmat.h"
+
+/** This example assembles a matrix, factorizes it, and assembles it again
+    twice with reassemble_generic after changes of the kernel parameter. The
+    products of the three assemblies are checked against the dense products.
+    The pivots of the ACA compressions are kept from the first reassembly on,
+    the compressions of the second one start from them.  */
+
+/** Create an open cylinder point cloud.
+
+    \param radius Radius of the cylinder
+    \param step distance between two neighboring points
+    \param n number of points
+    \return a vector of points.
+ */
+double* createCylinder(double radius, double step, int n) {
+  double* result = (double*) malloc(3 * n * sizeof(double));
+  double length = 2 * M_PI * radius;
+  int pointsPerCircle = length / step;
+  double angleStep = 2 * M_PI / pointsPerCircle;
+  int i;
+  for (i = 0; i < n; i++) {
+    result[3*i+0] = radius * cos(angleStep * i);
+    result[3*i+1] = radius * sin(angleStep * i),
+    result[3*i+2] = (step * i) / pointsPerCircle;
+  }
+  return result;
+}
+
+typedef struct {
+  int n;
+  double* points;
+  double l;
+} problem_data_t;
+
+/**
+  Define interaction between 2 degrees of freedoms  (real case)
+ */
+void interaction_real(void* data, int i, int j, void* result)
+{
+  problem_data_t* pdata = (problem_data_t*) data;
+  double* points = pdata->points;
+  double r = sqrt((points[3*i] - points[3*j])*(points[3*i] - points[3*j]) +
+                  (points[3*i+1] - points[3*j+1])*(points[3*i+1] - points[3*j+1]) +
+                  (points[3*i+2] - points[3*j+2])*(points[3*i+2] - points[3*j+2]));
+  *((double*)result) = exp(-r / pdata->l);
+}
+
+/** Relative norm of y - A x, with A computed from interaction_real */
+double productError(problem_data_t* pdata, const double* x, const double* y)
+{
+  int i, j;
+  double a, diff, diffNorm = 0., yNorm = 0.;
+  for (i = 0; i < pdata->n; i++) {
+    diff = y[i];
+    for (j = 0; j < pdata->n; j++) {
+      interaction_real(pdata, i, j, &a);
+      diff -= a * x[j];
+    }
+    diffNorm += diff * diff;
+    yNorm += y[i] * y[i];
+  }
+  return sqrt(diffNorm / yNorm);
+}
+
+int main(int argc, char **argv) {
+  const char* names[] = { "partial", "plus", "blocked" };
+  const hmat_compress_t methods[] = { hmat_compress_aca_partial, hmat_compress_aca_plus, hmat_compress_aca_blocked };
+  const char* steps[] = { "Assembly", "First reassembly", "Second reassembly" };
+  const double lengths[] = { 0.5, 0.3, 0.4 };
+  int i, k, m = -1;
+  double radius, step;
+  double* points;
+  double *x, *y;
+  double pone = 1., zero = 0.;
+  double err;
+  int n;
+  hmat_interface_t hmat;
+  hmat_settings_t settings;
+  hmat_clustering_algorithm_t* clustering;
+  hmat_cluster_tree_t* cluster_tree;
+  hmat_matrix_t* hmatrix;
+  hmat_assemble_context_t ctx;
+  hmat_info_t info;
+  problem_data_t problem_data;
+  int failed = 0;
+
+  if (argc == 3) {
+    for (i = 0; i < 3; i++)
+      if (0 == strcmp(argv[2], names[i]))
+        m = i;
+  }
+  if (m < 0) {
+      fprintf(stderr, "Usage: %s n_points (partial|plus|blocked)\n", argv[0]);
+      return 1;
+  }
+  n = atoi(argv[1]);
+
+  hmat_get_parameters(&settings);
+  hmat_init_default_interface(&hmat, HMAT_DOUBLE_PRECISION);
+  settings.compressionMethod = methods[m];
+  hmat_set_parameters(&settings);
+  if (0 != hmat.init())
+  {
+    fprintf(stderr, "Unable to initialize HMat library\n");
+    return 1;
+  }
+
+  radius = 1.;
+  step = 1.75 * M_PI * radius / sqrt((double)n);
+  points = createCylinder(radius, step, n);
+  problem_data.n = n;
+  problem_data.points = points;
+
+  clustering = hmat_create_clustering_median();
+  cluster_tree = hmat_create_cluster_tree(points, 3, n, clustering);
+  hmat_delete_clustering(clustering);
+  hmatrix = hmat.create_empty_hmatrix(cluster_tree, cluster_tree, 0);
+  hmat_assemble_context_init(&ctx);
+  ctx.user_context = &problem_data;
+  ctx.simple_compute = interaction_real;
+  ctx.lower_symmetric = 0;
+
+  x = (double*) malloc(n * sizeof(double));
+  y = (double*) malloc(n * sizeof(double));
+  for (i = 0; i < n; i++)
+    x[i] = sin(1. + 0.37 * i);
+
+  for (k = 0; k < 3; k++) {
+    problem_data.l = lengths[k] * radius;
+    if (k == 0)
+      hmat.assemble_generic(hmatrix, &ctx);
+    else
+      hmat.reassemble_generic(hmatrix, &ctx);
+    hmat.get_info(hmatrix, &info);
+    hmat.gemv('N', &pone, hmatrix, x, &zero, y, 1);
+    err = productError(&problem_data, x, y);
+    printf("%s: compressed size %ld, ||Hx - Ax|| / ||Hx|| = %e\n", steps[k], (long) info.compressed_size, err);
+    if (!(err < 1e-3)) {
+      fprintf(stderr, "%s is not accurate\n", steps[k]);
+      failed = 1;
+    }
+    /* The factors are dropped by the reassembly */
+    if (k == 0)
+      hmat.factorize(hmatrix, hmat_factorization_lu);
+  }
+
+  hmat.destroy(hmatrix);
+  hmat_delete_cluster_tree(cluster_tree);
+  hmat.finalize();
+  free(points);
+  free(x);
+  free(y);
+  return failed;
+}
@@ -0,0 +1,291 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hmat/hmat.h"
+
+/** This example factorizes a matrix with an LU decomposition, solves nrhs
+    systems with solve_systems, and checks the residual against the dense
+    matrix. The options are:
+    - threads=N: use the parallel interface with N threads,
+    - distinct-trees: build the rows and the columns trees separately, from
+      the same points, so that the matrix has two different cluster trees,
+    - low-precision: set lowPrecisionStorage, and check that some leaves are
+      stored in single precision,
+    - mixed-precision: factorize a single precision copy with
+      factorize_generic, and check that the iterative refinement of the solve
+      reaches the refinement_epsilon of the factorization context on the
+      HMatrix, which is left unchanged,
+    - accumulate: set accumulateRkUpdates,
+    - rand-svd: compress the blocks and truncate the sums of Rk-matrices of
+      the factorization with the randomized SVD instead of ACA+,
+    - validate=S: validate the compressed blocks of the assembly from S
+      sampled rows and columns, or from the whole blocks if S = 0, and check
+      the validation fields of hmat_info_t,
+    - coarsening: coarsen the matrix after the assembly, and check that
+      coarsening_saved_size is reported.  */
+
+/** Create an open cylinder point cloud.
+
+    \param radius Radius of the cylinder
+    \param step distance between two neighboring points
+    \param n number of points
+    \return a vector of points.
+ */
+double* createCylinder(double radius, double step, int n) {
+  double* result = (double*) malloc(3 * n * sizeof(double));
+  double length = 2 * M_PI * radius;
+  int pointsPerCircle = length / step;
+  double angleStep = 2 * M_PI / pointsPerCircle;
+  int i;
+  for (i = 0; i < n; i++) {
+    result[3*i+0] = radius * cos(angleStep * i);
+    result[3*i+1] = radius * sin(angleStep * i),
+    result[3*i+2] = (step * i) / pointsPerCircle;
+  }
+  return result;
+}
+
+typedef struct {
+  int n;
+  double* points;
+  double l;
+} problem_data_t;
+
+/**
+  Exponential covariance, which is symmetric positive definite. A short
+  correlation length keeps it well conditioned.
+ */
+void interaction_real(void* data, int i, int j, void* result)
+{
+  problem_data_t* pdata = (problem_data_t*) data;
+  double* points = pdata->points;
+  double r = sqrt((points[3*i] - points[3*j])*(points[3*i] - points[3*j]) +
+                  (points[3*i+1] - points[3*j+1])*(points[3*i+1] - points[3*j+1]) +
+                  (points[3*i+2] - points[3*j+2])*(points[3*i+2] - points[3*j+2]));
+  *((double*)result) = exp(-r / pdata->l);
+}
+
+/** Euclidean norm of a vector */
+double norm(const double* x, int size)
+{
+  int i;
+  double result = 0.;
+  for (i = 0; i < size; i++)
+    result += x[i] * x[i];
+  return sqrt(result);
+}
+
+/** Relative norm of A x - b, with A computed from interaction_real */
+double residual(problem_data_t* pdata, const double* x, const double* b, int nrhs)
+{
+  int i, j, k;
+  const int n = pdata->n;
+  double a, diffNorm = 0., bNorm = 0.;
+  double* ax = (double*) calloc(n * nrhs, sizeof(double));
+  for (j = 0; j < n; j++) {
+    for (i = 0; i < n; i++) {
+      interaction_real(pdata, i, j, &a);
+      for (k = 0; k < nrhs; k++)
+        ax[i + k * n] += a * x[j + k * n];
+    }
+  }
+  for (i = 0; i < n * nrhs; i++) {
+    diffNorm += (ax[i] - b[i]) * (ax[i] - b[i]);
+    bNorm += b[i] * b[i];
+  }
+  free(ax);
+  return sqrt(diffNorm / bNorm);
+}
+
+int main(int argc, char **argv) {
+  int i, n, nrhs;
+  int nbThreads = -1, distinctTrees = 0, lowPrecision = 0, mixedPrecision = 0;
+  int accumulate = 0, randomSvd = 0, validationSamples = -1;
+  int coarsening = 0;
+  double radius, step;
+  double* points;
+  double *x, *b, *hx;
+  double pone = 1., zero = 0.;
+  double err;
+  hmat_interface_t hmat;
+  hmat_settings_t settings;
+  hmat_clustering_algorithm_t* clustering;
+  hmat_cluster_tree_t *rows_tree, *cols_tree;
+  hmat_matrix_t* hmatrix;
+  hmat_factorization_context_t ctx;
+  hmat_info_t info;
+  problem_data_t problem_data;
+  int rc, failed = 0;
+
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s n_points nrhs [threads=N] [distinct-trees] [low-precision]\n"
+                    "       [mixed-precision] [accumulate] [rand-svd] [validate=S] [coarsening]\n", argv[0]);
+    return 1;
+  }
+  n = atoi(argv[1]);
+  nrhs = atoi(argv[2]);
+  for (i = 3; i < argc; i++) {
+    if (1 == sscanf(argv[i], "threads=%d", &nbThreads))
+      continue;
+    else if (1 == sscanf(argv[i], "validate=%d", &validationSamples))
+      continue;
+    else if (0 == strcmp(argv[i], "distinct-trees"))
+      distinctTrees = 1;
+    else if (0 == strcmp(argv[i], "low-precision"))
+      lowPrecision = 1;
+    else if (0 == strcmp(argv[i], "mixed-precision"))
+      mixedPrecision = 1;
+    else if (0 == strcmp(argv[i], "accumulate"))
+      accumulate = 1;
+    else if (0 == strcmp(argv[i], "rand-svd"))
+      randomSvd = 1;
+    else if (0 == strcmp(argv[i], "coarsening"))
+      coarsening = 1;
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  hmat_get_parameters(&settings);
+  if (nbThreads >= 0) {
+    /* interaction_real is thread safe, so the parallel interface can be used */
+    settings.nbThreads = nbThreads;
+    hmat_init_parallel_interface(&hmat, HMAT_DOUBLE_PRECISION);
+  } else {
+    hmat_init_default_interface(&hmat, HMAT_DOUBLE_PRECISION);
+  }
+  settings.compressionMethod = randomSvd ? hmat_compress_rand_svd : hmat_compress_aca_plus;
+  settings.lowPrecisionStorage = lowPrecision;
+  settings.accumulateRkUpdates = accumulate;
+  settings.coarsening = coarsening;
+  if (validationSamples >= 0) {
+    settings.validateCompression = 1;
+    settings.validationSamples = validationSamples;
+    settings.validationErrorThreshold = 1e-2;
+  }
+  hmat_set_parameters(&settings);
+  if (0 != hmat.init())
+  {
+    fprintf(stderr, "Unable to initialize HMat library\n");
+    return 1;
+  }
+
+  radius = 1.;
+  step = 1.75 * M_PI * radius / sqrt((double)n);
+  points = createCylinder(radius, step, n);
+  problem_data.n = n;
+  problem_data.points = points;
+  problem_data.l = 0.1 * radius;
+
+  clustering = hmat_create_clustering_median();
+  rows_tree = hmat_create_cluster_tree(points, 3, n, clustering);
+  cols_tree = distinctTrees ? hmat_create_cluster_tree(points, 3, n, clustering) : rows_tree;
+  hmat_delete_clustering(clustering);
+  hmatrix = hmat.create_empty_hmatrix(rows_tree, cols_tree, 0);
+  rc = hmat.assemble_simple_interaction(hmatrix, &problem_data, interaction_real, 0);
+  if (rc) {
+    fprintf(stderr, "Error in assembly, return code is %d, exiting...\n", rc);
+    hmat.finalize();
+    return rc;
+  }
+  if (validationSamples >= 0) {
+    hmat.get_info(hmatrix, &info);
+    printf("Validation: %ld blocks out of %ld, %ld failures, max error %e, mean error %e\n",
+           (long) info.validated_count, (long) info.rk_count, (long) info.validation_failures,
+           info.validation_max_error, info.validation_mean_error);
+    if (info.validated_count != info.rk_count || info.validation_failures != 0
+        || !(info.validation_mean_error > 0.)
+        || !(info.validation_mean_error <= info.validation_max_error)
+        || !(info.validation_max_error < settings.validationErrorThreshold)) {
+      fprintf(stderr, "The validation of the compression failed\n");
+      failed = 1;
+    }
+  }
+  if (coarsening) {
+    hmat.get_info(hmatrix, &info);
+    printf("Coarsening: compressed size %ld, saved %ld\n",
+           (long) info.compressed_size, (long) info.coarsening_saved_size);
+    if (info.coarsening_saved_size == 0) {
+      fprintf(stderr, "The coarsening did not merge any block\n");
+      failed = 1;
+    }
+  }
+
+  hmat_factorization_context_init(&ctx);
+  ctx.factorization = hmat_factorization_lu;
+  ctx.progress = NULL;
+  ctx.mixed_precision = mixedPrecision;
+  hmat.factorize_generic(hmatrix, &ctx);
+  hmat.get_info(hmatrix, &info);
+  printf("After the factorization: compressed size %ld, stored in single precision %ld\n",
+         (long) info.compressed_size, (long) info.low_precision_size);
+  if (lowPrecision && info.low_precision_size == 0) {
+    fprintf(stderr, "No leaf is stored in single precision\n");
+    failed = 1;
+  }
+
+  x = (double*) malloc(n * nrhs * sizeof(double));
+  b = (double*) malloc(n * nrhs * sizeof(double));
+  for (i = 0; i < n * nrhs; i++)
+    b[i] = sin(1. + 0.37 * i);
+  memcpy(x, b, n * nrhs * sizeof(double));
+  rc = hmat.solve_systems(hmatrix, x, nrhs);
+  if (rc) {
+    fprintf(stderr, "Error in solve, return code is %d, exiting...\n", rc);
+    hmat.finalize();
+    return rc;
+  }
+  err = residual(&problem_data, x, b, nrhs);
+  printf("%d right-hand sides: ||Ax - b|| / ||b|| = %e\n", nrhs, err);
+  if (!(err < 1e-3)) {
+    fprintf(stderr, "The solve is not accurate\n");
+    failed = 1;
+  }
+  if (mixedPrecision) {
+    hx = (double*) malloc(n * nrhs * sizeof(double));
+    hmat.gemv('N', &pone, hmatrix, x, &zero, hx, nrhs);
+    for (i = 0; i < n * nrhs; i++)
+      hx[i] -= b[i];
+    err = norm(hx, n * nrhs) / norm(b, n * nrhs);
+    printf("Iterative refinement: ||Hx - b|| / ||b|| = %e\n", err);
+    if (!(err < 100 * ctx.refinement_epsilon)) {
+      fprintf(stderr, "The iterative refinement did not converge\n");
+      failed = 1;
+    }
+    free(hx);
+  }
+
+  hmat.destroy(hmatrix);
+  if (distinctTrees)
+    hmat_delete_cluster_tree(cols_tree);
+  hmat_delete_cluster_tree(rows_tree);
+  hmat.finalize();
+  free(points);
+  free(x);
+  free(b);
+  return failed;
+}
@@ -0,0 +1,120 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+// Parallel clustering
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "hmat_cpp_interface.hpp"
+#include "clustering.hpp"
+#include "cluster_tree.hpp"
+
+using namespace hmat;
+
+/** This example builds the cluster trees of a point cloud with one thread
+    and with several, and checks that they are identical: same nodes and same
+    permutation of the points. Above 131072 points, the partitions of the
+    largest nodes are themselves parallel.
+ */
+
+
+/** Create an open cylinder point cloud.
+
+    \param radius Radius of the cylinder
+    \param step distance between two neighboring points
+    \param n number of points
+    \return a vector of points.
+ */
+std::vector<Point> createCylinder(double radius, double step, int n) {
+  std::vector<Point> result;
+  double length = 2 * M_PI * radius;
+  int pointsPerCircle = length / step;
+  double angleStep = 2 * M_PI / pointsPerCircle;
+  for (int i = 0; i < n; i++) {
+    Point p(radius * cos(angleStep * i), radius * sin(angleStep * i),
+            (step * i) / pointsPerCircle);
+    result.push_back(p);
+  }
+  return result;
+}
+
+
+/** True if both trees have the same nodes */
+bool sameNodes(const ClusterTree* a, const ClusterTree* b) {
+  if (a->data.offset() != b->data.offset() || a->data.size() != b->data.size()
+      || a->nrChild() != b->nrChild())
+    return false;
+  for (int i = 0; i < a->nrChild(); i++) {
+    const ClusterTree* childA = a->getChild(i);
+    const ClusterTree* childB = b->getChild(i);
+    if ((childA == NULL) != (childB == NULL))
+      return false;
+    if (childA && !sameNodes(childA, childB))
+      return false;
+  }
+  return true;
+}
+
+/** Build the trees with 1 and nbThreads threads, return true if they are identical */
+bool check(const DofCoordinates& coord, const ClusteringAlgorithm& algo, const char* name, int nbThreads) {
+  ClusterTree* sequential = createClusterTree(coord, algo, 1);
+  ClusterTree* parallel = createClusterTree(coord, algo, nbThreads);
+  const bool result = sameNodes(sequential, parallel)
+    && 0 == memcmp(sequential->data.indices(), parallel->data.indices(), coord.size() * sizeof(int));
+  std::cout << name << ": the trees built with 1 and " << nbThreads << " threads are "
+            << (result ? "identical" : "different") << std::endl;
+  if (!result)
+    std::cerr << "The parallel " << name << " clustering differs from the sequential one" << std::endl;
+  delete sequential;
+  delete parallel;
+  return result;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::cout << "Usage: " << argv[0] << " n_points n_threads" << std::endl;
+    return 1;
+  }
+  int n = atoi(argv[1]);
+  int nbThreads = atoi(argv[2]);
+
+  double radius = 1.;
+  double step = 1.75 * M_PI * radius / sqrt((double)n);
+  std::vector<Point> points = createCylinder(radius, step, n);
+  double * xyz = new double[3*points.size()];
+  for(size_t i = 0; i < points.size(); ++i)
+  {
+    xyz[3*i+0] = points[i].x;
+    xyz[3*i+1] = points[i].y;
+    xyz[3*i+2] = points[i].z;
+  }
+  DofCoordinates coord(xyz, 3, points.size(), true);
+  delete[] xyz;
+
+  bool ok = check(coord, MedianBisectionAlgorithm(), "median", nbThreads);
+  ok = check(coord, GeometricBisectionAlgorithm(), "geometric", nbThreads) && ok;
+  ok = check(coord, HybridBisectionAlgorithm(), "hybrid", nbThreads) && ok;
+  ok = check(coord, SpaceFillingCurveAlgorithm(), "sfc", nbThreads) && ok;
+  return ok ? 0 : 1;
+}
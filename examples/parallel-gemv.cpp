@@ -0,0 +1,233 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+// Parallel gemv
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "hmat_cpp_interface.hpp"
+#include "default_engine.hpp"
+#include "full_matrix.hpp"
+#include "h_matrix.hpp"
+
+using namespace hmat;
+
+/** This example compares the products by an HMatrix computed with several
+    threads by HMatrix::gemv() with the sequential ones, for trans = 'N' and
+    'T', with and without symmetry. Without symmetry and with trans = 'N', the
+    threads write different rows of the result, otherwise they add their
+    products in private copies of it, which are summed at the end.
+
+    The matrix is the one of h2-cylinder.cpp.
+ */
+
+
+/** Create an open cylinder point cloud.
+
+    \param radius Radius of the cylinder
+    \param step distance between two neighboring points
+    \param n number of points
+    \return a vector of points.
+ */
+std::vector<Point> createCylinder(double radius, double step, int n) {
+  std::vector<Point> result;
+  double length = 2 * M_PI * radius;
+  int pointsPerCircle = length / step;
+  double angleStep = 2 * M_PI / pointsPerCircle;
+  for (int i = 0; i < n; i++) {
+    Point p(radius * cos(angleStep * i), radius * sin(angleStep * i),
+            (step * i) / pointsPerCircle);
+    result.push_back(p);
+  }
+  return result;
+}
+
+
+template<typename T>
+class TestAssemblyFunction : public SimpleAssemblyFunction<T> {
+public:
+  /// Point coordinates
+  const DofCoordinates& points;
+  /// Wavenumber for the complex case.
+  double k;
+  /// Added to the distances, so that the diagonal does not hide the far interactions
+  double delta;
+
+public:
+  /** Constructor.
+
+      \param _points Point cloud
+      \param _k Wavenumber
+      \param _delta Regularization of the distances
+   */
+  TestAssemblyFunction(const DofCoordinates& _points, double _k, double _delta)
+    : SimpleAssemblyFunction<T>(), points(_points), k(_k), delta(_delta) {}
+  typename Types<T>::dp interaction(int i, int j) const;
+  double distanceTo(int i, int j) const;
+};
+
+template<typename T>
+double
+TestAssemblyFunction<T>::distanceTo(int i, int j) const
+{
+  double r = sqrt((points.get(0, i) - points.get(0, j))*(points.get(0, i) - points.get(0, j))+
+                  (points.get(1, i) - points.get(1, j))*(points.get(1, i) - points.get(1, j))+
+                  (points.get(2, i) - points.get(2, j))*(points.get(2, i) - points.get(2, j)));
+  return r;
+}
+
+
+template<>
+Types<S_t>::dp TestAssemblyFunction<S_t>::interaction(int i, int j) const {
+  double distance = this->distanceTo(i, j) + delta;
+  return 1. / distance;
+}
+template<>
+Types<D_t>::dp TestAssemblyFunction<D_t>::interaction(int i, int j) const {
+  double distance = this->distanceTo(i, j) + delta;
+  return 1. / distance;
+}
+template<>
+Types<C_t>::dp TestAssemblyFunction<C_t>::interaction(int i, int j) const {
+  double distance = this->distanceTo(i, j) + delta;
+  Z_t result(cos(k * distance) / (4 * M_PI * distance), sin(k * distance) / (4 * M_PI * distance));
+  return result;
+}
+template<>
+Types<Z_t>::dp TestAssemblyFunction<Z_t>::interaction(int i, int j) const {
+  double distance = this->distanceTo(i, j) + delta;
+  Z_t result(cos(k * distance) / (4 * M_PI * distance), sin(k * distance) / (4 * M_PI * distance));
+  return result;
+}
+
+hmat::StandardAdmissibilityCondition admissibilityCondition(3.);
+
+/** Relative Frobenius norm of a - b */
+template<typename T>
+double relativeError(const FullMatrix<T>& a, const FullMatrix<T>& b) {
+  double diffNorm = 0., bNorm = 0.;
+  for (int j = 0; j < b.cols; j++) {
+    for (int i = 0; i < b.rows; i++) {
+      diffNorm += std::norm(a.get(i, j) - b.get(i, j));
+      bNorm += std::norm(b.get(i, j));
+    }
+  }
+  return sqrt(diffNorm / bNorm);
+}
+
+/** Compare the products with nbThreads threads with the sequential ones, return true if they are close. */
+template<typename T>
+bool check(const DofCoordinates& coord, double k, double delta, SymmetryFlag sym, int nbThreads,
+           double tolerance) {
+  const char trans[] = { 'N', 'T' };
+  const int n = coord.size();
+  const int nrhs = 3;
+  ClusterTree* ct = createClusterTree(coord);
+  TestAssemblyFunction<T> f(coord, k, delta);
+  HMatInterface<T, DefaultEngine> hmat(ct, ct, sym, &admissibilityCondition);
+  hmat.assemble(f, sym);
+  const HMatrix<T>* h = hmat.engine().hmat;
+
+  FullMatrix<T> x(n, nrhs);
+  for (int j = 0; j < nrhs; j++)
+    for (int i = 0; i < n; i++)
+      x.get(i, j) = sin(1. + 0.37 * (i + j * n));
+  // The products with beta != 0 check that y is scaled once
+  const T alpha = 0.5;
+  const T beta = 2;
+  bool result = true;
+  for (int t = 0; t < 2; t++) {
+    FullMatrix<T> expected(n, nrhs);
+    FullMatrix<T> y(n, nrhs);
+    for (int j = 0; j < nrhs; j++)
+      for (int i = 0; i < n; i++)
+        expected.get(i, j) = y.get(i, j) = cos(0.23 * (i + j * n));
+    h->gemv(trans[t], alpha, &x, beta, &expected, 1);
+    h->gemv(trans[t], alpha, &x, beta, &y, nbThreads);
+    const double error = relativeError(y, expected);
+    std::cout << (sym == kLowerSymmetric ? "Symmetric" : "Non symmetric")
+              << " gemv('" << trans[t] << "'): " << nbThreads
+              << " threads vs 1 relative error " << error << std::endl;
+    if (!(error < tolerance)) {
+      std::cerr << "The parallel product differs from the sequential one" << std::endl;
+      result = false;
+    }
+  }
+  return result;
+}
+
+template<typename T>
+int go(const DofCoordinates& coord, double k, double delta, int nbThreads, double epsilon) {
+  // Only the order of the sums of the products of the leaves may change
+  const double tolerance = 10 * epsilon;
+  if (0 != HMatInterface<T, DefaultEngine>::init())
+    return 1;
+  bool ok = check<T>(coord, k, delta, kNotSymmetric, nbThreads, tolerance);
+  ok = check<T>(coord, k, delta, kLowerSymmetric, nbThreads, tolerance) && ok;
+  HMatInterface<T, DefaultEngine>::finalize();
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  HMatSettings& settings = HMatSettings::getInstance();
+
+  if (argc != 4) {
+    std::cout << "Usage: " << argv[0] << " n_points (S|D|C|Z) n_threads"
+              << std::endl;
+    return 1;
+  }
+  int n = atoi(argv[1]);
+  char arithmetic = argv[2][0];
+  int nbThreads = atoi(argv[3]);
+
+  settings.compressionMethod = AcaPlus;
+  settings.setParameters();
+  double radius = 1.;
+  double step = 1.75 * M_PI * radius / sqrt((double)n);
+  double k = 2 * M_PI / (10. * step); // 10 points / lambda
+  std::vector<Point> points = createCylinder(radius, step, n);
+  double * xyz = new double[3*points.size()];
+  for(size_t i = 0; i < points.size(); ++i)
+  {
+    xyz[3*i+0] = points[i].x;
+    xyz[3*i+1] = points[i].y;
+    xyz[3*i+2] = points[i].z;
+  }
+  DofCoordinates coord(xyz, 3, points.size(), true);
+  delete[] xyz;
+
+  switch (arithmetic) {
+  case 'S':
+    return go<S_t>(coord, k, step, nbThreads, std::numeric_limits<float>::epsilon());
+  case 'D':
+    return go<D_t>(coord, k, step, nbThreads, std::numeric_limits<double>::epsilon());
+  case 'C':
+    return go<C_t>(coord, k, step, nbThreads, std::numeric_limits<float>::epsilon());
+  case 'Z':
+    return go<Z_t>(coord, k, step, nbThreads, std::numeric_limits<double>::epsilon());
+  default:
+    std::cerr << "Unknown arithmetic code " << arithmetic << std::endl;
+    return 1;
+  }
+}
@@ -47,7 +47,9 @@ typedef enum {
   hmat_compress_svd,
   hmat_compress_aca_full,
   hmat_compress_aca_partial,
-  hmat_compress_aca_plus
+  hmat_compress_aca_plus,
+  hmat_compress_rand_svd,
+  hmat_compress_aca_blocked
 } hmat_compress_t;
 
 typedef enum {
@@ -67,6 +69,21 @@ typedef enum {
 /** The value of hmat_block_info_t.needed_memory when unset */
 #define HMAT_NEEDED_MEMORY_UNSET ((size_t)-1)
 
+/*! \brief Compute several rows, or several columns, of a block.
+
+\param v_data opaque pointer, as set by \a prepare_func() in field user_data of hmat_block_info_t
+\param count number of rows (or columns) to compute
+\param indices the indices of the rows (or columns) within the block, they are
+not sorted and not necessarily contiguous
+\param panel pointer to the output buffer. The i-th row (or column) is stored
+contiguously, from panel + i * n where n is the number of columns (or rows)
+of the block.
+
+\warning This function may be called concurrently on different blocks, see
+\a hmat_prepare_func_t.
+ */
+typedef void (*hmat_compute_panel_func_t)(void* v_data, int count, const int* indices, void* panel);
+
 struct hmat_block_info_t_struct {
     hmat_block_t block_type;
     /**
@@ -85,6 +102,14 @@ struct hmat_block_info_t_struct {
      * be called a second time to run the actual preparation.
      */
     size_t needed_memory;
+    /**
+     * Optional, may be set by the prepare function to compute several rows
+     * of the block in one call. When NULL, the rows are computed one by one
+     * with the hmat_compute_func_t.
+     */
+    hmat_compute_panel_func_t compute_rows;
+    /** Optional, same as compute_rows for the columns of the block. */
+    hmat_compute_panel_func_t compute_cols;
 };
 
 typedef struct hmat_block_info_t_struct hmat_block_info_t;
@@ -99,6 +124,12 @@ typedef struct hmat_block_info_t_struct hmat_block_info_t;
  \param col_hmat2client renumbered cols -> global col indices mapping
  \param col_client2hmat global col indices -> renumbered cols mapping
  \param context user provided data
+
+ \warning With the interface created by \a hmat_init_parallel_interface(), this
+ function, the compute function and block_info->release_user_data are called
+ concurrently from several threads, each thread working on a different block.
+ They must not modify context or any other shared state without synchronization.
+ The user data set in block_info is private to a block.
  */
 typedef void (*hmat_prepare_func_t)(int row_start,
     int row_count,
@@ -120,6 +151,10 @@ The supported cases are:
 - Compute exactly one row
 - Compute exactly one column
 
+Several rows or columns which are not contiguous can be requested in one
+call with the compute_rows and compute_cols fields of hmat_block_info_t,
+which are used by the hmat_compress_aca_blocked compression.
+
 Regarding the indexing: For all indices in this function, the "C"
 conventions are followed, ie indices start at 0, the lower bound is
 included and the upper bound is excluded. In contrast with
@@ -134,6 +169,9 @@ to the block, that is the row i is the i-th row within the block.
 \param block pointer to the output buffer. No padding is allowed,
 that is the leading dimension of the buffer must be its real leading
 dimension (1 for a row). Column-major order is assumed.
+
+\warning This function may be called concurrently on different blocks, see
+\a hmat_prepare_func_t.
  */
 typedef void (*hmat_compute_func_t)(void* v_data, int block_row_start, int block_row_count,
                              int block_col_start, int block_col_count, void* block);
@@ -145,6 +183,9 @@ typedef void (*hmat_compute_func_t)(void* v_data, int block_row_start, int block
 \param col column index
 \param result address where result is stored; result is a pointer to a double for real matrices,
               and a pointer to a double complex for complex matrices.
+
+\warning This function may be called concurrently from several threads, see
+\a hmat_prepare_func_t.
  */
 typedef void (*hmat_interaction_func_t)(void* user_context, int row, int col, void* result);
 
@@ -159,6 +200,8 @@ hmat_clustering_algorithm_t* hmat_create_clustering_median();
 hmat_clustering_algorithm_t* hmat_create_clustering_geometric();
 /* Hybrid clustering */
 hmat_clustering_algorithm_t* hmat_create_clustering_hybrid();
+/* Clustering along a Hilbert space-filling curve */
+hmat_clustering_algorithm_t* hmat_create_clustering_sfc();
 /* Create a new clustering algorithm by setting the maximum number of degrees of freedom in a leaf */
 hmat_clustering_algorithm_t* hmat_create_clustering_max_dof(const hmat_clustering_algorithm_t* algo, int max_dof);
 /* Create a new clustering algorithm (for tests purpose only */
@@ -170,6 +213,10 @@ void hmat_set_clustering_divider(hmat_clustering_algorithm_t* algo, int divider)
 
 /*! \brief Create a ClusterTree from the DoFs coordinates.
 
+  The tree is built sequentially, or with hmat_settings_t::nbThreads threads
+  once hmat_init_parallel_interface() has been called. The tree does not
+  depend on the number of threads.
+
   \param coord DoFs coordinates
   \param dimension spatial dimension
   \param size number of DoFs
@@ -190,6 +237,8 @@ void hmat_delete_cluster_tree_builder(hmat_cluster_tree_builder_t* ctb);
 
 /*! \brief Create a ClusterTree from the DoFs coordinates.
 
+  The threads are the same as for hmat_create_cluster_tree().
+
   \param coord DoFs coordinates
   \param dimension spatial dimension
   \param size number of DoFs
@@ -304,6 +353,23 @@ typedef struct
   int largest_rk_mem_cols;
   /*! Rank of the largest Rk matrice with memory criteria */
   int largest_rk_mem_rank;
+  /*! Number of the terms of compressed_size stored in single precision */
+  size_t low_precision_size;
+  /*! Estimated number of terms computed by the assembly, with the current settings */
+  double assembly_cost;
+  /*! Number of compressed blocks checked during the last assembly, if validateCompression is set */
+  size_t validated_count;
+  /*! Number of them with an error above validationErrorThreshold */
+  size_t validation_failures;
+  /*! Largest relative error of the checked blocks */
+  double validation_max_error;
+  /*! Mean relative error of the checked blocks */
+  double validation_mean_error;
+  /*! Number of terms saved by the coarsening during the last assembly */
+  size_t coarsening_saved_size;
+  /*! Number of terms stored by the H2 copy of the matrix used by the products,
+      0 without it. They are stored in addition to compressed_size. */
+  size_t h2_size;
 } hmat_info_t;
 
 typedef struct hmat_matrix_struct hmat_matrix_t;
@@ -351,11 +417,75 @@ typedef struct {
     hmat_factorization_t factorization;
     /** NULL disable progress display. The default is to use the hmat progress internal implementation. */
     hmat_progress_t * progress;
+    /**
+     * Factorize a single precision copy of the matrix, which is left unchanged,
+     * and solve the systems with an iterative refinement in the precision of
+     * the matrix. The default is 0.
+     */
+    int mixed_precision;
+    /** Relative residual norm at which the iterative refinement stops. The default is 1e-12. */
+    double refinement_epsilon;
+    /** Maximum number of iterative refinement steps. The default is 10. */
+    int refinement_max_iterations;
 } hmat_factorization_context_t;
 
 /** Init a hmat_factorization_context_t with default values */
 void hmat_factorization_context_init(hmat_factorization_context_t * context);
 
+/** Krylov method of the iterative solver */
+typedef enum {
+    /** Restarted GMRES, with a right preconditioning */
+    hmat_iterative_gmres,
+    /** BiCGStab, with a right preconditioning */
+    hmat_iterative_bicgstab,
+    /** Conjugate gradient, for hermitian positive definite matrices and preconditioners */
+    hmat_iterative_cg
+} hmat_iterative_method_t;
+
+/**
+ * Argument of the solve_iterative function.
+ * The last fields are set by solve_iterative.
+ */
+typedef struct {
+    /** The Krylov method. The default is hmat_iterative_gmres. */
+    hmat_iterative_method_t method;
+    /**
+     * Relative residual norm at which the iterations stop, it must be above
+     * the rounding errors of the scalar type. The default is 1e-8.
+     */
+    double tolerance;
+    /** Maximum number of iterations for each right-hand side. The default is 1000. */
+    int max_iterations;
+    /** Size of the Krylov basis before a restart of GMRES. The default is 30. */
+    int restart;
+    /**
+     * Factorization of a coarse copy of the matrix used as a preconditioner,
+     * or hmat_factorization_none for no preconditioning. The copy is stored
+     * in single precision, and is kept for the next calls until the matrix is
+     * modified. The default is hmat_factorization_none.
+     */
+    hmat_factorization_t preconditioner;
+    /** Accuracy of the compressions in the preconditioner. The default is 1e-2. */
+    double preconditioner_epsilon;
+    /** Largest number of iterations among the right-hand sides */
+    int iterations;
+    /** Largest relative norm of the residuals b - A x at exit */
+    double residual;
+    /** 1 if the method converged for all the right-hand sides */
+    int converged;
+    /** Time in seconds spent to build the preconditioner, 0 if it was reused */
+    double preconditioner_setup_time;
+    /** Time in seconds spent in the products by the matrix */
+    double product_time;
+    /** Time in seconds spent in the applications of the preconditioner */
+    double preconditioner_apply_time;
+    /** Total time in seconds of solve_iterative */
+    double total_time;
+} hmat_iterative_solver_context_t;
+
+/** Init a hmat_iterative_solver_context_t with default values */
+void hmat_iterative_solver_context_init(hmat_iterative_solver_context_t * context);
+
 /** Context for the get_values and get_block function */
 struct hmat_get_values_context_t {
     /** The matrix from witch to get values */
@@ -649,6 +779,47 @@ hmat
      */
     int (*walk)(hmat_matrix_t* hmatrix, hmat_procedure_t* proc);
 
+    /**
+     * @brief Write a matrix to a binary file
+     * The file holds the cluster trees, the block structure, the blocks and
+     * the factorization state of the matrix.
+     * \param hmatrix A hmatrix
+     * \param filename output filename
+     */
+    int (*write_file)(hmat_matrix_t* hmatrix, const char* filename);
+
+    /**
+     * @brief Load a matrix written by write_file
+     * The file is memory-mapped, blocks are read from it when they are first
+     * used. It must not be modified while the matrix exists. The returned
+     * matrix owns its cluster trees.
+     * \param filename input filename
+     * \return the matrix
+     */
+    hmat_matrix_t* (*read_file)(const char* filename);
+
+    /**
+     * @brief Solve A x = b with a Krylov method, x overwriting b
+     * The matrix must not be factorized. The initial guess is 0. The vectors
+     * are renumbered once, not at each iteration.
+     * \param hmatrix A hmatrix
+     * \param b right-hand sides, overwritten by the solutions at exit
+     * \param nrhs number of right-hand sides
+     * \param context parameters of the solver, its output fields are set
+     * \return 0 for success
+     */
+    int (*solve_iterative)(hmat_matrix_t* hmatrix, void* b, int nrhs, hmat_iterative_solver_context_t* context);
+
+    /*! \brief Assemble again an assembled HMatrix, with new values.
+
+      The block structure of the previous assembly is kept, and from the
+      second reassembly on the ACA pivots of the previous one are tried first,
+      see HMatInterface::reassemble(). The context is the one
+      of assemble_generic, lower_symmetric must be the same as for the
+      previous assembly.
+    */
+    void (*reassemble_generic)(hmat_matrix_t* matrix, hmat_assemble_context_t * context);
+
     hmat_value_t value_type;
 
     /** For internal use only */
@@ -658,6 +829,13 @@ hmat
 
 void hmat_init_default_interface(hmat_interface_t * i, hmat_value_t type);
 
+/*! \brief Initialize an interface running on a pool of threads.
+
+    The number of threads is hmat_settings_t::nbThreads. The user assembly
+    functions are called concurrently, so they must be thread safe.
+ */
+void hmat_init_parallel_interface(hmat_interface_t * i, hmat_value_t type);
+
 typedef struct
 {
   /*! \brief Tolerance for the assembly. */
@@ -669,7 +847,7 @@ typedef struct
    int compressionMinLeafSize;
   /*! \brief Maximum size of a leaf in a ClusterTree (and of a non-admissible block in an HMatrix) */
   int maxLeafSize;
-  /*! \brief max(|L0|) */
+  /*! \brief Maximum number of tasks the parallel assembly splits the leaves in, 0 for one task per leaf */
   int maxParallelLeaves;
   /*! \brief Padding for ABI backward compatiblity */
   int _dummyABI;
@@ -687,6 +865,24 @@ typedef struct
   int validationDump;
   /*! \brief Error threshold for the compression validation */
   double validationErrorThreshold;
+  /*! \brief Number of threads of the parallel interface, 0 for all the available processors */
+  int nbThreads;
+  /*! \brief Recycle the memory of the full blocks in a pool, 0 to use malloc and free */
+  int blockPool;
+  /*! \brief Number of power iterations of the hmat_compress_rand_svd compression */
+  int powerIterations;
+  /*! \brief Store the leaves of double precision matrices in single precision when the accuracy allows it */
+  int lowPrecisionStorage;
+  /*! \brief Append the products added to a compressed block during the H-matrix
+      products and factorizations, and recompress them together, when the block
+      is next solved or when their rank becomes too large */
+  int accumulateRkUpdates;
+  /*! \brief Number of rows and of columns the compression validation samples
+      to estimate the error of a block, 0 to compare with the whole block */
+  int validationSamples;
+  /*! \brief With coarsening, merge the children of a block when its compressed
+      form needs less than this fraction of their memory, in ]0, 1] */
+  double coarseningThreshold;
 } hmat_settings_t;
 
 /*! \brief Get current settings
@@ -726,6 +922,25 @@ const char * hmat_get_build_date();
 */
 void hmat_tracing_dump(char *filename) ;
 
+/*!
+ \brief hmat_tracing_record_timeline Starts recording the timeline of the traced contexts
+
+ Each worker keeps its last events, the previous ones are discarded. Hmat library
+ must be compiled with -DHAVE_CONTEXT for this to work.
+\param capacity the number of events kept per worker, 0 to stop the recording
+*/
+void hmat_tracing_record_timeline(int capacity) ;
+
+/*!
+ \brief hmat_tracing_dump_chrome Dumps the recorded timeline in the given filename
+
+ The file is in the Chrome trace event format, to be opened in chrome://tracing or
+ Perfetto, with one thread per worker. Hmat library must be compiled with -DHAVE_CONTEXT
+ for this to work.
+\param filename the name of the output json file
+*/
+void hmat_tracing_dump_chrome(char *filename) ;
+
 #ifdef __cplusplus
 }
 #endif
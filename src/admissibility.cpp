@@ -79,7 +79,7 @@ bool
 StandardAdmissibilityCondition::isAdmissible(const ClusterTree& rows, const ClusterTree& cols)
 {
     CompressionMethod m = HMatSettings::getInstance().compressionMethod;
-    bool isFullAlgo = !(m == AcaPartial || m == AcaPlus);
+    bool isFullAlgo = !(m == AcaPartial || m == AcaPlus || m == AcaBlocked);
     size_t elements = ((size_t) rows.data.size()) * cols.data.size();
 
     if(always_ && (rows.isLeaf() || cols.isLeaf()))
@@ -33,7 +33,7 @@
 namespace hmat {
 
 template<typename T>
-void AssemblyFunction<T>::assemble(const LocalSettings &,
+void AssemblyFunction<T>::assemble(const LocalSettings & settings,
                                      const ClusterTree &rows,
                                      const ClusterTree &cols,
                                      bool admissible,
@@ -49,7 +49,7 @@ void AssemblyFunction<T>::assemble(const LocalSettings &,
         method = Svd;
       }
       RkMatrix<typename Types<T>::dp>* rkDp = compress<T>(method, function_, &(rows.data), &(cols.data),
-                                                          allocationObserver);
+                                                          allocationObserver, settings.pivots);
       if (HMatrix<T>::recompress) {
         rkDp->truncate(rkDp->approx.recompressionEpsilon); // TODO assemblyEpsilon ?
       }
@@ -151,6 +151,8 @@ void initBlockInfo(hmat_block_info_t * info) {
     info->is_null_row = NULL;
     info->user_data = NULL;
     info->needed_memory = HMAT_NEEDED_MEMORY_UNSET;
+    info->compute_rows = NULL;
+    info->compute_cols = NULL;
 }
 
 template<typename T>
@@ -206,12 +208,59 @@ void BlockFunction<T>::getCol(const ClusterData* rows,
   //   }
   // }
 }
+
+template<typename T>
+void BlockFunction<T>::getRows(const ClusterData* rows, const ClusterData* cols,
+                               const int* rowIndices, int count, const hmat_block_info_t * block_info,
+                               FullMatrix<typename Types<T>::dp>* result) const {
+  DECLARE_CONTEXT;
+  if (block_info->compute_rows == NULL) {
+    Function<T>::getRows(rows, cols, rowIndices, count, block_info, result);
+    return;
+  }
+  assert(result->lda == cols->size());
+  block_info->compute_rows(block_info->user_data, count, rowIndices, (void*) result->m);
+}
+
+template<typename T>
+void BlockFunction<T>::getCols(const ClusterData* rows, const ClusterData* cols,
+                               const int* colIndices, int count, const hmat_block_info_t * block_info,
+                               FullMatrix<typename Types<T>::dp>* result) const {
+  DECLARE_CONTEXT;
+  if (block_info->compute_cols == NULL) {
+    Function<T>::getCols(rows, cols, colIndices, count, block_info, result);
+    return;
+  }
+  assert(result->lda == rows->size());
+  block_info->compute_cols(block_info->user_data, count, colIndices, (void*) result->m);
+}
+
 template<typename T>
 void Function<T>::prepareBlock(const ClusterData*, const ClusterData*,
              hmat_block_info_t * block_info, const AllocationObserver &) const {
    initBlockInfo(block_info);
 }
 
+template<typename T>
+void Function<T>::getRows(const ClusterData* rows, const ClusterData* cols,
+                          const int* rowIndices, int count, const hmat_block_info_t * block_info,
+                          FullMatrix<typename Types<T>::dp>* result) const {
+  for (int i = 0; i < count; i++) {
+    Vector<typename Types<T>::dp> row(result->m + ((size_t) result->lda) * i, cols->size());
+    getRow(rows, cols, rowIndices[i], block_info->user_data, &row);
+  }
+}
+
+template<typename T>
+void Function<T>::getCols(const ClusterData* rows, const ClusterData* cols,
+                          const int* colIndices, int count, const hmat_block_info_t * block_info,
+                          FullMatrix<typename Types<T>::dp>* result) const {
+  for (int j = 0; j < count; j++) {
+    Vector<typename Types<T>::dp> col(result->m + ((size_t) result->lda) * j, rows->size());
+    getCol(rows, cols, colIndices[j], block_info->user_data, &col);
+  }
+}
+
 
 // Template declaration
 template class Function<S_t>;
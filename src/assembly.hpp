@@ -48,6 +48,10 @@ public:
 
 /**
  * Abstract class, describing the creation of the H-matrix blocks
+ *
+ * When HMatrix::assemble() runs on several threads, assemble() is called
+ * concurrently on different blocks, so implementations and the underlying
+ * Function must be thread safe.
  */
 template<typename T> class Assembly {
 public:
@@ -162,6 +166,30 @@ public:
   virtual void getCol(const ClusterData* rows, const ClusterData* cols,
                       int colIndex, void* handle,
                       Vector<typename Types<T>::dp>* result) const = 0;
+
+  /*! \brief Compute several rows of a matrix block.
+
+    The default implementation calls \a getRow() for each row.
+
+    \param rows the rows of the subblock
+    \param cols the columns of the subblock
+    \param rowIndices the row indices in the subblock
+    \param count the number of rows
+    \param block_info the block information set by \a prepareBlock()
+    \param result the computed rows, stored in the columns of a cols->size() x count matrix
+  */
+  virtual void getRows(const ClusterData* rows, const ClusterData* cols,
+                       const int* rowIndices, int count, const hmat_block_info_t * block_info,
+                       FullMatrix<typename Types<T>::dp>* result) const;
+  /*! \brief Compute several columns of a matrix block.
+
+    The default implementation calls \a getCol() for each column.
+
+    \param result the computed columns, a rows->size() x count matrix
+  */
+  virtual void getCols(const ClusterData* rows, const ClusterData* cols,
+                       const int* colIndices, int count, const hmat_block_info_t * block_info,
+                       FullMatrix<typename Types<T>::dp>* result) const;
 };
 
 /**
@@ -226,6 +254,13 @@ public:
   virtual void getCol(const ClusterData* rows, const ClusterData* cols,
                       int colIndex, void* handle,
                       Vector<typename Types<T>::dp>* result) const;
+
+  virtual void getRows(const ClusterData* rows, const ClusterData* cols,
+                       const int* rowIndices, int count, const hmat_block_info_t * block_info,
+                       FullMatrix<typename Types<T>::dp>* result) const;
+  virtual void getCols(const ClusterData* rows, const ClusterData* cols,
+                       const int* colIndices, int count, const hmat_block_info_t * block_info,
+                       FullMatrix<typename Types<T>::dp>* result) const;
 };
 
 }  // end namespace hmat
@@ -276,6 +276,7 @@ void ger(const int m, const int n, const hmat::Z_t& alpha, const hmat::Z_t* x, c
 }
 
   // Level 3
+// transA and transB are 'N', 'T' or 'C'; 'C' is the same as 'T' for real values
 template<typename T>
 void gemm(const char transA, const char transB, const int m, const int n, const int k,
           const T& alpha, const T* a, const int lda, const T* b, const int ldb,
@@ -301,8 +302,8 @@ inline
 void gemm(const char transA, const char transB, const int m, const int n, const int k,
           const hmat::C_t& alpha, const hmat::C_t* a, const int lda, const hmat::C_t* b, const int ldb,
           const hmat::C_t& beta, hmat::C_t* c, const int ldc) {
-  const CBLAS_TRANSPOSE tA = (transA == 'N' ? CblasNoTrans : CblasTrans);
-  const CBLAS_TRANSPOSE tB = (transB == 'N' ? CblasNoTrans : CblasTrans);
+  const CBLAS_TRANSPOSE tA = (transA == 'N' ? CblasNoTrans : (transA == 'C' ? CblasConjTrans : CblasTrans));
+  const CBLAS_TRANSPOSE tB = (transB == 'N' ? CblasNoTrans : (transB == 'C' ? CblasConjTrans : CblasTrans));
   // WARNING: &alpha/&beta instead of alpha/beta for complex values
 #define _C_T hmat::C_t
 #ifdef HAVE_ZGEMM3M
@@ -316,8 +317,8 @@ inline
 void gemm(const char transA, const char transB, const int m, const int n, int k,
           const hmat::Z_t& alpha, const hmat::Z_t* a, const int lda, const hmat::Z_t* b, const int ldb,
           const hmat::Z_t& beta, hmat::Z_t* c, const int ldc) {
-  const CBLAS_TRANSPOSE tA = (transA == 'N' ? CblasNoTrans : CblasTrans);
-  const CBLAS_TRANSPOSE tB = (transB == 'N' ? CblasNoTrans : CblasTrans);
+  const CBLAS_TRANSPOSE tA = (transA == 'N' ? CblasNoTrans : (transA == 'C' ? CblasConjTrans : CblasTrans));
+  const CBLAS_TRANSPOSE tB = (transB == 'N' ? CblasNoTrans : (transB == 'C' ? CblasConjTrans : CblasTrans));
   // WARNING: &alpha/&beta instead of alpha/beta for complex values
 #define _C_T hmat::Z_t
 #ifdef HAVE_ZGEMM3M
@@ -24,6 +24,7 @@
 #include "coordinates.hpp"
 #include "hmat_cpp_interface.hpp"
 #include "default_engine.hpp"
+#include "parallel_engine.hpp"
 #include "clustering.hpp"
 #include "admissibility.hpp"
 #include "c_wrapping.hpp"
@@ -31,6 +32,16 @@
 
 using namespace hmat;
 
+namespace {
+// Set by hmat_init_parallel_interface(), the cluster trees are then built with
+// the threads of the parallel interface
+bool parallelInterface = false;
+
+int clusteringThreads() {
+  return parallelInterface ? 0 : 1;
+}
+}  // end anonymous namespace
+
 hmat_clustering_algorithm_t * hmat_create_clustering_median()
 {
     return (hmat_clustering_algorithm_t*) new MedianBisectionAlgorithm();
@@ -46,6 +57,11 @@ hmat_clustering_algorithm_t * hmat_create_clustering_hybrid()
     return (hmat_clustering_algorithm_t*) new HybridBisectionAlgorithm();
 }
 
+hmat_clustering_algorithm_t * hmat_create_clustering_sfc()
+{
+    return (hmat_clustering_algorithm_t*) new SpaceFillingCurveAlgorithm();
+}
+
 void hmat_delete_clustering(hmat_clustering_algorithm_t* algo)
 {
     delete (ClusteringAlgorithm*) algo;
@@ -74,7 +90,7 @@ hmat_create_void_clustering(const hmat_clustering_algorithm_t* algo)
 hmat_cluster_tree_t * hmat_create_cluster_tree(double* coord, int dimension, int size, hmat_clustering_algorithm_t* algo)
 {
     DofCoordinates dofs(coord, dimension, size, true);
-    return (hmat_cluster_tree_t*) createClusterTree(dofs, *((ClusteringAlgorithm*) algo));
+    return (hmat_cluster_tree_t*) createClusterTree(dofs, *((ClusteringAlgorithm*) algo), clusteringThreads());
 }
 
 hmat_cluster_tree_builder_t* hmat_create_cluster_tree_builder(const hmat_clustering_algorithm_t* algo)
@@ -100,7 +116,7 @@ hmat_cluster_tree_t * hmat_create_cluster_tree_from_builder(double* coord, int d
 {
     const ClusterTreeBuilder* ct_builder = static_cast<const ClusterTreeBuilder*>((void*) ctb);
     DofCoordinates dofs(coord, dimension, size, true);
-    return static_cast<hmat_cluster_tree_t*>((void*)  ct_builder->build(dofs));
+    return static_cast<hmat_cluster_tree_t*>((void*)  ct_builder->build(dofs, NULL, clusteringThreads()));
 }
 
 void hmat_delete_cluster_tree(hmat_cluster_tree_t * tree) {
@@ -167,6 +183,19 @@ void hmat_init_default_interface(hmat_interface_t * i, hmat_value_t type)
     }
 }
 
+void hmat_init_parallel_interface(hmat_interface_t * i, hmat_value_t type)
+{
+    parallelInterface = true;
+    i->value_type = type;
+    switch (type) {
+    case HMAT_SIMPLE_PRECISION: createCInterface<S_t, ParallelEngine>(i); break;
+    case HMAT_DOUBLE_PRECISION: createCInterface<D_t, ParallelEngine>(i); break;
+    case HMAT_SIMPLE_COMPLEX: createCInterface<C_t, ParallelEngine>(i); break;
+    case HMAT_DOUBLE_COMPLEX: createCInterface<Z_t, ParallelEngine>(i); break;
+    default: HMAT_ASSERT(false);
+    }
+}
+
 void hmat_get_parameters(hmat_settings_t* settings)
 {
     HMatSettings& settingsCxx = HMatSettings::getInstance();
@@ -185,6 +214,12 @@ void hmat_get_parameters(hmat_settings_t* settings)
     case AcaPlus:
       settings->compressionMethod = hmat_compress_aca_plus;
       break;
+    case RandomSvd:
+      settings->compressionMethod = hmat_compress_rand_svd;
+      break;
+    case AcaBlocked:
+      settings->compressionMethod = hmat_compress_aca_blocked;
+      break;
     default:
       std::cerr << "Internal error: invalid value for compression method: \"" << settingsCxx.compressionMethod << "\"." << std::endl;
       std::cerr << "Internal error: using SVD" << std::endl;
@@ -195,12 +230,19 @@ void hmat_get_parameters(hmat_settings_t* settings)
     settings->maxLeafSize = settingsCxx.maxLeafSize;
     settings->maxParallelLeaves = settingsCxx.maxParallelLeaves;
     settings->coarsening = settingsCxx.coarsening;
+    settings->coarseningThreshold = settingsCxx.coarseningThreshold;
     settings->recompress = settingsCxx.recompress;
     settings->validateCompression = settingsCxx.validateCompression;
     settings->validationErrorThreshold = settingsCxx.validationErrorThreshold;
     settings->validationReRun = settingsCxx.validationReRun;
     settings->dumpTrace = settingsCxx.dumpTrace;
     settings->validationDump = settingsCxx.validationDump;
+    settings->validationSamples = settingsCxx.validationSamples;
+    settings->nbThreads = settingsCxx.nbThreads;
+    settings->blockPool = settingsCxx.blockPool;
+    settings->powerIterations = settingsCxx.powerIterations;
+    settings->lowPrecisionStorage = settingsCxx.lowPrecisionStorage;
+    settings->accumulateRkUpdates = settingsCxx.accumulateRkUpdates;
 }
 
 int hmat_set_parameters(hmat_settings_t* settings)
@@ -223,6 +265,12 @@ int hmat_set_parameters(hmat_settings_t* settings)
     case hmat_compress_aca_plus:
       settingsCxx.compressionMethod = AcaPlus;
       break;
+    case hmat_compress_rand_svd:
+      settingsCxx.compressionMethod = RandomSvd;
+      break;
+    case hmat_compress_aca_blocked:
+      settingsCxx.compressionMethod = AcaBlocked;
+      break;
     default:
       std::cerr << "Invalid value for compression method: \"" << settings->compressionMethod << "\"." << std::endl;
       rc = 1;
@@ -232,12 +280,19 @@ int hmat_set_parameters(hmat_settings_t* settings)
     settingsCxx.maxLeafSize = settings->maxLeafSize;
     settingsCxx.maxParallelLeaves = settings->maxParallelLeaves;
     settingsCxx.coarsening = settings->coarsening;
+    settingsCxx.coarseningThreshold = settings->coarseningThreshold;
     settingsCxx.recompress = settings->recompress;
     settingsCxx.validateCompression = settings->validateCompression;
     settingsCxx.validationErrorThreshold = settings->validationErrorThreshold;
     settingsCxx.validationReRun = settings->validationReRun;
     settingsCxx.dumpTrace = settings->dumpTrace;
     settingsCxx.validationDump = settings->validationDump;
+    settingsCxx.validationSamples = settings->validationSamples;
+    settingsCxx.nbThreads = settings->nbThreads;
+    settingsCxx.blockPool = settings->blockPool;
+    settingsCxx.powerIterations = settings->powerIterations;
+    settingsCxx.lowPrecisionStorage = settings->lowPrecisionStorage;
+    settingsCxx.accumulateRkUpdates = settings->accumulateRkUpdates;
     settingsCxx.setParameters();
     return rc;
 }
@@ -273,6 +328,19 @@ void hmat_assemble_context_init(hmat_assemble_context_t * context) {
 void hmat_factorization_context_init(hmat_factorization_context_t *context) {
     context->factorization = hmat_factorization_lu;
     context->progress = DefaultProgress::getInstance();
+    context->mixed_precision = 0;
+    context->refinement_epsilon = 1e-12;
+    context->refinement_max_iterations = 10;
+}
+
+void hmat_iterative_solver_context_init(hmat_iterative_solver_context_t *context) {
+    memset(context, 0, sizeof(hmat_iterative_solver_context_t));
+    context->method = hmat_iterative_gmres;
+    context->tolerance = 1e-8;
+    context->max_iterations = 1000;
+    context->restart = 30;
+    context->preconditioner = hmat_factorization_none;
+    context->preconditioner_epsilon = 1e-2;
 }
 
 void hmat_delete_procedure(hmat_procedure_t* proc) {
@@ -303,3 +371,11 @@ void hmat_tracing_dump(char *filename) {
   tracing_dump(filename);
 }
 
+void hmat_tracing_record_timeline(int capacity) {
+  tracing_record_timeline(capacity > 0 ? capacity : 0);
+}
+
+void hmat_tracing_dump_chrome(char *filename) {
+  tracing_chrome_dump(filename);
+}
+
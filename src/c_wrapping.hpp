@@ -81,33 +81,41 @@ public:
 };
 
 template<typename T, template <typename> class E>
-void assemble_generic(hmat_matrix_t* matrix, hmat_assemble_context_t * ctx) {
+void assemble_context(hmat_matrix_t* matrix, hmat_assemble_context_t * ctx, bool reassembly) {
     DECLARE_CONTEXT;
     hmat::HMatInterface<T, E>* hmat = (hmat::HMatInterface<T, E>*)matrix;
     bool assembleOnly = ctx->factorization == hmat_factorization_none;
     hmat::SymmetryFlag sf = ctx->lower_symmetric ? hmat::kLowerSymmetric : hmat::kNotSymmetric;
+    hmat::Assembly<T> * f;
+    bool ownAssembly = true;
     if(ctx->assembly != NULL) {
         HMAT_ASSERT(ctx->block_compute == NULL && ctx->simple_compute == NULL);
-        hmat::Assembly<T> * cppAssembly = (hmat::Assembly<T> *)ctx->assembly;
-        hmat->assemble(*cppAssembly, sf, ctx->progress);
-        if(!assembleOnly)
-            hmat->factorize(ctx->factorization, ctx->progress);
+        f = (hmat::Assembly<T> *)ctx->assembly;
+        ownAssembly = false;
     } else if(ctx->block_compute != NULL) {
         HMAT_ASSERT(ctx->simple_compute == NULL && ctx->assembly == NULL);
-        hmat::BlockAssemblyFunction<T> * f =
-            new hmat::BlockAssemblyFunction<T> (hmat->rows(), hmat->cols(),
+        f = new hmat::BlockAssemblyFunction<T> (hmat->rows(), hmat->cols(),
                 ctx->user_context, ctx->prepare, ctx->block_compute);
-        hmat->assemble(*f, sf, true, ctx->progress, true);
-        if(!assembleOnly)
-            hmat->factorize(ctx->factorization, ctx->progress);
     } else {
         HMAT_ASSERT(ctx->block_compute == NULL && ctx->assembly == NULL);
-        SimpleCAssemblyFunction<T> * f = new SimpleCAssemblyFunction<T>(
-            ctx->user_context, ctx->simple_compute);
-        hmat->assemble(*f, sf, true, ctx->progress, true);
-        if(!assembleOnly)
-            hmat->factorize(ctx->factorization, ctx->progress);
+        f = new SimpleCAssemblyFunction<T>(ctx->user_context, ctx->simple_compute);
     }
+    if(reassembly)
+        hmat->reassemble(*f, sf, ctx->progress, ownAssembly);
+    else
+        hmat->assemble(*f, sf, true, ctx->progress, ownAssembly);
+    if(!assembleOnly)
+        hmat->factorize(ctx->factorization, ctx->progress);
+}
+
+template<typename T, template <typename> class E>
+void assemble_generic(hmat_matrix_t* matrix, hmat_assemble_context_t * ctx) {
+    assemble_context<T, E>(matrix, ctx, false);
+}
+
+template<typename T, template <typename> class E>
+void reassemble_generic(hmat_matrix_t* matrix, hmat_assemble_context_t * ctx) {
+    assemble_context<T, E>(matrix, ctx, true);
 }
 
 template<typename T, template <typename> class E>
@@ -184,7 +192,11 @@ template<typename T, template <typename> class E>
 void factorize_generic(hmat_matrix_t* holder, hmat_factorization_context_t * ctx) {
     DECLARE_CONTEXT;
     hmat::HMatInterface<T, E>* hmat = (hmat::HMatInterface<T, E>*) holder;
-    hmat->factorize(ctx->factorization, ctx->progress);
+    if (ctx->mixed_precision)
+      hmat->factorizeMixed(ctx->factorization, ctx->refinement_epsilon,
+                           ctx->refinement_max_iterations, ctx->progress);
+    else
+      hmat->factorize(ctx->factorization, ctx->progress);
 }
 
 template<typename T, template <typename> class E>
@@ -291,6 +303,15 @@ int solve_systems(hmat_matrix_t* holder, void* b, int nrhs) {
   return 0;
 }
 
+template<typename T, template <typename> class E>
+int solve_iterative(hmat_matrix_t* holder, void* b, int nrhs, hmat_iterative_solver_context_t* ctx) {
+  DECLARE_CONTEXT;
+  hmat::HMatInterface<T, E>* hmat = (hmat::HMatInterface<T, E>*)holder;
+  hmat::FullMatrix<T> mb((T*) b, hmat->cols()->size(), nrhs);
+  hmat->solveIterative(mb, *ctx);
+  return 0;
+}
+
 template<typename T, template <typename> class E>
 int transpose(hmat_matrix_t* hmat) {
   DECLARE_CONTEXT;
@@ -399,6 +420,19 @@ int walk(hmat_matrix_t* holder, hmat_procedure_t* proc) {
     return 0;
 }
 
+template <typename T, template <typename> class E>
+int write_file(hmat_matrix_t* holder, const char* filename) {
+  DECLARE_CONTEXT;
+    ((hmat::HMatInterface<T, E> *) holder)->writeFile(filename);
+    return 0;
+}
+
+template <typename T, template <typename> class E>
+hmat_matrix_t* read_file(const char* filename) {
+  DECLARE_CONTEXT;
+    return (hmat_matrix_t*) hmat::HMatInterface<T, E>::readFile(filename);
+}
+
 }  // end anonymous namespace
 
 namespace hmat {
@@ -438,6 +472,10 @@ static void createCInterface(hmat_interface_t * i)
     i->get_values = get_values<T, E>;
     i->get_block = get_block<T, E>;
     i->walk = walk<T, E>;
+    i->write_file = write_file<T, E>;
+    i->read_file = read_file<T, E>;
+    i->solve_iterative = solve_iterative<T, E>;
+    i->reassemble_generic = reassemble_generic<T, E>;
 }
 
 }  // end namespace hmat
@@ -20,17 +20,28 @@
   http://github.com/jeromerobert/hmat-oss
 */
 
+#include "config.h"
+
 #include "clustering.hpp"
 #include "cluster_tree.hpp"
+#include "task_pool.hpp"
 #include "common/my_assert.h"
 #include "hmat_cpp_interface.hpp"
 
 #include <algorithm>
 #include <cstring>
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace {
 
 /*! \brief Comparateur pour deux indices selon une de leur coordonnee.
+
+  Equal coordinates are ordered by index, so that the result of a split does not
+  depend on the order of the indices.
  */
 class IndicesComparator
 {
@@ -47,13 +58,270 @@ public:
     , dimension_(data.coordinates()->dimension())
     , axis_(axis)
   {}
-  bool operator() (int i, int j) {
-    if (group_index_ == NULL || group_index_[i] == group_index_[j])
-      return coordinates_[i * dimension_ + axis_] < coordinates_[j * dimension_ + axis_];
+  bool operator() (int i, int j) const {
+    if (group_index_ == NULL || group_index_[i] == group_index_[j]) {
+      const double ci = coordinates_[i * dimension_ + axis_];
+      const double cj = coordinates_[j * dimension_ + axis_];
+      return ci < cj || (ci == cj && i < j);
+    }
     return group_index_[i] < group_index_[j];
   }
 };
 
+/*! \brief Tell whether the coordinate of an index is below a threshold. */
+class CoordinateBelow
+{
+private:
+  const double* coordinates_;
+  const int dimension_;
+  const int axis_;
+  const double threshold_;
+
+public:
+  CoordinateBelow(int axis, double threshold, const hmat::ClusterData& data)
+    : coordinates_(&data.coordinates()->get(0,0))
+    , dimension_(data.coordinates()->dimension())
+    , axis_(axis)
+    , threshold_(threshold)
+  {}
+  bool operator() (int i) const {
+    return coordinates_[i * dimension_ + axis_] < threshold_;
+  }
+};
+
+/*! \brief Tell whether an index is before a pivot. */
+class IndexBefore
+{
+private:
+  const IndicesComparator& comparator_;
+  const int pivot_;
+
+public:
+  IndexBefore(const IndicesComparator& comparator, int pivot)
+    : comparator_(comparator), pivot_(pivot) {}
+  bool operator() (int i) const {
+    return comparator_(i, pivot_);
+  }
+};
+
+// The partitions work on chunks of this many indices, whatever the number of threads
+const int PARTITION_CHUNK_SIZE = 1 << 14;
+// Below this number of indices, partitions are sequential
+const int PARALLEL_PARTITION_MIN_SIZE = 1 << 17;
+// Below this number of indices, selectIndices() uses std::nth_element
+const int SELECT_MIN_SIZE = 1 << 12;
+// Number of samples used to choose the pivot of selectIndices()
+const int SELECT_SAMPLES = 127;
+
+// Number of threads of the running ClusterTreeBuilder::build()
+int buildThreads = 1;
+
+int partitionThreads(int n) {
+#ifdef _OPENMP
+  // Nested in a task of the parallel build, the subtree is already handled by one thread
+  if (n >= PARALLEL_PARTITION_MIN_SIZE && !omp_in_parallel())
+    return buildThreads;
+#endif
+  return 1;
+}
+
+/*! \brief Stable partition of indices, possibly in parallel.
+
+  Each chunk of indices counts how many of them satisfy the predicate, then
+  copies them at their final position, so the result does not depend on the
+  number of threads.
+
+  \return the number of indices satisfying the predicate, which come first
+ */
+template<typename Predicate>
+int stablePartition(int* indices, int n, const Predicate& predicate) {
+  const int nbThreads = partitionThreads(n);
+  if (nbThreads <= 1)
+    return std::stable_partition(indices, indices + n, predicate) - indices;
+  const int nbChunks = (n + PARTITION_CHUNK_SIZE - 1) / PARTITION_CHUNK_SIZE;
+  std::vector<int> before(nbChunks + 1, 0);
+  std::vector<int> buffer(n);
+#pragma omp parallel for num_threads(nbThreads)
+  for (int c = 0; c < nbChunks; c++) {
+    const int end = std::min(n, (c + 1) * PARTITION_CHUNK_SIZE);
+    int count = 0;
+    for (int i = c * PARTITION_CHUNK_SIZE; i < end; i++)
+      count += predicate(indices[i]) ? 1 : 0;
+    before[c + 1] = count;
+  }
+  for (int c = 0; c < nbChunks; c++)
+    before[c + 1] += before[c];
+  const int total = before[nbChunks];
+#pragma omp parallel for num_threads(nbThreads)
+  for (int c = 0; c < nbChunks; c++) {
+    const int begin = c * PARTITION_CHUNK_SIZE;
+    const int end = std::min(n, begin + PARTITION_CHUNK_SIZE);
+    int first = before[c];
+    int second = total + begin - before[c];
+    for (int i = begin; i < end; i++) {
+      if (predicate(indices[i]))
+        buffer[first++] = indices[i];
+      else
+        buffer[second++] = indices[i];
+    }
+  }
+#pragma omp parallel for num_threads(nbThreads)
+  for (int c = 0; c < nbChunks; c++) {
+    const int begin = c * PARTITION_CHUNK_SIZE;
+    const int end = std::min(n, begin + PARTITION_CHUNK_SIZE);
+    memcpy(indices + begin, &buffer[begin], (end - begin) * sizeof(int));
+  }
+  return total;
+}
+
+/*! \brief Move the k smallest indices of indices[0..n[ at the beginning.
+
+  Large ranges are narrowed by stable partitions around a pivot chosen in a
+  regular sample, then std::nth_element finishes the selection. The result
+  only depends on the input.
+ */
+void selectIndices(int* indices, int n, int k, const IndicesComparator& comparator) {
+  std::vector<int> sample(SELECT_SAMPLES);
+  while (n > SELECT_MIN_SIZE && k > 0 && k < n) {
+    for (int i = 0; i < SELECT_SAMPLES; i++)
+      sample[i] = indices[(long) i * n / SELECT_SAMPLES];
+    const int rank = (int) ((long) k * SELECT_SAMPLES / n);
+    std::nth_element(sample.begin(), sample.begin() + rank, sample.end(), comparator);
+    const int before = stablePartition(indices, n, IndexBefore(comparator, sample[rank]));
+    if (k <= before) {
+      n = before;
+    } else if (before > 0) {
+      indices += before;
+      n -= before;
+      k -= before;
+    } else {
+      // The pivot is the smallest index, nth_element will do
+      break;
+    }
+  }
+  if (k > 0 && k < n)
+    std::nth_element(indices, indices + k, indices + n, comparator);
+}
+
+/*! \brief Move a split position so that it does not cut a group of sorted indices. */
+int splitOutsideGroups(const hmat::ClusterData& data, int middleIndex) {
+  const int* group_index = data.group_index() + data.offset();
+  const int group(group_index[middleIndex]);
+  if (group_index[middleIndex-1] == group)
+  {
+    int upper = middleIndex;
+    int lower = middleIndex-1;
+    while (upper < data.size() && group_index[upper] == group)
+      ++upper;
+    while (lower >= 0 && group_index[lower] == group)
+      --lower;
+    if (lower < 0 && upper == data.size())
+    {
+      // All degrees of freedom belong to the same group, this is fine
+    }
+    else if (lower < 0)
+      middleIndex = upper;
+    else if (upper == data.size())
+      middleIndex = lower + 1;
+    else if (upper + lower < 2 * middleIndex)
+      middleIndex = upper;
+    else
+      middleIndex = lower + 1;
+  }
+  return middleIndex;
+}
+
+/*! \brief Position of the DOFs along a space-filling curve drawn in a cube.
+
+  Each coordinate is quantized on the same number of bits, and the key
+  interleaves these bits from the most significant ones. For the Hilbert
+  curve, the coordinates are first transformed with the algorithm of
+  J. Skilling, "Programming the Hilbert curve", AIP Conf. Proc. 707 (2004).
+ */
+class CurveKeys
+{
+private:
+  const double* coordinates_;
+  const int dimension_;
+  const bool hilbert_;
+  int bits_;
+  const double* origin_;
+  double scale_;
+
+public:
+  CurveKeys(const hmat::ClusterData& data, const hmat::AxisAlignedBoundingBox& cube, bool hilbert)
+    : coordinates_(&data.coordinates()->get(0,0))
+    , dimension_(data.coordinates()->dimension())
+    , hilbert_(hilbert)
+    , bits_(std::min(31, 63 / dimension_))
+    , origin_(cube.bbMin)
+    , scale_(0.)
+  {
+    HMAT_ASSERT_MSG(bits_ > 0, "Space-filling curves are limited to 63 dimensions");
+    const double side = cube.bbMax[0] - cube.bbMin[0];
+    if (side > 0)
+      scale_ = ((uint64_t) 1 << bits_) / side;
+  }
+  uint64_t operator() (int index) const {
+    uint32_t x[63];
+    const uint32_t maxCell = ((uint64_t) 1 << bits_) - 1;
+    for (int d = 0; d < dimension_; d++) {
+      const double cell = (coordinates_[index * dimension_ + d] - origin_[d]) * scale_;
+      x[d] = cell <= 0 ? 0 : (cell >= maxCell ? maxCell : (uint32_t) cell);
+    }
+    if (hilbert_)
+      toHilbertTranspose(x);
+    uint64_t key = 0;
+    for (int b = bits_ - 1; b >= 0; b--) {
+      for (int d = 0; d < dimension_; d++)
+        key = (key << 1) | ((x[d] >> b) & 1);
+    }
+    return key;
+  }
+
+private:
+  void toHilbertTranspose(uint32_t* x) const {
+    const uint32_t m = (uint32_t) 1 << (bits_ - 1);
+    // Inverse undo
+    for (uint32_t q = m; q > 1; q >>= 1) {
+      const uint32_t p = q - 1;
+      for (int d = 0; d < dimension_; d++) {
+        // Without branches: if bit q of x[d] is set, invert the low bits of
+        // x[0], otherwise exchange them with those of x[d]
+        const uint32_t set = 0u - ((x[d] & q) != 0);
+        const uint32_t t = (x[0] ^ x[d]) & p & ~set;
+        x[0] ^= (p & set) | t;
+        x[d] ^= t;
+      }
+    }
+    // Gray encode
+    for (int d = 1; d < dimension_; d++)
+      x[d] ^= x[d - 1];
+    uint32_t t = 0;
+    for (uint32_t q = m; q > 1; q >>= 1) {
+      if (x[dimension_ - 1] & q)
+        t ^= q - 1;
+    }
+    for (int d = 0; d < dimension_; d++)
+      x[d] ^= t;
+  }
+};
+
+/*! \brief Order (key, index) pairs by group, then by key and index. */
+class GroupThenKey
+{
+private:
+  const int* group_index_;
+
+public:
+  explicit GroupThenKey(const int* group_index) : group_index_(group_index) {}
+  bool operator() (const std::pair<uint64_t, int>& a, const std::pair<uint64_t, int>& b) const {
+    if (group_index_[a.second] != group_index_[b.second])
+      return group_index_[a.second] < group_index_[b.second];
+    return a < b;
+  }
+};
+
 }
 
 namespace hmat {
@@ -63,7 +331,23 @@ AxisAlignClusteringAlgorithm::sortByDimension(ClusterTree& node, int dim)
 const
 {
   int* myIndices = node.data.indices() + node.data.offset();
-  std::stable_sort(myIndices, myIndices + node.data.size(), IndicesComparator(dim, node.data));
+  std::sort(myIndices, myIndices + node.data.size(), IndicesComparator(dim, node.data));
+}
+
+void
+AxisAlignClusteringAlgorithm::selectByDimension(ClusterTree& node, int dim, int first, int k)
+const
+{
+  int* myIndices = node.data.indices() + node.data.offset() + first;
+  selectIndices(myIndices, node.data.size() - first, k, IndicesComparator(dim, node.data));
+}
+
+int
+AxisAlignClusteringAlgorithm::partitionByDimension(ClusterTree& node, int dim, double middle)
+const
+{
+  int* myIndices = node.data.indices() + node.data.offset();
+  return stablePartition(myIndices, node.data.size(), CoordinateBelow(dim, middle, node.data));
 }
 
 AxisAlignedBoundingBox*
@@ -110,19 +394,22 @@ const
   return result;
 }
 
+int
+AxisAlignClusteringAlgorithm::splitDimension(const ClusterTree& current, int axisIndex, int spatialDimension)
+const
+{
+  if (axisIndex < 0)
+    return largestDimension(current);
+  if (spatialDimension < 0)
+    spatialDimension = current.data.coordinates()->dimension();
+  return (axisIndex + current.depth) % spatialDimension;
+}
+
 void
 AxisAlignClusteringAlgorithm::sort(ClusterTree& current, int axisIndex, int spatialDimension)
 const
 {
-  int dim;
-  if (axisIndex < 0) {
-    dim = largestDimension(current);
-  } else {
-    if (spatialDimension < 0)
-      spatialDimension = current.data.coordinates()->dimension();
-    dim = ((axisIndex + current.depth) % spatialDimension);
-  }
-  sortByDimension(current, dim);
+  sortByDimension(current, splitDimension(current, axisIndex, spatialDimension));
 }
 
 void
@@ -155,16 +442,9 @@ ClusteringAlgorithm::setDivider(int divider)
 void
 GeometricBisectionAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree*>& children) const
 {
-  int dim;
-  if (spatialDimension_ < 0) {
-    spatialDimension_ = current.data.coordinates()->dimension();
-  }
-  if (axisIndex_ < 0) {
-    dim = largestDimension(current);
-  } else {
-    dim = ((axisIndex_ + current.depth) % spatialDimension_);
-  }
-  sortByDimension(current, dim);
+  // Not cached in spatialDimension_, partition() may be called concurrently
+  const int spatialDimension = spatialDimension_ < 0 ? current.data.coordinates()->dimension() : spatialDimension_;
+  const int dim = splitDimension(current, axisIndex_, spatialDimension);
   AxisAlignedBoundingBox* bbox = getAxisAlignedBoundingbox(current);
   current.clusteringAlgoData_ = bbox;
 
@@ -172,8 +452,14 @@ GeometricBisectionAlgorithm::partition(ClusterTree& current, std::vector<Cluster
   int middleIndex = 0;
   int* myIndices = current.data.indices() + current.data.offset();
   const double* coord = &current.data.coordinates()->get(0,0);
-  while (coord[myIndices[middleIndex]*spatialDimension_+dim] < middle) {
-    middleIndex++;
+  if (NULL == current.data.group_index()) {
+    // Only the indices below the middle have to come first
+    middleIndex = partitionByDimension(current, dim, middle);
+  } else {
+    sortByDimension(current, dim);
+    while (coord[myIndices[middleIndex]*spatialDimension+dim] < middle) {
+      middleIndex++;
+    }
   }
   if (NULL != current.data.group_index())
   {
@@ -196,7 +482,7 @@ GeometricBisectionAlgorithm::partition(ClusterTree& current, std::vector<Cluster
         middleIndex = upper;
       else if (upper == current.data.size())
         middleIndex = lower + 1;
-      else if (coord[myIndices[upper]*spatialDimension_+dim] + coord[myIndices[lower]*spatialDimension_+dim] < 2.0 * middle)
+      else if (coord[myIndices[upper]*spatialDimension+dim] + coord[myIndices[lower]*spatialDimension+dim] < 2.0 * middle)
         middleIndex = upper;
       else
         middleIndex = lower + 1;
@@ -216,38 +502,20 @@ GeometricBisectionAlgorithm::clean(ClusterTree& current) const
 void
 MedianBisectionAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree*>& children) const
 {
-  sort(current, axisIndex_, spatialDimension_);
+  const int dim = splitDimension(current, axisIndex_, spatialDimension_);
+  const bool grouped = NULL != current.data.group_index();
+  // Groups are moved to a single side of the split by looking at the
+  // neighbours of the median, which requires a complete sort
+  if (grouped)
+    sortByDimension(current, dim);
   int previousIndex = 0;
   // Loop on 'divider_' = the number of children created
   for (int i=1 ; i<divider_ ; i++) {
     int middleIndex = current.data.size() * i / divider_;
-  if (NULL != current.data.group_index())
-  {
-    // Ensure that we do not split inside a group
-    const int* group_index = current.data.group_index() + current.data.offset();
-    const int group(group_index[middleIndex]);
-    if (group_index[middleIndex-1] == group)
-    {
-      int upper = middleIndex;
-      int lower = middleIndex-1;
-      while (upper < current.data.size() && group_index[upper] == group)
-        ++upper;
-      while (lower >= 0 && group_index[lower] == group)
-        --lower;
-      if (lower < 0 && upper == current.data.size())
-      {
-        // All degrees of freedom belong to the same group, this is fine
-      }
-      else if (lower < 0)
-        middleIndex = upper;
-      else if (upper == current.data.size())
-        middleIndex = lower + 1;
-      else if (upper + lower < 2 * middleIndex)
-        middleIndex = upper;
-      else
-        middleIndex = lower + 1;
-    }
-  }
+    if (grouped)
+      middleIndex = splitOutsideGroups(current.data, middleIndex);
+    else
+      selectByDimension(current, dim, previousIndex, middleIndex - previousIndex);
     children.push_back(current.slice(current.data.offset()+previousIndex, middleIndex-previousIndex));
     previousIndex = middleIndex;
   }
@@ -290,6 +558,93 @@ HybridBisectionAlgorithm::clean(ClusterTree& current) const
   geometricAlgorithm_.clean(current);
 }
 
+void
+SpaceFillingCurveAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree*>& children) const
+{
+  const int size = current.data.size();
+  const int dimension = current.data.coordinates()->dimension();
+  AxisAlignedBoundingBox* cube = static_cast<AxisAlignedBoundingBox*>(current.clusteringAlgoData_);
+  bool first;
+#pragma omp critical (hmat_sfc_clustering)
+  {
+    first = cubes_.count(cube) == 0;
+    if (first && keys_.size() < (size_t) current.data.coordinates()->size())
+      keys_.resize(current.data.coordinates()->size());
+  }
+  int* myIndices = current.data.indices() + current.data.offset();
+  const int* group_index = current.data.group_index();
+
+  if (first) {
+    // The curve is drawn in the bounding cube of the first node split by this algorithm
+    cube = getAxisAlignedBoundingbox(current);
+    double side = 0.;
+    for (int d = 0; d < dimension; d++)
+      side = std::max(side, cube->bbMax[d] - cube->bbMin[d]);
+    for (int d = 0; d < dimension; d++)
+      cube->bbMax[d] = cube->bbMin[d] + side;
+    const CurveKeys curve(current.data, *cube, curve_ == Hilbert);
+    std::vector<std::pair<uint64_t, int> > sorted(size);
+#pragma omp parallel for num_threads(partitionThreads(size))
+    for (int i = 0; i < size; i++) {
+      const uint64_t key = curve(myIndices[i]);
+      keys_[myIndices[i]] = key;
+      sorted[i] = std::make_pair(key, myIndices[i]);
+    }
+    if (NULL != group_index)
+      std::sort(sorted.begin(), sorted.end(), GroupThenKey(group_index));
+    else
+      std::sort(sorted.begin(), sorted.end());
+    for (int i = 0; i < size; i++)
+      myIndices[i] = sorted[i].second;
+  }
+
+  int middleIndex = size / 2;
+  if (NULL != group_index) {
+    middleIndex = splitOutsideGroups(current.data, middleIndex);
+  } else {
+    const uint64_t diff = keys_[myIndices[0]] ^ keys_[myIndices[size - 1]];
+    // Otherwise all the DOFs are in the same cell of the curve: split in the middle
+    if (diff != 0) {
+      uint64_t bit = 1;
+      while (diff >> 1 >= bit)
+        bit <<= 1;
+      // The keys share their bits above this one: find the first key where it is set
+      int lower = 0;
+      int upper = size - 1;
+      while (lower < upper) {
+        const int middle = lower + (upper - lower) / 2;
+        if (keys_[myIndices[middle]] & bit)
+          upper = middle;
+        else
+          lower = middle + 1;
+      }
+      middleIndex = lower;
+    }
+  }
+  children.push_back(current.slice(current.data.offset(), middleIndex));
+  children.push_back(current.slice(current.data.offset() + middleIndex, size - middleIndex));
+  // The children are ranges of the same curve
+  for (size_t i = 0; i < children.size(); i++) {
+    AxisAlignedBoundingBox* childCube = new AxisAlignedBoundingBox(dimension, cube->bbMin, cube->bbMax);
+    children[i]->clusteringAlgoData_ = childCube;
+#pragma omp critical (hmat_sfc_clustering)
+    cubes_.insert(childCube);
+  }
+}
+
+void
+SpaceFillingCurveAlgorithm::clean(ClusterTree& current) const
+{
+#pragma omp critical (hmat_sfc_clustering)
+  {
+    cubes_.erase(current.clusteringAlgoData_);
+    if (cubes_.empty())
+      std::vector<uint64_t>().swap(keys_);
+  }
+  delete static_cast<AxisAlignedBoundingBox*>(current.clusteringAlgoData_);
+  current.clusteringAlgoData_ = NULL;
+}
+
 void
 VoidClusteringAlgorithm::partition(ClusterTree& current, std::vector<ClusterTree*>& children) const
 {
@@ -323,12 +678,20 @@ ClusterTreeBuilder::~ClusterTreeBuilder()
 }
 
 ClusterTree*
-ClusterTreeBuilder::build(const DofCoordinates& coordinates, int* group_index) const
+ClusterTreeBuilder::build(const DofCoordinates& coordinates, int* group_index, int nbThreads) const
 {
   DofData* dofData = new DofData(coordinates, group_index);
   ClusterTree* rootNode = new ClusterTree(dofData);
 
-  divide_recursive(*rootNode);
+  if (nbThreads == 0)
+    nbThreads = TaskPool::defaultThreadCount();
+  if (nbThreads > 1) {
+    buildThreads = nbThreads;
+    divide_parallel(*rootNode, nbThreads);
+    buildThreads = 1;
+  } else {
+    divide_recursive(*rootNode);
+  }
   clean_recursive(*rootNode);
   // Update reverse mapping
   int* indices_i2e = rootNode->data.indices();
@@ -385,20 +748,76 @@ ClusterTreeBuilder::addAlgorithm(int depth, const ClusteringAlgorithm& algo)
 }
 
 void
-ClusterTreeBuilder::divide_recursive(ClusterTree& current) const
+ClusterTreeBuilder::divide(ClusterTree& current, std::vector<ClusterTree*>& children) const
 {
   ClusteringAlgorithm* algo = getAlgorithm(current.depth);
   if (current.data.size() <= algo->getMaxLeafSize())
     return;
 
   // Sort degrees of freedom and partition current node
-  std::vector<ClusterTree*> children;
   algo->partition(current, children);
   for (size_t i = 0; i < children.size(); ++i)
   {
     current.insertChild(i, children[i]);
+  }
+}
+
+void
+ClusterTreeBuilder::divide_recursive(ClusterTree& current) const
+{
+  std::vector<ClusterTree*> children;
+  divide(current, children);
+  for (size_t i = 0; i < children.size(); ++i)
+  {
     divide_recursive(*children[i]);
   }
 }
 
+/*! \brief Division of a subtree, by a worker of the parallel build */
+class ClusterTreeBuilder::DivideTask : public Task
+{
+public:
+  DivideTask(const ClusterTreeBuilder& builder, ClusterTree& node)
+    : builder_(builder), node_(node) {}
+  void run() {
+    builder_.divide_recursive(node_);
+  }
+private:
+  const ClusterTreeBuilder& builder_;
+  ClusterTree& node_;
+};
+
+/* The largest nodes are split one at a time, with parallel partitions, until
+   there are enough subtrees to keep the threads busy. These subtrees work on
+   separate ranges of indices and are then divided concurrently. Each node is
+   split the same way whatever the thread running it, so the tree does not
+   depend on the number of threads. */
+void
+ClusterTreeBuilder::divide_parallel(ClusterTree& root, int nbThreads) const
+{
+  std::vector<ClusterTree*> subtrees(1, &root);
+  while (!subtrees.empty() && subtrees.size() < (size_t) (4 * nbThreads))
+  {
+    size_t largest = 0;
+    for (size_t i = 1; i < subtrees.size(); ++i)
+    {
+      if (subtrees[i]->data.size() > subtrees[largest]->data.size())
+        largest = i;
+    }
+    ClusterTree* current = subtrees[largest];
+    subtrees.erase(subtrees.begin() + largest);
+    std::vector<ClusterTree*> children;
+    divide(*current, children);
+    subtrees.insert(subtrees.end(), children.begin(), children.end());
+  }
+  TaskPool pool(nbThreads);
+  for (size_t i = 0; i < subtrees.size(); ++i)
+  {
+    Task* task = new DivideTask(*this, *subtrees[i]);
+    task->setPriority(subtrees[i]->data.size());
+    pool.submit(task);
+  }
+  pool.run();
+}
+
 }  // end namespace hmat
@@ -29,7 +29,9 @@
 
 #include <vector>
 #include <list>
+#include <set>
 #include <string>
+#include <stdint.h>
 
 namespace hmat {
 
@@ -49,14 +51,22 @@ public:
 
   /*! \brief Recursively apply splitting algorithms on points to create a ClusterTree instance.
 
+      With several threads, the subtrees are divided concurrently and the
+      largest nodes are split with parallel partitions. The tree is the same
+      as with a single thread.
+
       \param coordinates node coordinates
       \param group_index optional array containing group numbers of points.  Points of the same group cannot be scattered into different tree leaves.
+      \param nbThreads number of threads, 0 for HMatSettings::nbThreads
       \return a ClusterTree instance
    */
-  ClusterTree* build(const DofCoordinates& coordinates, int* group_index = NULL) const;
+  ClusterTree* build(const DofCoordinates& coordinates, int* group_index = NULL, int nbThreads = 1) const;
 
 private:
+  class DivideTask;
   void divide_recursive(ClusterTree& current) const;
+  void divide_parallel(ClusterTree& root, int nbThreads) const;
+  void divide(ClusterTree& current, std::vector<ClusterTree*>& children) const;
   void clean_recursive(ClusterTree& current) const;
   ClusteringAlgorithm* getAlgorithm(int depth) const;
 
@@ -102,6 +112,18 @@ protected:
 class AxisAlignClusteringAlgorithm : public ClusteringAlgorithm {
 protected:
   void sortByDimension(ClusterTree& node, int dim) const;
+  /*! \brief Move the k smallest indices along dim, among those after the first ones of node, right after them.
+
+    This is a selection, not a sort: indices are not ordered on each side.
+   */
+  void selectByDimension(ClusterTree& node, int dim, int first, int k) const;
+  /*! \brief Move the indices of node whose coordinate along dim is below middle first.
+
+    \return the number of these indices
+   */
+  int partitionByDimension(ClusterTree& node, int dim, double middle) const;
+  /*! \brief Axis along which current is split: the largest one if axisIndex < 0, otherwise they are cycled */
+  int splitDimension(const ClusterTree& current, int axisIndex, int spatialDimension) const;
   virtual AxisAlignedBoundingBox* getAxisAlignedBoundingbox(const ClusterTree& node) const;
   int largestDimension(const ClusterTree& node) const;
   double volume(const ClusterTree& node) const;
@@ -196,6 +218,42 @@ private:
   const double thresholdRatio_;
 };
 
+/*! \brief Creating tree by splitting a space-filling curve.
+
+  The DOFs are sorted once along a Hilbert (or Morton) curve drawn in the
+  bounding cube of the first node split by this algorithm. Each node is then
+  split where the curve keys of its DOFs start to differ, which bisects the
+  cells of the curve: children are ranges of the curve, and the DOFs are not
+  sorted again. Neighbouring clusters are thus contiguous, but their sizes are
+  not balanced. The divider is not used, nodes always have 2 children.
+
+  The keys are kept in this object until the tree is cleaned.
+
+  With a group_index, the DOFs are sorted by group, then along the curve, and
+  nodes are split in the middle without cutting a group.
+ */
+class SpaceFillingCurveAlgorithm : public AxisAlignClusteringAlgorithm
+{
+public:
+  enum Curve { Hilbert, Morton };
+
+  explicit SpaceFillingCurveAlgorithm(Curve curve = Hilbert)
+    : AxisAlignClusteringAlgorithm(), curve_(curve) {}
+
+  ClusteringAlgorithm* clone() const { return new SpaceFillingCurveAlgorithm(*this); }
+  std::string str() const { return curve_ == Hilbert ? "HilbertCurveAlgorithm" : "MortonCurveAlgorithm"; }
+
+  void partition(ClusterTree& current, std::vector<ClusterTree*>& children) const;
+  void clean(ClusterTree& current) const;
+
+private:
+  const Curve curve_;
+  /// Keys of the DOFs along the curve, indexed like the coordinates
+  mutable std::vector<uint64_t> keys_;
+  /// Cubes of the nodes created by this algorithm, whose DOFs are sorted
+  mutable std::set<const void*> cubes_;
+};
+
 class VoidClusteringAlgorithm : public AxisAlignClusteringAlgorithm
 {
 public:
@@ -0,0 +1,411 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Pool allocator for the arrays of the matrix blocks.
+*/
+#include "config.h"
+#include "block_allocator.hpp"
+#include "common/my_assert.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#ifndef _WIN32
+#include <pthread.h>
+#define HMAT_THREAD_EXIT
+#endif
+#endif
+
+#ifdef HAVE_JEMALLOC
+#define JEMALLOC_NO_DEMANGLE
+#include <jemalloc/jemalloc.h>
+#endif
+
+#if defined(__GNUC__)
+#define HMAT_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define HMAT_THREAD_LOCAL __declspec(thread)
+#endif
+
+namespace {
+
+// Size classes go from 2^MIN_SHIFT to 2^MAX_SHIFT bytes, 4 classes per power of 2
+const int MIN_SHIFT = 6;
+const int MAX_SHIFT = 22;
+const int NB_CLASSES = 4 * (MAX_SHIFT - MIN_SHIFT) + 1;
+// Bytes of each size class that a thread keeps for itself
+const size_t THREAD_CACHE_BYTES = 512 * 1024;
+const int THREAD_CACHE_MAX_COUNT = 64;
+
+/** Header in front of each array, the free lists are linked through the arrays. */
+struct BlockHeader {
+    size_t size;
+    int sizeClass; // -1 if allocated by the system
+};
+// Keep the arrays aligned as malloc does
+const size_t HEADER_SIZE = 16;
+typedef char header_fits[sizeof(BlockHeader) <= HEADER_SIZE ? 1 : -1];
+
+inline void* payload(BlockHeader* h) {
+    return ((char*) h) + HEADER_SIZE;
+}
+
+inline BlockHeader* header(void* p) {
+    return (BlockHeader*) (((char*) p) - HEADER_SIZE);
+}
+
+inline BlockHeader*& next(BlockHeader* h) {
+    return *(BlockHeader**) payload(h);
+}
+
+inline size_t classSize(int c) {
+    return ((size_t) (4 + c % 4) << (MIN_SHIFT + c / 4)) >> 2;
+}
+
+/** Smallest size class holding size bytes, -1 if there is none. */
+int sizeClass(size_t size) {
+    if (size <= ((size_t) 1 << MIN_SHIFT))
+        return 0;
+    // 2^e < size <= 2^(e+1)
+    int e = 0;
+    for (size_t s = size - 1; s > 1; s >>= 1)
+        e++;
+    if (e >= MAX_SHIFT)
+        return -1;
+    int c = 4 * (e - MIN_SHIFT);
+    while (classSize(c) < size)
+        c++;
+    return c;
+}
+
+int threadCacheCapacity(int c) {
+    size_t n = THREAD_CACHE_BYTES / classSize(c);
+    if (n < 1)
+        return 1;
+    return n > THREAD_CACHE_MAX_COUNT ? THREAD_CACHE_MAX_COUNT : (int) n;
+}
+
+BlockHeader* systemAllocate(size_t size) {
+#ifdef HAVE_JEMALLOC
+    BlockHeader* h = (BlockHeader*) je_calloc(HEADER_SIZE + size, 1);
+#else
+    BlockHeader* h = (BlockHeader*) calloc(HEADER_SIZE + size, 1);
+#endif
+    HMAT_ASSERT_MSG(h, "Trying to allocate %ldb of memory failed", size);
+    return h;
+}
+
+void systemFree(BlockHeader* h) {
+#ifdef HAVE_JEMALLOC
+    je_free(h);
+#else
+    ::free(h);
+#endif
+}
+
+/** Free lists of a thread.
+
+    The owner holds the lock while it uses its cache, so that release() can
+    empty it from another thread. When the owner exits, the cache is flushed
+    and given to the next new thread. Caches are never deleted, so the list
+    of caches can be walked without locking it.
+ */
+struct ThreadCache {
+    BlockHeader* heads[NB_CLASSES];
+    int counts[NB_CLASSES];
+    ThreadCache* nextCache;
+    bool inUse;
+#ifdef _OPENMP
+    omp_lock_t lock;
+#endif
+};
+
+inline void lockCache(ThreadCache* cache) {
+#ifdef _OPENMP
+    omp_set_lock(&cache->lock);
+#else
+    (void) cache;
+#endif
+}
+
+inline void unlockCache(ThreadCache* cache) {
+#ifdef _OPENMP
+    omp_unset_lock(&cache->lock);
+#else
+    (void) cache;
+#endif
+}
+
+// Shared free lists, protected by the hmat_block_allocator critical section
+BlockHeader* sharedHeads[NB_CLASSES];
+size_t sharedBytes;
+// All the thread caches ever created, new ones are inserted at the head
+ThreadCache* threadCaches;
+#ifdef HMAT_THREAD_EXIT
+// Calls BlockAllocator::threadExit() when a thread exits
+pthread_key_t threadExitKey;
+#endif
+
+/** Cache of the current thread, locked. */
+ThreadCache* threadCache() {
+#ifdef HMAT_THREAD_LOCAL
+    static HMAT_THREAD_LOCAL ThreadCache* cache = NULL;
+    if (cache == NULL) {
+#pragma omp critical (hmat_block_allocator)
+        {
+            for (ThreadCache* c = threadCaches; c && !cache; c = c->nextCache) {
+                if (!c->inUse)
+                    cache = c;
+            }
+            if (!cache) {
+                cache = new ThreadCache();
+                memset(cache, 0, sizeof(ThreadCache));
+#ifdef _OPENMP
+                omp_init_lock(&cache->lock);
+#endif
+                cache->nextCache = threadCaches;
+                threadCaches = cache;
+            }
+            cache->inUse = true;
+        }
+#ifdef HMAT_THREAD_EXIT
+        pthread_setspecific(threadExitKey, cache);
+#endif
+    }
+    lockCache(cache);
+    return cache;
+#else
+    return NULL;
+#endif
+}
+
+}  // end anonymous namespace
+
+namespace hmat {
+
+BlockAllocator::BlockAllocator()
+  : enabled_(true), maxCachedBytes_((size_t) 256 << 20),
+    usedBytes_(0), cachedBytes_(0), peakBytes_(0) {
+#ifdef HMAT_THREAD_EXIT
+    pthread_key_create(&threadExitKey, threadExit);
+#endif
+}
+
+void* BlockAllocator::allocate(size_t size) {
+    return instance().allocateImpl(size);
+}
+
+void BlockAllocator::free(void* p) {
+    if (p)
+        instance().freeImpl(p);
+}
+
+void BlockAllocator::addUsed(ptrdiff_t used, ptrdiff_t cached) {
+#pragma omp atomic
+    usedBytes_ += used;
+#pragma omp atomic
+    cachedBytes_ += cached;
+    if (used > 0) {
+        size_t total = usedBytes_ + cachedBytes_;
+        if (total > peakBytes_)
+            peakBytes_ = total;
+    }
+}
+
+void* BlockAllocator::allocateImpl(size_t size) {
+    const int c = enabled_ ? sizeClass(size) : -1;
+    if (c < 0) {
+        BlockHeader* h = systemAllocate(size);
+        h->size = size;
+        h->sizeClass = -1;
+        addUsed(size, 0);
+        return payload(h);
+    }
+    const size_t bytes = classSize(c);
+    ThreadCache* cache = threadCache();
+    BlockHeader* h = NULL;
+    if (cache && cache->heads[c]) {
+        h = cache->heads[c];
+        cache->heads[c] = next(h);
+        cache->counts[c]--;
+    } else {
+        // Refill half of the thread cache at once
+        int n = cache ? (threadCacheCapacity(c) + 1) / 2 : 1;
+#pragma omp critical (hmat_block_allocator)
+        {
+            h = sharedHeads[c];
+            if (h) {
+                sharedHeads[c] = next(h);
+                sharedBytes -= bytes;
+                for (int i = 1; i < n && cache && sharedHeads[c]; i++) {
+                    BlockHeader* b = sharedHeads[c];
+                    sharedHeads[c] = next(b);
+                    sharedBytes -= bytes;
+                    next(b) = cache->heads[c];
+                    cache->heads[c] = b;
+                    cache->counts[c]++;
+                }
+            }
+        }
+    }
+    if (cache)
+        unlockCache(cache);
+    if (h) {
+        memset(payload(h), 0, size);
+        addUsed(bytes, -(ptrdiff_t) bytes);
+    } else {
+        h = systemAllocate(bytes);
+        addUsed(bytes, 0);
+    }
+    h->size = size;
+    h->sizeClass = c;
+    return payload(h);
+}
+
+void BlockAllocator::freeImpl(void* p) {
+    BlockHeader* h = header(p);
+    if (h->sizeClass < 0 || !enabled_) {
+        addUsed(-(ptrdiff_t) (h->sizeClass < 0 ? h->size : classSize(h->sizeClass)), 0);
+        systemFree(h);
+        return;
+    }
+    const int c = h->sizeClass;
+    const size_t bytes = classSize(c);
+    size_t cached;
+#pragma omp atomic read
+    cached = cachedBytes_;
+    if (cached + bytes > maxCachedBytes_) {
+        // The free lists of all the threads already hold the maximum
+        addUsed(-(ptrdiff_t) bytes, 0);
+        systemFree(h);
+        return;
+    }
+    addUsed(-(ptrdiff_t) bytes, bytes);
+    ThreadCache* cache = threadCache();
+    if (!cache) {
+        next(h) = NULL;
+        flush(c, h, 1);
+        return;
+    }
+    next(h) = cache->heads[c];
+    cache->heads[c] = h;
+    cache->counts[c]++;
+    if (cache->counts[c] > threadCacheCapacity(c)) {
+        // Move half of the thread cache to the shared list
+        const int n = cache->counts[c] / 2;
+        BlockHeader* chain = cache->heads[c];
+        BlockHeader* last = chain;
+        for (int i = 1; i < n; i++)
+            last = next(last);
+        cache->heads[c] = next(last);
+        cache->counts[c] -= n;
+        flush(c, chain, n);
+    }
+    unlockCache(cache);
+}
+
+void BlockAllocator::flush(int c, void* first, int n) {
+    const size_t bytes = classSize(c);
+    BlockHeader* chain = (BlockHeader*) first;
+    // Arrays which do not fit in the shared lists go back to the system
+    BlockHeader* toFree = NULL;
+#pragma omp critical (hmat_block_allocator)
+    {
+        for (int i = 0; i < n; i++) {
+            BlockHeader* b = chain;
+            chain = next(b);
+            if (sharedBytes + bytes <= maxCachedBytes_) {
+                next(b) = sharedHeads[c];
+                sharedHeads[c] = b;
+                sharedBytes += bytes;
+            } else {
+                next(b) = toFree;
+                toFree = b;
+            }
+        }
+    }
+    while (toFree) {
+        BlockHeader* b = toFree;
+        toFree = next(b);
+        addUsed(0, -(ptrdiff_t) bytes);
+        systemFree(b);
+    }
+}
+
+void BlockAllocator::setEnabled(bool enabled) {
+    enabled_ = enabled;
+}
+
+void BlockAllocator::threadExit(void* p) {
+    ThreadCache* cache = (ThreadCache*) p;
+    lockCache(cache);
+    for (int c = 0; c < NB_CLASSES; c++) {
+        if (cache->heads[c])
+            instance().flush(c, cache->heads[c], cache->counts[c]);
+        cache->heads[c] = NULL;
+        cache->counts[c] = 0;
+    }
+    unlockCache(cache);
+#pragma omp critical (hmat_block_allocator)
+    cache->inUse = false;
+}
+
+void BlockAllocator::release() {
+    size_t freed = 0;
+    ThreadCache* caches;
+#pragma omp critical (hmat_block_allocator)
+    caches = threadCaches;
+    // The owner of a cache may be using it, wait for it with the cache lock
+    for (ThreadCache* cache = caches; cache; cache = cache->nextCache) {
+        lockCache(cache);
+        for (int c = 0; c < NB_CLASSES; c++) {
+            BlockHeader* list = cache->heads[c];
+            cache->heads[c] = NULL;
+            cache->counts[c] = 0;
+            while (list) {
+                BlockHeader* b = list;
+                list = next(b);
+                systemFree(b);
+                freed += classSize(c);
+            }
+        }
+        unlockCache(cache);
+    }
+#pragma omp critical (hmat_block_allocator)
+    {
+        for (int c = 0; c < NB_CLASSES; c++) {
+            while (sharedHeads[c]) {
+                BlockHeader* b = sharedHeads[c];
+                sharedHeads[c] = next(b);
+                systemFree(b);
+                freed += classSize(c);
+            }
+        }
+        sharedBytes = 0;
+    }
+    addUsed(0, -(ptrdiff_t) freed);
+}
+
+}  // end namespace hmat
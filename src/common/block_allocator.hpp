@@ -0,0 +1,108 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Pool allocator for the arrays of the matrix blocks.
+*/
+#ifndef _BLOCK_ALLOCATOR_HPP
+#define _BLOCK_ALLOCATOR_HPP
+#include <stddef.h>
+
+namespace hmat {
+
+/*! \brief Size-class pool for the arrays of FullMatrix and Vector.
+
+  Factorizations and products create and free a lot of short-lived blocks.
+  Freed arrays are kept in free lists, one per size class, and given back by
+  the next allocations of the same class instead of going through malloc.
+  Size classes are spaced by a quarter of a power of two, so at most 25% of
+  an array is wasted. Each thread first uses its own cache, the shared lists
+  are only locked to refill or flush a thread cache. Arrays larger than the
+  biggest class, and all arrays when the pool is disabled, are allocated
+  with calloc (or jemalloc).
+
+  The amount of memory kept in the free lists, thread caches included, is
+  bounded, the arrays above this bound are given back to the system. The
+  cache of a thread is moved to the shared lists when the thread exits.
+ */
+class BlockAllocator {
+public:
+    /** Return a zero-filled array of size bytes. */
+    static void* allocate(size_t size);
+    /** Free an array returned by \a allocate(). */
+    static void free(void* p);
+
+    /** Use the pool (true, the default) or fall back to calloc/free.
+
+        It can be changed at any time, arrays are freed according to the way
+        they were allocated.
+     */
+    void setEnabled(bool enabled);
+    bool enabled() const { return enabled_; }
+    /** Maximum number of bytes kept in the free lists, thread caches included. */
+    void setMaxCachedBytes(size_t bytes) { maxCachedBytes_ = bytes; }
+
+    /** Give all the free arrays back to the system.
+
+        The caches of the other threads are emptied as well, each one while
+        its owner does not use it.
+     */
+    void release();
+
+    /** Bytes of the arrays currently in use. */
+    size_t usedBytes() const { return usedBytes_; }
+    /** Bytes of the free arrays kept by the pool. */
+    size_t cachedBytes() const { return cachedBytes_; }
+    /** Highest value of usedBytes() + cachedBytes(), this is approximate with several threads. */
+    size_t peakBytes() const { return peakBytes_; }
+
+    static BlockAllocator& instance()
+    {
+        static BlockAllocator INSTANCE;
+        return INSTANCE;
+    }
+
+private:
+    BlockAllocator();
+    BlockAllocator(const BlockAllocator&);
+    void operator=(const BlockAllocator&);
+
+    void* allocateImpl(size_t size);
+    void freeImpl(void* p);
+    void addUsed(ptrdiff_t used, ptrdiff_t cached);
+    /** Move n free arrays of a size class, linked from chain, to the shared
+        lists, or to the system above the bound.
+     */
+    void flush(int sizeClass, void* chain, int n);
+    /** Flush a thread cache when its thread exits. */
+    static void threadExit(void* cache);
+
+    bool enabled_;
+    size_t maxCachedBytes_;
+    size_t usedBytes_;
+    size_t cachedBytes_;
+    size_t peakBytes_;
+};
+
+}
+#endif
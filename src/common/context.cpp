@@ -30,6 +30,7 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <iomanip>
 #include <string>
 
 namespace trace {
@@ -51,9 +52,80 @@ namespace trace {
     nodeIndexFunction = nodeIndexFunc;
   }
 
+  /// Enter or leave event of a context
+  struct Event {
+    const char* name;
+    int64_t time;   ///< ns since the start of the recording
+    int64_t flops;  ///< Flops of the context, for a leave event
+    int rows;       ///< Size of the block, for a leave event. 0 if unknown.
+    int cols;
+    bool enter;
+  };
+
+  /// Context entered and not left yet
+  struct OpenContext {
+    int64_t flops;  ///< Value of Timeline::flops when entering
+    int rows;
+    int cols;
+  };
+
+  /// Events of a worker, which is the only one to write them.
+  struct Timeline {
+    std::vector<Event> events;       ///< Ring buffer
+    size_t count;                    ///< Number of events recorded since the start
+    std::vector<OpenContext> open;
+    int64_t flops;                   ///< Flops counted since the start
+    Timeline() : count(0), flops(0) {}
+  };
+
+  /** State of a worker.
+
+      It is padded so that two workers never write in the same cache line.
+   */
+  struct Root {
+    /// Trace trees, by enclosing context
+    UM_NS::unordered_map<void*, Node*> currentNodes;
+    void* enclosingContext;
+    Timeline timeline;
+    char padding[64];
+    Root() : enclosingContext(NULL) {}
+  };
+
+  static Root roots[MAX_ROOTS];
+  /// Number of events kept per worker, 0 if the timeline is not recorded
+  static size_t timelineCapacity = 0;
+  static Time timelineStart;
+
+  /** Add an event to the timeline of a worker, overwriting the oldest one if it is full. */
+  static Event& newEvent(Timeline& t, const char* name, Time time, bool enter) {
+    if (t.events.size() != timelineCapacity)
+      t.events.resize(timelineCapacity);
+    Event& e = t.events[t.count % timelineCapacity];
+    t.count++;
+    e.name = name;
+    e.time = time_diff_in_nanos(timelineStart, time);
+    e.flops = 0;
+    e.rows = 0;
+    e.cols = 0;
+    e.enter = enter;
+    return e;
+  }
+
+  /** Write a JSON string, escaping its special characters. */
+  static void jsonString(std::ofstream& f, const char* s) {
+    f << '"';
+    for (; *s; s++) {
+      if (*s == '"' || *s == '\\')
+        f << '\\' << *s;
+      else if ((unsigned char) *s < 0x20)
+        f << ' ';
+      else
+        f << *s;
+    }
+    f << '"';
+  }
+
   bool Node::enabled = true;
-  UM_NS::unordered_map<void*, Node*> Node::currentNodes[MAX_ROOTS];
-  void* Node::enclosingContext[MAX_ROOTS] = {};
 
   Node::Node(const char* _name, Node* _parent)
     : name(_name), data(), parent(_parent), children() {}
@@ -69,31 +141,49 @@ namespace trace {
     assert(current);
     Node* child = current->findChild(name);
     int index = currentNodeIndex();
-    void* enclosing = enclosingContext[index];
+    void* enclosing = roots[index].enclosingContext;
 
     if (!child) {
       child = new Node(name, current);
       current->children.push_back(child);
     }
     assert(child);
-    currentNodes[index][enclosing] = child;
+    roots[index].currentNodes[enclosing] = child;
     current = child;
     current->data.lastEnterTime = now();
     current->data.n += 1;
+    if (timelineCapacity) {
+      Timeline& t = roots[index].timeline;
+      OpenContext open = { t.flops, 0, 0 };
+      t.open.push_back(open);
+      newEvent(t, name, current->data.lastEnterTime, true);
+    }
   }
 
   void Node::leaveContext() {
     int index = currentNodeIndex();
-    void* enclosing = enclosingContext[index];
-    Node* current = currentNodes[index][enclosing];
+    void* enclosing = roots[index].enclosingContext;
+    Node* current = roots[index].currentNodes[enclosing];
     assert(current);
 
-    current->data.totalTime += time_diff_in_nanos(current->data.lastEnterTime, now());
+    Time time = now();
+    current->data.totalTime += time_diff_in_nanos(current->data.lastEnterTime, time);
+    if (timelineCapacity) {
+      Timeline& t = roots[index].timeline;
+      Event& e = newEvent(t, current->name, time, false);
+      // The context may have been entered before the start of the recording
+      if (!t.open.empty()) {
+        e.flops = t.flops - t.open.back().flops;
+        e.rows = t.open.back().rows;
+        e.cols = t.open.back().cols;
+        t.open.pop_back();
+      }
+    }
 
     if (!(current->parent)) {
       std::cout << "Warning! Closing root node." << std::endl;
     } else {
-      currentNodes[index][enclosing] = current->parent;
+      roots[index].currentNodes[enclosing] = current->parent;
     }
   }
 
@@ -103,11 +193,23 @@ namespace trace {
 
   void Node::setEnclosingContext(void* enclosing) {
     int index = currentNodeIndex();
-    enclosingContext[index] = enclosing;
+    roots[index].enclosingContext = enclosing;
   }
 
   void Node::incrementFlops(int64_t flops) {
     currentNode()->data.totalFlops += flops;
+    if (timelineCapacity)
+      roots[currentNodeIndex()].timeline.flops += flops;
+  }
+
+  void Node::setBlockSize(int rows, int cols) {
+    if (!timelineCapacity)
+      return;
+    Timeline& t = roots[currentNodeIndex()].timeline;
+    if (!t.open.empty()) {
+      t.open.back().rows = rows;
+      t.open.back().cols = cols;
+    }
   }
 
   void Node::startComm() {
@@ -157,9 +259,9 @@ namespace trace {
     f << "[";
     std::string delimiter("");
     for (int i = 0; i < MAX_ROOTS; i++) {
-      if (!currentNodes[i].empty()) {
-        UM_NS::unordered_map<void*, Node*>::iterator p = currentNodes[i].begin();
-        for(; p != currentNodes[i].end(); ++p) {
+      if (!roots[i].currentNodes.empty()) {
+        UM_NS::unordered_map<void*, Node*>::iterator p = roots[i].currentNodes.begin();
+        for(; p != roots[i].currentNodes.end(); ++p) {
           Node* root = p->second;
           f << delimiter << std::endl;
           root->jsonDump(f);
@@ -170,14 +272,72 @@ namespace trace {
     f << std::endl << "]" << std::endl;
   }
 
+  void Node::recordTimeline(size_t capacity) {
+    if (capacity) {
+      for (int i = 0; i < MAX_ROOTS; i++) {
+        Timeline& t = roots[i].timeline;
+        std::vector<Event>().swap(t.events);
+        t.count = 0;
+        t.open.clear();
+        t.flops = 0;
+      }
+      timelineStart = now();
+    }
+    timelineCapacity = capacity;
+  }
+
+  void Node::chromeDumpMain(const char* filename) {
+    std::ofstream f(filename);
+
+    f << std::fixed << std::setprecision(3);
+    f << "{\"traceEvents\": [";
+    std::string delimiter("");
+    for (int i = 0; i < MAX_ROOTS; i++) {
+      const Timeline& t = roots[i].timeline;
+      if (t.count == 0)
+        continue;
+      f << delimiter << std::endl
+        << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << i
+        << ", \"args\": {\"name\": \"";
+      if (i == 0)
+        f << "root";
+      else
+        f << "Worker #" << std::setw(3) << std::setfill('0') << i << std::setfill(' ');
+      f << "\"}}";
+      delimiter = ", ";
+      const size_t size = t.events.size();
+      const size_t first = t.count > size ? t.count - size : 0;
+      int depth = 0;
+      for (size_t k = first; k < t.count; k++) {
+        const Event& e = t.events[k % size];
+        // The enter event was overwritten or recorded before the start
+        if (!e.enter && depth == 0)
+          continue;
+        depth += e.enter ? 1 : -1;
+        f << "," << std::endl << "{\"name\": ";
+        jsonString(f, e.name);
+        f << ", \"ph\": \"" << (e.enter ? 'B' : 'E') << "\", \"pid\": 0, \"tid\": " << i
+          << ", \"ts\": " << e.time / 1e3;
+        if (!e.enter) {
+          f << ", \"args\": {\"flops\": " << e.flops;
+          if (e.rows || e.cols)
+            f << ", \"rows\": " << e.rows << ", \"cols\": " << e.cols;
+          f << "}";
+        }
+        f << "}";
+      }
+    }
+    f << std::endl << "], \"displayTimeUnit\": \"ms\"}" << std::endl;
+  }
+
   /** Find the current node, allocating one if necessary.
    */
   Node* Node::currentNode() {
     int index = currentNodeIndex();
-    void* enclosing = enclosingContext[index];
-    UM_NS::unordered_map<void*, Node*>::iterator it = currentNodes[index].find(enclosing);
+    void* enclosing = roots[index].enclosingContext;
+    UM_NS::unordered_map<void*, Node*>::iterator it = roots[index].currentNodes.find(enclosing);
     Node* current;
-    if (it == currentNodes[index].end()) {
+    if (it == roots[index].currentNodes.end()) {
       // TODO : avec runtime, les threads N+1 et N+2 ne sont pas des workers, ce sont les threads MPI et IO
       char *name = const_cast<char*>("root");
       if (index != 0) {
@@ -186,7 +346,7 @@ namespace trace {
         sprintf(name, "Worker #%03d - %p", index, enclosing);
       }
       current = new Node(name, NULL);
-      currentNodes[index][enclosing] = current;
+      roots[index].currentNodes[enclosing] = current;
     } else {
       current = it->second;
     }
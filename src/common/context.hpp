@@ -92,9 +92,6 @@ namespace trace {
     Node* parent;
     /// Ordered list of children nodes.
     std::vector<Node*> children;
-    /// List of trace trees.
-    static UM_NS::unordered_map<void*, Node*> currentNodes[MAX_ROOTS]; // TODO: padding to avoid false sharing ?
-    static void* enclosingContext[MAX_ROOTS]; // TODO: padding to avoid false sharing ?
 
   public:
     /** Enter a context noted by a name.
@@ -119,6 +116,29 @@ namespace trace {
     /** Dumps the trace trees to a JSON file.
      */
     static void jsonDumpMain(const char* filename);
+    /** Attach the size of the block being processed to the current context.
+
+        It is only recorded in the timeline, see \a recordTimeline().
+     */
+    static void setBlockSize(int rows, int cols);
+    /** Start recording the enter and leave events of the contexts.
+
+        Each worker writes its events in its own ring buffer, without any
+        lock. When the buffer is full, the oldest events are overwritten. The
+        previous events are discarded. This must be called outside of the
+        parallel regions.
+
+        \param capacity the number of events kept per worker, 0 to stop the recording.
+     */
+    static void recordTimeline(size_t capacity);
+    /** Dumps the recorded events to a JSON file in the Chrome trace event
+        format, which can be opened in chrome://tracing or Perfetto.
+
+        There is one thread per worker. The flops counted in each context,
+        including its children, and the block size are in the arguments of
+        its events. This must be called outside of the parallel regions.
+     */
+    static void chromeDumpMain(const char* filename);
 
   private:
     Node(const char* _name, Node* _parent);
@@ -153,6 +173,9 @@ public:
 #define leave_context() trace::Node::leaveContext()
 #define increment_flops(x) trace::Node::incrementFlops(x)
 #define tracing_dump(x) trace::Node::jsonDumpMain(x)
+#define tracing_block_size(m, n) trace::Node::setBlockSize(m, n)
+#define tracing_record_timeline(x) trace::Node::recordTimeline(x)
+#define tracing_chrome_dump(x) trace::Node::chromeDumpMain(x)
 
 #else
 #define tracing_set_worker_index_func(f) do {} while (0)
@@ -160,6 +183,9 @@ public:
 #define leave_context()  do {} while(0)
 #define increment_flops(x) do { hmat::ignore_unused_arg(x); } while(0)
 #define tracing_dump(x) do { hmat::ignore_unused_arg(x); } while(0)
+#define tracing_block_size(m, n) do { hmat::ignore_unused_arg(m); hmat::ignore_unused_arg(n); } while(0)
+#define tracing_record_timeline(x) do { hmat::ignore_unused_arg(x); } while(0)
+#define tracing_chrome_dump(x) do { hmat::ignore_unused_arg(x); } while(0)
 #define DISABLE_CONTEXT_IN_BLOCK do {} while (0)
 #endif
 
@@ -25,6 +25,7 @@
   \brief Memory Allocation tracking.
 */
 #include "memory_instrumentation.hpp"
+#include "common/block_allocator.hpp"
 #include "common/my_assert.h"
 #include <algorithm>
 
@@ -53,6 +54,11 @@ static size_t get_res_mem(void *)
 }
 #endif
 
+static size_t get_block_pool_mem(void *)
+{
+    return BlockAllocator::instance().cachedBytes();
+}
+
 MemoryInstrumenter::MemoryInstrumenter(): enabled_(false) {
     char * ws = getenv("HMAT_MEMINSTR_WS");
     write_sampling = ws ? atoi(ws) : 1;
@@ -88,6 +94,8 @@ MemoryInstrumenter::MemoryInstrumenter(): enabled_(false) {
     // addType("Total free space (fordblks)", false);
     addType("Top-most, releasable (keepcost)", false);
 #endif
+    // Free arrays kept by the BlockAllocator
+    addType("Block pool cache", false, get_block_pool_mem, NULL);
 }
 
 void MemoryInstrumenter::setFile(const std::string & filename) {
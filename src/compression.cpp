@@ -29,8 +29,12 @@
 #include "compression.hpp"
 
 #include <vector>
+#include <algorithm>
 #include <cfloat>
 #include <cstring>
+#include <stdint.h>
+#include <set>
+#include <sstream>
 
 #include "cluster_tree.hpp"
 #include "assembly.hpp"
@@ -91,6 +95,28 @@ public:
     if (info.block_type != hmat_block_sparse || !info.is_null_col(&info, index))
       f.getCol(rows, cols, index, info.user_data, &result);
   }
+  /** Compute several rows, stored in the columns of result (cols->size() x count) */
+  void getRows(const int* indices, int count, FullMatrix<typename Types<T>::dp>& result) const {
+    if (info.block_type != hmat_block_sparse) {
+      f.getRows(rows, cols, indices, count, &info, &result);
+      return;
+    }
+    for (int i = 0; i < count; i++) {
+      Vector<typename Types<T>::dp> row(result.m + ((size_t) result.lda) * i, cols->size());
+      getRow(indices[i], row);
+    }
+  }
+  /** Compute several columns, stored in result (rows->size() x count) */
+  void getCols(const int* indices, int count, FullMatrix<typename Types<T>::dp>& result) const {
+    if (info.block_type != hmat_block_sparse) {
+      f.getCols(rows, cols, indices, count, &info, &result);
+      return;
+    }
+    for (int j = 0; j < count; j++) {
+      Vector<typename Types<T>::dp> col(result.m + ((size_t) result.lda) * j, rows->size());
+      getCol(indices[j], col);
+    }
+  }
   FullMatrix<typename Types<T>::dp>* assemble() const {
     if (info.block_type != hmat_block_null)
       return f.assemble(rows, cols, &info, allocationObserver_) ;
@@ -277,6 +303,21 @@ static int findMinCol(const ClusterAssemblyFunction<T>& block,
 }
 
 
+/** The next of the pivots of a previous compression which is still free, or -1.
+
+    \param hints the pivots of the previous compression, see AcaPivots
+    \param next the index of the next pivot to try in hints, updated by this function
+    \param free the rows or columns that are free to choose from
+ */
+static int nextHint(const vector<int>& hints, size_t& next, const vector<bool>& free) {
+  while (next < hints.size()) {
+    const int i = hints[next++];
+    if (i >= 0 && i < (int) free.size() && free[i])
+      return i;
+  }
+  return -1;
+}
+
 template<typename T>
 RkMatrix<T>* compressMatrix(FullMatrix<T>* m, const IndexSet* rows,
                             const IndexSet* cols) {
@@ -324,16 +365,20 @@ RkMatrix<T>* compressMatrix(FullMatrix<T>* m, const IndexSet* rows,
     }
   }
 
+  RkMatrix<T>* result = new RkMatrix<T>(rows, cols, k, Svd);
   FullMatrix<T> matU(u->m, rowCount, k);
-  FullMatrix<T>* uTilde = matU.copy();
-  FullMatrix<T> matV(vt->m, k, colCount, maxK);
-  FullMatrix<T>* vTilde = matV.copyAndTranspose();
+  result->a->copyMatrixAtOffset(&matU, 0, 0);
+  // vTilde = V^t restricted to its k first rows, transposed
+  for (int col = 0; col < colCount; col++) {
+    for (int row = 0; row < k; row++) {
+      result->b->get(col, row) = vt->get(row, col);
+    }
+  }
 
   delete u;
   delete vt;
   delete sigma;
-  FullMatrix<T>* a = uTilde; // TODO : why this copy ?
-  return new RkMatrix<T>(a, rows, vTilde, cols, Svd);
+  return result;
 }
 
 
@@ -350,6 +395,224 @@ compressSvd(const ClusterAssemblyFunction<T>& block) {
 }
 
 
+/** Generator of the Gaussian random vectors used by randomizedSvd().
+
+    This is a xorshift64* generator with a Box-Muller transform. Each block
+    has its own generator seeded from its position, so that the compression
+    is reproducible and thread safe.
+ */
+class GaussianGenerator {
+public:
+  GaussianGenerator(const IndexSet* rows, const IndexSet* cols) : hasSpare_(false), spare_(0.) {
+    state_ = 0x9E3779B97F4A7C15ULL;
+    const int keys[4] = { rows->offset(), rows->size(), cols->offset(), cols->size() };
+    for (int i = 0; i < 4; i++) {
+      state_ ^= (uint64_t) keys[i] + 0x9E3779B97F4A7C15ULL + (state_ << 6) + (state_ >> 2);
+    }
+    if (state_ == 0)
+      state_ = 1;
+  }
+  double gaussian() {
+    if (hasSpare_) {
+      hasSpare_ = false;
+      return spare_;
+    }
+    const double u = uniform();
+    const double v = uniform();
+    const double r = sqrt(-2. * log(u));
+    const double theta = 6.283185307179586 * v;
+    spare_ = r * sin(theta);
+    hasSpare_ = true;
+    return r * cos(theta);
+  }
+  /** Uniform random number in ]0, 1[ */
+  double uniform() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return (((state_ * 2685821657736338717ULL) >> 11) + 0.5) / 9007199254740992.;
+  }
+private:
+  uint64_t state_;
+  bool hasSpare_;
+  double spare_;
+};
+
+template<typename T> static T gaussianValue(GaussianGenerator& g) {
+  return T(g.gaussian());
+}
+template<> C_t gaussianValue<C_t>(GaussianGenerator& g) {
+  const float re = g.gaussian();
+  return C_t(re, g.gaussian());
+}
+template<> Z_t gaussianValue<Z_t>(GaussianGenerator& g) {
+  const double re = g.gaussian();
+  return Z_t(re, g.gaussian());
+}
+
+/** A matrix, or the product a * b^T, only used through its products with blocks of vectors. */
+template<typename T>
+class SampledMatrix {
+public:
+  SampledMatrix(const FullMatrix<T>* a, const FullMatrix<T>* b) : a_(a), b_(b) {}
+  int rows() const { return a_->rows; }
+  int cols() const { return b_ ? b_->rows : a_->cols; }
+  /** y <- M x if trans is 'N', M x^* if trans is 'C' */
+  void product(char trans, const FullMatrix<T>* x, FullMatrix<T>* y) const {
+    if (b_ == NULL) {
+      y->gemm('N', trans, Constants<T>::pone, a_, x, Constants<T>::zero);
+      return;
+    }
+    FullMatrix<T> tmp(b_->cols, y->cols);
+    tmp.gemm('T', trans, Constants<T>::pone, b_, x, Constants<T>::zero);
+    y->gemm('N', 'N', Constants<T>::pone, a_, &tmp, Constants<T>::zero);
+  }
+  /** w <- x^* M */
+  void adjointProduct(const FullMatrix<T>* x, FullMatrix<T>* w) const {
+    if (b_ == NULL) {
+      w->gemm('C', 'N', Constants<T>::pone, x, a_, Constants<T>::zero);
+      return;
+    }
+    FullMatrix<T> tmp(x->cols, a_->cols);
+    tmp.gemm('C', 'N', Constants<T>::pone, x, a_, Constants<T>::zero);
+    w->gemm('N', 'T', Constants<T>::pone, &tmp, b_, Constants<T>::zero);
+  }
+private:
+  const FullMatrix<T>* a_;
+  const FullMatrix<T>* b_;
+};
+
+/** y <- (I - Q Q^*) y */
+template<typename T>
+static void projectOut(const FullMatrix<T>* q, FullMatrix<T>* y) {
+  FullMatrix<T> qty(q->cols, y->cols);
+  qty.gemm('C', 'N', Constants<T>::pone, q, y, Constants<T>::zero);
+  y->gemm('N', 'N', Constants<T>::mone, q, &qty, Constants<T>::pone);
+}
+
+// Number of random vectors of the first sample of randomizedSvd(), it is
+// doubled at each step up to the maximum.
+static const int RANDOM_SVD_MIN_BLOCK = 8;
+static const int RANDOM_SVD_MAX_BLOCK = 64;
+
+template<typename T>
+RkMatrix<T>* randomizedSvd(const FullMatrix<T>* a, const FullMatrix<T>* b,
+                           const IndexSet* rows, const IndexSet* cols,
+                           double epsilon) {
+  DECLARE_CONTEXT;
+  RkApproximationControl& approx = RkMatrix<T>::approx;
+  const SampledMatrix<T> matrix(a, b);
+  const int rowCount = matrix.rows();
+  const int colCount = matrix.cols();
+  assert(rowCount == rows->size());
+  assert(colCount == cols->size());
+  int maxK = min(rowCount, colCount);
+  if (b)
+    maxK = min(maxK, a->cols);
+  // With a fixed rank, a few more vectors are sampled to get accurate singular values
+  const int fixedK = (approx.k == 0 ? 0 : min(approx.k + RANDOM_SVD_MIN_BLOCK, maxK));
+
+  GaussianGenerator generator(rows, cols);
+  // Orthonormal basis of the sampled range, in its k first columns
+  FullMatrix<T>* q = NULL;
+  int k = 0;
+  double sampleNormSqr = 0.;
+  int sampleCount = 0;
+  int blockSize = RANDOM_SVD_MIN_BLOCK;
+  while (k < (fixedK ? fixedK : maxK)) {
+    const int n = min(blockSize, (fixedK ? fixedK : maxK) - k);
+    FullMatrix<T> omega(colCount, n);
+    for (int j = 0; j < n; j++) {
+      for (int i = 0; i < colCount; i++) {
+        omega.get(i, j) = gaussianValue<T>(generator);
+      }
+    }
+    FullMatrix<T> y(rowCount, n);
+    matrix.product('N', &omega, &y);
+    sampleNormSqr += y.normSqr();
+    sampleCount += n;
+    FullMatrix<T> qk(q ? q->m : NULL, rowCount, k);
+    if (k > 0)
+      projectOut(&qk, &y);
+    // E(|(I - Q Q^*) M omega|^2) = n |(I - Q Q^*) M|^2, so the relative error of
+    // the current basis is estimated with these new samples.
+    if (fixedK == 0 && y.normSqr() * sampleCount <= epsilon * epsilon * sampleNormSqr * n)
+      break;
+    for (int i = 0; i < approx.powerIterations; i++) {
+      orthonormalize(&y);
+      FullMatrix<T> w(n, colCount);
+      matrix.adjointProduct(&y, &w);
+      matrix.product('C', &w, &y);
+      if (k > 0)
+        projectOut(&qk, &y);
+    }
+    orthonormalize(&y);
+    if (k > 0) {
+      // Orthogonalize twice, the first pass loses the orthogonality
+      // when y is mostly in the range of Q
+      projectOut(&qk, &y);
+      orthonormalize(&y);
+    }
+    FullMatrix<T>* newQ = new FullMatrix<T>(rowCount, k + n);
+    if (k > 0)
+      memcpy(newQ->m, q->m, sizeof(T) * rowCount * k);
+    memcpy(newQ->m + ((size_t) rowCount) * k, y.m, sizeof(T) * rowCount * n);
+    delete q;
+    q = newQ;
+    k += n;
+    blockSize = min(2 * blockSize, RANDOM_SVD_MAX_BLOCK);
+  }
+
+  if (k == 0) {
+    delete q;
+    return new RkMatrix<T>(NULL, rows, NULL, cols, NoCompression);
+  }
+
+  // SVD of Q^* M = U S V^*, hence M ~ (Q U S) V^*
+  FullMatrix<T> projected(k, colCount);
+  matrix.adjointProduct(q, &projected);
+  FullMatrix<T> *u = NULL, *vt = NULL;
+  Vector<double>* sigma = NULL;
+  int info = truncatedSvd<T>(&projected, &u, &sigma, &vt);
+  HMAT_ASSERT(info == 0);
+  const int newK = approx.findK(sigma->v, min(k, colCount), epsilon);
+  RkMatrix<T>* result = NULL;
+  if (newK == 0) {
+    result = new RkMatrix<T>(NULL, rows, NULL, cols, NoCompression);
+  } else {
+    for (int col = 0; col < newK; col++) {
+      for (int row = 0; row < k; row++) {
+        u->get(row, col) *= sigma->v[col];
+      }
+    }
+    result = new RkMatrix<T>(rows, cols, newK, RandomSvd);
+    FullMatrix<T> uk(u->m, k, newK, u->lda);
+    result->a->gemm('N', 'N', Constants<T>::pone, q, &uk, Constants<T>::zero);
+    for (int col = 0; col < colCount; col++) {
+      for (int row = 0; row < newK; row++) {
+        result->b->get(col, row) = vt->get(row, col);
+      }
+    }
+  }
+  delete q;
+  delete u;
+  delete vt;
+  delete sigma;
+  return result;
+}
+
+template<typename T>
+static RkMatrix<typename Types<T>::dp>*
+compressRandomSvd(const ClusterAssemblyFunction<T>& block) {
+  DECLARE_CONTEXT;
+  typedef typename Types<T>::dp dp_t;
+  FullMatrix<dp_t>* m = block.assemble();
+  RkMatrix<dp_t>* result = randomizedSvd<dp_t>(m, NULL, block.rows, block.cols,
+                                               RkMatrix<dp_t>::approx.assemblyEpsilon);
+  delete m;
+  return result;
+}
+
 template<typename T>
 static RkMatrix<typename Types<T>::dp>*
 compressAcaFull(const ClusterAssemblyFunction<T>& block) {
@@ -365,10 +628,10 @@ compressAcaFull(const ClusterAssemblyFunction<T>& block) {
     maxK = min(maxK, RkMatrix<dp_t>::approx.k);
   }
 
-  FullMatrix<dp_t> tmpA(m->rows, maxK);
-  tmpA.clear();
-  FullMatrix<dp_t> tmpB(m->cols, maxK);
-  tmpB.clear();
+  // A and B are built in place, the rank is reduced at the end
+  RkMatrix<dp_t>* result = new RkMatrix<dp_t>(block.rows, block.cols, maxK, AcaFull);
+  FullMatrix<dp_t>& tmpA = *result->a;
+  FullMatrix<dp_t>& tmpB = *result->b;
   int nu;
 
   for (nu = 0; nu < maxK; nu++) {
@@ -420,24 +683,14 @@ compressAcaFull(const ClusterAssemblyFunction<T>& block) {
   }
   delete m;
 
-  if (nu == 0) {
-    return new RkMatrix<dp_t>(NULL, block.rows, NULL, block.cols, AcaFull);
-  }
-
-  FullMatrix<dp_t>* newA = new FullMatrix<dp_t>(tmpA.rows, nu);
-  newA->clear();
-  memcpy(newA->m, tmpA.m, sizeof(dp_t) * tmpA.rows * nu);
-  FullMatrix<dp_t>* newB = new FullMatrix<dp_t>(tmpB.rows, nu);
-  newB->clear();
-  memcpy(newB->m, tmpB.m, sizeof(dp_t) * tmpB.rows * nu);
-
-  return new RkMatrix<dp_t>(newA, block.rows, newB, block.cols, AcaFull);
+  result->resize(nu);
+  return result;
 }
 
 
 template<typename T>
 static RkMatrix<typename Types<T>::dp>*
-compressAcaPartial(const ClusterAssemblyFunction<T>& block) {
+compressAcaPartial(const ClusterAssemblyFunction<T>& block, AcaPivots* pivots) {
   typedef typename Types<T>::dp dp_t;
 
   const double epsilon = RkMatrix<dp_t>::approx.assemblyEpsilon;
@@ -453,12 +706,23 @@ compressAcaPartial(const ClusterAssemblyFunction<T>& block) {
   vector<bool> colFree(colCount, true);
   vector<Vector<dp_t>*> aCols;
   vector<Vector<dp_t>*> bCols;
+  // The pivot rows of a previous compression are tried first
+  vector<int> hintRows, pivotRows, pivotCols;
+  size_t nextHintRow = 0;
+  if (pivots) {
+    hintRows.swap(pivots->rows);
+    aCols.reserve(hintRows.size() + 1);
+    bCols.reserve(hintRows.size() + 1);
+  }
 
   int I = 0;
   int J = 0;
   int k = 0;
 
   do {
+    const int hint = nextHint(hintRows, nextHintRow, rowFree);
+    if (hint >= 0)
+      I = hint;
     Vector<dp_t>* bCol = new Vector<dp_t>(block.cols->size());
     // Calculation of row I and its residue
     block.getRow(I, *bCol);
@@ -495,6 +759,8 @@ compressAcaPartial(const ClusterAssemblyFunction<T>& block) {
       updateCol(*aCol, J, aCols, bCols, k);
       colFree[J] = false;
       aCols.push_back(aCol);
+      pivotRows.push_back(I);
+      pivotCols.push_back(J);
 
       // Find max and argmax of the residue
       maxNorm2 = 0.;
@@ -524,38 +790,38 @@ compressAcaPartial(const ClusterAssemblyFunction<T>& block) {
       // Evaluate the stopping criterion
       // ||a_nu|| ||b_nu|| < epsilon * ||S_nu||
       // <=> ||a_nu||^2 ||b_nu||^2 < epsilon^2 ||S_nu||^2
-      if (ab_norm_2 < epsilon * epsilon * estimateSquaredNorm) {
+      // A previous pivot may be a poor one for the new values, so only the
+      // pivots chosen as usual can stop the compression.
+      if (hint < 0 && ab_norm_2 < epsilon * epsilon * estimateSquaredNorm) {
+        // The last pivot is negligible, it is not worth trying next time
+        pivotRows.pop_back();
+        pivotCols.pop_back();
         break;
       }
     }
   } while (rowPivotCount < maxK);
 
-  FullMatrix<dp_t> *newA, *newB;
-  if (k != 0) {
-    newA = new FullMatrix<dp_t>(block.rows->size(), k);
-    for (int i = 0; i < k; i++) {
-      memcpy(newA->m + (i * newA->rows), aCols[i]->v, sizeof(dp_t) * newA->rows);
-      delete aCols[i];
-      aCols[i] = NULL;
-    }
-    newB = new FullMatrix<dp_t>(block.cols->size(), k);
-    for (int i = 0; i < k; i++) {
-      memcpy(newB->m + (i * newB->rows), bCols[i]->v, sizeof(dp_t) * newB->rows);
-      delete bCols[i];
-      bCols[i] = NULL;
-    }
-  } else {
-    // If k == 0, block is only made of zeros.
-    return new RkMatrix<dp_t>(NULL, block.rows, NULL, block.cols, AcaPartial);
+  if (pivots) {
+    pivots->rows.swap(pivotRows);
+    pivots->cols.swap(pivotCols);
   }
-
-  return new RkMatrix<dp_t>(newA, block.rows, newB, block.cols, AcaPartial);
+  // If k == 0, block is only made of zeros.
+  RkMatrix<dp_t>* result = new RkMatrix<dp_t>(block.rows, block.cols, k, AcaPartial);
+  for (int i = 0; i < k; i++) {
+    memcpy(result->a->m + (i * result->a->rows), aCols[i]->v, sizeof(dp_t) * result->a->rows);
+    delete aCols[i];
+    aCols[i] = NULL;
+    memcpy(result->b->m + (i * result->b->rows), bCols[i]->v, sizeof(dp_t) * result->b->rows);
+    delete bCols[i];
+    bCols[i] = NULL;
+  }
+  return result;
 }
 
 
 template<typename T>
 static RkMatrix<typename Types<T>::dp>*
-compressAcaPlus(const ClusterAssemblyFunction<T>& block) {
+compressAcaPlus(const ClusterAssemblyFunction<T>& block, AcaPivots* pivots) {
   typedef typename Types<T>::dp dp_t;
   const double epsilon = RkMatrix<dp_t>::approx.assemblyEpsilon;
   double estimateSquaredNorm = 0;
@@ -565,6 +831,15 @@ compressAcaPlus(const ClusterAssemblyFunction<T>& block) {
   Vector<dp_t> bRef(colCount), aRef(rowCount);
   vector<bool> rowFree(rowCount, true), colFree(colCount, true);
   vector<Vector<dp_t>*> aCols, bCols;
+  // The pivot rows of a previous compression are tried first
+  vector<int> hintRows, pivotRows, pivotCols;
+  size_t nextHintRow = 0;
+  if (pivots) {
+    hintRows.swap(pivots->rows);
+    pivots->cols.clear();
+    aCols.reserve(hintRows.size() + 1);
+    bCols.reserve(hintRows.size() + 1);
+  }
 
   j_ref = findCol(block, colFree, aRef);
   if (j_ref == -1) {
@@ -589,11 +864,28 @@ compressAcaPlus(const ClusterAssemblyFunction<T>& block) {
     j_star = bRef.absoluteMaxIndex();
     j_star_value = bRef.v[j_star];
 
-    if (squaredNorm<dp_t>(i_star_value) > squaredNorm<dp_t>(j_star_value)) {
+    bool rowFixed = squaredNorm<dp_t>(i_star_value) > squaredNorm<dp_t>(j_star_value);
+    bool rowComputed = false;
+    for (int hint = nextHint(hintRows, nextHintRow, rowFree); hint >= 0;
+         hint = nextHint(hintRows, nextHintRow, rowFree)) {
+      block.getRow(hint, *bVec);
+      updateRow<dp_t>(*bVec, hint, bCols, aCols, k);
+      if (!isZero(*bVec)) {
+        i_star = hint;
+        rowFixed = rowComputed = true;
+        break;
+      }
+      rowFree[hint] = false;
+      bVec->clear();
+    }
+
+    if (rowFixed) {
       // i_star is fixed, we look for j_star
-      block.getRow(i_star, *bVec);
-      // Calculate the residue
-      updateRow<dp_t>(*bVec, i_star, bCols, aCols, k);
+      if (!rowComputed) {
+        block.getRow(i_star, *bVec);
+        // Calculate the residue
+        updateRow<dp_t>(*bVec, i_star, bCols, aCols, k);
+      }
       j_star = bVec->absoluteMaxIndex();
       dp_t pivot = bVec->v[j_star];
       HMAT_ASSERT(pivot != Constants<dp_t>::zero);
@@ -616,6 +908,8 @@ compressAcaPlus(const ClusterAssemblyFunction<T>& block) {
 
     rowFree[i_star] = false;
     colFree[j_star] = false;
+    pivotRows.push_back(i_star);
+    pivotCols.push_back(j_star);
 
     aCols.push_back(aVec);
     bCols.push_back(bVec);
@@ -637,7 +931,10 @@ compressAcaPlus(const ClusterAssemblyFunction<T>& block) {
     // Evaluate the stopping criterion
     // ||a_nu|| ||b_nu|| < epsilon * ||S_nu||
     // <=> ||a_nu||^2 ||b_nu||^2 < epsilon^2 ||S_nu||^2
-    if (ab_norm_2 < epsilon * epsilon * estimateSquaredNorm) {
+    // As in compressAcaPartial(), a previous pivot cannot stop the compression.
+    if (!rowComputed && ab_norm_2 < epsilon * epsilon * estimateSquaredNorm) {
+      pivotRows.pop_back();
+      pivotCols.pop_back();
       break;
     }
 
@@ -688,26 +985,258 @@ compressAcaPlus(const ClusterAssemblyFunction<T>& block) {
   } while (k < maxK);
 
   assert(k > 0);
-  FullMatrix<dp_t>* newA = new FullMatrix<dp_t>(block.rows->size(), k);
+  if (pivots) {
+    pivots->rows.swap(pivotRows);
+    pivots->cols.swap(pivotCols);
+  }
+  RkMatrix<dp_t>* result = new RkMatrix<dp_t>(block.rows, block.cols, k, AcaPlus);
   for (int i = 0; i < k; i++) {
-    memcpy(newA->m + (i * newA->rows), aCols[i]->v, sizeof(dp_t) * newA->rows);
+    memcpy(result->a->m + (i * result->a->rows), aCols[i]->v, sizeof(dp_t) * result->a->rows);
     delete aCols[i];
     aCols[i] = NULL;
-  }
-  FullMatrix<dp_t>* newB = new FullMatrix<dp_t>(block.cols->size(), k);
-  for (int i = 0; i < k; i++) {
-    memcpy(newB->m + (i * newB->rows), bCols[i]->v, sizeof(dp_t) * newB->rows);
+    memcpy(result->b->m + (i * result->b->rows), bCols[i]->v, sizeof(dp_t) * result->b->rows);
     delete bCols[i];
     bCols[i] = NULL;
   }
-  return new RkMatrix<dp_t>(newA, block.rows, newB, block.cols, AcaPlus);
+  return result;
+}
+
+// Number of rows of the first panel of compressAcaBlocked(), it is doubled
+// after each panel up to the maximum.
+static const int ACA_MIN_PANEL = 4;
+static const int ACA_MAX_PANEL = 16;
+
+/** Make room for at least n columns in m, keeping its k first columns. */
+template<typename T>
+static void reserveColumns(FullMatrix<T>*& m, int k, int n) {
+  if (m->cols >= n)
+    return;
+  FullMatrix<T>* bigger = new FullMatrix<T>(m->rows, max(n, 2 * m->cols));
+  memcpy(bigger->m, m->m, sizeof(T) * m->rows * k);
+  delete m;
+  m = bigger;
+}
+
+/** Add up to count free rows to panel, evenly spread among the free rows. */
+static void selectFreeRows(const vector<bool>& rowFree, int count, vector<int>& panel) {
+  const int rowCount = rowFree.size();
+  vector<int> freeRows;
+  for (int i = 0; i < rowCount; i++) {
+    if (rowFree[i] && std::find(panel.begin(), panel.end(), i) == panel.end())
+      freeRows.push_back(i);
+  }
+  count = min(count, (int) freeRows.size());
+  for (int t = 0; t < count; t++) {
+    panel.push_back(freeRows[(((size_t) t) * freeRows.size()) / count]);
+  }
+}
+
+/*! \brief Partial ACA computing several pivots at once.
+
+  Each step computes a panel of rows, chooses the pivot columns by an
+  elimination within the panel, then computes these columns. Rows and
+  columns are requested with \a Function::getRows() and \a Function::getCols(),
+  so that the user can compute them in a single call, and the residual of a
+  panel is computed with one gemm against all the previous pivots. The
+  pivots of a panel are then the same as with a sequential partial ACA whose
+  rows would have been chosen in this order. The rows of the next panel are
+  the maximum of the new columns, as in \a compressAcaPartial().
+ */
+template<typename T>
+static RkMatrix<typename Types<T>::dp>*
+compressAcaBlocked(const ClusterAssemblyFunction<T>& block, AcaPivots* pivots) {
+  DECLARE_CONTEXT;
+  typedef typename Types<T>::dp dp_t;
+
+  const double epsilon = RkMatrix<dp_t>::approx.assemblyEpsilon;
+  double estimateSquaredNorm = 0;
+
+  const int rowCount = block.rows->size();
+  const int colCount = block.cols->size();
+  const int maxK = min(rowCount, colCount);
+  vector<bool> rowFree(rowCount, true);
+  vector<bool> colFree(colCount, true);
+  int rowPivotCount = 0;
+  // The pivot rows of a previous compression are the first panel, and
+  // give the rank to expect
+  vector<int> hintRows, pivotRows, pivotCols;
+  if (pivots)
+    hintRows.swap(pivots->rows);
+  const int expectedK = min(maxK, max(ACA_MIN_PANEL, (int) hintRows.size() + 1));
+  // The k first columns of a and b are the pivot columns and rows
+  FullMatrix<dp_t>* a = new FullMatrix<dp_t>(rowCount, expectedK);
+  FullMatrix<dp_t>* b = new FullMatrix<dp_t>(colCount, expectedK);
+  int k = 0;
+
+  int panelSize = ACA_MIN_PANEL;
+  vector<int> panelRows;
+  size_t nextHintRow = 0;
+  for (int i = nextHint(hintRows, nextHintRow, rowFree); i >= 0; i = nextHint(hintRows, nextHintRow, rowFree)) {
+    if (std::find(panelRows.begin(), panelRows.end(), i) == panelRows.end())
+      panelRows.push_back(i);
+  }
+  bool hintedPanel = !panelRows.empty();
+  if (panelRows.empty())
+    selectFreeRows(rowFree, panelSize, panelRows);
+  bool converged = false;
+  while (!converged && !panelRows.empty() && rowPivotCount < maxK && k < maxK) {
+    const int p = panelRows.size();
+    for (int t = 0; t < p; t++)
+      rowFree[panelRows[t]] = false;
+    rowPivotCount += p;
+
+    // Residual of the rows, M(I, :) - A(I, :) B^t, stored as the columns of rowPanel
+    FullMatrix<dp_t> rowPanel(colCount, p);
+    block.getRows(&panelRows[0], p, rowPanel);
+    if (k > 0) {
+      FullMatrix<dp_t> aRows(p, k);
+      for (int l = 0; l < k; l++)
+        for (int t = 0; t < p; t++)
+          aRows.get(t, l) = a->get(panelRows[t], l);
+      FullMatrix<dp_t> bk(b->m, colCount, k, b->lda);
+      rowPanel.gemm('N', 'T', Constants<dp_t>::mone, &bk, &aRows, Constants<dp_t>::pone);
+    }
+
+    // Choose the pivot columns by an elimination on the rows of the panel,
+    // after which the t-th row is the residual once the previous pivots are removed.
+    vector<int> panelPivotRows, panelPivotCols;
+    for (int t = 0; t < p; t++) {
+      dp_t* row = rowPanel.m + ((size_t) colCount) * t;
+      double maxNorm2 = 0.;
+      int j = -1;
+      for (int jj = 0; jj < colCount; jj++) {
+        const double norm2 = squaredNorm<dp_t>(row[jj]);
+        if (colFree[jj] && norm2 > maxNorm2) {
+          maxNorm2 = norm2;
+          j = jj;
+        }
+      }
+      if (j < 0)
+        continue;
+      colFree[j] = false;
+      panelPivotRows.push_back(t);
+      panelPivotCols.push_back(j);
+      const dp_t pivotInv = Constants<dp_t>::pone / row[j];
+      for (int s = t + 1; s < p; s++) {
+        dp_t* other = rowPanel.m + ((size_t) colCount) * s;
+        const dp_t coef = Constants<dp_t>::mone * other[j] * pivotInv;
+        proxy_cblas::axpy(colCount, coef, row, 1, other, 1);
+      }
+    }
+    const int q = panelPivotRows.size();
+    if (q == 0) {
+      // Only null rows, try other ones
+      hintedPanel = false;
+      panelRows.clear();
+      selectFreeRows(rowFree, panelSize, panelRows);
+      continue;
+    }
+
+    // Residual of the pivot columns, M(:, J) - A B(J, :)^t
+    FullMatrix<dp_t> colPanel(rowCount, q);
+    block.getCols(&panelPivotCols[0], q, colPanel);
+    if (k > 0) {
+      FullMatrix<dp_t> bCols(q, k);
+      for (int l = 0; l < k; l++)
+        for (int u = 0; u < q; u++)
+          bCols.get(u, l) = b->get(panelPivotCols[u], l);
+      FullMatrix<dp_t> ak(a->m, rowCount, k, a->lda);
+      colPanel.gemm('N', 'T', Constants<dp_t>::mone, &ak, &bCols, Constants<dp_t>::pone);
+    }
+
+    reserveColumns(a, k, k + q);
+    reserveColumns(b, k, k + q);
+    const int firstK = k;
+    for (int u = 0; u < q; u++) {
+      const int j = panelPivotCols[u];
+      // Remove the previous pivots of this panel from the column
+      FullMatrix<dp_t> aCol(colPanel.m + ((size_t) rowCount) * u, rowCount, 1);
+      if (u > 0) {
+        FullMatrix<dp_t> aPanel(a->m + ((size_t) rowCount) * firstK, rowCount, u, a->lda);
+        FullMatrix<dp_t> bRow(&b->get(j, firstK), 1, u, b->lda);
+        aCol.gemm('N', 'T', Constants<dp_t>::mone, &aPanel, &bRow, Constants<dp_t>::pone);
+      }
+      const dp_t* row = rowPanel.m + ((size_t) colCount) * panelPivotRows[u];
+      const dp_t pivotInv = Constants<dp_t>::pone / row[j];
+      memcpy(a->m + ((size_t) rowCount) * k, aCol.m, sizeof(dp_t) * rowCount);
+      dp_t* bVec = b->m + ((size_t) colCount) * k;
+      for (int jj = 0; jj < colCount; jj++)
+        bVec[jj] = row[jj] * pivotInv;
+
+      // Update the estimated norm, as in compressAcaPartial()
+      FullMatrix<dp_t> aVec(a->m + ((size_t) rowCount) * k, rowCount, 1);
+      FullMatrix<dp_t> bVecM(bVec, colCount, 1);
+      if (k > 0) {
+        FullMatrix<dp_t> ak(a->m, rowCount, k, a->lda);
+        FullMatrix<dp_t> bk(b->m, colCount, k, b->lda);
+        FullMatrix<dp_t> aDots(k, 1), bDots(k, 1);
+        aDots.gemm('C', 'N', Constants<dp_t>::pone, &ak, &aVec, Constants<dp_t>::zero);
+        bDots.gemm('C', 'N', Constants<dp_t>::pone, &bk, &bVecM, Constants<dp_t>::zero);
+        double newEstimate = 0.0;
+        for (int l = 0; l < k; l++) {
+          newEstimate += hmat::real(aDots.m[l] * bDots.m[l]);
+        }
+        estimateSquaredNorm += 2.0 * newEstimate;
+      }
+      const double ab_norm_2 = aVec.normSqr() * bVecM.normSqr();
+      estimateSquaredNorm += ab_norm_2;
+      k++;
+      pivotRows.push_back(panelRows[panelPivotRows[u]]);
+      pivotCols.push_back(j);
+
+      // ||a_nu||^2 ||b_nu||^2 < epsilon^2 ||S_nu||^2, the previous pivots cannot stop
+      if (!hintedPanel && ab_norm_2 < epsilon * epsilon * estimateSquaredNorm) {
+        pivotRows.pop_back();
+        pivotCols.pop_back();
+        converged = true;
+        break;
+      }
+    }
+
+    // The rows of the next panel are the maxima of the new columns. After
+    // the previous pivots, a single row usually shows the convergence.
+    panelSize = hintedPanel ? 1 : min(2 * panelSize, ACA_MAX_PANEL);
+    hintedPanel = false;
+    panelRows.clear();
+    for (int l = firstK; l < k && (int) panelRows.size() < panelSize; l++) {
+      double maxNorm2 = 0.;
+      int i = -1;
+      for (int ii = 0; ii < rowCount; ii++) {
+        const double norm2 = squaredNorm<dp_t>(a->get(ii, l));
+        if (rowFree[ii] && norm2 > maxNorm2 &&
+            std::find(panelRows.begin(), panelRows.end(), ii) == panelRows.end()) {
+          maxNorm2 = norm2;
+          i = ii;
+        }
+      }
+      if (i >= 0)
+        panelRows.push_back(i);
+    }
+    if (panelRows.empty())
+      selectFreeRows(rowFree, panelSize, panelRows);
+  }
+
+  if (pivots) {
+    pivots->rows.swap(pivotRows);
+    pivots->cols.swap(pivotCols);
+  }
+  // If k == 0, block is only made of zeros.
+  RkMatrix<dp_t>* result = new RkMatrix<dp_t>(block.rows, block.cols, k, AcaBlocked);
+  if (k > 0) {
+    memcpy(result->a->m, a->m, sizeof(dp_t) * rowCount * k);
+    memcpy(result->b->m, b->m, sizeof(dp_t) * colCount * k);
+  }
+  delete a;
+  delete b;
+  return result;
 }
 
 #include <iostream>
 
 template<typename T>
 RkMatrix<typename Types<T>::dp>* compressWithoutValidation(CompressionMethod method,
-                                                           const ClusterAssemblyFunction<T>& block) {
+                                                           const ClusterAssemblyFunction<T>& block,
+                                                           AcaPivots* pivots) {
   typedef typename Types<T>::dp dp_t;
   RkMatrix<dp_t>* rk = NULL;
   switch (method) {
@@ -718,10 +1247,16 @@ RkMatrix<typename Types<T>::dp>* compressWithoutValidation(CompressionMethod met
     rk = compressAcaFull(block);
     break;
   case AcaPartial:
-    rk = compressAcaPartial(block);
+    rk = compressAcaPartial(block, pivots);
     break;
   case AcaPlus:
-    rk = compressAcaPlus(block);
+    rk = compressAcaPlus(block, pivots);
+    break;
+  case RandomSvd:
+    rk = compressRandomSvd(block);
+    break;
+  case AcaBlocked:
+    rk = compressAcaBlocked(block, pivots);
     break;
   case NoCompression:
     // Must not happen
@@ -733,70 +1268,154 @@ RkMatrix<typename Types<T>::dp>* compressWithoutValidation(CompressionMethod met
 }
 
 
+static CompressionValidation validation_;
+
+CompressionValidation compressionValidation() {
+  CompressionValidation result;
+#pragma omp critical (hmat_compression_validation)
+  result = validation_;
+  return result;
+}
+
+void resetCompressionValidation() {
+#pragma omp critical (hmat_compression_validation)
+  validation_ = CompressionValidation();
+}
+
+/** Draw count distinct indices in [0, n[, in increasing order (Floyd's algorithm). */
+static void sampleIndices(GaussianGenerator& g, int n, int count, vector<int>& indices) {
+  std::set<int> selected;
+  for (int j = n - count; j < n; j++) {
+    const int t = min(j, (int) (g.uniform() * (j + 1)));
+    selected.insert(selected.count(t) ? j : t);
+  }
+  indices.assign(selected.begin(), selected.end());
+}
+
+/** Estimate the squared Frobenius norms of a block and of its difference with rk.
+
+    The norms are extrapolated from \a samples random rows and \a samples random
+    columns of the block, so the cost is (rows + cols) * samples evaluations of
+    the kernel and (rows + cols) * samples * rank operations, instead of
+    rows * cols * (1 + rank) for the comparison with the whole block.
+ */
+template<typename T>
+static void sampledNorms(const ClusterAssemblyFunction<T>& block,
+                         const RkMatrix<typename Types<T>::dp>* rk, int samples,
+                         double& fullNorm2, double& diffNorm2) {
+  typedef typename Types<T>::dp dp_t;
+  const int m = block.rows->size();
+  const int n = block.cols->size();
+  const int k = rk->rank();
+  GaussianGenerator generator(block.rows, block.cols);
+  vector<int> rowIndices, colIndices;
+  sampleIndices(generator, m, min(samples, m), rowIndices);
+  sampleIndices(generator, n, min(samples, n), colIndices);
+  const int r = rowIndices.size();
+  const int c = colIndices.size();
+
+  // Sampled rows, stored in columns: M(I, :)^T - B A(I, :)^T
+  FullMatrix<dp_t> sampledRows(n, r);
+  block.getRows(&rowIndices[0], r, sampledRows);
+  const double rowsNorm2 = sampledRows.normSqr();
+  if (k > 0) {
+    FullMatrix<dp_t> a(r, k);
+    for (int l = 0; l < k; l++)
+      for (int i = 0; i < r; i++)
+        a.get(i, l) = rk->a->get(rowIndices[i], l);
+    sampledRows.gemm('N', 'T', Constants<dp_t>::mone, rk->b, &a, Constants<dp_t>::pone);
+  }
+  const double rowsDiff2 = sampledRows.normSqr();
+
+  // Sampled columns: M(:, J) - A B(J, :)^T
+  FullMatrix<dp_t> sampledCols(m, c);
+  block.getCols(&colIndices[0], c, sampledCols);
+  const double colsNorm2 = sampledCols.normSqr();
+  if (k > 0) {
+    FullMatrix<dp_t> b(c, k);
+    for (int l = 0; l < k; l++)
+      for (int j = 0; j < c; j++)
+        b.get(j, l) = rk->b->get(colIndices[j], l);
+    sampledCols.gemm('N', 'T', Constants<dp_t>::mone, rk->a, &b, Constants<dp_t>::pone);
+  }
+  const double colsDiff2 = sampledCols.normSqr();
+
+  fullNorm2 = 0.5 * (rowsNorm2 * m / r + colsNorm2 * n / c);
+  diffNorm2 = 0.5 * (rowsDiff2 * m / r + colsDiff2 * n / c);
+}
+
 /* Appele par HMatrix<T>::assemble() */
 template<typename T>
 RkMatrix<typename Types<T>::dp>* compress(CompressionMethod method,
                                           const Function<T>& f,
                                           const ClusterData* rows,
                                           const ClusterData* cols,
-                                          const AllocationObserver & ao) {
+                                          const AllocationObserver & ao,
+                                          AcaPivots* pivots) {
   typedef typename Types<T>::dp dp_t;
   RkMatrix<dp_t>* rk = NULL;
   ClusterAssemblyFunction<T> block(f, rows, cols, ao);
 
-  rk = compressWithoutValidation(method, block);
+  rk = compressWithoutValidation(method, block, pivots);
 
   if (HMatrix<T>::validateCompression) {
-    FullMatrix<dp_t>* full = block.assemble();
     if (rk->a) rk->a->checkNan();
     if (rk->b) rk->b->checkNan();
-    FullMatrix<dp_t>* rkFull = rk->eval();
-    const double approxNorm = rkFull->norm();
-    const double fullNorm = full->norm();
+    double fullNorm2, diffNorm2;
+    if (HMatrix<T>::validationSamples > 0) {
+      sampledNorms(block, rk, HMatrix<T>::validationSamples, fullNorm2, diffNorm2);
+    } else {
+      FullMatrix<dp_t>* full = block.assemble();
+      FullMatrix<dp_t>* rkFull = rk->eval();
+      fullNorm2 = full->normSqr();
+      rkFull->axpy(Constants<T>::mone, full);
+      diffNorm2 = rkFull->normSqr();
+      delete rkFull;
+      delete full;
+    }
+    const double error = fullNorm2 > 0. ? sqrt(diffNorm2 / fullNorm2) : sqrt(diffNorm2);
 
     // If I meet a NaN, I save & leave
     // TODO : improve this behaviour
-    if (isnan(approxNorm)) {
-      rkFull->toFile("Rk");
-      full->toFile("Full");
+    if (isnan(error)) {
+      rk->eval()->toFile("Rk");
+      block.assemble()->toFile("Full");
       HMAT_ASSERT(false);
     }
 
-    rkFull->axpy(Constants<T>::mone, full);
-    double diffNorm = rkFull->norm();
-    if (diffNorm > HMatrix<T>::validationErrorThreshold * fullNorm ) {
-      std::cout << rows->description() << "x" << cols->description() << std::endl
-           << std::scientific
-           << "|M|  = " << fullNorm << std::endl
-           << "|Rk| = " << approxNorm << std::endl
-           << "|M - Rk| / |M| = " << diffNorm / fullNorm << std::endl
-           << "Rank = " << rk->rank() << " / " << min(full->rows, full->cols) << std::endl << std::endl;
-
-      if (HMatrix<T>::validationReRun) {
-        // Call compression a 2nd time, for debugging with gdb the work of the compression algorithm...
-        RkMatrix<dp_t>* rk_bis = NULL;
+    const bool failed = error > HMatrix<T>::validationErrorThreshold;
+#pragma omp critical (hmat_compression_validation)
+    {
+      validation_.count++;
+      validation_.sumError += error;
+      if (failed)
+        validation_.failures++;
+      validation_.maxError = std::max(validation_.maxError, error);
+    }
 
-        rk_bis = compressWithoutValidation(method, block);
-        delete rk_bis ;
-      }
+    if (failed && HMatrix<T>::validationReRun) {
+      // Call compression a 2nd time, for debugging with gdb the work of the compression algorithm...
+      RkMatrix<dp_t>* rk_bis = NULL;
 
-      if (HMatrix<T>::validationDump) {
-        std::string filename;
-        std::ostringstream convert;   // stream used for the conversion
-        convert << rows->description() << "x" << cols->description()  ;
-
-        filename = "Rk_";
-        filename += convert.str(); // set 'Result' to the contents of the stream
-        delete rkFull;
-        rkFull = rk->eval();
-        rkFull->toFile(filename.c_str());
-        filename = "Full_"+convert.str(); // set 'Result' to the contents of the stream
-        full->toFile(filename.c_str());
-      }
+      rk_bis = compressWithoutValidation(method, block, (AcaPivots*) NULL);
+      delete rk_bis ;
     }
 
-    delete rkFull;
-    delete full;
+    if (failed && HMatrix<T>::validationDump) {
+      std::string filename;
+      std::ostringstream convert;   // stream used for the conversion
+      convert << rows->description() << "x" << cols->description()  ;
+
+      filename = "Rk_";
+      filename += convert.str(); // set 'Result' to the contents of the stream
+      FullMatrix<dp_t>* rkFull = rk->eval();
+      rkFull->toFile(filename.c_str());
+      delete rkFull;
+      filename = "Full_"+convert.str(); // set 'Result' to the contents of the stream
+      FullMatrix<dp_t>* full = block.assemble();
+      full->toFile(filename.c_str());
+      delete full;
+    }
   }
   return rk;
 }
@@ -807,10 +1426,15 @@ template RkMatrix<D_t>* compressMatrix(FullMatrix<D_t>* m, const IndexSet* rows,
 template RkMatrix<C_t>* compressMatrix(FullMatrix<C_t>* m, const IndexSet* rows, const IndexSet* cols);
 template RkMatrix<Z_t>* compressMatrix(FullMatrix<Z_t>* m, const IndexSet* rows, const IndexSet* cols);
 
-template RkMatrix<Types<S_t>::dp>* compress<S_t>(CompressionMethod method, const Function<S_t>& f, const ClusterData* rows, const ClusterData* cols, const AllocationObserver &);
-template RkMatrix<Types<D_t>::dp>* compress<D_t>(CompressionMethod method, const Function<D_t>& f, const ClusterData* rows, const ClusterData* cols, const AllocationObserver &);
-template RkMatrix<Types<C_t>::dp>* compress<C_t>(CompressionMethod method, const Function<C_t>& f, const ClusterData* rows, const ClusterData* cols, const AllocationObserver &);
-template RkMatrix<Types<Z_t>::dp>* compress<Z_t>(CompressionMethod method, const Function<Z_t>& f, const ClusterData* rows, const ClusterData* cols, const AllocationObserver &);
+template RkMatrix<S_t>* randomizedSvd(const FullMatrix<S_t>* a, const FullMatrix<S_t>* b, const IndexSet* rows, const IndexSet* cols, double epsilon);
+template RkMatrix<D_t>* randomizedSvd(const FullMatrix<D_t>* a, const FullMatrix<D_t>* b, const IndexSet* rows, const IndexSet* cols, double epsilon);
+template RkMatrix<C_t>* randomizedSvd(const FullMatrix<C_t>* a, const FullMatrix<C_t>* b, const IndexSet* rows, const IndexSet* cols, double epsilon);
+template RkMatrix<Z_t>* randomizedSvd(const FullMatrix<Z_t>* a, const FullMatrix<Z_t>* b, const IndexSet* rows, const IndexSet* cols, double epsilon);
+
+template RkMatrix<Types<S_t>::dp>* compress<S_t>(CompressionMethod method, const Function<S_t>& f, const ClusterData* rows, const ClusterData* cols, const AllocationObserver &, AcaPivots*);
+template RkMatrix<Types<D_t>::dp>* compress<D_t>(CompressionMethod method, const Function<D_t>& f, const ClusterData* rows, const ClusterData* cols, const AllocationObserver &, AcaPivots*);
+template RkMatrix<Types<C_t>::dp>* compress<C_t>(CompressionMethod method, const Function<C_t>& f, const ClusterData* rows, const ClusterData* cols, const AllocationObserver &, AcaPivots*);
+template RkMatrix<Types<Z_t>::dp>* compress<Z_t>(CompressionMethod method, const Function<Z_t>& f, const ClusterData* rows, const ClusterData* cols, const AllocationObserver &, AcaPivots*);
 
 }  // end namespace hmat
 
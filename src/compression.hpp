@@ -24,6 +24,7 @@
 #define _COMPRESSION_HPP
 /* Implementation of the algorithms of blocks compression */
 #include "data_types.hpp"
+#include <vector>
 
 /** Choice of the compression method.
  */
@@ -32,7 +33,7 @@
 namespace hmat {
 
 enum CompressionMethod {
-  Svd, AcaFull, AcaPartial, AcaPlus, NoCompression
+  Svd, AcaFull, AcaPartial, AcaPlus, RandomSvd, AcaBlocked, NoCompression
 };
 class IndexSet;
 
@@ -50,19 +51,80 @@ template<typename T>
 RkMatrix<T>* compressMatrix(FullMatrix<T>* m, const IndexSet* rows,
                             const IndexSet* cols);
 
+/** Compress a matrix, or a product of two matrices, with a randomized SVD.
+
+    The range of the matrix is sampled by its products with blocks of
+    Gaussian random vectors, until the norm of the part of a new sample
+    outside of the current basis is below \a epsilon times the norm of
+    the sample (or until the fixed rank \a RkApproximationControl::k is
+    reached). \a RkApproximationControl::powerIterations power iterations
+    improve the basis when the singular values decay slowly. The SVD is then
+    computed on the projection of the matrix onto this basis, and truncated
+    with \a RkApproximationControl::findK().
+
+    The random vectors only depend on the block, so the result does not
+    depend on the execution order.
+
+    \param a The matrix to compress if b is NULL, left factor otherwise.
+    \param b NULL, or the right factor of the product a * b^T to compress.
+    \param rows The block rows
+    \param cols The block colums
+    \param epsilon The tolerance
+    \return A RkMatrix approximating a or a * b^T.
+*/
+template<typename T>
+RkMatrix<T>* randomizedSvd(const FullMatrix<T>* a, const FullMatrix<T>* b,
+                           const IndexSet* rows, const IndexSet* cols,
+                           double epsilon);
+
+/** Pivots of the ACA compression of a block, relative to the block.
+
+    They are kept in the leaves of an HMatrix from its first reassembly on, so
+    that the next assembly of the same structure, with other values of the
+    same kind of kernel, tries them first and knows the rank to expect.
+ */
+struct AcaPivots {
+  std::vector<int> rows;
+  std::vector<int> cols;
+};
+
 /** Compress a block into an RkMatrix.
 
     \param method The compression method
     \param f The assembly functions used to compute block elements
     \param rows The block rows
     \param cols The block colums
+    \param pivots NULL, or the pivots of a previous compression of the block,
+    replaced by the new ones. They are used by AcaPartial, AcaPlus and
+    AcaBlocked, and left unchanged by the other methods.
     \return A RkMatrix representation of the rows x cols block.
 */
 template<typename T>
 RkMatrix<typename Types<T>::dp>*
 compress(CompressionMethod method, const Function<T>& f,
          const ClusterData* rows, const ClusterData* cols,
-         const AllocationObserver & = AllocationObserver());
+         const AllocationObserver & = AllocationObserver(),
+         AcaPivots* pivots = NULL);
+
+/** Statistics of the blocks checked by compress() when HMatrix::validateCompression is set.
+
+    The errors are the relative errors |M - Rk|_F / |M|_F, computed on the
+    whole blocks, or estimated from HMatrix::validationSamples rows and
+    columns of them.
+ */
+struct CompressionValidation {
+  size_t count;       ///< Number of validated blocks
+  size_t failures;    ///< Number of blocks above HMatrix::validationErrorThreshold
+  double maxError;    ///< Largest error
+  double sumError;    ///< Sum of the errors, to compute the mean
+
+  CompressionValidation() : count(0), failures(0), maxError(0.), sumError(0.) {}
+  double meanError() const { return count ? sumError / count : 0.; }
+};
+
+/** Statistics of the validations done since the last resetCompressionValidation() */
+CompressionValidation compressionValidation();
+void resetCompressionValidation();
 
 }  // end namespace hmat
 #endif
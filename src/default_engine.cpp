@@ -22,6 +22,8 @@
 
 #include "default_engine.hpp"
 #include "hmat_cpp_interface.hpp"
+#include "task_pool.hpp"
+#include "common/block_allocator.hpp"
 #include "common/context.hpp"
 #include "common/my_assert.h"
 #include "hmat/hmat.h"
@@ -57,12 +59,18 @@ static void setTemplatedParameters(const HMatSettings& s) {
   RkMatrix<T>::approx.recompressionEpsilon = s.recompressionEpsilon;
   RkMatrix<T>::approx.method = s.compressionMethod;
   RkMatrix<T>::approx.compressionMinLeafSize = s.compressionMinLeafSize;
+  RkMatrix<T>::approx.powerIterations = s.powerIterations;
   HMatrix<T>::validateCompression = s.validateCompression;
   HMatrix<T>::validationErrorThreshold = s.validationErrorThreshold;
   HMatrix<T>::validationReRun = s.validationReRun;
   HMatrix<T>::validationDump = s.validationDump;
+  HMatrix<T>::validationSamples = s.validationSamples;
   HMatrix<T>::coarsening = s.coarsening;
+  HMatrix<T>::coarseningThreshold = s.coarseningThreshold;
   HMatrix<T>::recompress = s.recompress;
+  HMatrix<T>::lowPrecisionStorage = s.lowPrecisionStorage;
+  HMatrix<T>::accumulateRkUpdates = s.accumulateRkUpdates;
+  HMatrix<T>::maxParallelLeaves = s.maxParallelLeaves;
 }
 
 
@@ -70,6 +78,12 @@ void HMatSettings::setParameters() const {
   HMAT_ASSERT(assemblyEpsilon > 0.);
   HMAT_ASSERT(recompressionEpsilon > 0.);
   HMAT_ASSERT(validationErrorThreshold >= 0.);
+  HMAT_ASSERT(validationSamples >= 0);
+  HMAT_ASSERT(coarseningThreshold > 0.);
+  HMAT_ASSERT(nbThreads >= 0);
+  HMAT_ASSERT(powerIterations >= 0);
+  TaskPool::setDefaultThreadCount(nbThreads);
+  BlockAllocator::instance().setEnabled(blockPool);
   setTemplatedParameters<S_t>(*this);
   setTemplatedParameters<D_t>(*this);
   setTemplatedParameters<C_t>(*this);
@@ -84,6 +98,7 @@ void HMatSettings::printSettings(std::ostream& out) const {
   out << "Resolution Epsilon         = " << recompressionEpsilon << std::endl;
   out << "Compression Min Leaf Size  = " << compressionMinLeafSize << std::endl;
   out << "Validation Error Threshold = " << validationErrorThreshold << std::endl;
+  out << "Validation Samples         = " << validationSamples << std::endl;
   switch (compressionMethod) {
   case Svd:
     out << "SVD Compression" << std::endl;
@@ -97,6 +112,12 @@ void HMatSettings::printSettings(std::ostream& out) const {
   case AcaPlus:
     out << "ACA+ compression" << std::endl;
     break;
+  case AcaBlocked:
+    out << "Blocked ACA compression (Partial Pivoting)" << std::endl;
+    break;
+  case RandomSvd:
+    out << "Randomized SVD compression (" << powerIterations << " power iterations)" << std::endl;
+    break;
   case NoCompression:
     // Should not happen
     break;
@@ -104,23 +125,25 @@ void HMatSettings::printSettings(std::ostream& out) const {
   out.flags(savedIosFlags);
 }
 
-ClusterTree* createClusterTree(const DofCoordinates& dls, const ClusteringAlgorithm& algo) {
+ClusterTree* createClusterTree(const DofCoordinates& dls, const ClusteringAlgorithm& algo, int nbThreads) {
   DECLARE_CONTEXT;
 
   ClusterTreeBuilder ctb(algo);
-  return ctb.build(dls);
+  return ctb.build(dls, NULL, nbThreads);
 }
 
 
 template<typename T>
-void DefaultEngine<T>::assembly(Assembly<T>& f, SymmetryFlag sym, bool ownAssembly) {
+size_t DefaultEngine<T>::assembly(Assembly<T>& f, SymmetryFlag sym, bool ownAssembly) {
+  size_t saved;
   if (sym == kLowerSymmetric || hmat->isLower || hmat->isUpper) {
-    hmat->assembleSymmetric(f, NULL, hmat->isLower || hmat->isUpper);
+    saved = hmat->assembleSymmetric(f, NULL, hmat->isLower || hmat->isUpper);
   } else {
-    hmat->assemble(f);
+    saved = hmat->assemble(f);
   }
   if(ownAssembly)
       delete &f;
+  return saved;
 }
 
 template<typename T>
@@ -166,20 +189,7 @@ void DefaultEngine<T>::addIdentity(T alpha) {
 
 template<typename T>
 void DefaultEngine<T>::solve(FullMatrix<T>& b, hmat_factorization_t t) const {
-  switch(t) {
-  case hmat_factorization_lu:
-      hmat->solve(&b);
-      break;
-  case hmat_factorization_ldlt:
-      hmat->solveLdlt(&b);
-      break;
-  case hmat_factorization_llt:
-      hmat->solveLlt(&b);
-      break;
-  default:
-     // not supported
-     HMAT_ASSERT(false);
-  }
+  hmat->solve(&b, t, 1);
 }
 
 template<typename T>
@@ -226,6 +236,11 @@ template<typename T> void DefaultEngine<T>::transpose() {
 namespace hmat {
 
 // Explicit template instantiation
+template class DefaultEngine<S_t>;
+template class DefaultEngine<D_t>;
+template class DefaultEngine<C_t>;
+template class DefaultEngine<Z_t>;
+
 template class HMatInterface<S_t, DefaultEngine>;
 template class HMatInterface<D_t, DefaultEngine>;
 template class HMatInterface<C_t, DefaultEngine>;
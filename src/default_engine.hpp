@@ -42,7 +42,8 @@ public:
   HMatrix<T>* hmat;
   static int init() { return 0; }
   static void finalize(){}
-  void assembly(Assembly<T>& f, SymmetryFlag sym, bool ownAssembly);
+  /// Return the number of terms saved by the coarsening
+  size_t assembly(Assembly<T>& f, SymmetryFlag sym, bool ownAssembly);
   void factorization(hmat_factorization_t);
   void inverse();
   void gemv(char trans, T alpha, FullMatrix<T>& x, T beta, FullMatrix<T>& y) const;
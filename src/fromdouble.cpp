@@ -34,6 +34,19 @@ FullMatrix<Z_t>* fromDoubleFull(FullMatrix<Z_t>* f) {
   return f;
 }
 
+/** Copy f into result, which has the same size. */
+template<typename From, typename To>
+static void convert(const FullMatrix<From>* f, FullMatrix<To>* result) {
+  assert(f->rows == result->rows && f->cols == result->cols);
+  for (int j = 0; j < f->cols; ++j) {
+    To* const r = result->m + ((size_t) j) * result->lda;
+    const From* m = f->m + ((size_t) j) * f->lda;
+    for (int i = 0; i < f->rows; ++i) {
+      r[i] = To(m[i]);
+    }
+  }
+}
+
 template<typename T>
 FullMatrix<T>* fromDoubleFull(FullMatrix<typename Types<T>::dp>* f) {
   if (!f) {
@@ -41,13 +54,7 @@ FullMatrix<T>* fromDoubleFull(FullMatrix<typename Types<T>::dp>* f) {
   }
   FullMatrix<T>* result = new FullMatrix<T>(f->rows, f->cols);
   assert(result);
-  assert(f->lda == f->rows);
-  const size_t size = ((size_t) f->rows) * f->cols;
-  T* const r = result->m;
-  const typename Types<T>::dp* m = f->m;
-  for (size_t i = 0; i < size; ++i) {
-    r[i] = T(m[i]);
-  }
+  convert(f, result);
   delete f;
   return result;
 }
@@ -63,13 +70,11 @@ template<> RkMatrix<Z_t>* fromDoubleRk(RkMatrix<Z_t>* rk) {
 }
 
 template<typename T> RkMatrix<T>* fromDoubleRk(RkMatrix<typename Types<T>::dp>* rk) {
-  RkMatrix<T>* result = new RkMatrix<T>(fromDoubleFull<T>(rk->a),
-                                        rk->rows,
-                                        fromDoubleFull<T>(rk->b),
-                                        rk->cols,
-                                        rk->method);
-  rk->a= NULL;
-  rk->b = NULL;
+  RkMatrix<T>* result = new RkMatrix<T>(rk->rows, rk->cols, rk->rank(), rk->method);
+  if (rk->rank() > 0) {
+    convert(rk->a, result->a);
+    convert(rk->b, result->b);
+  }
   delete rk;
   return result;
 }
@@ -77,4 +82,25 @@ template<typename T> RkMatrix<T>* fromDoubleRk(RkMatrix<typename Types<T>::dp>*
 template RkMatrix<S_t>* fromDoubleRk(RkMatrix<Types<S_t>::dp>* rk);
 template RkMatrix<C_t>* fromDoubleRk(RkMatrix<Types<C_t>::dp>* rk);
 
+template<typename T>
+FullMatrix<typename Types<T>::sp>* toSingleFull(const FullMatrix<T>* f) {
+  FullMatrix<typename Types<T>::sp>* result = new FullMatrix<typename Types<T>::sp>(f->rows, f->cols);
+  convert(f, result);
+  return result;
+}
+
+template<typename T>
+void fromSingleFull(const FullMatrix<typename Types<T>::sp>* f, FullMatrix<T>* result) {
+  convert(f, result);
+}
+
+template FullMatrix<Types<S_t>::sp>* toSingleFull(const FullMatrix<S_t>* f);
+template FullMatrix<Types<D_t>::sp>* toSingleFull(const FullMatrix<D_t>* f);
+template FullMatrix<Types<C_t>::sp>* toSingleFull(const FullMatrix<C_t>* f);
+template FullMatrix<Types<Z_t>::sp>* toSingleFull(const FullMatrix<Z_t>* f);
+template void fromSingleFull(const FullMatrix<Types<S_t>::sp>* f, FullMatrix<S_t>* result);
+template void fromSingleFull(const FullMatrix<Types<D_t>::sp>* f, FullMatrix<D_t>* result);
+template void fromSingleFull(const FullMatrix<Types<C_t>::sp>* f, FullMatrix<C_t>* result);
+template void fromSingleFull(const FullMatrix<Types<Z_t>::sp>* f, FullMatrix<Z_t>* result);
+
 }  // end namespace hmat
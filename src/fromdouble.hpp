@@ -40,5 +40,15 @@ template<typename T> FullMatrix<T>* fromDoubleFull(FullMatrix<typename Types<T>:
 
 template<typename T> RkMatrix<T>* fromDoubleRk(RkMatrix<typename Types<T>::dp>* rk);
 
+/** Returns a single precision copy of a matrix, without padding.
+
+    f is not modified. If T is a single precision type, this is a plain copy.
+ */
+template<typename T> FullMatrix<typename Types<T>::sp>* toSingleFull(const FullMatrix<T>* f);
+
+/** Copy a single precision matrix into result, which has the same size.
+ */
+template<typename T> void fromSingleFull(const FullMatrix<typename Types<T>::sp>* f, FullMatrix<T>* result);
+
 }  // end namespace hmat
 
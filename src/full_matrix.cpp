@@ -37,8 +37,10 @@
 #include "data_types.hpp"
 #include "lapack_overloads.hpp"
 #include "blas_overloads.hpp"
+#include "small_blas.hpp"
 #include "lapack_exception.hpp"
 #include "common/memory_instrumentation.hpp"
+#include "common/block_allocator.hpp"
 #include "system_types.h"
 #include "common/my_assert.h"
 #include "common/context.hpp"
@@ -62,11 +64,6 @@
 
 #include <stdlib.h>
 
-#ifdef HAVE_JEMALLOC
-#define JEMALLOC_NO_DEMANGLE
-#include <jemalloc/jemalloc.h>
-#endif
-
 #ifdef _MSC_VER
 // Intel compiler defines isnan in global namespace
 // MSVC defines _isnan
@@ -127,11 +124,7 @@ FullMatrix<T>::FullMatrix(int _rows, int _cols)
   : ownsMemory(true), triUpper_(false), triLower_(false),
     rows(_rows), cols(_cols), lda(_rows), pivots(NULL), diagonal(NULL) {
   size_t size = ((size_t) rows) * cols * sizeof(T);
-#ifdef HAVE_JEMALLOC
-  m = (T*) je_calloc(size, 1);
-#else
-  m = (T*) calloc(size, 1);
-#endif
+  m = (T*) BlockAllocator::allocate(size);
   HMAT_ASSERT_MSG(m, "Trying to allocate %ldb of memory failed (rows=%d cols=%d sizeof(T)=%d)", size, rows, cols, sizeof(T));
   MemoryInstrumenter::instance().alloc(size, MemoryInstrumenter::FULL_MATRIX);
 #ifdef POISON_ALLOCATION
@@ -155,11 +148,7 @@ template<typename T> FullMatrix<T>::~FullMatrix() {
   if (ownsMemory) {
     size_t size = ((size_t) rows) * cols * sizeof(T);
     MemoryInstrumenter::instance().free(size, MemoryInstrumenter::FULL_MATRIX);
-#ifdef HAVE_JEMALLOC
-    je_free(m);
-#else
-    free(m);
-#endif
+    BlockAllocator::free(m);
     m = NULL;
   }
   if (pivots) {
@@ -325,6 +314,10 @@ void FullMatrix<T>::gemm(char transA, char transB, T alpha,
     const size_t muls = _m * _n * _k;
     increment_flops(Multipliers<T>::add * adds + Multipliers<T>::mul * muls);
   }
+  if (small_blas::applies<T>(transA, transB, m, n, k)) {
+    small_blas::gemm(transA, m, n, k, alpha, a->m, a->lda, b->m, b->lda, beta, this->m, this->lda);
+    return;
+  }
   proxy_cblas::gemm(transA, transB, m, n, k, alpha, a->m, a->lda, b->m, b->lda,
                     beta, this->m, this->lda);
 }
@@ -369,6 +362,8 @@ void FullMatrix<T>::multiplyWithDiagOrDiagInv(const Vector<T>* d, bool inverse,
 
 template<typename T>
 void FullMatrix<T>::ldltDecomposition() {
+  DECLARE_CONTEXT;
+  tracing_block_size(rows, cols);
   // Void matrix
   if (rows == 0 || cols == 0) return;
 
@@ -418,6 +413,8 @@ void FullMatrix<T>::ldltDecomposition() {
 }
 
 template<typename T> void FullMatrix<T>::lltDecomposition() {
+    DECLARE_CONTEXT;
+    tracing_block_size(rows, cols);
     // Void matrix
     if (rows == 0 || cols == 0) return;
 
@@ -442,6 +439,8 @@ template<typename T> void FullMatrix<T>::lltDecomposition() {
 
 template<typename T>
 void FullMatrix<T>::luDecomposition() {
+  DECLARE_CONTEXT;
+  tracing_block_size(rows, cols);
   // Void matrix
   if (rows == 0 || cols == 0) return;
 
@@ -662,10 +661,11 @@ template<typename T> void FullMatrix<T>::fromFile(const char * filename) {
   HMAT_ASSERT(r == 1);
   r = fseek(f, 2 * sizeof(int), SEEK_CUR);
   HMAT_ASSERT(r == 0);
-  if(m)
-      free(m);
+  if(m && ownsMemory)
+      BlockAllocator::free(m);
   size_t size = ((size_t) rows) * cols * sizeof(T);
-  m = (T*) calloc(size, 1);
+  m = (T*) BlockAllocator::allocate(size);
+  ownsMemory = true;
   r = fread(m, size, 1, f);
   fclose(f);
   HMAT_ASSERT(r == 1);
@@ -817,7 +817,7 @@ template<typename T> Vector<T>::Vector(T* _v, int _rows)
 template<typename T> Vector<T>::Vector(int _rows)
   : ownsMemory(true), rows(_rows) {
   size_t size = rows * sizeof(T);
-  v = (T*) calloc(size, 1);
+  v = (T*) BlockAllocator::allocate(size);
   MemoryInstrumenter::instance().alloc(size, MemoryInstrumenter::FULL_MATRIX);
   HMAT_ASSERT(v);
 }
@@ -825,7 +825,7 @@ template<typename T> Vector<T>::Vector(int _rows)
 template<typename T> Vector<T>::~Vector() {
   if (ownsMemory) {
     size_t size = rows * sizeof(T);
-    free(v);
+    BlockAllocator::free(v);
     MemoryInstrumenter::instance().free(size, MemoryInstrumenter::FULL_MATRIX);
   }
   v = NULL;
@@ -92,11 +92,11 @@ public:
   static FullMatrix* Zero(int rows, int cols);
   ~FullMatrix();
 
-  bool isTriUpper() {
+  bool isTriUpper() const {
       return triUpper_;
   }
 
-  bool isTriLower() {
+  bool isTriLower() const {
       return triLower_;
   }
 
@@ -0,0 +1,444 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "h2_matrix.hpp"
+#include "h_matrix.hpp"
+#include "rk_matrix.hpp"
+#include "full_matrix.hpp"
+#include "cluster_tree.hpp"
+#include "lapack_operations.hpp"
+#include "common/context.hpp"
+#include "common/my_assert.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+namespace hmat {
+
+/** Conversion of an HMatrix into an H2Matrix, see H2Matrix::H2Matrix().
+
+    The side 0 is the rows, the side 1 the columns: the row basis is computed
+    from the left factors a of the Rk blocks a b^T, the column basis from
+    their right factors b.
+ */
+template<typename T> class H2Builder {
+public:
+  H2Builder(H2Matrix<T>& h2, double epsilon) : h2_(h2), epsilon_(epsilon) {}
+  ~H2Builder();
+  void convert(const HMatrix<T>* h);
+
+private:
+  typedef typename H2Matrix<T>::Basis Basis;
+  /// A non null Rk block a b^T of the matrix
+  struct LowRankBlock {
+    const ClusterTree* clusters[2];
+    const FullMatrix<T>* factors[2];
+  };
+
+  /** List the leaves of h, or of h^T if transposed is true */
+  void collect(const HMatrix<T>* h, bool transposed);
+  /** Build the basis of a cluster and of its subtree.
+
+      \param inherited the blocks of the ancestors of node
+      \param projections set to V^* f restricted to node, for the factors f of the inherited
+      blocks, or NULL if the basis has a null rank.
+      \return the index of the basis
+   */
+  int buildBasis(int side, const ClusterTree* node, const std::vector<int>& inherited,
+                 std::vector<FullMatrix<T>*>& projections);
+  /** R^T, R being the triangular factor of the QR decomposition of f */
+  static FullMatrix<T>* weight(const FullMatrix<T>* f);
+
+  H2Matrix<T>& h2_;
+  double epsilon_;
+  int offsets_[2];
+  std::vector<LowRankBlock> blocks_;
+  /// Rk leaves of blocks_ unpacked from their single precision copy
+  std::vector<RkMatrix<T>*> unpacked_;
+  /// Blocks of each cluster
+  std::map<const ClusterTree*, std::vector<int> > clusterBlocks_[2];
+  /// Index of the basis of each cluster
+  std::map<const ClusterTree*, int> basisIndex_[2];
+  /// Weight of the factor of each block, from the other factor
+  std::vector<FullMatrix<T>*> weights_[2];
+  /// Projection of the factor of each block onto the basis of its cluster
+  std::vector<FullMatrix<T>*> projections_[2];
+};
+
+template<typename T> H2Builder<T>::~H2Builder() {
+  for (size_t i = 0; i < unpacked_.size(); i++)
+    delete unpacked_[i];
+  for (int side = 0; side < 2; side++) {
+    for (size_t b = 0; b < blocks_.size(); b++) {
+      delete weights_[side][b];
+      delete projections_[side][b];
+    }
+  }
+}
+
+template<typename T>
+void H2Builder<T>::collect(const HMatrix<T>* h, bool transposed) {
+  if (h->isLeaf()) {
+    if (h->isNull())
+      return;
+    const ClusterTree* rows = transposed ? h->colsTree() : h->rowsTree();
+    const ClusterTree* cols = transposed ? h->rowsTree() : h->colsTree();
+    if (h->isRkMatrix()) {
+      RkMatrix<T>* tmp = NULL;
+      const RkMatrix<T>* rk = h->readRk(tmp);
+      if (tmp)
+        unpacked_.push_back(tmp);
+      LowRankBlock block;
+      block.clusters[0] = rows;
+      block.clusters[1] = cols;
+      block.factors[0] = transposed ? rk->b : rk->a;
+      block.factors[1] = transposed ? rk->a : rk->b;
+      blocks_.push_back(block);
+    } else {
+      FullMatrix<T>* tmp = NULL;
+      const FullMatrix<T>* full = h->readFull(tmp);
+      typename H2Matrix<T>::Dense dense;
+      dense.rowOffset = rows->data.offset() - offsets_[0];
+      dense.colOffset = cols->data.offset() - offsets_[1];
+      dense.m = transposed ? full->copyAndTranspose() : full->copy();
+      delete tmp;
+      h2_.dense_.push_back(dense);
+    }
+    return;
+  }
+  HMAT_ASSERT_MSG(!h->isTriLower && !h->isTriUpper, "H2Matrix: factorized matrices are not supported");
+  for (int i = 0; i < h->nrChildRow(); i++) {
+    for (int j = 0; j < h->nrChildCol(); j++) {
+      const HMatrix<T>* child = h->get(i, j);
+      if (child) {
+        collect(child, transposed);
+      } else if ((h->isLower && i < j) || (h->isUpper && i > j)) {
+        // Only one half of a symmetric block is stored
+        collect(h->get(j, i), !transposed);
+      }
+    }
+  }
+}
+
+template<typename T>
+FullMatrix<T>* H2Builder<T>::weight(const FullMatrix<T>* f) {
+  FullMatrix<T>* qr = f->copy();
+  T* tau = qrDecomposition(qr);
+  free(tau);
+  const int k = f->cols;
+  const int p = std::min(f->rows, k);
+  FullMatrix<T>* result = new FullMatrix<T>(k, p);
+  for (int i = 0; i < p; i++)
+    for (int j = i; j < k; j++)
+      result->get(j, i) = qr->get(i, j);
+  delete qr;
+  return result;
+}
+
+/* At a leaf cluster t, the basis is the truncated SVD of [F_b|t R_b^T], for
+   the factors F_b of the blocks b of t and of its ancestors and their weights
+   R_b^T. At an inner cluster, F_b|t is replaced by its projection
+   [V_t1^* F_b|t1; V_t2^* F_b|t2] onto the bases of the children, which gives
+   the transfer matrices. */
+template<typename T>
+int H2Builder<T>::buildBasis(int side, const ClusterTree* node, const std::vector<int>& inherited,
+                             std::vector<FullMatrix<T>*>& projections) {
+  std::vector<Basis>& bases = side == 0 ? h2_.rowBases_ : h2_.colBases_;
+  std::vector<int> blocks(inherited);
+  typename std::map<const ClusterTree*, std::vector<int> >::const_iterator own = clusterBlocks_[side].find(node);
+  if (own != clusterBlocks_[side].end())
+    blocks.insert(blocks.end(), own->second.begin(), own->second.end());
+  const int index = bases.size();
+  bases.push_back(Basis(node->data.offset() - offsets_[side], node->data.size()));
+  basisIndex_[side][node] = index;
+
+  // Rows of the factors restricted to node, or their projections onto the children bases
+  std::vector<FullMatrix<T>*> local(blocks.size(), (FullMatrix<T>*) NULL);
+  int localRows = 0;
+  if (node->isLeaf()) {
+    localRows = node->data.size();
+    for (size_t i = 0; i < blocks.size(); i++) {
+      const LowRankBlock& block = blocks_[blocks[i]];
+      const FullMatrix<T>* f = block.factors[side];
+      const int start = node->data.offset() - block.clusters[side]->data.offset();
+      local[i] = new FullMatrix<T>(f->m + start, localRows, f->cols, f->lda);
+    }
+  } else {
+    std::vector<std::vector<FullMatrix<T>*> > childProjections;
+    for (int c = 0; c < node->nrChild(); c++) {
+      const ClusterTree* child = static_cast<const ClusterTree*>(node->getChild(c));
+      if (!child)
+        continue;
+      childProjections.push_back(std::vector<FullMatrix<T>*>());
+      const int childIndex = buildBasis(side, child, blocks, childProjections.back());
+      bases[index].children.push_back(childIndex);
+      localRows += bases[childIndex].rank;
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+      if (localRows > 0)
+        local[i] = new FullMatrix<T>(localRows, blocks_[blocks[i]].factors[side]->cols);
+      int row = 0;
+      for (size_t c = 0; c < childProjections.size(); c++) {
+        FullMatrix<T>* p = childProjections[c][i];
+        if (p) {
+          local[i]->copyMatrixAtOffset(p, row, 0);
+          row += p->rows;
+          delete p;
+        }
+      }
+    }
+  }
+
+  int totalCols = 0;
+  for (size_t i = 0; i < blocks.size(); i++)
+    totalCols += weights_[side][blocks[i]]->cols;
+  FullMatrix<T>* basis = NULL;
+  if (localRows > 0 && totalCols > 0) {
+    FullMatrix<T> x(localRows, totalCols);
+    int col = 0;
+    for (size_t i = 0; i < blocks.size(); i++) {
+      const FullMatrix<T>* w = weights_[side][blocks[i]];
+      FullMatrix<T> sub(x.m + ((size_t) col) * x.lda, localRows, w->cols, x.lda);
+      sub.gemm('N', 'N', Constants<T>::pone, local[i], w, Constants<T>::zero);
+      col += w->cols;
+    }
+    FullMatrix<T>* u = NULL;
+    Vector<double>* sigma = NULL;
+    FullMatrix<T>* vt = NULL;
+    truncatedSvd(&x, &u, &sigma, &vt);
+    const int rank = RkMatrix<T>::approx.findK(sigma->v, std::min(localRows, totalCols), epsilon_);
+    if (rank > 0)
+      basis = FullMatrix<T>(u->m, localRows, rank, u->lda).copy();
+    delete u;
+    delete sigma;
+    delete vt;
+  }
+
+  projections.assign(inherited.size(), (FullMatrix<T>*) NULL);
+  if (basis) {
+    const int rank = basis->cols;
+    bases[index].rank = rank;
+    for (size_t i = 0; i < blocks.size(); i++) {
+      FullMatrix<T>* p = new FullMatrix<T>(rank, local[i]->cols);
+      p->gemm('C', 'N', Constants<T>::pone, basis, local[i], Constants<T>::zero);
+      if (i < inherited.size())
+        projections[i] = p;
+      else
+        projections_[side][blocks[i]] = p;
+    }
+    if (node->isLeaf()) {
+      bases[index].leafBasis = basis;
+    } else {
+      int row = 0;
+      for (size_t c = 0; c < bases[index].children.size(); c++) {
+        Basis& child = bases[bases[index].children[c]];
+        if (child.rank == 0)
+          continue;
+        child.transfer = FullMatrix<T>(basis->m + row, child.rank, rank, basis->lda).copy();
+        row += child.rank;
+      }
+      delete basis;
+    }
+  }
+  for (size_t i = 0; i < local.size(); i++)
+    delete local[i];
+  return index;
+}
+
+template<typename T>
+void H2Builder<T>::convert(const HMatrix<T>* h) {
+  offsets_[0] = h->rows()->offset();
+  offsets_[1] = h->cols()->offset();
+  collect(h, false);
+  for (int side = 0; side < 2; side++) {
+    weights_[side].resize(blocks_.size());
+    projections_[side].assign(blocks_.size(), (FullMatrix<T>*) NULL);
+    for (size_t b = 0; b < blocks_.size(); b++) {
+      clusterBlocks_[side][blocks_[b].clusters[side]].push_back(b);
+      // The weight of a factor comes from the other one
+      weights_[side][b] = weight(blocks_[b].factors[1 - side]);
+    }
+    std::vector<FullMatrix<T>*> none;
+    buildBasis(side, side == 0 ? h->rowsTree() : h->colsTree(), std::vector<int>(), none);
+  }
+  // a b^T ~ V (V^* a) (W^* b)^T W^T
+  for (size_t b = 0; b < blocks_.size(); b++) {
+    const FullMatrix<T>* pRows = projections_[0][b];
+    const FullMatrix<T>* pCols = projections_[1][b];
+    if (!pRows || !pCols)
+      continue;
+    typename H2Matrix<T>::Coupling coupling;
+    coupling.rowBasis = basisIndex_[0][blocks_[b].clusters[0]];
+    coupling.colBasis = basisIndex_[1][blocks_[b].clusters[1]];
+    coupling.s = new FullMatrix<T>(pRows->rows, pCols->rows);
+    coupling.s->gemm('N', 'T', Constants<T>::pone, pRows, pCols, Constants<T>::zero);
+    h2_.couplings_.push_back(coupling);
+  }
+}
+
+template<typename T>
+H2Matrix<T>::H2Matrix(const HMatrix<T>* h, double epsilon)
+  : rows_(h->rows()->size()), cols_(h->cols()->size()) {
+  DECLARE_CONTEXT;
+  H2Builder<T> builder(*this, epsilon);
+  builder.convert(h);
+}
+
+template<typename T> H2Matrix<T>::~H2Matrix() {
+  for (int side = 0; side < 2; side++) {
+    std::vector<Basis>& bases = side == 0 ? rowBases_ : colBases_;
+    for (size_t i = 0; i < bases.size(); i++) {
+      delete bases[i].leafBasis;
+      delete bases[i].transfer;
+    }
+  }
+  for (size_t i = 0; i < couplings_.size(); i++)
+    delete couplings_[i].s;
+  for (size_t i = 0; i < dense_.size(); i++)
+    delete dense_[i].m;
+}
+
+template<typename T>
+void H2Matrix<T>::forward(const std::vector<Basis>& bases, int i, const FullMatrix<T>* x,
+                          std::vector<FullMatrix<T>*>& xHat) const {
+  const Basis& basis = bases[i];
+  for (size_t c = 0; c < basis.children.size(); c++)
+    forward(bases, basis.children[c], x, xHat);
+  if (basis.rank == 0)
+    return;
+  xHat[i] = new FullMatrix<T>(basis.rank, x->cols);
+  if (basis.leafBasis) {
+    FullMatrix<T> subX(x->m + basis.offset, basis.size, x->cols, x->lda);
+    xHat[i]->gemm('T', 'N', Constants<T>::pone, basis.leafBasis, &subX, Constants<T>::zero);
+  } else {
+    for (size_t c = 0; c < basis.children.size(); c++) {
+      const int child = basis.children[c];
+      if (xHat[child])
+        xHat[i]->gemm('T', 'N', Constants<T>::pone, bases[child].transfer, xHat[child], Constants<T>::pone);
+    }
+  }
+}
+
+template<typename T>
+void H2Matrix<T>::backward(const std::vector<Basis>& bases, int i, T alpha, FullMatrix<T>* y,
+                           std::vector<FullMatrix<T>*>& yHat) const {
+  const Basis& basis = bases[i];
+  if (yHat[i]) {
+    if (basis.leafBasis) {
+      FullMatrix<T> subY(y->m + basis.offset, basis.size, y->cols, y->lda);
+      subY.gemm('N', 'N', alpha, basis.leafBasis, yHat[i], Constants<T>::pone);
+    } else {
+      for (size_t c = 0; c < basis.children.size(); c++) {
+        const int child = basis.children[c];
+        if (!bases[child].transfer)
+          continue;
+        if (!yHat[child])
+          yHat[child] = new FullMatrix<T>(bases[child].rank, y->cols);
+        yHat[child]->gemm('N', 'N', Constants<T>::pone, bases[child].transfer, yHat[i], Constants<T>::pone);
+      }
+    }
+  }
+  for (size_t c = 0; c < basis.children.size(); c++)
+    backward(bases, basis.children[c], alpha, y, yHat);
+}
+
+/* The product is done in 3 steps: the forward transform computes the
+   coefficients W_s^T x|s of x in the column bases, bottom-up with the transfer
+   matrices; the coupling matrices give the coefficients of y in the row bases;
+   the backward transform adds them to y, top-down. */
+template<typename T>
+void H2Matrix<T>::gemv(char trans, T alpha, const FullMatrix<T>* x, T beta, FullMatrix<T>* y) const {
+  DECLARE_CONTEXT;
+  HMAT_ASSERT(trans == 'N' || trans == 'T');
+  const bool notTransposed = trans == 'N';
+  assert(x->cols == y->cols);
+  assert(x->rows == (notTransposed ? cols_ : rows_));
+  assert(y->rows == (notTransposed ? rows_ : cols_));
+  if (beta != Constants<T>::pone)
+    y->scale(beta);
+  const std::vector<Basis>& in = notTransposed ? colBases_ : rowBases_;
+  const std::vector<Basis>& out = notTransposed ? rowBases_ : colBases_;
+  std::vector<FullMatrix<T>*> xHat(in.size(), (FullMatrix<T>*) NULL);
+  std::vector<FullMatrix<T>*> yHat(out.size(), (FullMatrix<T>*) NULL);
+  if (!in.empty())
+    forward(in, 0, x, xHat);
+  for (size_t c = 0; c < couplings_.size(); c++) {
+    const Coupling& coupling = couplings_[c];
+    const int i = notTransposed ? coupling.colBasis : coupling.rowBasis;
+    const int o = notTransposed ? coupling.rowBasis : coupling.colBasis;
+    if (!yHat[o])
+      yHat[o] = new FullMatrix<T>(out[o].rank, x->cols);
+    yHat[o]->gemm(trans, 'N', Constants<T>::pone, coupling.s, xHat[i], Constants<T>::pone);
+  }
+  if (!out.empty())
+    backward(out, 0, alpha, y, yHat);
+  for (size_t d = 0; d < dense_.size(); d++) {
+    const Dense& dense = dense_[d];
+    const int xOffset = notTransposed ? dense.colOffset : dense.rowOffset;
+    const int yOffset = notTransposed ? dense.rowOffset : dense.colOffset;
+    const int xRows = notTransposed ? dense.m->cols : dense.m->rows;
+    const int yRows = notTransposed ? dense.m->rows : dense.m->cols;
+    const FullMatrix<T> subX(x->m + xOffset, xRows, x->cols, x->lda);
+    FullMatrix<T> subY(y->m + yOffset, yRows, y->cols, y->lda);
+    subY.gemm(trans, 'N', alpha, dense.m, &subX, Constants<T>::pone);
+  }
+  for (size_t i = 0; i < xHat.size(); i++)
+    delete xHat[i];
+  for (size_t i = 0; i < yHat.size(); i++)
+    delete yHat[i];
+}
+
+template<typename T> size_t H2Matrix<T>::storedSize() const {
+  size_t result = 0;
+  for (int side = 0; side < 2; side++) {
+    const std::vector<Basis>& bases = side == 0 ? rowBases_ : colBases_;
+    for (size_t i = 0; i < bases.size(); i++) {
+      if (bases[i].leafBasis)
+        result += ((size_t) bases[i].leafBasis->rows) * bases[i].leafBasis->cols;
+      if (bases[i].transfer)
+        result += ((size_t) bases[i].transfer->rows) * bases[i].transfer->cols;
+    }
+  }
+  for (size_t i = 0; i < couplings_.size(); i++)
+    result += ((size_t) couplings_[i].s->rows) * couplings_[i].s->cols;
+  for (size_t i = 0; i < dense_.size(); i++)
+    result += ((size_t) dense_[i].m->rows) * dense_[i].m->cols;
+  return result;
+}
+
+template<typename T> int H2Matrix<T>::maxRank() const {
+  int result = 0;
+  for (size_t i = 0; i < rowBases_.size(); i++)
+    result = std::max(result, rowBases_[i].rank);
+  for (size_t i = 0; i < colBases_.size(); i++)
+    result = std::max(result, colBases_[i].rank);
+  return result;
+}
+
+// Templates declaration
+template class H2Matrix<S_t>;
+template class H2Matrix<D_t>;
+template class H2Matrix<C_t>;
+template class H2Matrix<Z_t>;
+
+}  // end namespace hmat
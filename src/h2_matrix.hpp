@@ -0,0 +1,128 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief H2-matrices, with nested cluster bases.
+*/
+#ifndef _H2_MATRIX_HPP
+#define _H2_MATRIX_HPP
+
+#include <vector>
+#include <cstddef>
+#include "data_types.hpp"
+
+namespace hmat {
+
+template<typename T> class FullMatrix;
+template<typename T> class HMatrix;
+template<typename T> class H2Builder;
+
+/*! \brief Matrix whose compressed blocks share nested cluster bases.
+
+  An admissible block (t, s) is V_t S_ts W_s^T, where V_t and W_s are the
+  bases of the row cluster t and of the column cluster s, and S_ts is a small
+  coupling matrix. The bases are nested: the basis of a cluster t with
+  children t1 and t2 is [V_t1 E_t1; V_t2 E_t2], so only the bases of the
+  leaves and the transfer matrices E_ti are stored. The memory and the cost
+  of gemv() are O(n k) instead of O(n log(n) k) for an HMatrix. The other
+  blocks are kept as full matrices.
+
+  It is only used through its products with vectors, in iterative methods,
+  see HMatInterface::convertToH2().
+ */
+template<typename T> class H2Matrix {
+public:
+  /*! \brief Convert an assembled HMatrix.
+
+    The basis of a row cluster t approximates the rows of t of the Rk blocks
+    of t and of its ancestors, each one weighted by the R factor of the QR
+    decomposition of its other factor, so that the basis is truncated
+    according to the error on the blocks. The bases are computed bottom-up
+    from the projections of the blocks onto the bases of the children, and
+    the column bases likewise.
+
+    \param h an assembled and not factorized HMatrix. It can be deleted afterwards.
+    \param epsilon the truncation tolerance of the bases, see RkApproximationControl::findK()
+   */
+  H2Matrix(const HMatrix<T>* h, double epsilon);
+  ~H2Matrix();
+
+  /*! \brief y <- alpha * op(this) * x + beta * y
+
+    \param trans 'N' for op(M) = M, 'T' for op(M) = M^T
+   */
+  void gemv(char trans, T alpha, const FullMatrix<T>* x, T beta, FullMatrix<T>* y) const;
+
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+  /*! \brief Number of terms stored in the bases, transfer, coupling and full matrices. */
+  size_t storedSize() const;
+  /*! \brief Largest rank of the cluster bases. */
+  int maxRank() const;
+
+private:
+  template<typename> friend class H2Builder;
+
+  /// Basis of a cluster
+  struct Basis {
+    int offset;   ///< First index, relative to the matrix
+    int size;
+    int rank;
+    FullMatrix<T>* leafBasis;      ///< size x rank for the leaves, NULL otherwise
+    FullMatrix<T>* transfer;       ///< rank x parent rank, NULL for the root or a null rank
+    std::vector<int> children;     ///< Indices of the children bases
+    Basis(int o, int s) : offset(o), size(s), rank(0), leafBasis(NULL), transfer(NULL) {}
+  };
+  /// Admissible block V_t S W_s^T
+  struct Coupling {
+    int rowBasis;
+    int colBasis;
+    FullMatrix<T>* s;
+  };
+  /// Non admissible block
+  struct Dense {
+    int rowOffset;
+    int colOffset;
+    FullMatrix<T>* m;
+  };
+
+  /** xHat[i] <- V_i^T x for the bases of the subtree of i, bottom-up */
+  void forward(const std::vector<Basis>& bases, int i, const FullMatrix<T>* x,
+               std::vector<FullMatrix<T>*>& xHat) const;
+  /** y += alpha * V_i yHat[i] for the bases of the subtree of i, top-down */
+  void backward(const std::vector<Basis>& bases, int i, T alpha, FullMatrix<T>* y,
+                std::vector<FullMatrix<T>*>& yHat) const;
+
+  int rows_;
+  int cols_;
+  std::vector<Basis> rowBases_;
+  std::vector<Basis> colBases_;
+  std::vector<Coupling> couplings_;
+  std::vector<Dense> dense_;
+
+  H2Matrix(const H2Matrix&);
+  void operator=(const H2Matrix&);
+};
+
+}  // end namespace hmat
+#endif
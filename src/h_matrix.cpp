@@ -28,16 +28,21 @@
 */
 #include <algorithm>
 #include <list>
+#include <functional>
 #include <vector>
 #include <cstring>
+#include <cmath>
 
 #include "h_matrix.hpp"
 #include "cluster_tree.hpp"
 #include "rk_matrix.hpp"
 #include "data_types.hpp"
 #include "compression.hpp"
+#include "low_precision_block.hpp"
+#include "fromdouble.hpp"
 #include "postscript.hpp"
 #include "recursion.hpp"
+#include "task_pool.hpp"
 #include "common/context.hpp"
 #include "common/my_assert.h"
 
@@ -47,11 +52,16 @@ namespace hmat {
 
 // The default values below will be overwritten in default_engine.cpp by HMatSettings values
 template<typename T> bool HMatrix<T>::coarsening = false;
+template<typename T> double HMatrix<T>::coarseningThreshold = 1.;
 template<typename T> bool HMatrix<T>::recompress = false;
 template<typename T> bool HMatrix<T>::validateCompression = false;
 template<typename T> bool HMatrix<T>::validationReRun = false;
 template<typename T> bool HMatrix<T>::validationDump = false;
 template<typename T> double HMatrix<T>::validationErrorThreshold = 0;
+template<typename T> int HMatrix<T>::validationSamples = 0;
+template<typename T> bool HMatrix<T>::lowPrecisionStorage = false;
+template<typename T> bool HMatrix<T>::accumulateRkUpdates = false;
+template<typename T> int HMatrix<T>::maxParallelLeaves = 5000;
 
 template<typename T> HMatrix<T>::~HMatrix() {
   if (isRkMatrix() && rk_) {
@@ -62,9 +72,13 @@ template<typename T> HMatrix<T>::~HMatrix() {
     delete full_;
     full_ = NULL;
   }
+  delete packed_;
+  delete localSettings.pivots;
   if(ownClusterTree_) {
       delete rows_;
-      delete cols_;
+      // rows and columns may share the same tree
+      if (cols_ != rows_)
+        delete cols_;
   }
 }
 
@@ -102,7 +116,7 @@ void restoreVectorOrder(FullMatrix<T>* v, int* indices) {
 template<typename T>
 HMatrix<T>::HMatrix(ClusterTree* _rows, ClusterTree* _cols, const hmat::MatrixSettings * settings,
                     SymmetryFlag symFlag, AdmissibilityCondition * admissibilityCondition)
-  : Tree<HMatrix<T> >(NULL), RecursionMatrix<T, HMatrix<T> >(), rows_(_rows), cols_(_cols), rk_(NULL), rank_(UNINITIALIZED_BLOCK),
+  : Tree<HMatrix<T> >(NULL), RecursionMatrix<T, HMatrix<T> >(), rows_(_rows), cols_(_cols), rk_(NULL), rank_(UNINITIALIZED_BLOCK), packed_(NULL),
     isUpper(false), isLower(false),
     isTriUpper(false), isTriLower(false), rowsAdmissible(false), colsAdmissible(false), temporary(false), ownClusterTree_(false),
     localSettings(settings)
@@ -139,9 +153,9 @@ HMatrix<T>::HMatrix(ClusterTree* _rows, ClusterTree* _cols, const hmat::MatrixSe
 template<typename T>
 HMatrix<T>::HMatrix(const hmat::MatrixSettings * settings) :
     Tree<HMatrix<T> >(NULL), RecursionMatrix<T, HMatrix<T> >(), rows_(NULL), cols_(NULL),
-    rk_(NULL), rank_(UNINITIALIZED_BLOCK), isUpper(false), isLower(false),
-    rowsAdmissible(false), colsAdmissible(false), temporary(false), ownClusterTree_(false),
-    localSettings(settings)
+    rk_(NULL), rank_(UNINITIALIZED_BLOCK), packed_(NULL), isUpper(false), isLower(false),
+    rowsAdmissible(false), colsAdmissible(false), isCompressible(false), temporary(false),
+    ownClusterTree_(false), localSettings(settings)
     {}
 
 template<typename T> HMatrix<T> * HMatrix<T>::internalCopy(bool temporary, bool withChildren) const {
@@ -172,6 +186,46 @@ template<typename T> HMatrix<T> * HMatrix<T>::internalCopy(bool temporary, bool
     return r;
 }
 
+template<typename T>
+HMatrix<typename Types<T>::sp>* HMatrix<T>::singlePrecisionCopy() const {
+  typedef typename Types<T>::sp sp_t;
+  HMatrix<sp_t>* h = new HMatrix<sp_t>(localSettings.global);
+  h->rows_ = rows_;
+  h->cols_ = cols_;
+  h->isUpper = isUpper;
+  h->isLower = isLower;
+  h->isTriUpper = isTriUpper;
+  h->isTriLower = isTriLower;
+  h->rowsAdmissible = rowsAdmissible;
+  h->colsAdmissible = colsAdmissible;
+  h->isCompressible = isCompressible;
+  h->rank_ = rank_;
+  if (!this->isLeaf()) {
+    for (int i = 0; i < this->nrChild(); ++i) {
+      if (this->getChild(i)) {
+        h->insertChild(i, this->getChild(i)->singlePrecisionCopy());
+      }
+    }
+  } else if (packed_) {
+    // Already in single precision
+    if (packed_->isRk())
+      h->rk(packed_->copyRk());
+    else
+      h->full(packed_->copyFull());
+  } else if (isRkMatrix()) {
+    if (rank_ > 0)
+      h->rk(new RkMatrix<sp_t>(toSingleFull(rk_->a), &rows_->data, toSingleFull(rk_->b),
+                               &cols_->data, rk_->method));
+    else
+      h->rk(new RkMatrix<sp_t>(NULL, &rows_->data, NULL, &cols_->data, NoCompression));
+  } else if (isFullMatrix()) {
+    HMAT_ASSERT_MSG(full_->pivots == NULL && full_->diagonal == NULL,
+                    "A factorized matrix cannot be converted to single precision");
+    h->full(toSingleFull(full_));
+  }
+  return h;
+}
+
 template<typename T>
 HMatrix<T>* HMatrix<T>::copyStructure() const {
   HMatrix<T>* h = internalCopy();
@@ -181,6 +235,7 @@ HMatrix<T>* HMatrix<T>::copyStructure() const {
   h->isTriLower = isTriLower;
   h->rowsAdmissible = rowsAdmissible;
   h->colsAdmissible = colsAdmissible;
+  h->isCompressible = isCompressible;
   h->rank_ = rank_ >= 0 ? 0 : rank_;
   if(!this->isLeaf()){
     for (int i = 0; i < this->nrChild(); ++i) {
@@ -261,71 +316,186 @@ void HMatrix<T>::setClusterTrees(const ClusterTree* rows, const ClusterTree* col
     }
 }
 
+namespace {
+/** Assembly of a chunk of leaves, and of their transposes when the upper block is not NULL. */
+template<typename T> class AssembleLeavesTask : public Task {
+  Assembly<T>& f_;
+  const AllocationObserver& ao_;
+  std::vector<std::pair<HMatrix<T>*, HMatrix<T>*> > leaves_;
+public:
+  AssembleLeavesTask(Assembly<T>& f, const AllocationObserver& ao)
+    : f_(f), ao_(ao) {}
+  void add(HMatrix<T>* leaf, HMatrix<T>* upper) {
+    leaves_.push_back(std::make_pair(leaf, upper));
+  }
+  void run() {
+    for (size_t i = 0; i < leaves_.size(); i++)
+      leaves_[i].first->assembleLeaf(f_, ao_, leaves_[i].second);
+  }
+};
+
+/** Coarsening of a block, and of its transpose when the upper block is not NULL. */
+template<typename T> class CoarsenTask : public Task {
+  HMatrix<T>* m_;
+  HMatrix<T>* upper_;
+  size_t* saved_;
+public:
+  CoarsenTask(HMatrix<T>* m, HMatrix<T>* upper, size_t* saved)
+    : m_(m), upper_(upper), saved_(saved) {}
+  void run() {
+    const size_t saved = m_->coarsen(upper_);
+#pragma omp atomic
+    *saved_ += saved;
+  }
+};
+
+/** Order the leaves by decreasing assembly cost. */
+template<typename T> struct CostlierLeaf {
+  bool operator()(const std::pair<HMatrix<T>*, HMatrix<T>*>& a,
+                  const std::pair<HMatrix<T>*, HMatrix<T>*>& b) const {
+    return a.first->assemblyCost() > b.first->assemblyCost();
+  }
+};
+}  // end anonymous namespace
+
+template<typename T>
+double HMatrix<T>::assemblyCost() const {
+  const double m = rows()->size();
+  const double n = cols()->size();
+  if (!isCompressible || std::max(m, n) < RkMatrix<T>::approx.compressionMinLeafSize)
+    return m * n;
+  const CompressionMethod method = RkMatrix<T>::approx.method;
+  // These methods compute the whole block before compressing it
+  if (method == Svd || method == AcaFull)
+    return m * n;
+  // The rank is not known before the compression: use the fixed rank if any,
+  // otherwise the number of digits of the requested accuracy.
+  double k = RkMatrix<T>::approx.k;
+  if (k <= 0) {
+    const double epsilon = RkMatrix<T>::approx.assemblyEpsilon;
+    k = epsilon > 0 && epsilon < 1 ? 4 * ceil(-log10(epsilon)) : 1;
+  }
+  k = std::min(k, std::min(m, n));
+  // k rows and columns are computed, and each of them is updated by the
+  // previous pivots, which costs about as much as computing 1/8 of its terms.
+  return (m + n) * k * (1 + k / 8);
+}
+
+template<typename T>
+double HMatrix<T>::estimateAssemblyCost() const {
+  if (this->isLeaf())
+    return assemblyCost();
+  double result = 0;
+  for (int i = 0; i < this->nrChild(); i++) {
+    if (this->getChild(i))
+      result += this->getChild(i)->estimateAssemblyCost();
+  }
+  return result;
+}
+
 template<typename T>
-void HMatrix<T>::assemble(Assembly<T>& f, const AllocationObserver & ao) {
+void HMatrix<T>::listLeavesAssembly(std::vector<std::pair<HMatrix<T>*, HMatrix<T>*> >& leaves,
+                                    bool symmetric, HMatrix<T>* upper, bool onlyLower) {
+  if (symmetric && !onlyLower && !upper)
+    upper = this;
   if (this->isLeaf()) {
-    // If the leaf is admissible, matrix assembly and compression.
-    // if not we keep the matrix.
-    FullMatrix<T> * m = NULL;
-    RkMatrix<T>* assembledRk = NULL;
-    f.assemble(localSettings, *rows_, *cols_, isCompressible, m, assembledRk, ao);
-    HMAT_ASSERT(m == NULL || assembledRk == NULL);
-    if(assembledRk) {
-        if(rk_)
-            delete rk_;
-        rk(assembledRk);
-    } else {
-        if(full_)
-            delete full_;
-        full(m);
-    }
-  } else {
-    full_ = NULL;
-    rk_ = NULL;
+    leaves.push_back(std::make_pair(this, upper == this ? (HMatrix<T>*) NULL : upper));
+    return;
+  }
+  full_ = NULL;
+  rk_ = NULL;
+  if (!symmetric) {
     for (int i = 0; i < this->nrChild(); i++) {
       if (this->getChild(i))
-        this->getChild(i)->assemble(f, ao);
+        this->getChild(i)->listLeavesAssembly(leaves, false, NULL, false);
+    }
+  } else if (onlyLower) {
+    for (int i = 0; i < nrChildRow(); i++) {
+      for (int j = 0; j < nrChildCol(); j++) {
+        if ((*rows() == *cols()) && (j > i)) {
+          continue;
+        }
+        get(i,j)->listLeavesAssembly(leaves, true, NULL, true);
+      }
+    }
+  } else if (this == upper) {
+    for (int i = 0; i < nrChildRow(); i++) {
+      for (int j = 0; j <= i; j++) {
+        HMatrix<T> *child = get(i, j);
+        HMatrix<T> *upperChild = get(j, i);
+        assert(child != NULL);
+        child->listLeavesAssembly(leaves, true, upperChild, false);
+      }
+    }
+  } else {
+    assert(*this->rows() == *upper->cols());
+    assert(*this->cols() == *upper->rows());
+    for (int i = 0; i < nrChildRow(); i++) {
+      for (int j = 0; j < nrChildCol(); j++) {
+        HMatrix<T> *child = get(i, j);
+        HMatrix<T> *upperChild = upper->get(j, i);
+        child->listLeavesAssembly(leaves, true, upperChild, false);
+      }
     }
-    assembledRecurse();
-    if (coarsening)
-      coarsen();
   }
 }
 
+/* With several threads, the leaves are dealt to at most maxParallelLeaves
+   tasks: each leaf, the most expensive first, goes to the task with the
+   lowest estimated cost so far. */
 template<typename T>
-void HMatrix<T>::assembleSymmetric(Assembly<T>& f,
-   HMatrix<T>* upper, bool onlyLower, const AllocationObserver & ao) {
-  if (!onlyLower) {
-    if (!upper){
-      upper = this;
-    }
-    assert(*this->rows() == *upper->cols());
-    assert(*this->cols() == *upper->rows());
+void HMatrix<T>::submitLeavesAssembly(TaskPool& pool, Assembly<T>& f, const AllocationObserver & ao,
+                                      bool symmetric, HMatrix<T>* upper, bool onlyLower) {
+  std::vector<std::pair<HMatrix<T>*, HMatrix<T>*> > leaves;
+  listLeavesAssembly(leaves, symmetric, upper, onlyLower);
+  if (leaves.empty())
+    return;
+  if (pool.nbThreads() <= 1) {
+    AssembleLeavesTask<T>* task = new AssembleLeavesTask<T>(f, ao);
+    for (size_t i = 0; i < leaves.size(); i++)
+      task->add(leaves[i].first, leaves[i].second);
+    pool.submit(task);
+    return;
+  }
+  std::stable_sort(leaves.begin(), leaves.end(), CostlierLeaf<T>());
+  size_t nbTasks = leaves.size();
+  if (maxParallelLeaves > 0)
+    nbTasks = std::min(nbTasks, (size_t) maxParallelLeaves);
+  std::vector<AssembleLeavesTask<T>*> tasks(nbTasks);
+  std::vector<double> costs(nbTasks, 0.);
+  // Min-heap of the (cost, index) of the tasks
+  std::vector<std::pair<double, size_t> > heap;
+  for (size_t i = 0; i < nbTasks; i++) {
+    tasks[i] = new AssembleLeavesTask<T>(f, ao);
+    heap.push_back(std::make_pair(0., i));
+  }
+  std::greater<std::pair<double, size_t> > cheaper;
+  for (size_t i = 0; i < leaves.size(); i++) {
+    std::pop_heap(heap.begin(), heap.end(), cheaper);
+    const size_t t = heap.back().second;
+    tasks[t]->add(leaves[i].first, leaves[i].second);
+    costs[t] += leaves[i].first->assemblyCost();
+    heap.back().first = costs[t];
+    std::push_heap(heap.begin(), heap.end(), cheaper);
+  }
+  for (size_t i = 0; i < nbTasks; i++) {
+    tasks[i]->setPriority(costs[i]);
+    pool.submit(tasks[i]);
   }
+}
 
-  if (this->isLeaf()) {
-    // If the leaf is admissible, matrix assembly and compression.
-    // if not we keep the matrix.
-    this->assemble(f, ao);
-    if (isRkMatrix()) {
-      if ((!onlyLower) && (upper != this)) {
-        // Admissible leaf: a matrix represented by AB^t is transposed by exchanging A and B.
-        RkMatrix<T>* newRk = new RkMatrix<T>(NULL, upper->rows(),
-                                          NULL, upper->cols(), rk()->method);
-        newRk->a = rk()->b ? rk()->b->copy() : NULL;
-        newRk->b = rk()->a ? rk()->a->copy() : NULL;
-        if(upper->rk() != NULL)
-            delete upper->rk();
-        upper->rk(newRk);
-      }
-    } else {
-      if ((!onlyLower) && ( upper != this)) {
-        if(isFullMatrix())
-            upper->full(full()->copyAndTranspose());
-        else
-            upper->full(NULL);
-      }
+template<typename T>
+void HMatrix<T>::assembledLeaves(bool symmetric, HMatrix<T>* upper, bool onlyLower) {
+  if (this->isLeaf())
+    return;
+  if (symmetric && !onlyLower && !upper)
+    upper = this;
+  if (!symmetric) {
+    for (int i = 0; i < this->nrChild(); i++) {
+      if (this->getChild(i))
+        this->getChild(i)->assembledLeaves(false, NULL, false);
     }
+    assembledRecurse();
   } else {
     if (onlyLower) {
       for (int i = 0; i < nrChildRow(); i++) {
@@ -333,44 +503,186 @@ void HMatrix<T>::assembleSymmetric(Assembly<T>& f,
           if ((*rows() == *cols()) && (j > i)) {
             continue;
           }
-          get(i,j)->assembleSymmetric(f, NULL, true, ao);
+          get(i,j)->assembledLeaves(true, NULL, true);
         }
       }
-    } else {
-      if (this == upper) {
-        for (int i = 0; i < nrChildRow(); i++) {
-          for (int j = 0; j <= i; j++) {
-            HMatrix<T> *child = get(i, j);
-            HMatrix<T> *upperChild = get(j, i);
-            assert(child != NULL);
-            child->assembleSymmetric(f, upperChild, false, ao);
-          }
+    } else if (this == upper) {
+      for (int i = 0; i < nrChildRow(); i++) {
+        for (int j = 0; j <= i; j++) {
+          get(i, j)->assembledLeaves(true, get(j, i), false);
         }
-      } else {
-        for (int i = 0; i < nrChildRow(); i++) {
-          for (int j = 0; j < nrChildCol(); j++) {
-            HMatrix<T> *child = get(i, j);
-            HMatrix<T> *upperChild = upper->get(j, i);
-            child->assembleSymmetric(f, upperChild, false, ao);
-          }
+      }
+    } else {
+      for (int i = 0; i < nrChildRow(); i++) {
+        for (int j = 0; j < nrChildCol(); j++) {
+          get(i, j)->assembledLeaves(true, upper->get(j, i), false);
         }
-        upper->assembledRecurse();
-        if (coarsening)
-          coarsen(upper);
       }
+      upper->assembledRecurse();
     }
     assembledRecurse();
   }
 }
 
+/* The coarsening of a block waits for the one of its children, so that the
+   merges propagate up the tree, and independent subtrees are coarsened in
+   parallel. A block with a full or a missing child can never become an Rk
+   leaf, so no task is submitted for it nor for its ancestors. */
+template<typename T>
+bool HMatrix<T>::submitCoarsening(TaskPool& pool, bool symmetric, HMatrix<T>* upper,
+                                  bool onlyLower, size_t* saved) {
+  if (this->isLeaf())
+    return isRkMatrix();
+  if (symmetric && !onlyLower && !upper)
+    upper = this;
+  bool mergeable = true;
+  std::vector<const void*> reads, writes;
+  if (!symmetric) {
+    for (int i = 0; i < this->nrChild(); i++) {
+      HMatrix<T>* child = this->getChild(i);
+      mergeable = child && child->submitCoarsening(pool, false, NULL, false, saved) && mergeable;
+      reads.push_back(child);
+    }
+  } else if (onlyLower) {
+    const bool diagonal = *rows() == *cols();
+    for (int i = 0; i < nrChildRow(); i++) {
+      for (int j = 0; j < nrChildCol(); j++) {
+        if (diagonal && j > i)
+          continue;
+        HMatrix<T>* child = get(i, j);
+        mergeable = child && child->submitCoarsening(pool, true, NULL, true, saved) && mergeable;
+        reads.push_back(child);
+      }
+    }
+    // The upper part of a diagonal block is not assembled
+    mergeable = mergeable && !diagonal;
+  } else if (this == upper) {
+    for (int i = 0; i < nrChildRow(); i++) {
+      for (int j = 0; j <= i; j++) {
+        get(i, j)->submitCoarsening(pool, true, get(j, i), false, saved);
+      }
+    }
+    // The diagonal leaves are full blocks
+    mergeable = false;
+  } else {
+    for (int i = 0; i < nrChildRow(); i++) {
+      for (int j = 0; j < nrChildCol(); j++) {
+        HMatrix<T>* child = get(i, j);
+        mergeable = child && child->submitCoarsening(pool, true, upper->get(j, i), false, saved) && mergeable;
+        reads.push_back(child);
+        reads.push_back(upper->get(j, i));
+      }
+    }
+    writes.push_back(upper);
+  }
+  if (!mergeable)
+    return false;
+  writes.push_back(this);
+  pool.submit(new CoarsenTask<T>(this, symmetric && !onlyLower ? upper : NULL, saved), reads, writes);
+  return true;
+}
+
+template<typename T>
+void HMatrix<T>::assembleLeaf(Assembly<T>& f, const AllocationObserver & ao, HMatrix<T>* upper) {
+  DECLARE_CONTEXT;
+  tracing_block_size(rows()->size(), cols()->size());
+  assert(this->isLeaf());
+  // If the leaf is admissible, matrix assembly and compression.
+  // if not we keep the matrix.
+  FullMatrix<T> * m = NULL;
+  RkMatrix<T>* assembledRk = NULL;
+  // The pivots of the ACA compressions are kept for the next assembly from
+  // the first reassembly of the leaf on, a matrix assembled once has none
+  const CompressionMethod method = RkMatrix<T>::approx.method;
+  if (isCompressible && !localSettings.pivots && isAssembled()
+      && (method == AcaPartial || method == AcaPlus || method == AcaBlocked))
+    localSettings.pivots = new AcaPivots();
+  f.assemble(localSettings, *rows_, *cols_, isCompressible, m, assembledRk, ao);
+  HMAT_ASSERT(m == NULL || assembledRk == NULL);
+  if(assembledRk) {
+      if(rk_)
+          delete rk_;
+      rk(assembledRk);
+  } else {
+      if(full_)
+          delete full_;
+      full(m);
+  }
+  if (upper == NULL || upper == this)
+    return;
+  assert(*this->rows() == *upper->cols());
+  assert(*this->cols() == *upper->rows());
+  if (isRkMatrix()) {
+    // Admissible leaf: a matrix represented by AB^t is transposed by exchanging A and B.
+    RkMatrix<T>* newRk = new RkMatrix<T>(NULL, upper->rows(),
+                                      NULL, upper->cols(), rk()->method);
+    newRk->a = rk()->b ? rk()->b->copy() : NULL;
+    newRk->b = rk()->a ? rk()->a->copy() : NULL;
+    if(upper->rk() != NULL)
+        delete upper->rk();
+    upper->rk(newRk);
+  } else {
+    if(isFullMatrix())
+        upper->full(full()->copyAndTranspose());
+    else
+        upper->full(NULL);
+  }
+}
+
+/* The leaves are independent: they are first all assembled, possibly in
+   parallel by balanced chunks and the most expensive first, then the upper
+   levels are tagged as assembled, and coarsened bottom-up by a second pass
+   with the same threads. With a single thread, leaves are assembled in the
+   order of the recursive traversal. */
+template<typename T>
+size_t HMatrix<T>::assemble(Assembly<T>& f, const AllocationObserver & ao, int nbThreads) {
+  DECLARE_CONTEXT;
+  TaskPool pool(nbThreads);
+  submitLeavesAssembly(pool, f, ao, false, NULL, false);
+  pool.run();
+  assembledLeaves(false, NULL, false);
+  size_t saved = 0;
+  if (coarsening) {
+    submitCoarsening(pool, false, NULL, false, &saved);
+    pool.run();
+  }
+  return saved;
+}
+
+template<typename T>
+size_t HMatrix<T>::assembleSymmetric(Assembly<T>& f,
+   HMatrix<T>* upper, bool onlyLower, const AllocationObserver & ao, int nbThreads) {
+  DECLARE_CONTEXT;
+  if (!onlyLower) {
+    if (!upper){
+      upper = this;
+    }
+    assert(*this->rows() == *upper->cols());
+    assert(*this->cols() == *upper->rows());
+  }
+  TaskPool pool(nbThreads);
+  submitLeavesAssembly(pool, f, ao, true, upper, onlyLower);
+  pool.run();
+  assembledLeaves(true, upper, onlyLower);
+  size_t saved = 0;
+  if (coarsening) {
+    submitCoarsening(pool, true, upper, onlyLower, &saved);
+    pool.run();
+  }
+  return saved;
+}
+
 template<typename T> void HMatrix<T>::info(hmat_info_t & result) {
     result.nr_block_clusters++;
     if(this->isLeaf()) {
+        result.assembly_cost += assemblyCost();
         size_t s = ((size_t)rows()->size()) * cols()->size();
         result.uncompressed_size += s;
         if(isRkMatrix()) {
             size_t mem = rank() * (((size_t)rows()->size()) + cols()->size());
             result.compressed_size += mem;
+            if (packed_)
+              result.low_precision_size += mem;
             int dim = result.largest_rk_dim_cols + result.largest_rk_dim_rows;
             if(rows()->size() + cols()->size() > dim) {
                 result.largest_rk_dim_cols = cols()->size();
@@ -386,7 +698,10 @@ template<typename T> void HMatrix<T>::info(hmat_info_t & result) {
             result.rk_count++;
             result.rk_size += s;
         } else {
-          if (isFullMatrix()) {
+          if (packed_) {
+            result.full_zeros += packed_->storedZeros();
+            result.low_precision_size += s;
+          } else if (isFullMatrix()) {
             result.full_zeros += full()->storedZeros();
           }
             result.compressed_size += s;
@@ -402,6 +717,95 @@ template<typename T> void HMatrix<T>::info(hmat_info_t & result) {
     }
 }
 
+template<typename T> void HMatrix<T>::compact() {
+  // Nothing to gain for the single precision types
+  if (sizeof(typename Types<T>::sp) == sizeof(T))
+    return;
+  compactRecurse(std::min(RkMatrix<T>::approx.assemblyEpsilon, RkMatrix<T>::approx.recompressionEpsilon));
+}
+
+template<typename T> void HMatrix<T>::flushUpdates() {
+  if (!this->isLeaf()) {
+    for (int i = 0; i < this->nrChild(); i++) {
+      HMatrix<T> *child = this->getChild(i);
+      if (child)
+        child->flushUpdates();
+    }
+  } else if (isRkMatrix() && rk_ && rk_->pendingRank() > 0) {
+    rk_->flush();
+    rank_ = rk_->rank();
+  }
+}
+
+template<typename T> void HMatrix<T>::compactRecurse(double epsilon) {
+  if (!this->isLeaf()) {
+    for (int i = 0; i < this->nrChild(); i++) {
+      HMatrix<T> *child = this->getChild(i);
+      if (child)
+        child->compactRecurse(epsilon);
+    }
+    return;
+  }
+  if (packed_ != NULL || !isAssembled() || isNull())
+    return;
+  if (isRkMatrix()) {
+    // The pending updates would be lost
+    if (rk_->pendingRank() > 0)
+      return;
+    if (LowPrecisionBlock<T>::isAccurate(rk_, epsilon)) {
+      packed_ = new LowPrecisionBlock<T>(rk_);
+      delete rk_;
+      rk_ = NULL;
+    }
+  } else if (isCompressible && full_->diagonal == NULL && full_->pivots == NULL
+             && !full_->isTriUpper() && !full_->isTriLower()
+             && LowPrecisionBlock<T>::isAccurate(full_, epsilon)) {
+    // Admissible block which was not compressed
+    packed_ = new LowPrecisionBlock<T>(full_);
+    delete full_;
+    full_ = NULL;
+  }
+}
+
+template<typename T> void HMatrix<T>::unpackImpl() const {
+  HMatrix<T>* me = const_cast<HMatrix<T>*>(this);
+  // Leaves which are only read, like in a solve, may be accessed by several threads
+#pragma omp critical (hmat_unpack)
+  {
+    LowPrecisionBlock<T>* p = packed_;
+    if (p != NULL) {
+      if (p->isRk())
+        me->rk_ = p->unpackRk();
+      else
+        me->full_ = p->unpackFull();
+      // Release rk_ or full_, see packedAcquire()
+#pragma omp flush
+#pragma omp atomic write
+      me->packed_ = NULL;
+      delete p;
+    }
+  }
+}
+
+template<typename T> const RkMatrix<T>* HMatrix<T>::readRk(RkMatrix<T>*& tmp) const {
+  assert(rank_ >= 0);
+  const LowPrecisionBlock<T>* p = packedAcquire();
+  tmp = p == NULL ? NULL : p->unpackRk();
+  return p == NULL ? rk_ : tmp;
+}
+
+template<typename T> const FullMatrix<T>* HMatrix<T>::readFull(FullMatrix<T>*& tmp) const {
+  assert(rank_ == FULL_BLOCK);
+  const LowPrecisionBlock<T>* p = packedAcquire();
+  tmp = p == NULL ? NULL : p->unpackFull();
+  return p == NULL ? full_ : tmp;
+}
+
+template<typename T> void HMatrix<T>::dropPacked() {
+  delete packed_;
+  packed_ = NULL;
+}
+
 template<typename T>
 void HMatrix<T>::eval(FullMatrix<T>* result, bool renumber) const {
   if (this->isLeaf()) {
@@ -504,53 +908,514 @@ void HMatrix<T>::scale(T alpha) {
 }
 
 template<typename T>
-void HMatrix<T>::coarsen(HMatrix<T>* upper) {
+size_t HMatrix<T>::coarsen(HMatrix<T>* upper) {
   // If all children are Rk leaves, then we try to merge them into a single Rk-leaf.
-  // This is done if the memory of the resulting leaf is less than the sum of the initial
-  // leaves. Note that this operation could be used hierarchically.
-
-  bool allRkLeaves = true;
-  const RkMatrix<T>* childrenArray[this->nrChild()];
+  // This is done if the memory of the resulting leaf is less than coarseningThreshold
+  // times the sum of the initial leaves.
+  if (this->isLeaf())
+    return 0;
+  std::vector<const RkMatrix<T>*> childrenArray;
   size_t childrenElements = 0;
+  int maxRank = 0;
   for (int i = 0; i < this->nrChild(); i++) {
     HMatrix<T> *child = this->getChild(i);
-    if (!child->isRkMatrix()) {
-      allRkLeaves = false;
-      break;
+    if (!child || !child->isLeaf() || !child->isRkMatrix())
+      return 0;
+    if (child->rank() > 0)
+      childrenArray.push_back(child->rk());
+    childrenElements += (((size_t) child->rows()->size()) + child->cols()->size()) * child->rank();
+    maxRank = std::max(maxRank, child->rank());
+  }
+  const size_t dimensions = ((size_t) rows()->size()) + cols()->size();
+  RkMatrix<T>* candidate;
+  if (childrenElements == 0) {
+    // Null children: a single null leaf saves the leaves visits
+    candidate = new RkMatrix<T>(NULL, rows(), NULL, cols(), NoCompression);
+  } else {
+    // The rank of the merged leaf is at least the one of each child, skip the
+    // recompression when this is already too large.
+    const double budget = std::min(coarseningThreshold * childrenElements, childrenElements - 1.);
+    if (dimensions * maxRank > budget)
+      return 0;
+    std::vector<T> alpha(childrenArray.size(), Constants<T>::pone);
+    RkMatrix<T> dummy(NULL, rows(), NULL, cols(), NoCompression);
+    candidate = dummy.formattedAddParts(&alpha[0], &childrenArray[0], childrenArray.size());
+    if (dimensions * candidate->rank() > budget) {
+      delete candidate;
+      return 0;
+    }
+  }
+  const size_t elements = dimensions * candidate->rank();
+  // Replace 'this' by the new Rk matrix
+  for (int i = 0; i < this->nrChild(); i++)
+    this->removeChild(i);
+  this->children.clear();
+  rk(candidate);
+  // The next assemblies compress this block as a whole
+  isCompressible = true;
+  assert(this->isLeaf());
+  assert(isRkMatrix());
+  if (!upper || upper == this)
+    return childrenElements - elements;
+  // Replace 'upper' by the new Rk matrix transposed (exchange a and b)
+  for (int i = 0; i < upper->nrChild(); i++)
+    upper->removeChild(i);
+  upper->children.clear();
+  upper->rk(new RkMatrix<T>(candidate->b ? candidate->b->copy() : NULL, upper->rows(),
+                            candidate->a ? candidate->a->copy() : NULL, upper->cols(), candidate->method));
+  upper->isCompressible = true;
+  assert(upper->isLeaf());
+  assert(upper->isRkMatrix());
+  return 2 * (childrenElements - elements);
+}
+
+namespace {
+/** Cost of the product of a leaf with a vector */
+template<typename T> double gemvCost(const HMatrix<T>* leaf) {
+  const double m = leaf->rows()->size();
+  const double n = leaf->cols()->size();
+  return leaf->isRkMatrix() ? (m + n) * leaf->rank() : m * n;
+}
+
+/** True for an Rk leaf A B^t with a non null rank, packed or not. */
+template<typename T> bool isRkLeaf(const HMatrix<T>* leaf) {
+  return leaf->packed() ? leaf->packed()->isRk() : leaf->isRkMatrix() && leaf->rank() > 0;
+}
+
+/* z <- z + B^t x for trans = 'N', or A^t x for 'T', for an Rk leaf A B^t */
+template<typename T>
+void rkLeafProject(const HMatrix<T>* leaf, char trans, const FullMatrix<T>* x, FullMatrix<T>* z) {
+  if (leaf->packed()) {
+    leaf->packed()->gemvProject(trans, x, z);
+  } else {
+    const FullMatrix<T>* right = trans == 'N' ? leaf->rk()->b : leaf->rk()->a;
+    z->gemm('T', 'N', Constants<T>::pone, right, x, Constants<T>::pone);
+  }
+}
+
+/* y <- y + alpha * op(leaf) * x, restricted to the rows [start, start + size) of y
+
+   For an Rk leaf, z = B^t x (or A^t x) may be given when it is already computed.
+ */
+template<typename T>
+void leafGemvPart(const HMatrix<T>* leaf, char trans, T alpha, const FullMatrix<T>* x,
+                  FullMatrix<T>* y, int start, int size, const FullMatrix<T>* z = NULL) {
+  FullMatrix<T> subY(y->m + start, size, y->cols, y->lda);
+  if (leaf->packed() && z) {
+    leaf->packed()->gemvExpand(trans, alpha, z, &subY, start);
+  } else if (leaf->packed()) {
+    leaf->packed()->gemv(trans, alpha, x, &subY, start);
+  } else if (leaf->isFullMatrix()) {
+    const FullMatrix<T>* f = leaf->full();
+    if (trans == 'N') {
+      FullMatrix<T> subF(f->m + start, size, f->cols, f->lda);
+      subY.gemm('N', 'N', alpha, &subF, x, Constants<T>::pone);
     } else {
-      childrenArray[i] = child->rk();
-      childrenElements += (childrenArray[i]->rows->size()
-                           + childrenArray[i]->cols->size()) * childrenArray[i]->rank();
+      FullMatrix<T> subF(f->m + ((size_t) start) * f->lda, f->rows, size, f->lda);
+      subY.gemm('T', 'N', alpha, &subF, x, Constants<T>::pone);
+    }
+  } else if (leaf->rank() > 0) {
+    // op(AB^t) x = A (B^t x), or B (A^t x), with only a part of the rows of A or B
+    const FullMatrix<T>* left = trans == 'N' ? leaf->rk()->a : leaf->rk()->b;
+    FullMatrix<T>* ownZ = NULL;
+    if (!z) {
+      ownZ = new FullMatrix<T>(leaf->rank(), x->cols);
+      rkLeafProject(leaf, trans, x, ownZ);
+      z = ownZ;
+    }
+    FullMatrix<T> subLeft(left->m + start, size, left->cols, left->lda);
+    subY.gemm('N', 'N', alpha, &subLeft, z, Constants<T>::pone);
+    delete ownZ;
+  }
+}
+
+/** z <- B^t x for an Rk leaf A B^t shared by several GemvRowsTask. */
+template<typename T> class GemvProjectTask : public Task {
+  const HMatrix<T>* leaf_;
+  FullMatrix<T> x_;
+  FullMatrix<T>* z_;
+public:
+  GemvProjectTask(const HMatrix<T>* leaf, int xBase, const FullMatrix<T>* x, FullMatrix<T>* z)
+    : leaf_(leaf), x_(x->m + leaf->cols()->offset() - xBase, leaf->cols()->size(), x->cols, x->lda),
+      z_(z) {}
+  void run() {
+    rkLeafProject(leaf_, 'N', &x_, z_);
+  }
+};
+
+/** Part of op(this) x in a set of consecutive rows of y, written by this task only. */
+template<typename T> class GemvRowsTask : public Task {
+  const std::vector<std::pair<const HMatrix<T>*, char> >& leaves_;
+  /// B^t x for the Rk leaves shared with other tasks, NULL for the other leaves
+  const std::vector<FullMatrix<T>*>& projections_;
+  int start_, size_;
+  int xBase_, yBase_;
+  T alpha_;
+  const FullMatrix<T>* x_;
+  FullMatrix<T>* y_;
+public:
+  /// Indices in leaves_ of the leaves writing rows of this task
+  std::vector<int> leafIndices;
+  GemvRowsTask(const std::vector<std::pair<const HMatrix<T>*, char> >& leaves,
+               const std::vector<FullMatrix<T>*>& projections,
+               int start, int size, int xBase, int yBase, T alpha,
+               const FullMatrix<T>* x, FullMatrix<T>* y)
+    : leaves_(leaves), projections_(projections), start_(start), size_(size), xBase_(xBase), yBase_(yBase),
+      alpha_(alpha), x_(x), y_(y) {}
+  void run() {
+    for (size_t i = 0; i < leafIndices.size(); i++) {
+      const HMatrix<T>* leaf = leaves_[leafIndices[i]].first;
+      const int xOffset = leaf->cols()->offset() - xBase_;
+      const int yOffset = leaf->rows()->offset() - yBase_;
+      const int begin = std::max(start_, yOffset);
+      const int end = std::min(start_ + size_, yOffset + leaf->rows()->size());
+      FullMatrix<T> subX(x_->m + xOffset, leaf->cols()->size(), x_->cols, x_->lda);
+      FullMatrix<T> subY(y_->m + yOffset, leaf->rows()->size(), y_->cols, y_->lda);
+      leafGemvPart(leaf, 'N', alpha_, &subX, &subY, begin - yOffset, end - begin,
+                   projections_[leafIndices[i]]);
+    }
+  }
+};
+
+/** Product of a leaf, added to the private copy of y of the current thread. */
+template<typename T> class GemvLeafTask : public Task {
+  const HMatrix<T>* leaf_;
+  char trans_;
+  int xBase_, yBase_;
+  T alpha_;
+  const FullMatrix<T>* x_;
+  const std::vector<FullMatrix<T>*>& buffers_;
+public:
+  GemvLeafTask(const HMatrix<T>* leaf, char trans, int xBase, int yBase, T alpha,
+               const FullMatrix<T>* x, const std::vector<FullMatrix<T>*>& buffers)
+    : leaf_(leaf), trans_(trans), xBase_(xBase), yBase_(yBase), alpha_(alpha),
+      x_(x), buffers_(buffers) {}
+  void run() {
+    // The modulo only matters when the pool runs sequentially inside a parallel region
+    FullMatrix<T>* y = buffers_[TaskPool::workerIndex() % buffers_.size()];
+    const ClusterData* xData = trans_ == 'N' ? leaf_->cols() : leaf_->rows();
+    const ClusterData* yData = trans_ == 'N' ? leaf_->rows() : leaf_->cols();
+    FullMatrix<T> subX(x_->m + xData->offset() - xBase_, xData->size(), x_->cols, x_->lda);
+    FullMatrix<T> subY(y->m + yData->offset() - yBase_, yData->size(), y->cols, y->lda);
+    leafGemvPart(leaf_, trans_, alpha_, &subX, &subY, 0, yData->size());
+  }
+};
+
+/** y <- y + sum of the private copies, on a set of consecutive rows. */
+template<typename T> class GemvReduceTask : public Task {
+  const std::vector<FullMatrix<T>*>& buffers_;
+  int start_, size_;
+  FullMatrix<T>* y_;
+public:
+  GemvReduceTask(const std::vector<FullMatrix<T>*>& buffers, int start, int size, FullMatrix<T>* y)
+    : buffers_(buffers), start_(start), size_(size), y_(y) {}
+  void run() {
+    FullMatrix<T> subY(y_->m + start_, size_, y_->cols, y_->lda);
+    for (size_t i = 0; i < buffers_.size(); i++) {
+      FullMatrix<T> subB(buffers_[i]->m + start_, size_, y_->cols, buffers_[i]->lda);
+      subY.axpy(Constants<T>::pone, &subB);
+    }
+  }
+};
+
+/** Solve of a panel of right-hand sides. */
+template<typename T> class SolvePanelTask : public Task {
+  const HMatrix<T>* m_;
+  hmat_factorization_t t_;
+  FullMatrix<T> panel_;
+public:
+  SolvePanelTask(const HMatrix<T>* m, hmat_factorization_t t, const FullMatrix<T>* b, int start, int size)
+    : m_(m), t_(t), panel_(b->m + ((size_t) start) * b->lda, b->rows, size, b->lda) {}
+  void run() {
+    m_->solve(&panel_, t_, 1);
+  }
+};
+
+/** Solve of a diagonal block of a triangular solve, on the rows of b in front of it. */
+template<typename T> class SolveBlockTask : public Task {
+public:
+  enum Kind { LOWER, UPPER, DIAGONAL };
+  SolveBlockTask(const HMatrix<T>* m, Kind kind, bool unitriangular, bool lowerStored,
+                 const FullMatrix<T>& b)
+    : m_(m), kind_(kind), unitriangular_(unitriangular), lowerStored_(lowerStored),
+      b_(b.m, b.rows, b.cols, b.lda) {
+    setPriority(1);
+  }
+  void run() {
+    switch (kind_) {
+    case LOWER:
+      m_->solveLowerTriangularLeft(&b_, unitriangular_);
+      break;
+    case UPPER:
+      m_->solveUpperTriangularLeft(&b_, unitriangular_, lowerStored_);
+      break;
+    case DIAGONAL:
+      m_->solveDiagonal(&b_);
+      break;
     }
   }
-  if (allRkLeaves) {
-    std::vector<T> alpha(this->nrChild(), Constants<T>::pone);
-    RkMatrix<T> dummy(NULL, rows(), NULL, cols(), NoCompression);
-    RkMatrix<T>* candidate = dummy.formattedAddParts(&alpha[0], childrenArray, this->nrChild());
-    size_t elements = (((size_t) candidate->rows->size()) + candidate->cols->size()) * candidate->rank();
-    if (elements < childrenElements) {
-      cout << "Coarsening ! " << elements << " < " << childrenElements << endl;
-      // Replace 'this' by the new Rk matrix
-      for (int i = 0; i < this->nrChild(); i++)
-        this->removeChild(i);
-      this->children.clear();
-      rk(candidate);
-      assert(this->isLeaf());
-      assert(isRkMatrix());
-      // If necessary, replace 'upper' by the new Rk matrix transposed (exchange a and b)
-      if (upper) {
-        for (int i = 0; i < this->nrChild(); i++)
-          upper->removeChild(i);
-        upper->children.clear();
-        upper->rk(new RkMatrix<T>(candidate->b->copy(), upper->rows(),
-                                  candidate->a->copy(), upper->cols(), candidate->method));
-        assert(upper->isLeaf());
-        assert(upper->isRkMatrix());
+private:
+  const HMatrix<T>* m_;
+  Kind kind_;
+  bool unitriangular_, lowerStored_;
+  FullMatrix<T> b_;
+};
+
+/** y <- y - op(m) x, x and y being disjoint parts of the right-hand sides. */
+template<typename T> class SolveUpdateTask : public Task {
+  const HMatrix<T>* m_;
+  char trans_;
+  FullMatrix<T> x_, y_;
+public:
+  SolveUpdateTask(const HMatrix<T>* m, char trans, const FullMatrix<T>& x, const FullMatrix<T>& y)
+    : m_(m), trans_(trans), x_(x.m, x.rows, x.cols, x.lda), y_(y.m, y.rows, y.cols, y.lda) {}
+  void run() {
+    m_->gemv(trans_, Constants<T>::mone, &x_, Constants<T>::pone, &y_);
+  }
+};
+
+/*! \brief Task graph of the triangular solves of a factorized HMatrix.
+
+  The recursions of solveLowerTriangularLeft(), solveUpperTriangularLeft() and
+  solveDiagonal() are unrolled down to a given depth of the block tree. Below
+  it, diagonal blocks are solved and off-diagonal blocks are applied by a
+  single task. The depth is the one of the row clusters, which unlike
+  HMatrix::depth is the depth in the whole tree. The handles of the tasks are
+  the row clusters of the solved matrix at that depth, so that the updates of
+  different row clusters run concurrently, while the updates of the same rows
+  keep their sequential order. The column clusters of the updates are mapped
+  to these row clusters by their indices, the column tree may be another
+  object.
+ */
+template<typename T> class SolveGraph {
+  TaskPool& pool_;
+  FullMatrix<T>* b_;
+  /// Row of the matrix in front of the first row of b_
+  int base_;
+  /// Depth of the row clusters of the blocks submitted as a whole, and of the handles
+  int depth_;
+  /// Row clusters of the solved matrix, the handles are its nodes at depth_
+  const ClusterTree* root_;
+
+  FullMatrix<T> view(const ClusterData* rows) const {
+    return FullMatrix<T>(b_->m + rows->offset() - base_, rows->size(), b_->cols, b_->lda);
+  }
+  /** The row clusters of root_ at depth_, or leaves above it, which intersect indices */
+  void handles(const ClusterTree* cluster, const IndexSet& indices, std::vector<const void*>& result) const {
+    if (!cluster->data.intersects(indices))
+      return;
+    if (cluster->isLeaf() || cluster->depth >= depth_) {
+      result.push_back(cluster);
+      return;
+    }
+    for (int i = 0; i < cluster->nrChild(); i++)
+      if (cluster->getChild(i))
+        handles(cluster->getChild(i), indices, result);
+  }
+  void handles(const ClusterData* indices, std::vector<const void*>& result) const {
+    handles(root_, *indices, result);
+  }
+  void submitBlock(const HMatrix<T>* m, typename SolveBlockTask<T>::Kind kind,
+                   bool unitriangular, bool lowerStored) {
+    std::vector<const void*> h;
+    handles(m->rows(), h);
+    pool_.submit(new SolveBlockTask<T>(m, kind, unitriangular, lowerStored, view(m->rows())), h, h);
+  }
+  bool isTask(const HMatrix<T>* m) const {
+    return m->isLeaf() || m->rowsTree()->depth >= depth_;
+  }
+
+public:
+  /** Graph of the solves of the rows of b in front of m, unrolled on \a levels levels. */
+  SolveGraph(TaskPool& pool, FullMatrix<T>* b, const HMatrix<T>* m, int levels)
+    : pool_(pool), b_(b), base_(m->rows()->offset()), depth_(m->rowsTree()->depth + levels),
+      root_(m->rowsTree()) {}
+
+  /** Tasks of m->solveLowerTriangularLeft() */
+  void lower(const HMatrix<T>* m, bool unitriangular) {
+    if (m->rows()->size() == 0) return;
+    if (isTask(m)) {
+      submitBlock(m, SolveBlockTask<T>::LOWER, unitriangular, false);
+      return;
+    }
+    for (int i = 0; i < m->nrChildRow(); i++) {
+      for (int j = 0; j < i; j++)
+        if (m->get(i, j))
+          update(m->get(i, j), 'N');
+      lower(m->get(i, i), unitriangular);
+    }
+  }
+
+  /** Tasks of m->solveUpperTriangularLeft() */
+  void upper(const HMatrix<T>* m, bool unitriangular, bool lowerStored) {
+    if (m->rows()->size() == 0) return;
+    if (isTask(m)) {
+      submitBlock(m, SolveBlockTask<T>::UPPER, unitriangular, lowerStored);
+      return;
+    }
+    for (int i = m->nrChildRow() - 1; i >= 0; i--) {
+      upper(m->get(i, i), unitriangular, lowerStored);
+      for (int j = 0; j < i; j++) {
+        const HMatrix<T>* u_ji = lowerStored ? m->get(i, j) : m->get(j, i);
+        if (u_ji)
+          update(u_ji, lowerStored ? 'T' : 'N');
+      }
+    }
+  }
+
+  /** Tasks of m->solveDiagonal() */
+  void diagonal(const HMatrix<T>* m) {
+    if (m->rows()->size() == 0) return;
+    if (isTask(m)) {
+      submitBlock(m, SolveBlockTask<T>::DIAGONAL, false, false);
+      return;
+    }
+    for (int i = 0; i < m->nrChildRow(); i++)
+      diagonal(m->get(i, i));
+  }
+
+  /** Tasks of b[op(m) rows] -= op(m) b[op(m) cols] */
+  void update(const HMatrix<T>* m, char trans) {
+    if (m->rows()->size() == 0 || m->cols()->size() == 0) return;
+    if (!isTask(m)) {
+      for (int i = 0; i < m->nrChildRow(); i++)
+        for (int j = 0; j < m->nrChildCol(); j++)
+          if (m->get(i, j))
+            update(m->get(i, j), trans);
+      return;
+    }
+    const ClusterTree* x = trans == 'N' ? m->colsTree() : m->rowsTree();
+    const ClusterTree* y = trans == 'N' ? m->rowsTree() : m->colsTree();
+    std::vector<const void*> reads, writes;
+    handles(&x->data, reads);
+    handles(&y->data, writes);
+    pool_.submit(new SolveUpdateTask<T>(m, trans, view(&x->data), view(&y->data)), reads, writes);
+  }
+};
+
+/** Split a cluster tree into clusters of at most maxSize elements, unless they are leaves. */
+void splitRows(const ClusterTree* tree, int maxSize, std::vector<IndexSet>& result) {
+  if (tree->isLeaf() || tree->data.size() <= maxSize) {
+    if (tree->data.size() > 0)
+      result.push_back(IndexSet(tree->data.offset(), tree->data.size()));
+    return;
+  }
+  for (int i = 0; i < tree->nrChild(); i++)
+    if (tree->getChild(i))
+      splitRows(tree->getChild(i), maxSize, result);
+}
+
+bool startsBefore(const IndexSet& a, const IndexSet& b) {
+  return a.offset() < b.offset();
+}
+}  // end anonymous namespace
+
+template<typename T>
+void HMatrix<T>::listGemvLeaves(char matTrans, std::vector<std::pair<const HMatrix<T>*, char> >& leaves) const {
+  if (rows()->size() == 0 || cols()->size() == 0) return;
+  if (this->isLeaf()) {
+    if (!isNull())
+      leaves.push_back(std::make_pair(this, matTrans));
+    return;
+  }
+  // Same traversal as gemv()
+  for (int i = 0; i < nrChildRow(); i++)
+    for (int j = 0; j < nrChildCol(); j++) {
+      const HMatrix<T>* child = get(i,j);
+      char trans = matTrans;
+      if(!child) {
+        if (isTriLower || isTriUpper || !(isLower || isUpper))
+          continue;
+        child = get(j, i);
+        trans = (trans == 'N' ? 'T' : 'N');
+      }
+      child->listGemvLeaves(trans, leaves);
+    }
+}
+
+template<typename T>
+void HMatrix<T>::parallelGemv(TaskPool& pool, char matTrans, T alpha, const FullMatrix<T>* x, FullMatrix<T>* y) const {
+  DECLARE_CONTEXT;
+  std::vector<std::pair<const HMatrix<T>*, char> > leaves;
+  listGemvLeaves(matTrans, leaves);
+  bool transposed = false;
+  for (size_t i = 0; i < leaves.size(); i++)
+    transposed = transposed || leaves[i].second != 'N';
+  const int xBase = matTrans == 'N' ? cols()->offset() : rows()->offset();
+  const int yBase = matTrans == 'N' ? rows()->offset() : cols()->offset();
+  const int n = pool.nbThreads();
+
+  if (!transposed) {
+    // Each task owns a set of rows of y, several tasks share the leaves
+    // larger than their row cluster. B^t x is computed once for the shared
+    // Rk leaves A B^t, by a task the row tasks depend on, and each of them
+    // only computes its rows of A (B^t x).
+    std::vector<IndexSet> parts;
+    splitRows(rows_, std::max(1, rows()->size() / (4 * n)), parts);
+    std::vector<GemvRowsTask<T>*> tasks(parts.size());
+    std::vector<FullMatrix<T>*> projections(leaves.size(), (FullMatrix<T>*) NULL);
+    for (size_t p = 0; p < parts.size(); p++)
+      tasks[p] = new GemvRowsTask<T>(leaves, projections, parts[p].offset() - yBase, parts[p].size(),
+                                     xBase, yBase, alpha, x, y);
+    std::vector<double> costs(parts.size(), 0.);
+    std::vector<std::vector<const void*> > reads(parts.size());
+    const std::vector<const void*> noHandle;
+    for (size_t i = 0; i < leaves.size(); i++) {
+      const HMatrix<T>* leaf = leaves[i].first;
+      const ClusterData* r = leaf->rows();
+      IndexSet first(r->offset(), 0);
+      size_t p = std::upper_bound(parts.begin(), parts.end(), first, startsBefore) - parts.begin();
+      if (p > 0)
+        p--;
+      while (p < parts.size() && parts[p].offset() + parts[p].size() <= r->offset())
+        p++;
+      const bool shared = isRkLeaf(leaf) && p + 1 < parts.size()
+        && parts[p + 1].offset() < r->offset() + r->size();
+      double cost = gemvCost(leaf) / r->size();
+      if (shared) {
+        const int k = leaf->packed() ? leaf->packed()->rank() : leaf->rank();
+        projections[i] = new FullMatrix<T>(k, x->cols);
+        Task* project = new GemvProjectTask<T>(leaf, xBase, x, projections[i]);
+        project->setPriority(((double) leaf->cols()->size()) * k);
+        pool.submit(project, noHandle, std::vector<const void*>(1, leaf));
+        // Only A (B^t x) is left to the row tasks
+        cost = k;
+      }
+      for (; p < parts.size() && parts[p].offset() < r->offset() + r->size(); p++) {
+        tasks[p]->leafIndices.push_back(i);
+        if (shared)
+          reads[p].push_back(leaf);
+        costs[p] += cost * (std::min(parts[p].offset() + parts[p].size(), r->offset() + r->size())
+                            - std::max(parts[p].offset(), r->offset()));
       }
-    } else {
-      delete candidate;
     }
+    for (size_t p = 0; p < parts.size(); p++) {
+      tasks[p]->setPriority(costs[p]);
+      pool.submit(tasks[p], reads[p], noHandle);
+    }
+    pool.run();
+    for (size_t i = 0; i < projections.size(); i++)
+      delete projections[i];
+    return;
   }
+
+  // Rows of y are written by leaves in different places, each thread has its
+  // own copy of y.
+  std::vector<FullMatrix<T>*> buffers(n);
+  for (int i = 0; i < n; i++)
+    buffers[i] = new FullMatrix<T>(y->rows, y->cols);
+  for (size_t i = 0; i < leaves.size(); i++) {
+    Task* task = new GemvLeafTask<T>(leaves[i].first, leaves[i].second, xBase, yBase, alpha, x, buffers);
+    task->setPriority(gemvCost(leaves[i].first));
+    pool.submit(task);
+  }
+  pool.run();
+  const int chunk = (y->rows + n - 1) / n;
+  for (int start = 0; start < y->rows; start += chunk)
+    pool.submit(new GemvReduceTask<T>(buffers, start, std::min(chunk, y->rows - start), y));
+  pool.run();
+  for (int i = 0; i < n; i++)
+    delete buffers[i];
 }
 
 template<typename T>
@@ -562,7 +1427,8 @@ void HMatrix<T>::gemv(char trans, T alpha, const Vector<T>* x, T beta, Vector<T>
 }
 
 template<typename T>
-void HMatrix<T>::gemv(char matTrans, T alpha, const FullMatrix<T>* x, T beta, FullMatrix<T>* y) const {
+void HMatrix<T>::gemv(char matTrans, T alpha, const FullMatrix<T>* x, T beta, FullMatrix<T>* y,
+                      int nbThreads) const {
   assert(x->cols == y->cols);
   if (rows()->size() == 0 || cols()->size() == 0) return;
   assert((matTrans == 'T' ? cols()->size() : rows()->size()) == y->rows);
@@ -572,6 +1438,14 @@ void HMatrix<T>::gemv(char matTrans, T alpha, const FullMatrix<T>* x, T beta, Fu
   }
   beta = Constants<T>::pone;
 
+  if (nbThreads != 1 && !this->isLeaf()) {
+    TaskPool pool(nbThreads);
+    if (pool.nbThreads() > 1) {
+      parallelGemv(pool, matTrans, alpha, x, y);
+      return;
+    }
+  }
+
   if (!this->isLeaf()) {
     const ClusterData* myRows = rows();
     const ClusterData* myCols = cols();
@@ -617,7 +1491,10 @@ void HMatrix<T>::gemv(char matTrans, T alpha, const FullMatrix<T>* x, T beta, Fu
       }
     }
   } else {
-    if (isFullMatrix()) {
+    const LowPrecisionBlock<T>* p = packedAcquire();
+    if (p != NULL) {
+      p->gemv(matTrans, alpha, x, y);
+    } else if (isFullMatrix()) {
       y->gemm(matTrans, 'N', alpha, full(), x, beta);
     } else if(!isNull()){
       rk()->gemv(matTrans, alpha, x, beta, y);
@@ -747,7 +1624,10 @@ void HMatrix<T>::axpy(T alpha, const RkMatrix<T>* b) {
     if (isRkMatrix()) {
       if(!rk())
           rk(new RkMatrix<T>(NULL, rows(), NULL, cols(), NoCompression));
-      rk()->axpy(alpha, newRk);
+      if (accumulateRkUpdates)
+        rk()->accumulate(alpha, newRk);
+      else
+        rk()->axpy(alpha, newRk);
       rank_ = rk()->rank();
     } else {
       // In this case, the matrix has small size
@@ -846,7 +1726,13 @@ template<typename T> HMatrix<T> * HMatrix<T>::subset(
 
         tmpMatrix->rows_ = r;
         tmpMatrix->cols_ = c;
-        if(this->isRkMatrix()) {
+        const LowPrecisionBlock<T>* p = packedAcquire();
+        if (p != NULL) {
+          // A view on the packed block, the leaves which are written must be unpacked first
+          tmpMatrix->packed_ = p->subset(rows->offset() - this->rows()->offset(), tmpMatrix->rows(),
+                                         cols->offset() - this->cols()->offset(), tmpMatrix->cols());
+          tmpMatrix->rank_ = rank_;
+        } else if(this->isRkMatrix()) {
             tmpMatrix->rk(const_cast<RkMatrix<T>*>(rk()->subset(
                 tmpMatrix->rows(), tmpMatrix->cols())));
         } else {
@@ -1077,7 +1963,14 @@ HMatrix<T>::leafGemm(char transA, char transB, T alpha, const HMatrix<T>* a, con
         assert((transA == 'N' ? *a->cols() : *a->rows()) == (transB == 'N' ? *b->rows() : *b->cols()));
         assert(*rows() == (transA == 'N' ? *a->rows() : *a->cols()));
         assert(*cols() == (transB == 'N' ? *b->cols() : *b->rows()));
-        rk()->gemmRk(transA, transB, alpha, a, b, Constants<T>::pone);
+        if (accumulateRkUpdates) {
+          // The product is recompressed later, together with the next ones
+          RkMatrix<T> product(NULL, rows(), NULL, cols(), NoCompression);
+          product.gemmRk(transA, transB, alpha, a, b, Constants<T>::pone);
+          rk()->accumulate(Constants<T>::pone, &product);
+        } else {
+          rk()->gemmRk(transA, transB, alpha, a, b, Constants<T>::pone);
+        }
         rank_ = rk()->rank();
         return;
     }
@@ -1164,8 +2057,13 @@ void HMatrix<T>::gemm(char transA, char transB, T alpha, const HMatrix<T>* a, co
     //    return;
   }
 
+  // A packed leaf is converted to T for the update, and packed again after it
+  if (this->isLeaf())
+    unpack();
+
   // This and B are Rk matrices with the same panel 'b' -> the gemm is only applied on the panels 'a'
-  if(isRkMatrix() && !isNull() && b->isRkMatrix() && !b->isNull() && rk()->b == b->rk()->b) {
+  // (a packed leaf never shares its panels)
+  if(isRkMatrix() && !isNull() && b->isRkMatrix() && !b->isNull() && b->packed() == NULL && rk()->b == b->rk()->b) {
     // Ca * CbT = beta * Ca * CbT + alpha * A * Ba * BbT
     // As Cb = Bb we get
     // Ca = beta * Ca + alpha A * Ba with only Ca and Ba full matrices
@@ -1184,7 +2082,7 @@ void HMatrix<T>::gemm(char transA, char transB, T alpha, const HMatrix<T>* a, co
   }
 
   // This and A are Rk matrices with the same panel 'a' -> the gemm is only applied on the panels 'b'
-  if(isRkMatrix() && !isNull() && a->isRkMatrix() && !a->isNull() && rk()->a == a->rk()->a) {
+  if(isRkMatrix() && !isNull() && a->isRkMatrix() && !a->isNull() && a->packed() == NULL && rk()->a == a->rk()->a) {
     // Ca * CbT = beta * Ca * CbT + alpha * Aa * AbT * B
     // As Ca = Aa we get
     // CbT = beta * CbT + alpha AbT * B with only Cb and Ab full matrices
@@ -1207,12 +2105,14 @@ void HMatrix<T>::gemm(char transA, char transB, T alpha, const HMatrix<T>* a, co
   if((a->isLeaf() && a->isNull()) || (b->isLeaf() && b->isNull())) {
       if(!isAssembled() && this->isLeaf())
           rk(new RkMatrix<T>(NULL, rows(), NULL, cols(), NoCompression));
+      repack();
       return;
   }
 
   // Once the scaling is done, beta is reset to 1
   // to avoid an other scaling.
   recursiveGemm(transA, transB, alpha, a, b);
+  repack();
 }
 
 template<typename T>
@@ -1266,24 +2166,27 @@ RkMatrix<T>* HMatrix<T>::multiplyRkMatrix(char transA, char transB, const HMatri
   //  - A Rk, B Rk
   //  - A Rk, B F
   //  - A F,  B Rk
+  // The packed leaves are converted to temporaries
+  RkMatrix<T> *aRk = NULL, *bRk = NULL;
+  FullMatrix<T> *aFull = NULL, *bFull = NULL;
   if (a->isRkMatrix() && !b->isLeaf()) {
-    rk = RkMatrix<T>::multiplyRkH(transA, transB, a->rk(), b);
+    rk = RkMatrix<T>::multiplyRkH(transA, transB, a->readRk(aRk), b);
     HMAT_ASSERT(rk);
   }
   else if (!a->isLeaf() && b->isRkMatrix()) {
-    rk = RkMatrix<T>::multiplyHRk(transA, transB, a, b->rk());
+    rk = RkMatrix<T>::multiplyHRk(transA, transB, a, b->readRk(bRk));
     HMAT_ASSERT(rk);
   }
   else if (a->isRkMatrix() && b->isRkMatrix()) {
-    rk = RkMatrix<T>::multiplyRkRk(transA, transB, a->rk(), b->rk());
+    rk = RkMatrix<T>::multiplyRkRk(transA, transB, a->readRk(aRk), b->readRk(bRk));
     HMAT_ASSERT(rk);
   }
   else if (a->isRkMatrix() && b->isFullMatrix()) {
-    rk = RkMatrix<T>::multiplyRkFull(transA, transB, a->rk(), b->full(), (transB == 'N' ? b->cols() : b->rows()));
+    rk = RkMatrix<T>::multiplyRkFull(transA, transB, a->readRk(aRk), b->readFull(bFull), (transB == 'N' ? b->cols() : b->rows()));
     HMAT_ASSERT(rk);
   }
   else if (a->isFullMatrix() && b->isRkMatrix()) {
-    rk = RkMatrix<T>::multiplyFullRk(transA, transB, a->full(), b->rk(), (transA == 'N' ? a->rows() : a->cols()));
+    rk = RkMatrix<T>::multiplyFullRk(transA, transB, a->readFull(aFull), b->readRk(bRk), (transA == 'N' ? a->rows() : a->cols()));
     HMAT_ASSERT(rk);
   } else if(a->isNull() || b->isNull()) {
     return new RkMatrix<T>(NULL, transA ? a->cols() : a->rows(),
@@ -1292,6 +2195,10 @@ RkMatrix<T>* HMatrix<T>::multiplyRkMatrix(char transA, char transB, const HMatri
     // None of the above cases, impossible.
     HMAT_ASSERT(false);
   }
+  delete aRk;
+  delete bRk;
+  delete aFull;
+  delete bFull;
   return rk;
 }
 
@@ -1304,21 +2211,25 @@ FullMatrix<T>* HMatrix<T>::multiplyFullMatrix(char transA, char transB,
   assert(a->isFullMatrix() || b->isFullMatrix());
   assert(!(a->isRkMatrix() || b->isRkMatrix()));
   FullMatrix<T> *result = NULL;
+  // The packed leaves are converted to temporaries
+  FullMatrix<T> *aTmp = NULL, *bTmp = NULL;
   // The cases are:
   //  - A H, B F
   //  - A F, B H
   //  - A F, B F
   if (!a->isLeaf() && b->isFullMatrix()) {
-    result = HMatrix<T>::multiplyHFull(transA, transB, a, b->full());
+    result = HMatrix<T>::multiplyHFull(transA, transB, a, b->readFull(bTmp));
     HMAT_ASSERT(result);
   } else if (a->isFullMatrix() && !b->isLeaf()) {
-    result = HMatrix<T>::multiplyFullH(transA, transB, a->full(), b);
+    result = HMatrix<T>::multiplyFullH(transA, transB, a->readFull(aTmp), b);
     HMAT_ASSERT(result);
   } else if (a->isFullMatrix() && b->isFullMatrix()) {
-    int aRows = ((transA == 'N')? a->full()->rows : a->full()->cols);
-    int bCols = ((transB == 'N')? b->full()->cols : b->full()->rows);
+    const FullMatrix<T>* aFull = a->readFull(aTmp);
+    const FullMatrix<T>* bFull = b->readFull(bTmp);
+    int aRows = ((transA == 'N')? aFull->rows : aFull->cols);
+    int bCols = ((transB == 'N')? bFull->cols : bFull->rows);
     result = new FullMatrix<T>(aRows, bCols);
-    result->gemm(transA, transB, Constants<T>::pone, a->full(), b->full(),
+    result->gemm(transA, transB, Constants<T>::pone, aFull, bFull,
                  Constants<T>::zero);
     HMAT_ASSERT(result);
   } else if(a->isNull() || b->isNull()) {
@@ -1327,6 +2238,8 @@ FullMatrix<T>* HMatrix<T>::multiplyFullMatrix(char transA, char transB,
     // None of above, impossible
     HMAT_ASSERT(false);
   }
+  delete aTmp;
+  delete bTmp;
   return result;
 }
 
@@ -1364,6 +2277,7 @@ void HMatrix<T>::multiplyWithDiag(const HMatrix<T>* d, bool left, bool inverse)
     assert(!rk()->a->isTriUpper() && !rk()->b->isTriUpper());
     assert(!rk()->a->isTriLower() && !rk()->b->isTriLower());
     rk()->multiplyWithDiagOrDiagInv(d, inverse, left);
+    const_cast<HMatrix<T>*>(this)->repack();
   } else if(isFullMatrix()){
     if (d->isFullMatrix()) {
       full()->multiplyWithDiagOrDiagInv(d->full()->diagonal, inverse, left);
@@ -1372,6 +2286,7 @@ void HMatrix<T>::multiplyWithDiag(const HMatrix<T>* d, bool left, bool inverse)
       d->extractDiagonal(diag.v);
       full()->multiplyWithDiagOrDiagInv(&diag, inverse, left);
     }
+    const_cast<HMatrix<T>*>(this)->repack();
   } else {
     // this is a null matrix (either full of Rk) so nothing to do
   }
@@ -1392,6 +2307,8 @@ template<typename T> void HMatrix<T>::transposeNoRecurse() {
       for (int j=0 ; j<i ; j++)
         swap(this->children[i + j * nrChildRow()], this->children[j + i * nrChildRow()]);
     swap(rows_, cols_);
+    if (localSettings.pivots)
+      swap(localSettings.pivots->rows, localSettings.pivots->cols);
 }
 
 template<typename T>
@@ -1603,21 +2520,28 @@ void HMatrix<T>::copy(const HMatrix<T>* o) {
     if (isAssembled() && isNull() && o->isNull()) {
       return;
     }
+    // o is only read, a packed leaf stays packed
+    FullMatrix<T>* fTmp = NULL;
+    RkMatrix<T>* rkTmp = NULL;
+    const FullMatrix<T>* oFull = o->isFullMatrix() ? o->readFull(fTmp) : NULL;
+    const RkMatrix<T>* oRk = o->isRkMatrix() ? o->readRk(rkTmp) : NULL;
     // When the matrix has not allocated but only the structure
-    if (o->isFullMatrix() && isFullMatrix()) {
-      o->full()->copy(full());
-    } else if(o->isFullMatrix()) {
+    if (oFull && isFullMatrix()) {
+      oFull->copy(full());
+    } else if(oFull) {
       assert(!isAssembled() || isNull());
-      full(o->full()->copy());
-    } else if (o->isRkMatrix() && !rk()) {
-      rk(new RkMatrix<T>(NULL, o->rk()->rows, NULL, o->rk()->cols, o->rk()->method));
+      full(oFull->copy());
+    } else if (oRk && !rk()) {
+      rk(new RkMatrix<T>(NULL, oRk->rows, NULL, oRk->cols, oRk->method));
     }
     assert((isRkMatrix() == o->isRkMatrix())
            && (isFullMatrix() == o->isFullMatrix()));
-    if (o->isRkMatrix()) {
-      rk()->copy(o->rk());
+    if (oRk) {
+      rk()->copy(oRk);
       rank_ = rk()->rank();
     }
+    delete fTmp;
+    delete rkTmp;
   } else {
     rank_ = o->rank_;
     for (int i = 0; i < o->nrChildRow(); i++) {
@@ -1638,6 +2562,7 @@ void HMatrix<T>::clear() {
   if (rows()->size() == 0 || cols()->size() == 0) return;
   if (this->isLeaf()) {
     if (isFullMatrix()) {
+      dropPacked();
       delete full_;
       full_ = NULL;
     } else if(isRkMatrix()){
@@ -1740,6 +2665,8 @@ void HMatrix<T>::solveLowerTriangularLeft(HMatrix<T>* b, bool unitriangular) con
   } else {
     // if B is a leaf, the resolve is done by column
     if (b->isLeaf()) {
+      // The subset of a packed leaf would be a copy
+      b->unpack();
       if (b->isFullMatrix()) {
         this->solveLowerTriangularLeft(b->full(), unitriangular);
       } else {
@@ -1747,6 +2674,7 @@ void HMatrix<T>::solveLowerTriangularLeft(HMatrix<T>* b, bool unitriangular) con
           return;
         }
         assert(b->isRkMatrix());
+        b->flushUpdates();
         HMatrix<T> * tmp = b->subset(this->cols(), b->cols());
         this->solveLowerTriangularLeft(tmp->rk()->a, unitriangular);
         if(tmp != b)
@@ -1765,6 +2693,7 @@ void HMatrix<T>::solveLowerTriangularLeft(HMatrix<T>* b, bool unitriangular) con
       b->axpy(Constants<T>::pone, bFull, b->rows(), b->cols());
       delete bFull;
     }
+    b->repack();
   }
 }
 
@@ -1817,6 +2746,8 @@ void HMatrix<T>::solveUpperTriangularRight(HMatrix<T>* b, bool unitriangular, bo
   } else {
     // if B is a leaf, the resolve is done by row
     if (b->isLeaf()) {
+      // The subset of a packed leaf would be a copy
+      b->unpack();
       if (b->isFullMatrix()) {
         b->full()->transpose();
         this->solveUpperTriangularRight(b->full(), unitriangular, lowerStored);
@@ -1827,6 +2758,7 @@ void HMatrix<T>::solveUpperTriangularRight(HMatrix<T>* b, bool unitriangular, bo
         //   - Xb^t U = Bb^t
         // Xb is stored without been transposed
         // it become again a resolution by column of Bb
+        b->flushUpdates();
         HMatrix<T> * tmp;
         if(*rows() == *b->cols())
             tmp = b;
@@ -1862,6 +2794,7 @@ void HMatrix<T>::solveUpperTriangularRight(HMatrix<T>* b, bool unitriangular, bo
       b->axpy(Constants<T>::pone, bFull, b->rows(), b->cols());
       delete bFull;
     }
+    b->repack();
   }
 }
 
@@ -1878,6 +2811,9 @@ void HMatrix<T>::solveUpperTriangularLeft(HMatrix<T>* b, bool unitriangular, boo
   } else {
     // if B is a leaf, the resolve is done by column
     if (b->isLeaf()) {
+      // The subset of a packed leaf would be a copy
+      b->unpack();
+      b->flushUpdates();
       HMatrix * bSubset = b->subset(lowerStored ? this->rows() : this->cols(), b->cols());
       if (bSubset->isFullMatrix()) {
         this->solveUpperTriangularLeft(bSubset->full(), unitriangular, lowerStored);
@@ -1899,6 +2835,7 @@ void HMatrix<T>::solveUpperTriangularLeft(HMatrix<T>* b, bool unitriangular, boo
       b->axpy(Constants<T>::pone, bFull, b->rows(), b->cols());
       delete bFull;
     }
+    b->repack();
   }
 }
 
@@ -1976,12 +2913,31 @@ void HMatrix<T>::solveUpperTriangularLeft(FullMatrix<T>* b, bool unitriangular,
 
   }
 }
-template<typename T> void HMatrix<T>::lltDecomposition() {
+namespace {
+/** Number of levels of the block tree split in tasks */
+int taskLevels(const TaskPool& pool) {
+  // Enough diagonal blocks to keep the threads busy
+  int levels = 1;
+  while ((1 << levels) < 4 * pool.nbThreads())
+    levels++;
+  return levels;
+}
+
+template<typename T> int taskDepth(const HMatrix<T>* m, const TaskPool& pool) {
+  return m->depth + taskLevels(pool);
+}
+}  // end anonymous namespace
+
+template<typename T> void HMatrix<T>::lltDecomposition(int nbThreads) {
 
     assertLower(this);
     if (rows()->size() == 0 || cols()->size() == 0) return;
     if(this->isLeaf()) {
         full()->lltDecomposition();
+    } else if (nbThreads != 1) {
+      TaskPool pool(nbThreads);
+      RecursionGraph<T, HMatrix<T> >(pool, taskDepth(this, pool)).lltDecomposition(this);
+      pool.run();
     } else {
         HMAT_ASSERT(isLower);
       this->recursiveLltDecomposition();
@@ -1991,7 +2947,7 @@ template<typename T> void HMatrix<T>::lltDecomposition() {
 }
 
 template<typename T>
-void HMatrix<T>::luDecomposition() {
+void HMatrix<T>::luDecomposition(int nbThreads) {
   DECLARE_CONTEXT;
 
   if (rows()->size() == 0 || cols()->size() == 0) return;
@@ -1999,6 +2955,10 @@ void HMatrix<T>::luDecomposition() {
     assert(isFullMatrix());
     full()->luDecomposition();
     full()->checkNan();
+  } else if (nbThreads != 1) {
+    TaskPool pool(nbThreads);
+    RecursionGraph<T, HMatrix<T> >(pool, taskDepth(this, pool)).luDecomposition(this);
+    pool.run();
   } else {
     this->recursiveLuDecomposition();
   }
@@ -2039,7 +2999,9 @@ void HMatrix<T>::mdmtProduct(const HMatrix<T>* m, const HMatrix<T>* d) {
       assert(*m->cols() == *d->rows());
       assert(*m_copy->rk()->cols == *d->rows());
       m_copy->multiplyWithDiag(d); // right multiplication by D
-      RkMatrix<T>* rkMat = RkMatrix<T>::multiplyRkRk('N', 'T', m_copy->rk(), m->rk());
+      RkMatrix<T>* mTmp = NULL;
+      RkMatrix<T>* rkMat = RkMatrix<T>::multiplyRkRk('N', 'T', m_copy->rk(), m->readRk(mTmp));
+      delete mTmp;
       delete m_copy;
 
       this->axpy(Constants<T>::mone, rkMat);
@@ -2074,7 +3036,9 @@ void HMatrix<T>::mdmtProduct(const HMatrix<T>* m, const HMatrix<T>* d) {
       HMatrix<T>* m_copy = m->copy();
       m_copy->multiplyWithDiag(d);
 
-      RkMatrix<T>* rkMat = RkMatrix<T>::multiplyRkRk('N', 'T', m_copy->rk(), m->rk());
+      RkMatrix<T>* mTmp = NULL;
+      RkMatrix<T>* rkMat = RkMatrix<T>::multiplyRkRk('N', 'T', m_copy->rk(), m->readRk(mTmp));
+      delete mTmp;
       FullMatrix<T>* fullMat = rkMat->eval();
       delete m_copy;
       delete rkMat;
@@ -2084,10 +3048,12 @@ void HMatrix<T>::mdmtProduct(const HMatrix<T>* m, const HMatrix<T>* d) {
       // S <- S - M*D*M^T
       assert(!full()->isTriUpper());
       assert(!full()->isTriLower());
-      assert(!m->full()->isTriUpper());
-      assert(!m->full()->isTriLower());
-      FullMatrix<T> mTmp(m->full()->rows, m->full()->cols);
-      mTmp.copyMatrixAtOffset(m->full(), 0, 0);
+      FullMatrix<T>* mFullTmp = NULL;
+      const FullMatrix<T>* mFull = m->readFull(mFullTmp);
+      assert(!mFull->isTriUpper());
+      assert(!mFull->isTriLower());
+      FullMatrix<T> mTmp(mFull->rows, mFull->cols);
+      mTmp.copyMatrixAtOffset(mFull, 0, 0);
       if (d->isFullMatrix()) {
         mTmp.multiplyWithDiagOrDiagInv(d->full()->diagonal, false, false);
       } else {
@@ -2095,9 +3061,11 @@ void HMatrix<T>::mdmtProduct(const HMatrix<T>* m, const HMatrix<T>* d) {
         d->extractDiagonal(diag.v);
         mTmp.multiplyWithDiagOrDiagInv(&diag, false, false);
       }
-      full()->gemm('N', 'T', Constants<T>::mone, &mTmp, m->full(), Constants<T>::pone);
+      full()->gemm('N', 'T', Constants<T>::mone, &mTmp, mFull, Constants<T>::pone);
+      delete mFullTmp;
     }
   }
+  repack();
 }
 
 template<typename T> void assertLdlt(const HMatrix<T> * me) {
@@ -2156,7 +3124,7 @@ template<typename T> void assertUpper(const HMatrix<T> * me) {
 }
 
 template<typename T>
-void HMatrix<T>::ldltDecomposition() {
+void HMatrix<T>::ldltDecomposition(int nbThreads) {
   DECLARE_CONTEXT;
   assertLower(this);
 
@@ -2168,6 +3136,10 @@ void HMatrix<T>::ldltDecomposition() {
     assert(isFullMatrix());
     full()->ldltDecomposition();
     assert(full()->diagonal);
+  } else if (nbThreads != 1) {
+    TaskPool pool(nbThreads);
+    RecursionGraph<T, HMatrix<T> >(pool, taskDepth(this, pool)).ldltDecomposition(this);
+    pool.run();
   } else {
     this->recursiveLdltDecomposition();
   }
@@ -2185,6 +3157,73 @@ void HMatrix<T>::solve(FullMatrix<T>* b) const {
   this->solveUpperTriangularLeft(b, false, false);
 }
 
+namespace {
+// Size of the part of a panel of right-hand sides in front of a diagonal leaf
+const size_t SOLVE_PANEL_BYTES = 64 * 1024;
+// Bounds of the number of columns of a panel
+const int SOLVE_PANEL_MIN_COLUMNS = 16;
+const int SOLVE_PANEL_MAX_COLUMNS = 128;
+}  // end anonymous namespace
+
+template<typename T>
+void HMatrix<T>::solve(FullMatrix<T>* b, hmat_factorization_t t, int nbThreads) const {
+  DECLARE_CONTEXT;
+  const HMatrix<T>* leaf = this;
+  while (!leaf->isLeaf() && leaf->get(0, 0))
+    leaf = leaf->get(0, 0);
+  int width = SOLVE_PANEL_BYTES / (sizeof(T) * std::max(1, leaf->rows()->size()));
+  width = std::max(SOLVE_PANEL_MIN_COLUMNS, std::min(SOLVE_PANEL_MAX_COLUMNS, width));
+  TaskPool pool(nbThreads);
+  // Enough panels to keep the threads busy
+  if (pool.nbThreads() > 1)
+    width = std::min(width, std::max(SOLVE_PANEL_MIN_COLUMNS,
+                                     (b->cols + pool.nbThreads() - 1) / pool.nbThreads()));
+  if (pool.nbThreads() > 1 && !this->isLeaf() && (b->cols + width - 1) / width < pool.nbThreads()) {
+    // Too few panels for the threads: the solves of all the columns are split
+    // in tasks following the block tree instead
+    SolveGraph<T> graph(pool, b, this, taskLevels(pool));
+    switch (t) {
+    case hmat_factorization_lu:
+      graph.lower(this, true);
+      graph.upper(this, false, false);
+      break;
+    case hmat_factorization_ldlt:
+      assertLdlt(this);
+      graph.lower(this, true);
+      graph.diagonal(this);
+      graph.upper(this, true, true);
+      break;
+    case hmat_factorization_llt:
+      graph.lower(this, false);
+      graph.upper(this, false, true);
+      break;
+    default:
+      HMAT_ASSERT(false);
+    }
+    pool.run();
+    return;
+  }
+  if (b->cols <= width) {
+    switch (t) {
+    case hmat_factorization_lu:
+      solve(b);
+      break;
+    case hmat_factorization_ldlt:
+      solveLdlt(b);
+      break;
+    case hmat_factorization_llt:
+      solveLlt(b);
+      break;
+    default:
+      HMAT_ASSERT(false);
+    }
+    return;
+  }
+  for (int start = 0; start < b->cols; start += width)
+    pool.submit(new SolvePanelTask<T>(this, t, b, start, std::min(width, b->cols - start)));
+  pool.run();
+}
+
 template<typename T>
 void HMatrix<T>::extractDiagonal(T* diag) const {
   DECLARE_CONTEXT;
@@ -2312,6 +3351,16 @@ template<typename T> void HMatrix<T>::setTriLower(bool value)
     }
 }
 
+template<typename T> void HMatrix<T>::setLower(bool value)
+{
+    isLower = value;
+    if(!this->isLeaf())
+    {
+      for (int i = 0; i < nrChildRow(); i++)
+        get(i, i)->setLower(value);
+    }
+}
+
 template<typename T>  void HMatrix<T>::rk(const FullMatrix<T> * a, const FullMatrix<T> * b, bool updateRank) {
     assert(isRkMatrix());
     if(a == NULL && isNull())
@@ -2320,12 +3369,7 @@ template<typename T>  void HMatrix<T>::rk(const FullMatrix<T> * a, const FullMat
         rk(new RkMatrix<T>(NULL, rows(), NULL, cols(), Svd));
     // TODO: if the matrices exist and are of the right size (same rank),
     // reuse them.
-    if (rk_->a) {
-      delete rk_->a;
-    }
-    if (rk_->b) {
-      delete rk_->b;
-    }
+    rk_->clear();
     rk_->a = a == NULL ? NULL : a->copy();
     rk_->b = b == NULL ? NULL : b->copy();
     if(updateRank)
@@ -2412,4 +3456,9 @@ namespace hmat {
   template class RecursionMatrix<D_t, HMatrix<D_t> >;
   template class RecursionMatrix<Z_t, HMatrix<Z_t> >;
 
+  template class RecursionGraph<S_t, HMatrix<S_t> >;
+  template class RecursionGraph<C_t, HMatrix<C_t> >;
+  template class RecursionGraph<D_t, HMatrix<D_t> >;
+  template class RecursionGraph<Z_t, HMatrix<Z_t> >;
+
 }  // end namespace hmat
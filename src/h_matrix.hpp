@@ -36,6 +36,8 @@
 #include "recursion.hpp"
 #include <cassert>
 #include <fstream>
+#include <utility>
+#include <vector>
 #include <iostream>
 
 
@@ -43,6 +45,8 @@ namespace hmat {
 
 template<typename T> class Vector;
 template<typename T> class RkMatrix;
+class TaskPool;
+struct AcaPivots;
 
 /** Flag used to describe the symmetry of a matrix.
  */
@@ -59,7 +63,9 @@ struct MatrixSettings {
 /** Settings local to a matrix bloc */
 struct LocalSettings {
     const MatrixSettings * global;
-    explicit LocalSettings(const MatrixSettings * s): global(s) {}
+    /// Pivots of the last ACA compression of the leaf, owned by the leaf, or NULL
+    AcaPivots * pivots;
+    explicit LocalSettings(const MatrixSettings * s): global(s), pivots(NULL) {}
     //TODO add epsilons
 };
 
@@ -87,6 +93,9 @@ template<typename T> void reorderVector(FullMatrix<T>* v, int* indices);
 template<typename T> void restoreVectorOrder(FullMatrix<T>* v, int *indices);
 
 template<typename T> class HMatrix;
+template<typename T> class HMatrixFile;
+template<typename T> class H2Builder;
+template<typename T> class LowPrecisionBlock;
 /** Class to write user defined data when dumping matrix onto disk.
 
     This class is used by dumpTreeToFile to write extra information into
@@ -126,6 +135,9 @@ public:
  */
 template<typename T> class HMatrix : public Tree<HMatrix<T> >, public RecursionMatrix<T, HMatrix<T> > {
   friend class RkMatrix<T>;
+  friend class HMatrixFile<T>;
+  friend class H2Builder<T>;
+  template<typename U> friend class HMatrix;
 
   /// Rows of this HMatrix block
   const ClusterTree * rows_;
@@ -139,6 +151,45 @@ template<typename T> class HMatrix : public Tree<HMatrix<T> >, public RecursionM
   };
   /// rank_ of the block for Rk matrices, or: UNINITIALIZED_BLOCK=-3 for an uninitialized matrix, NONLEAF_BLOCK=-2 for non leaf, FULL_BLOCK=-1 for full a matrix
   int rank_;
+  /// Leaf stored in single precision by compact(), rk_ and full_ are NULL when it is set
+  LowPrecisionBlock<T> * packed_;
+  /*! \brief Read packed_ with an acquire semantic.
+
+    rk_ or full_ are written by unpackImpl() before it releases packed_, so
+    they can be read after this returns NULL.
+   */
+  LowPrecisionBlock<T> * packedAcquire() const {
+    LowPrecisionBlock<T> * p;
+#pragma omp atomic read
+    p = packed_;
+#pragma omp flush
+    return p;
+  }
+  /*! \brief Replace packed_ by the equivalent RkMatrix or FullMatrix.
+
+    It is meant for the leaves which are written, the read-only accesses
+    should use readRk() and readFull() which leave the leaf packed. It may
+    still be called concurrently on a leaf which is only read.
+   */
+  void unpack() const {
+    if (packedAcquire() != NULL)
+      unpackImpl();
+  }
+  void unpackImpl() const;
+  /*! \brief RkMatrix of this leaf for a read-only access.
+
+    A packed leaf stays packed, it is converted to a new RkMatrix returned
+    in tmp, which the caller deletes. tmp is set to NULL otherwise.
+   */
+  const RkMatrix<T> * readRk(RkMatrix<T> * & tmp) const;
+  /// FullMatrix of this leaf for a read-only access, see readRk()
+  const FullMatrix<T> * readFull(FullMatrix<T> * & tmp) const;
+  /// Pack again the leaves of this block after an update, see compact()
+  void repack() {
+    if (lowPrecisionStorage)
+      compact();
+  }
+  void compactRecurse(double epsilon);
   void uncompatibleGemm(char transA, char transB, T alpha, const HMatrix<T>* a, const HMatrix<T>*b);
   void recursiveGemm(char transA, char transB, T alpha, const HMatrix<T>* a, const HMatrix<T>*b);
   void leafGemm(char transA, char transB, T alpha, const HMatrix<T>* a, const HMatrix<T>*b);
@@ -146,6 +197,32 @@ template<typename T> class HMatrix : public Tree<HMatrix<T> >, public RecursionM
   /*! \brief Auxiliary function used by HMatrix::dumpTreeToFile().
    */
   void dumpSubTree(std::ofstream& f, int depth, const HMatrixNodeDumper<T>& nodeDumper) const;
+  /*! \brief List the leaves of this subtree to assemble, with the upper block
+    receiving their transpose, or NULL.
+
+    The traversal is the one of assembleSymmetric() when symmetric is true,
+    upper and onlyLower having the same meaning.
+   */
+  void listLeavesAssembly(std::vector<std::pair<HMatrix<T>*, HMatrix<T>*> >& leaves,
+                          bool symmetric, HMatrix<T>* upper, bool onlyLower);
+  /*! \brief Submit the assembly of the leaves of this subtree, by chunks of
+    similar estimated cost, see listLeavesAssembly().
+   */
+  void submitLeavesAssembly(TaskPool& pool, Assembly<T>& f, const AllocationObserver & ao,
+                            bool symmetric, HMatrix<T>* upper, bool onlyLower);
+  /*! \brief Tag the non-leaf blocks as assembled, once the leaves are done. */
+  void assembledLeaves(bool symmetric, HMatrix<T>* upper, bool onlyLower);
+  /*! \brief Submit the coarsening of the blocks of this subtree, bottom-up, see coarsen().
+
+    \param saved incremented by the number of terms saved
+    \return true if this block may become an Rk leaf
+   */
+  bool submitCoarsening(TaskPool& pool, bool symmetric, HMatrix<T>* upper, bool onlyLower,
+                        size_t* saved);
+  /*! \brief List the non empty leaves involved in gemv(), with the operation applied to each of them. */
+  void listGemvLeaves(char trans, std::vector<std::pair<const HMatrix<T>*, char> >& leaves) const;
+  /*! \brief Multithreaded part of gemv(), y has already been scaled by beta. */
+  void parallelGemv(TaskPool& pool, char trans, T alpha, const FullMatrix<T>* x, FullMatrix<T>* y) const;
   /** Only used by internalCopy */
   HMatrix(const MatrixSettings * settings);
 public:
@@ -168,24 +245,38 @@ public:
   /*! \brief HMatrix coarsening.
 
      If all children are Rk leaves, then we try to merge them into a single Rk-leaf.
-     This is done if the memory of the resulting leaf is less than the sum of the initial
-     leaves. Note that this operation could be used hierarchically.
+     This is done if the memory of the resulting leaf is less than coarseningThreshold
+     times the sum of the initial leaves. The assembly applies it bottom-up, so that
+     the merges propagate to the upper levels.
      \param upper the symmetric of 'this', when building a non-sym matrix with a sym content
+     \return the number of terms saved, including the ones of upper
    */
-  void coarsen(HMatrix<T>* upper = NULL) ;
+  size_t coarsen(HMatrix<T>* upper = NULL) ;
   /*! \brief HMatrix assembly.
+
+    \param f the assembly function
+    \param nbThreads number of threads assembling the leaves, 0 for all the
+    available processors. With more than one thread, f and the allocation
+    observer are called concurrently on different blocks and must be thread safe.
+    \return the number of terms saved by the coarsening, if coarsening is set
+   */
+  size_t assemble(Assembly<T>& f, const AllocationObserver & = AllocationObserver(),
+                int nbThreads = 1);
+  /*! \brief Assembly of the leaf this, and of its transpose in upper if not NULL.
    */
-  void assemble(Assembly<T>& f, const AllocationObserver & = AllocationObserver());
+  void assembleLeaf(Assembly<T>& f, const AllocationObserver & ao, HMatrix<T>* upper = NULL);
   /*! \brief HMatrix assembly.
 
     \param f the assembly function
     \param upper the upper part of the matrix. If NULL, it is assumed
                  that upper=this (that is, the current block is on the diagonal)
     \param onlyLower if true, only assemble the lower part of the matrix, ie don't copy.
+    \param nbThreads number of threads, see assemble()
+    \return the number of terms saved by the coarsening, if coarsening is set
    */
-  void assembleSymmetric(Assembly<T>& f,
+  size_t assembleSymmetric(Assembly<T>& f,
      HMatrix<T>* upper=NULL, bool onlyLower=false,
-     const AllocationObserver & = AllocationObserver());
+     const AllocationObserver & = AllocationObserver(), int nbThreads = 1);
   /*! \brief Evaluate the HMatrix, ie converts it to a full matrix.
 
     This conversion does the reorderng of the unknowns such that the resulting
@@ -209,6 +300,35 @@ public:
   void evalPart(FullMatrix<T>* result, const IndexSet* _rows, const IndexSet* _cols) const;
 
   void info(hmat_info_t &);
+  /*! \brief Store the leaves in single precision where the accuracy allows it.
+
+    Only the double precision types are concerned. An Rk leaf is packed when
+    the rounding of its factors is far below the assembly and recompression
+    epsilons, relatively to its norm. The full leaves of admissible blocks
+    are packed in the same way. The products with a vector use the packed
+    leaves directly. The products and the solves convert the leaves they
+    read to temporaries, and pack the leaves they write again when they are
+    done, so that a factorization converts only the blocks it is working on.
+    The other operations convert the leaves back to T when they access them.
+   */
+  void compact();
+  /*! \brief Estimated cost of the assembly of this leaf.
+
+    It is the number of terms computed: m*n for a full leaf, or for a block
+    compressed by SVD or full ACA, and (m+n)*k*(1+k/8) for the other
+    compression methods, k being the fixed rank if any, or 4 times the number
+    of digits of the assembly accuracy.
+   */
+  double assemblyCost() const;
+  /*! \brief Sum of assemblyCost() over the leaves of this matrix. */
+  double estimateAssemblyCost() const;
+  /*! \brief Recompress the products accumulated in the Rk leaves.
+
+    With \a accumulateRkUpdates, the products added to an Rk leaf by gemm()
+    and axpy() are only appended to its factors, until the leaf is solved or
+    the appended rank becomes too large. This recompresses what is left.
+   */
+  void flushUpdates();
 
   /** This *= alpha
 
@@ -223,8 +343,14 @@ public:
   /** Compute y <- alpha * op(this) * x + beta * y.
 
       The arguments are similar to BLAS GEMV.
+
+      \param nbThreads number of threads, 0 for all the available processors.
+      Without symmetry and with trans='N', each thread computes a set of row
+      clusters of y. Otherwise threads add their products into private copies
+      of y, which are summed at the end.
    */
-  void gemv(char trans, T alpha, const FullMatrix<T>* x, T beta, FullMatrix<T>* y) const;
+  void gemv(char trans, T alpha, const FullMatrix<T>* x, T beta, FullMatrix<T>* y,
+            int nbThreads = 1) const;
   /*! \brief this <- alpha * op(A) * op(B) + beta * this
 
     \param transA 'N' or 'T', as in BLAS
@@ -314,6 +440,11 @@ public:
       allocated) mirroring the structure of this.
    */
   HMatrix<T>* copyStructure() const;
+  /** Return a copy of this HMatrix in single precision.
+
+      The copy shares the cluster trees of this, which must outlive it.
+   */
+  HMatrix<typename Types<T>::sp>* singlePrecisionCopy() const;
   /*! \brief Return square of the Frobenius norm of the matrix.
    */
   double normSqr() const;
@@ -350,15 +481,19 @@ public:
   void copyAndTranspose(const HMatrix<T>* o);
   /*! \brief LU decomposition in place.
 
+    \param nbThreads number of threads, 0 for all the available processors.
+    With more than one thread, the recursion is run as a graph of tasks (see
+    RecursionGraph).
     \warning Do not use. Doesn't work
    */
-  void luDecomposition();
+  void luDecomposition(int nbThreads = 1);
   /* \brief LDL^t decomposition in place
      \warning this has to be created with the flag lower
      \warning this has to be assembled with assembleSymmetric with onlyLower = true
+     \param nbThreads see luDecomposition()
    */
-  void ldltDecomposition();
-  void lltDecomposition();
+  void ldltDecomposition(int nbThreads = 1);
+  void lltDecomposition(int nbThreads = 1);
 
   /** This <- This + alpha * b
 
@@ -388,13 +523,13 @@ public:
   /*! Return true if this is a full block.
    */
   inline bool isFullMatrix() const {
-    return rank_ == FULL_BLOCK && full_ != NULL;
+    return rank_ == FULL_BLOCK && (packedAcquire() != NULL || full_ != NULL);
   }
   /* Return the full matrix corresponding to the current leaf
    */
   FullMatrix<T>* getFullMatrix() const {
     assert(isFullMatrix());
-    return full_;
+    return full();
   }
   /*! Return true if this is a compressed block.
    */
@@ -495,11 +630,26 @@ public:
     \warning This doit etre factorisee avec \a HMatrix::lltDecomposition() avant.
    */
   void solveLlt(FullMatrix<T>* b) const ;
+  /*! \brief Solve this * X = B, with this factorized by t, B being overwritten by X.
+
+    The columns of B are split into panels, so that the part of a panel in
+    front of a leaf stays in cache, and the panels are solved independently,
+    in parallel if nbThreads != 1. With a single panel, this is \a solve(),
+    \a solveLdlt() or \a solveLlt(). When there are fewer panels than
+    threads, the triangular solves of all the columns are split into tasks
+    along the block tree instead, so that the updates of independent row
+    clusters run concurrently.
+
+    \param nbThreads number of threads, 0 for all the available processors.
+   */
+  void solve(FullMatrix<T>* b, hmat_factorization_t t, int nbThreads = 1) const;
   /*! Triggers an assertion is the HMatrix contains any NaN.
    */
   void checkNan() const;
   /** Recursively set the isTriLower flag on this matrix */
   void setTriLower(bool value);
+  /** Recursively set the isLower flag on this matrix */
+  void setLower(bool value);
 
   const ClusterData* rows() const;
   const ClusterData* cols() const;
@@ -560,6 +710,8 @@ public:
 
   /// Should try to coarsen the matrix at assembly
   static bool coarsening;
+  /// Largest ratio of the memory of a coarsened block to the one of its children
+  static double coarseningThreshold;
   /// Should recompress the matrix after assembly
   static bool recompress;
   /// Validate the rk-matrices after compression
@@ -570,6 +722,14 @@ public:
   static bool validationDump;
   /// Error threshold for the compression validation
   static double validationErrorThreshold;
+  /// Number of rows and columns sampled by the validation, 0 to assemble the whole blocks
+  static int validationSamples;
+  /// Store the leaves in single precision after the operations creating them
+  static bool lowPrecisionStorage;
+  /// Accumulate the products added to the Rk leaves, see RkMatrix::accumulate()
+  static bool accumulateRkUpdates;
+  /// Maximum number of tasks the parallel assembly splits the leaves in
+  static int maxParallelLeaves;
   char isUpper:1, isLower:1,       /// symmetric, upper or lower stored
        isTriUpper:1, isTriLower:1, /// upper/lower triangular
        rowsAdmissible:1, colsAdmissible:1,
@@ -584,31 +744,43 @@ public:
 
   RkMatrix<T> * rk() const {
       assert(rank_ >= 0);
+      unpack();
       return rk_;
   }
 
   void rk(const FullMatrix<T> * a, const FullMatrix<T> * b, bool updateRank = true);
 
   void rk(RkMatrix<T> * m) {
+      dropPacked();
       rk_ = m;
       rank_ = m == NULL ? 0 : m->rank();
   }
 
   FullMatrix<T> * full() const {
       assert(rank_ == FULL_BLOCK);
+      unpack();
       return full_;
   }
 
   void full(FullMatrix<T> * m) {
+      dropPacked();
       full_ = m;
       rank_ = FULL_BLOCK;
   }
 
   bool isNull() const {
       assert(rank_ >= FULL_BLOCK);
-      return rank_ == 0 || (rank_ == FULL_BLOCK && full_ == NULL);
+      return rank_ == 0 || (rank_ == FULL_BLOCK && packedAcquire() == NULL && full_ == NULL);
   }
 
+  /// Single precision copy of this leaf, or NULL
+  const LowPrecisionBlock<T> * packed() const {
+      return packedAcquire();
+  }
+
+  /// Forget the single precision copy of this leaf
+  void dropPacked();
+
   bool isAssembled() const {
       return rank_ > UNINITIALIZED_BLOCK;
   }
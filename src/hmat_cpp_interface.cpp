@@ -22,12 +22,21 @@
 
 #include "hmat_cpp_interface.hpp"
 #include "h_matrix.hpp"
+#include "h2_matrix.hpp"
 #include "rk_matrix.hpp"
 #include "cluster_tree.hpp"
+#include "serialization.hpp"
 #include "common/context.hpp"
+#include "common/block_allocator.hpp"
 #include "disable_threading.hpp"
+#include "iterative_solver.hpp"
+#include "common/chrono.h"
 
+#include "fromdouble.hpp"
+
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
 namespace hmat {
 
@@ -48,11 +57,15 @@ void HMatInterface<T, E>::finalize() {
   if (!initialized) return;
   initialized = false;
   E<T>::finalize();
+  BlockAllocator::instance().release();
 }
 
 template<typename T, template <typename> class E>
 HMatInterface<T, E>::HMatInterface(ClusterTree* _rows, ClusterTree* _cols, SymmetryFlag sym,
                                    AdmissibilityCondition * admissibilityCondition)
+  : factorizationType(hmat_factorization_none), mappedFile_(NULL),
+    lowPrecisionFactors_(NULL), refinementEpsilon_(0), refinementMaxIterations_(0),
+    preconditioner_(NULL), preconditionerEpsilon_(0), coarseningSaved_(0), h2_(NULL)
 {
   DECLARE_CONTEXT;
   engine_.hmat = new HMatrix<T>(_rows, _cols, &HMatSettings::getInstance(), sym, admissibilityCondition);
@@ -60,13 +73,21 @@ HMatInterface<T, E>::HMatInterface(ClusterTree* _rows, ClusterTree* _cols, Symme
 
 template<typename T, template <typename> class E>
 HMatInterface<T, E>::~HMatInterface() {
+  // The factors share the cluster trees of the matrix
+  delete lowPrecisionFactors_;
+  delete preconditioner_;
+  delete h2_;
   engine_.destroy();
   delete engine_.hmat;
+  // The leaves of the matrix may be views on the mapping
+  delete mappedFile_;
 }
 
 template<typename T, template <typename> class E>
 HMatInterface<T, E>::HMatInterface(HMatrix<T>* h) :
-    engine_(h)
+    engine_(h), factorizationType(hmat_factorization_none), mappedFile_(NULL),
+    lowPrecisionFactors_(NULL), refinementEpsilon_(0), refinementMaxIterations_(0),
+    preconditioner_(NULL), preconditionerEpsilon_(0), coarseningSaved_(0), h2_(NULL)
 {}
 
 template<typename T, template <typename> class E>
@@ -75,7 +96,24 @@ void HMatInterface<T, E>::assemble(Assembly<T>& f, SymmetryFlag sym, bool,
   DISABLE_THREADING_IN_BLOCK;
   DECLARE_CONTEXT;
   engine_.progress(progress);
-  engine_.assembly(f, sym, ownAssembly);
+  resetCompressionValidation();
+  coarseningSaved_ = engine_.assembly(f, sym, ownAssembly);
+  validation_ = compressionValidation();
+  valuesChanged();
+}
+
+template<typename T, template <typename> class E>
+void HMatInterface<T, E>::reassemble(Assembly<T>& f, SymmetryFlag sym,
+                                     hmat_progress_t * progress, bool ownAssembly) {
+  HMAT_ASSERT_MSG(engine_.hmat->isAssembled(), "reassemble() needs an assembled matrix");
+  if (factorizationType != hmat_factorization_none) {
+    // The leaves are overwritten by the assembly, only the flags remain
+    if (factorizationType == hmat_factorization_ldlt || factorizationType == hmat_factorization_llt)
+      engine_.hmat->setLower(true);
+    engine_.hmat->setTriLower(false);
+    factorizationType = hmat_factorization_none;
+  }
+  assemble(f, sym, true, progress, ownAssembly);
 }
 
 template<typename T, template <typename> class E>
@@ -85,6 +123,20 @@ void HMatInterface<T, E>::factorize(hmat_factorization_t t, hmat_progress_t * pr
   engine_.progress(progress);
   engine_.factorization(t);
   factorizationType = t;
+  valuesChanged();
+}
+
+template<typename T, template <typename> class E>
+void HMatInterface<T, E>::factorizeMixed(hmat_factorization_t t, double epsilon, int maxIterations,
+                                         hmat_progress_t * progress) {
+  DISABLE_THREADING_IN_BLOCK;
+  DECLARE_CONTEXT;
+  HMAT_ASSERT(epsilon > 0 && maxIterations > 0);
+  delete lowPrecisionFactors_;
+  lowPrecisionFactors_ = new HMatInterface<typename Types<T>::sp, E>(engine_.hmat->singlePrecisionCopy());
+  lowPrecisionFactors_->factorize(t, progress);
+  refinementEpsilon_ = epsilon;
+  refinementMaxIterations_ = maxIterations;
 }
 
 template<typename T, template <typename> class E>
@@ -93,6 +145,21 @@ void HMatInterface<T, E>::inverse(hmat_progress_t * progress) {
   DECLARE_CONTEXT;
   engine_.progress(progress);
   engine_.inverse();
+  valuesChanged();
+}
+
+template<typename T, template <typename> class E>
+void HMatInterface<T, E>::valuesChanged() {
+  delete lowPrecisionFactors_;
+  lowPrecisionFactors_ = NULL;
+  delete preconditioner_;
+  preconditioner_ = NULL;
+  delete h2_;
+  h2_ = NULL;
+  if (HMatrix<T>::accumulateRkUpdates)
+    engine_.hmat->flushUpdates();
+  if (HMatrix<T>::lowPrecisionStorage)
+    engine_.hmat->compact();
 }
 
 template<typename T, template <typename> class E>
@@ -102,11 +169,24 @@ void HMatInterface<T, E>::gemv(char trans, T alpha, FullMatrix<T>& x, T beta,
   DECLARE_CONTEXT;
   reorderVector(&x, trans == 'N' ? engine_.hmat->cols()->indices() : engine_.hmat->rows()->indices());
   reorderVector(&y, trans == 'N' ? engine_.hmat->rows()->indices() : engine_.hmat->cols()->indices());
-  engine_.gemv(trans, alpha, x, beta, y);
+  if (h2_)
+    h2_->gemv(trans, alpha, &x, beta, &y);
+  else
+    engine_.gemv(trans, alpha, x, beta, y);
   restoreVectorOrder(&x, trans == 'N' ? engine_.hmat->cols()->indices() : engine_.hmat->rows()->indices());
   restoreVectorOrder(&y, trans == 'N' ? engine_.hmat->rows()->indices() : engine_.hmat->cols()->indices());
 }
 
+template<typename T, template <typename> class E>
+void HMatInterface<T, E>::convertToH2(double epsilon) {
+  DECLARE_CONTEXT;
+  HMAT_ASSERT_MSG(engine_.hmat->isAssembled(), "convertToH2() needs an assembled matrix");
+  HMAT_ASSERT_MSG(factorizationType == hmat_factorization_none,
+                  "convertToH2() needs a matrix which is not factored");
+  delete h2_;
+  h2_ = new H2Matrix<T>(engine_.hmat, epsilon);
+}
+
 template<typename T, template <typename> class E>
 void HMatInterface<T, E>::gemm(char transA, char transB, T alpha,
                             const HMatInterface<T, E>* a,
@@ -114,6 +194,7 @@ void HMatInterface<T, E>::gemm(char transA, char transB, T alpha,
     DISABLE_THREADING_IN_BLOCK;
     DECLARE_CONTEXT;
     engine_.gemm(transA, transB, alpha, a->engine_, b->engine_, beta);
+    valuesChanged();
 }
 
 template<typename T, template <typename> class E>
@@ -142,10 +223,154 @@ void HMatInterface<T, E>::solve(FullMatrix<T>& b) const {
   DISABLE_THREADING_IN_BLOCK;
   DECLARE_CONTEXT;
   reorderVector<T>(&b, engine_.hmat->cols()->indices());
-  engine_.solve(b, factorizationType);
+  if (lowPrecisionFactors_)
+    refinedSolve(b);
+  else
+    engine_.solve(b, factorizationType);
   restoreVectorOrder<T>(&b, engine_.hmat->cols()->indices());
 }
 
+/** Largest relative norm of the columns of r, the norms of the columns of b being bNorms. */
+template<typename T>
+static double relativeResidual(const FullMatrix<T>& r, const std::vector<double>& bNorms) {
+  double result = 0;
+  for (int j = 0; j < r.cols; j++) {
+    const FullMatrix<T> column(r.m + ((size_t) j) * r.lda, r.rows, 1, r.lda);
+    const double norm = column.norm() / (bNorms[j] > 0 ? bNorms[j] : 1);
+    result = std::max(result, norm);
+  }
+  return result;
+}
+
+template<typename T, template <typename> class E>
+void HMatInterface<T, E>::refinedSolve(FullMatrix<T>& b) const {
+  typedef typename Types<T>::sp sp_t;
+  const hmat_factorization_t t = lowPrecisionFactors_->factorizationType;
+  std::vector<double> bNorms(b.cols);
+  for (int j = 0; j < b.cols; j++) {
+    const FullMatrix<T> column(b.m + ((size_t) j) * b.lda, b.rows, 1, b.lda);
+    bNorms[j] = column.norm();
+  }
+  FullMatrix<T> x(b.rows, b.cols);
+  FullMatrix<T> r(b.rows, b.cols);
+  FullMatrix<T> dx(b.rows, b.cols);
+  b.copy(&r);
+  double residual = 1;
+  for (int i = 0; i < refinementMaxIterations_ && residual > refinementEpsilon_; i++) {
+    // dx = A^-1 r with the single precision factors
+    FullMatrix<sp_t>* d = toSingleFull(&r);
+    lowPrecisionFactors_->engine().solve(*d, t);
+    fromSingleFull(d, &dx);
+    delete d;
+    x.axpy(Constants<T>::pone, &dx);
+    // r = b - A x
+    b.copy(&r);
+    engine_.gemv('N', Constants<T>::mone, x, Constants<T>::pone, r);
+    const double newResidual = relativeResidual(r, bNorms);
+    if (newResidual >= residual) {
+      // The refinement does not converge, keep the previous solution
+      x.axpy(Constants<T>::mone, &dx);
+      break;
+    }
+    residual = newResidual;
+  }
+  x.copy(&b);
+}
+
+/** Product by an HMatrix, in its internal numbering. */
+template<typename T, template <typename> class E>
+class HMatrixOperator : public LinearOperator<T> {
+private:
+  const E<T>& engine_;
+public:
+  explicit HMatrixOperator(const E<T>& engine) : engine_(engine) {}
+  void apply(const Vector<T>& x, Vector<T>& y) const {
+    FullMatrix<T> mx(x.v, x.rows, 1);
+    FullMatrix<T> my(y.v, y.rows, 1);
+    engine_.gemv('N', Constants<T>::pone, mx, Constants<T>::zero, my);
+  }
+};
+
+/** Solve with single precision factors, in their internal numbering. */
+template<typename T, template <typename> class E>
+class FactorsOperator : public LinearOperator<T> {
+private:
+  typedef typename Types<T>::sp sp_t;
+  const E<sp_t>& factors_;
+  hmat_factorization_t factorization_;
+public:
+  FactorsOperator(const E<sp_t>& factors, hmat_factorization_t t) : factors_(factors), factorization_(t) {}
+  void apply(const Vector<T>& x, Vector<T>& y) const {
+    const FullMatrix<T> mx(x.v, x.rows, 1);
+    FullMatrix<T> my(y.v, y.rows, 1);
+    FullMatrix<sp_t>* d = toSingleFull(&mx);
+    factors_.solve(*d, factorization_);
+    fromSingleFull(d, &my);
+    delete d;
+  }
+};
+
+template<typename T, template <typename> class E>
+void HMatInterface<T, E>::solveIterative(FullMatrix<T>& b, hmat_iterative_solver_context_t& context) {
+  DISABLE_THREADING_IN_BLOCK;
+  DECLARE_CONTEXT;
+  typedef typename Types<T>::sp sp_t;
+  HMAT_ASSERT_MSG(factorizationType == hmat_factorization_none,
+                  "The iterative solvers need the matrix, not its factors");
+  HMAT_ASSERT(context.tolerance > 0 && context.max_iterations >= 0 && context.restart > 0);
+  const Time start = now();
+  context.iterations = 0;
+  context.residual = 0;
+  context.converged = 1;
+  context.preconditioner_setup_time = 0;
+  context.product_time = 0;
+  context.preconditioner_apply_time = 0;
+  const bool usePreconditioner = context.preconditioner != hmat_factorization_none;
+  if (usePreconditioner && (preconditioner_ == NULL ||
+                            preconditioner_->factorizationType != context.preconditioner ||
+                            preconditionerEpsilon_ != context.preconditioner_epsilon)) {
+    delete preconditioner_;
+    HMatrix<sp_t>* h = engine_.hmat->singlePrecisionCopy();
+    EpsilonTruncate<sp_t> truncate(context.preconditioner_epsilon);
+    h->walk(&truncate);
+    preconditioner_ = new HMatInterface<sp_t, E>(h);
+    preconditionerEpsilon_ = context.preconditioner_epsilon;
+    // The factorization recompresses at the accuracy of the preconditioner
+    const double recompressionEpsilon = RkMatrix<sp_t>::approx.recompressionEpsilon;
+    RkMatrix<sp_t>::approx.recompressionEpsilon = context.preconditioner_epsilon;
+    try {
+      preconditioner_->factorize(context.preconditioner, NULL);
+    } catch (...) {
+      RkMatrix<sp_t>::approx.recompressionEpsilon = recompressionEpsilon;
+      delete preconditioner_;
+      preconditioner_ = NULL;
+      throw;
+    }
+    RkMatrix<sp_t>::approx.recompressionEpsilon = recompressionEpsilon;
+    context.preconditioner_setup_time = time_diff(start, now());
+  }
+
+  reorderVector<T>(&b, engine_.hmat->cols()->indices());
+  HMatrixOperator<T, E> a(engine_);
+  FactorsOperator<T, E>* m = NULL;
+  if (usePreconditioner)
+    m = new FactorsOperator<T, E>(preconditioner_->engine_, preconditioner_->factorizationType);
+  IterativeSolver<T> solver(a, m, context);
+  Vector<T> x(b.rows);
+  for (int j = 0; j < b.cols; j++) {
+    Vector<T> column(b.m + ((size_t) j) * b.lda, b.rows);
+    x.clear();
+    if (!solver.solve(column, x))
+      context.converged = 0;
+    context.iterations = std::max(context.iterations, solver.iterations());
+    context.residual = std::max(context.residual, solver.residual());
+    memcpy(column.v, x.v, sizeof(T) * x.rows);
+  }
+  delete m;
+  restoreVectorOrder<T>(&b, engine_.hmat->cols()->indices());
+  context.total_time = time_diff(start, now());
+}
+
 template<typename T, template <typename> class E>
 void HMatInterface<T, E>::solve(HMatInterface<T, E>& b) const {
   DISABLE_THREADING_IN_BLOCK;
@@ -174,6 +399,7 @@ HMatInterface<T, E>* HMatInterface<T, E>::copy() const {
   HMatInterface<T, E>* result = new HMatInterface<T, E>(NULL);
   engine_.copy(result->engine_);
   assert(result->engine_.hmat);
+  result->valuesChanged();
   return result;
 }
 
@@ -181,6 +407,7 @@ template<typename T, template <typename> class E>
 void HMatInterface<T, E>::transpose() {
   DECLARE_CONTEXT;
   engine_.transpose();
+  valuesChanged();
 }
 
 
@@ -196,6 +423,7 @@ void HMatInterface<T, E>::scale(T alpha) {
   DISABLE_THREADING_IN_BLOCK;
   DECLARE_CONTEXT;
   engine_.hmat->scale(alpha);
+  valuesChanged();
 }
 
 template<typename T, template <typename> class E>
@@ -203,6 +431,7 @@ void HMatInterface<T, E>::addIdentity(T alpha) {
   DISABLE_THREADING_IN_BLOCK;
   DECLARE_CONTEXT;
   engine_.addIdentity(alpha);
+  valuesChanged();
 }
 
 template<typename T, template <typename> class E>
@@ -210,6 +439,12 @@ void HMatInterface<T, E>::info(hmat_info_t & result) const {
   DECLARE_CONTEXT;
     memset(&result, 0, sizeof(hmat_info_t));
     engine_.hmat->info(result);
+    result.validated_count = validation_.count;
+    result.validation_failures = validation_.failures;
+    result.validation_max_error = validation_.maxError;
+    result.validation_mean_error = validation_.meanError();
+    result.coarsening_saved_size = coarseningSaved_;
+    result.h2_size = h2_ ? h2_->storedSize() : 0;
 }
 
 template<typename T, template <typename> class E>
@@ -243,5 +478,25 @@ void HMatInterface<T, E>::walk(TreeProcedure<HMatrix<T> > *proc){
   DECLARE_CONTEXT;
   return engine_.hmat->walk(proc);
 }
+
+template<typename T, template <typename> class E>
+void HMatInterface<T, E>::writeFile(const char* filename) const {
+  DISABLE_THREADING_IN_BLOCK;
+  DECLARE_CONTEXT;
+  HMatrixFile<T>::write(engine_.hmat, factorizationType, filename);
+}
+
+template<typename T, template <typename> class E>
+HMatInterface<T, E>* HMatInterface<T, E>::readFile(const char* filename) {
+  DISABLE_THREADING_IN_BLOCK;
+  DECLARE_CONTEXT;
+  MappedFile* file = new MappedFile(filename);
+  hmat_factorization_t factorization;
+  HMatrix<T>* h = HMatrixFile<T>::read(*file, &HMatSettings::getInstance(), &factorization);
+  HMatInterface<T, E>* result = new HMatInterface<T, E>(h);
+  result->factorizationType = factorization;
+  result->mappedFile_ = file;
+  return result;
+}
 } // end namespace hmat
 
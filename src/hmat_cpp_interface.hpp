@@ -40,6 +40,8 @@ class AdmissibilityCondition;
 
 class DofCoordinates;
 class ClusteringAlgorithm;
+class MappedFile;
+template<typename T> class H2Matrix;
 
 /** Settings for the HMatrix library.
 
@@ -60,14 +62,21 @@ public:
       \f]
    */
   int maxLeafSize; ///< Maximum size of a leaf in a ClusterTree (and of a non-admissible block in an HMatrix)
-  int maxParallelLeaves; ///< max(|L0|)
+  int maxParallelLeaves; ///< Maximum number of tasks of the parallel assembly, 0 for one per leaf
   bool coarsening; ///< Coarsen the matrix structure after assembly.
+  double coarseningThreshold; ///< Coarsen a block if its Rk form needs less than this fraction of the memory of its children
   bool recompress; ////< Recompress the matrix after assembly.
   bool validateCompression; ///< Validate the rk-matrices after compression
   bool validationReRun; ///< For blocks above error threshold, re-run the compression algorithm
   bool dumpTrace; ///< Dump trace at the end of the algorithms (depends on the runtime)
   bool validationDump; ///< For blocks above error threshold, dump the faulty block to disk
   double validationErrorThreshold; ///< Error threshold for the compression validation
+  int validationSamples; ///< Number of rows and columns sampled by the validation, 0 for the whole blocks
+  int nbThreads; ///< Number of threads of the ParallelEngine, 0 for all the available processors
+  bool blockPool; ///< Recycle the memory of the full blocks in a BlockAllocator, false to use malloc
+  int powerIterations; ///< Number of power iterations of the RandomSvd compression
+  bool lowPrecisionStorage; ///< Store the leaves of double precision matrices in single precision when the accuracy allows it
+  bool accumulateRkUpdates; ///< Recompress the products added to an Rk leaf together instead of one by one
 private:
   /** This constructor sets the default values.
    */
@@ -75,9 +84,12 @@ private:
                    compressionMethod(AcaPlus),  compressionMinLeafSize(100),
                    maxLeafSize(100),
                    maxParallelLeaves(5000),
-                   coarsening(false),
+                   coarsening(false), coarseningThreshold(1.),
                    recompress(true), validateCompression(false),
-                   validationReRun(false), dumpTrace(false), validationDump(false), validationErrorThreshold(0.) {
+                   validationReRun(false), dumpTrace(false), validationDump(false), validationErrorThreshold(0.),
+                   validationSamples(0),
+                   nbThreads(0), blockPool(true), powerIterations(0),
+                   lowPrecisionStorage(false), accumulateRkUpdates(false) {
     setParameters();
   }
   // Disable the copy.
@@ -116,9 +128,12 @@ DofCoordinates* createCoordinates(double* coord, int dim, int size);
     @note This is the only proper way to dispose of a ClusterTree instance.
 
     @param dls Array of DofCoordinate, of length n
+    @param nbThreads number of threads, 0 for HMatSettings::nbThreads, see
+    ClusterTreeBuilder::build()
     @return a ClusterTree instance.
  */
-ClusterTree* createClusterTree(const DofCoordinates& dls, const ClusteringAlgorithm& algo = MedianBisectionAlgorithm());
+ClusterTree* createClusterTree(const DofCoordinates& dls, const ClusteringAlgorithm& algo = MedianBisectionAlgorithm(),
+                               int nbThreads = 1);
 
 class DefaultProgress
 {
@@ -151,6 +166,33 @@ class HMatInterface {
 private:
   E<T> engine_;
   hmat_factorization_t factorizationType;
+  /// File holding the leaves of a matrix created by readFile(), NULL otherwise
+  MappedFile* mappedFile_;
+  /// Single precision factors computed by factorizeMixed(), or NULL
+  HMatInterface<typename Types<T>::sp, E>* lowPrecisionFactors_;
+  /// Stop criterion of the iterative refinement done with lowPrecisionFactors_
+  double refinementEpsilon_;
+  int refinementMaxIterations_;
+  /// Single precision factors of a coarse copy used by solveIterative(), or NULL
+  HMatInterface<typename Types<T>::sp, E>* preconditioner_;
+  /// Accuracy of the compressions in preconditioner_
+  double preconditionerEpsilon_;
+  /// Statistics of the compression validation of the last assemble()
+  CompressionValidation validation_;
+  /// Number of terms saved by the coarsening of the last assemble()
+  size_t coarseningSaved_;
+  /// Nested basis copy used by gemv() after convertToH2(), or NULL
+  H2Matrix<T>* h2_;
+  template<typename, template <typename> class> friend class HMatInterface;
+  /** Must be called after each operation changing the values of the matrix.
+
+      It drops the factors of factorizeMixed() and solveIterative() and the
+      copy of convertToH2(), and packs the leaves in single precision if
+      HMatSettings::lowPrecisionStorage is set.
+   */
+  void valuesChanged();
+  /** Solve with an iterative refinement, b being in the internal numbering. */
+  void refinedSolve(FullMatrix<T>& b) const;
 
 public:
   /** Initialize the library.
@@ -200,6 +242,25 @@ public:
                 hmat_progress_t * progress = DefaultProgress::getInstance(),
                 bool ownAssembly=false);
 
+  /** Assemble again an assembled HMatrix, with new values.
+
+      This is meant for a sequence of matrices on the same geometry, such as a
+      frequency sweep: the cluster trees, the block structure and the
+      admissibility decisions of the previous assembly are kept, including the
+      merges of HMatSettings::coarsening. The pivots of the ACA compressions
+      are kept from the first reassembly on: the compressions of the next ones
+      first try the pivot rows of the previous compression of each block, and
+      allocate the factors for its rank. A factorization of the previous
+      values is dropped.
+
+      @param f The assembly function used to compute various matrix sub-parts
+      @param sym The symmetry of the previous assembly
+      @param ownAssembly true if &f should be deleted by this function
+   */
+  void reassemble(Assembly<T>& f, SymmetryFlag sym,
+                  hmat_progress_t * progress = DefaultProgress::getInstance(),
+                  bool ownAssembly=false);
+
   /** Compute a \f$LU\f$ or \f$LDL^T\f$ decomposition of the HMatrix, in place.
 
       An LDL^T decomposition is done if the HMatrix is symmetric and has been
@@ -209,6 +270,19 @@ public:
    */
   void factorize(hmat_factorization_t, hmat_progress_t * progress = DefaultProgress::getInstance());
 
+  /** Factorize a single precision copy of the HMatrix.
+
+      The HMatrix itself is not modified. The following calls to \a solve()
+      with a FullMatrix do an iterative refinement: the corrections are
+      computed with the single precision factors, and the residuals with
+      \a gemv() in the precision of T. This roughly halves the memory and the
+      time of the factorization for D_t and Z_t. The refinement stops when
+      the relative residual norm of each column is below epsilon, after
+      maxIterations steps, or when the residual does not decrease anymore.
+   */
+  void factorizeMixed(hmat_factorization_t, double epsilon, int maxIterations,
+                      hmat_progress_t * progress = DefaultProgress::getInstance());
+
   /** Compute the inverse of the HMatrix, in place.
    */
   void inverse(hmat_progress_t * progress = DefaultProgress::getInstance());
@@ -226,6 +300,18 @@ public:
       @param y
    */
   void gemv(char trans, T alpha, FullMatrix<T>& x, T beta, FullMatrix<T>& y) const;
+  /** Convert the HMatrix to an H2Matrix, with nested cluster bases.
+
+      The HMatrix itself is not modified. The following calls to \a gemv()
+      use the H2Matrix, whose products are cheaper, until the HMatrix is
+      modified. The HMatrix is kept for the other operations, so this speeds
+      up the products but does not save memory: the H2Matrix is stored in
+      addition, its size is hmat_info_t::h2_size.
+
+      @param epsilon the truncation tolerance of the cluster bases
+      @warning The HMatrix must be assembled and not factored.
+   */
+  void convertToH2(double epsilon);
   /** Matrix-Matrix product.
 
       This computes \f$ C \gets \alpha . op(A) \times op(B) + \beta C\f$ with A,
@@ -260,9 +346,22 @@ public:
   void transpose();
   /** Solve the system \f$A x = b\f$ in place, with A = this, and b a FullMatrix.
 
-      @warning A has to be factored first with \a HMatInterface<T>::factorize().
+      @warning A has to be factored first with \a HMatInterface<T>::factorize()
+      or \a HMatInterface<T>::factorizeMixed().
    */
   void solve(FullMatrix<T>& b) const;
+  /** Solve the system \f$A x = b\f$ in place with a Krylov method, with A = this, and b a FullMatrix.
+
+      The vectors are renumbered once, the iterations are done in the internal
+      numbering. If context.preconditioner is not hmat_factorization_none, a
+      single precision copy of A is truncated at context.preconditioner_epsilon,
+      factorized with the same accuracy, and used as a preconditioner. It is
+      kept for the next calls with the same preconditioner and epsilon, until
+      A is modified. The output fields of context are set.
+
+      @warning A must not be factored.
+   */
+  void solveIterative(FullMatrix<T>& b, hmat_iterative_solver_context_t& context);
   /** Solve the system \f$A x = B\f$ in place, with A = this, and B a HMatInterface<T>.
 
       @warning A has to be factored first with \a HMatInterface<T>::factorize().
@@ -327,6 +426,22 @@ public:
   /** Recursively apply a procedure to all nodes of an HMatrix.
    */
   void walk(TreeProcedure<HMatrix<T> > *proc);
+  /** Write the matrix, its cluster trees and its factorization state to a binary file.
+
+      @param filename output filename
+   */
+  void writeFile(const char* filename) const;
+  /** Load a matrix written by \a writeFile().
+
+      The file is memory-mapped and the blocks are not copied, they are read
+      from the page cache when first used. The cluster trees are owned by the
+      returned instance. The file must not be modified while this instance
+      exists, changes done to the matrix are not written back to it.
+
+      @param filename input filename
+      @return a new HMatInterface instance
+   */
+  static HMatInterface<T, E>* readFile(const char* filename);
 
   typename E<T>::Settings & engineSettings() { return engine_.settings; }
 
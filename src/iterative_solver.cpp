@@ -0,0 +1,297 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "iterative_solver.hpp"
+#include "common/chrono.h"
+#include "common/my_assert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace hmat {
+
+// Conjugate of a scalar, the identity for the real types
+static inline S_t conjugate(S_t x) { return x; }
+static inline D_t conjugate(D_t x) { return x; }
+static inline C_t conjugate(C_t x) { return std::conj(x); }
+static inline Z_t conjugate(Z_t x) { return std::conj(x); }
+
+template<typename T>
+static void copyVector(const Vector<T>& from, Vector<T>& to) {
+  assert(from.rows == to.rows);
+  memcpy(to.v, from.v, sizeof(T) * from.rows);
+}
+
+/** Givens rotation (c, s) such that -conj(s) a + c b = 0. */
+template<typename T>
+static void makeRotation(T a, T b, double& c, T& s) {
+  const double absA = std::abs(a);
+  const double absB = std::abs(b);
+  if (absB == 0) {
+    c = 1;
+    s = Constants<T>::zero;
+  } else if (absA == 0) {
+    c = 0;
+    s = conjugate(b) / T(absB);
+  } else {
+    const double r = sqrt(absA * absA + absB * absB);
+    c = absA / r;
+    s = (a / T(absA)) * conjugate(b) / T(r);
+  }
+}
+
+/** (a, b) <- (c a + s b, -conj(s) a + c b) */
+template<typename T>
+static void applyRotation(double c, T s, T& a, T& b) {
+  const T t = T(c) * a + s * b;
+  b = T(c) * b - conjugate(s) * a;
+  a = t;
+}
+
+template<typename T>
+IterativeSolver<T>::IterativeSolver(const LinearOperator<T>& a, const LinearOperator<T>* preconditioner,
+                                    hmat_iterative_solver_context_t& context)
+  : a_(a), preconditioner_(preconditioner), context_(context), iterations_(0), residual_(0) {}
+
+template<typename T>
+void IterativeSolver<T>::product(const Vector<T>& x, Vector<T>& y) {
+  Time tick = now();
+  a_.apply(x, y);
+  context_.product_time += time_diff(tick, now());
+}
+
+template<typename T>
+void IterativeSolver<T>::precondition(const Vector<T>& x, Vector<T>& y) {
+  if (!preconditioner_) {
+    copyVector(x, y);
+    return;
+  }
+  Time tick = now();
+  preconditioner_->apply(x, y);
+  context_.preconditioner_apply_time += time_diff(tick, now());
+}
+
+template<typename T>
+void IterativeSolver<T>::residualVector(const Vector<T>& b, const Vector<T>& x, Vector<T>& r) {
+  product(x, r);
+  r.scale(Constants<T>::mone);
+  r.axpy(Constants<T>::pone, &b);
+}
+
+template<typename T>
+bool IterativeSolver<T>::solve(const Vector<T>& b, Vector<T>& x) {
+  iterations_ = 0;
+  const double bNorm = b.norm();
+  if (bNorm == 0) {
+    x.clear();
+    residual_ = 0;
+    return true;
+  }
+  bool converged = false;
+  switch (context_.method) {
+  case hmat_iterative_gmres:
+    // GMRES ends with the computation of b - A x
+    return gmres(b, x, bNorm);
+  case hmat_iterative_bicgstab:
+    converged = bicgstab(b, x, bNorm);
+    break;
+  case hmat_iterative_cg:
+    converged = cg(b, x, bNorm);
+    break;
+  default:
+    HMAT_ASSERT_MSG(false, "Unknown iterative method %d", (int) context_.method);
+  }
+  // The residual updated by the recurrences may drift from b - A x
+  Vector<T> r(b.rows);
+  residualVector(b, x, r);
+  residual_ = r.norm() / bNorm;
+  return converged;
+}
+
+template<typename T>
+bool IterativeSolver<T>::gmres(const Vector<T>& b, Vector<T>& x, double bNorm) {
+  const int n = b.rows;
+  const int m = std::max(1, std::min(context_.restart, n));
+  std::vector<Vector<T>*> v(m + 1);
+  for (int i = 0; i <= m; i++)
+    v[i] = new Vector<T>(n);
+  Vector<T> w(n);
+  Vector<T> z(n);
+  // Hessenberg matrix reduced by the Givens rotations (c, s), column major
+  std::vector<T> h((m + 1) * m);
+  std::vector<double> c(m);
+  std::vector<T> s(m);
+  std::vector<T> g(m + 1);
+  std::vector<T> y(m);
+  bool converged = false;
+  while (true) {
+    // Restart from the true residual
+    residualVector(b, x, *v[0]);
+    const double beta = v[0]->norm();
+    residual_ = beta / bNorm;
+    if (residual_ <= context_.tolerance) {
+      converged = true;
+      break;
+    }
+    if (iterations_ >= context_.max_iterations)
+      break;
+    v[0]->scale(T(1 / beta));
+    std::fill(g.begin(), g.end(), Constants<T>::zero);
+    g[0] = T(beta);
+    int k = 0;
+    while (k < m && iterations_ < context_.max_iterations) {
+      precondition(*v[k], z);
+      product(z, w);
+      // Modified Gram-Schmidt
+      T* hk = &h[k * (m + 1)];
+      for (int i = 0; i <= k; i++) {
+        hk[i] = Vector<T>::dot(v[i], &w);
+        w.axpy(-hk[i], v[i]);
+      }
+      const double wNorm = w.norm();
+      hk[k + 1] = T(wNorm);
+      for (int i = 0; i < k; i++)
+        applyRotation(c[i], s[i], hk[i], hk[i + 1]);
+      makeRotation(hk[k], hk[k + 1], c[k], s[k]);
+      applyRotation(c[k], s[k], hk[k], hk[k + 1]);
+      applyRotation(c[k], s[k], g[k], g[k + 1]);
+      k++;
+      iterations_++;
+      // |g[k]| is the residual norm of the least squares problem
+      if (std::abs(g[k]) <= context_.tolerance * bNorm || wNorm == 0)
+        break;
+      copyVector(w, *v[k]);
+      v[k]->scale(T(1 / wNorm));
+    }
+    // x <- x + M^-1 V y, with H y = g
+    for (int i = k - 1; i >= 0; i--) {
+      T sum = g[i];
+      for (int j = i + 1; j < k; j++)
+        sum -= h[j * (m + 1) + i] * y[j];
+      y[i] = sum / h[i * (m + 1) + i];
+    }
+    w.clear();
+    for (int i = 0; i < k; i++)
+      w.axpy(y[i], v[i]);
+    precondition(w, z);
+    x.axpy(Constants<T>::pone, &z);
+  }
+  for (int i = 0; i <= m; i++)
+    delete v[i];
+  return converged;
+}
+
+template<typename T>
+bool IterativeSolver<T>::bicgstab(const Vector<T>& b, Vector<T>& x, double bNorm) {
+  const int n = b.rows;
+  Vector<T> r(n), rHat(n), p(n), v(n), pHat(n), s(n), sHat(n), t(n);
+  residualVector(b, x, r);
+  copyVector(r, rHat);
+  p.clear();
+  v.clear();
+  T rho = Constants<T>::pone;
+  T alpha = Constants<T>::pone;
+  T omega = Constants<T>::pone;
+  residual_ = r.norm() / bNorm;
+  while (residual_ > context_.tolerance && iterations_ < context_.max_iterations) {
+    const T rhoNew = Vector<T>::dot(&rHat, &r);
+    if (rhoNew == Constants<T>::zero)
+      break;
+    const T beta = (rhoNew / rho) * (alpha / omega);
+    // p <- r + beta (p - omega v)
+    p.axpy(-omega, &v);
+    p.scale(beta);
+    p.axpy(Constants<T>::pone, &r);
+    precondition(p, pHat);
+    product(pHat, v);
+    const T rHatV = Vector<T>::dot(&rHat, &v);
+    if (rHatV == Constants<T>::zero)
+      break;
+    alpha = rhoNew / rHatV;
+    x.axpy(alpha, &pHat);
+    // s <- r - alpha v
+    copyVector(r, s);
+    s.axpy(-alpha, &v);
+    iterations_++;
+    residual_ = s.norm() / bNorm;
+    if (residual_ <= context_.tolerance)
+      break;
+    precondition(s, sHat);
+    product(sHat, t);
+    const double tNorm = t.normSqr();
+    if (tNorm == 0)
+      break;
+    omega = Vector<T>::dot(&t, &s) / T(tNorm);
+    x.axpy(omega, &sHat);
+    // r <- s - omega t
+    copyVector(s, r);
+    r.axpy(-omega, &t);
+    rho = rhoNew;
+    residual_ = r.norm() / bNorm;
+    if (omega == Constants<T>::zero)
+      break;
+  }
+  return residual_ <= context_.tolerance;
+}
+
+template<typename T>
+bool IterativeSolver<T>::cg(const Vector<T>& b, Vector<T>& x, double bNorm) {
+  const int n = b.rows;
+  Vector<T> r(n), z(n), p(n), q(n);
+  residualVector(b, x, r);
+  residual_ = r.norm() / bNorm;
+  if (residual_ <= context_.tolerance)
+    return true;
+  precondition(r, z);
+  copyVector(z, p);
+  T rz = Vector<T>::dot(&r, &z);
+  while (iterations_ < context_.max_iterations) {
+    product(p, q);
+    const T pq = Vector<T>::dot(&p, &q);
+    if (pq == Constants<T>::zero)
+      break;
+    const T alpha = rz / pq;
+    x.axpy(alpha, &p);
+    r.axpy(-alpha, &q);
+    iterations_++;
+    residual_ = r.norm() / bNorm;
+    if (residual_ <= context_.tolerance)
+      break;
+    precondition(r, z);
+    const T rzNew = Vector<T>::dot(&r, &z);
+    // p <- z + rzNew / rz p
+    p.scale(rzNew / rz);
+    p.axpy(Constants<T>::pone, &z);
+    rz = rzNew;
+  }
+  return residual_ <= context_.tolerance;
+}
+
+// Templates declaration
+template class IterativeSolver<S_t>;
+template class IterativeSolver<D_t>;
+template class IterativeSolver<C_t>;
+template class IterativeSolver<Z_t>;
+
+}  // end namespace hmat
@@ -0,0 +1,95 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Krylov solvers.
+*/
+#ifndef _ITERATIVE_SOLVER_HPP
+#define _ITERATIVE_SOLVER_HPP
+
+#include "hmat/hmat.h"
+#include "full_matrix.hpp"
+
+namespace hmat {
+
+/*! \brief A linear operator applied by \a IterativeSolver.
+ */
+template<typename T> class LinearOperator {
+public:
+  virtual ~LinearOperator() {}
+  /** y <- op(x), x and y having the same size. */
+  virtual void apply(const Vector<T>& x, Vector<T>& y) const = 0;
+};
+
+/*! \brief Krylov solvers of A x = b, for one right-hand side.
+
+  The method and the stop criterion are taken from a
+  hmat_iterative_solver_context_t, the time spent in the products by A and in
+  the preconditioner are added to its product_time and
+  preconditioner_apply_time fields. The preconditioning of GMRES and BiCGStab
+  is done on the right, so that the residual they minimize is the one of the
+  original system.
+ */
+template<typename T> class IterativeSolver {
+public:
+  /**
+      \param a the matrix A
+      \param preconditioner an approximation of A^-1, or NULL
+      \param context the parameters of the solver
+   */
+  IterativeSolver(const LinearOperator<T>& a, const LinearOperator<T>* preconditioner,
+                  hmat_iterative_solver_context_t& context);
+
+  /** Solve A x = b, x holding the initial guess.
+
+      \return true if the relative residual norm is below the tolerance
+   */
+  bool solve(const Vector<T>& b, Vector<T>& x);
+  /** Number of iterations of the last \a solve(). */
+  int iterations() const { return iterations_; }
+  /** Relative norm of b - A x at the end of the last \a solve(). */
+  double residual() const { return residual_; }
+
+private:
+  bool gmres(const Vector<T>& b, Vector<T>& x, double bNorm);
+  bool bicgstab(const Vector<T>& b, Vector<T>& x, double bNorm);
+  bool cg(const Vector<T>& b, Vector<T>& x, double bNorm);
+  /** r <- b - A x */
+  void residualVector(const Vector<T>& b, const Vector<T>& x, Vector<T>& r);
+  /** y <- A x */
+  void product(const Vector<T>& x, Vector<T>& y);
+  /** y <- M^-1 x, or x without preconditioner */
+  void precondition(const Vector<T>& x, Vector<T>& y);
+
+  const LinearOperator<T>& a_;
+  const LinearOperator<T>* preconditioner_;
+  hmat_iterative_solver_context_t& context_;
+  int iterations_;
+  double residual_;
+
+  IterativeSolver(const IterativeSolver&);
+  void operator=(const IterativeSolver&);
+};
+
+}  // end namespace hmat
+#endif
@@ -423,5 +423,35 @@ template int productQ(char side, char trans, FullMatrix<D_t>* qr, D_t* tau, Full
 template int productQ(char side, char trans, FullMatrix<C_t>* qr, C_t* tau, FullMatrix<C_t>* c);
 template int productQ(char side, char trans, FullMatrix<Z_t>* qr, Z_t* tau, FullMatrix<Z_t>* c);
 
+template<typename T>
+void orthonormalize(FullMatrix<T>* m) {
+  DECLARE_CONTEXT;
+  const int rows = m->rows;
+  const int cols = m->cols;
+  assert(rows >= cols);
+  assert(m->lda == rows);
+  T* tau = qrDecomposition<T>(m);
+  {
+    size_t _m = rows, _n = cols;
+    size_t muls = 2 * _m * _n * _n - (2 * _n * _n * _n) / 3;
+    increment_flops((Multipliers<T>::mul + Multipliers<T>::add) * muls);
+  }
+  int info;
+  T workSize_req;
+  info = proxy_lapack_convenience::or_un_gqr(rows, cols, cols, m->m, rows, tau, &workSize_req, -1);
+  HMAT_ASSERT(!info);
+  int workSize = (int) hmat::real(workSize_req) + 1;
+  T* work = new T[workSize];
+  info = proxy_lapack_convenience::or_un_gqr(rows, cols, cols, m->m, rows, tau, work, workSize);
+  delete[] work;
+  free(tau);
+  HMAT_ASSERT(!info);
+}
+// Explicit instantiations
+template void orthonormalize(FullMatrix<S_t>* m);
+template void orthonormalize(FullMatrix<D_t>* m);
+template void orthonormalize(FullMatrix<C_t>* m);
+template void orthonormalize(FullMatrix<Z_t>* m);
+
 }  // end namespace hmat
 
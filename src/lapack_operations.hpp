@@ -65,6 +65,14 @@ template<typename T> T* qrDecomposition(FullMatrix<T>* m);
 template<typename T>
 int productQ(char side, char trans, FullMatrix<T>* qr, T* tau, FullMatrix<T>* c);
 
+/** Replace the columns of m by an orthonormal basis of the space they span.
+
+    This is the Q factor of the QR decomposition of m, m must have
+    at least as many rows as columns and lda == rows.
+
+    \param m the matrix, overwritten by Q
+ */
+template<typename T> void orthonormalize(FullMatrix<T>* m);
 
 /** Multiplication used in RkMatrix::truncate()
 
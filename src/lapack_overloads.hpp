@@ -600,6 +600,31 @@ or_un_mqr<hmat::Z_t>(char side, char trans, int m, int n, int k, const hmat::Z_t
   return proxy_lapack::unmqr(side, t, m, n, k, a, lda, tau, c, ldc, work, lwork);
 }
 
+// Generate the Q matrix of a QR factorization, with xORGQR or xUNGQR.
+template<typename T>
+int or_un_gqr(int m, int n, int k, T* a, int lda, const T* tau, T* work, int lwork);
+
+template<>
+inline int
+or_un_gqr<hmat::S_t>(int m, int n, int k, hmat::S_t* a, int lda, const hmat::S_t* tau, hmat::S_t* work, int lwork) {
+  return proxy_lapack::orgqr(m, n, k, a, lda, tau, work, lwork);
+}
+template<>
+inline int
+or_un_gqr<hmat::D_t>(int m, int n, int k, hmat::D_t* a, int lda, const hmat::D_t* tau, hmat::D_t* work, int lwork) {
+  return proxy_lapack::orgqr(m, n, k, a, lda, tau, work, lwork);
+}
+template<>
+inline int
+or_un_gqr<hmat::C_t>(int m, int n, int k, hmat::C_t* a, int lda, const hmat::C_t* tau, hmat::C_t* work, int lwork) {
+  return proxy_lapack::ungqr(m, n, k, a, lda, tau, work, lwork);
+}
+template<>
+inline int
+or_un_gqr<hmat::Z_t>(int m, int n, int k, hmat::Z_t* a, int lda, const hmat::Z_t* tau, hmat::Z_t* work, int lwork) {
+  return proxy_lapack::ungqr(m, n, k, a, lda, tau, work, lwork);
+}
+
 }  // end namespace proxy_lapack_convenience
 
 namespace hmat {
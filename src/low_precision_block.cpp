@@ -0,0 +1,181 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "low_precision_block.hpp"
+#include "fromdouble.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace hmat {
+
+// Size of the buffer holding the columns converted to T in gemv()
+static const size_t CONVERSION_BUFFER_BYTES = 64 * 1024;
+// Unit roundoff of the single precision
+static const double SINGLE_ROUNDOFF = FLT_EPSILON / 2;
+// The rounding must be this fraction of the target accuracy at most
+static const double ROUNDOFF_MARGIN = 0.1;
+
+template<typename T>
+LowPrecisionBlock<T>::LowPrecisionBlock(const RkMatrix<T>* rk)
+  : a_(toSingleFull(rk->a)), b_(toSingleFull(rk->b)),
+    rows_(rk->rows), cols_(rk->cols), method_(rk->method) {
+  assert(rk->rank() > 0);
+}
+
+template<typename T>
+LowPrecisionBlock<T>::LowPrecisionBlock(const FullMatrix<T>* f)
+  : a_(toSingleFull(f)), b_(NULL), rows_(NULL), cols_(NULL), method_(NoCompression) {
+  assert(f->diagonal == NULL && f->pivots == NULL);
+}
+
+template<typename T>
+LowPrecisionBlock<T>::~LowPrecisionBlock() {
+  delete a_;
+  delete b_;
+}
+
+template<typename T>
+RkMatrix<T>* LowPrecisionBlock<T>::unpackRk() const {
+  assert(isRk());
+  RkMatrix<T>* result = new RkMatrix<T>(rows_, cols_, a_->cols, method_);
+  fromSingleFull(a_, result->a);
+  fromSingleFull(b_, result->b);
+  return result;
+}
+
+template<typename T>
+FullMatrix<T>* LowPrecisionBlock<T>::unpackFull() const {
+  assert(!isRk());
+  FullMatrix<T>* result = new FullMatrix<T>(a_->rows, a_->cols);
+  fromSingleFull(a_, result);
+  return result;
+}
+
+template<typename T>
+RkMatrix<typename Types<T>::sp>* LowPrecisionBlock<T>::copyRk() const {
+  assert(isRk());
+  return new RkMatrix<sp_t>(a_->copy(), rows_, b_->copy(), cols_, method_);
+}
+
+template<typename T>
+FullMatrix<typename Types<T>::sp>* LowPrecisionBlock<T>::copyFull() const {
+  assert(!isRk());
+  return a_->copy();
+}
+
+template<typename T>
+LowPrecisionBlock<T>* LowPrecisionBlock<T>::subset(int rowOffset, const IndexSet* subRows,
+                                                   int colOffset, const IndexSet* subCols) const {
+  if (!isRk()) {
+    FullMatrix<sp_t>* a = new FullMatrix<sp_t>(a_->m + rowOffset + ((size_t) colOffset) * a_->lda,
+                                               subRows->size(), subCols->size(), a_->lda);
+    return new LowPrecisionBlock<T>(a, NULL, NULL, NULL, method_);
+  }
+  FullMatrix<sp_t>* a = new FullMatrix<sp_t>(a_->m + rowOffset, subRows->size(), a_->cols, a_->lda);
+  FullMatrix<sp_t>* b = new FullMatrix<sp_t>(b_->m + colOffset, subCols->size(), b_->cols, b_->lda);
+  return new LowPrecisionBlock<T>(a, b, subRows, subCols, method_);
+}
+
+/** y <- y + alpha * op(m) * x, m being converted to T by chunks of columns. */
+template<typename T>
+static void chunkedProduct(const FullMatrix<typename Types<T>::sp>* m, char trans, T alpha,
+                           const FullMatrix<T>* x, FullMatrix<T>* y) {
+  typedef typename Types<T>::sp sp_t;
+  const int chunk = std::max(1, (int) (CONVERSION_BUFFER_BYTES / (sizeof(T) * std::max(m->rows, 1))));
+  FullMatrix<T> buffer(m->rows, std::min(chunk, m->cols));
+  for (int j = 0; j < m->cols; j += chunk) {
+    const int n = std::min(chunk, m->cols - j);
+    const FullMatrix<sp_t> mj(m->m + ((size_t) j) * m->lda, m->rows, n, m->lda);
+    FullMatrix<T> converted(buffer.m, m->rows, n, m->rows);
+    fromSingleFull(&mj, &converted);
+    if (trans == 'N') {
+      const FullMatrix<T> xj(x->m + j, n, x->cols, x->lda);
+      y->gemm('N', 'N', alpha, &converted, &xj, Constants<T>::pone);
+    } else {
+      FullMatrix<T> yj(y->m + j, n, y->cols, y->lda);
+      yj.gemm('T', 'N', alpha, &converted, x, Constants<T>::pone);
+    }
+  }
+}
+
+template<typename T>
+void LowPrecisionBlock<T>::gemv(char trans, T alpha, const FullMatrix<T>* x, FullMatrix<T>* y,
+                                int start) const {
+  assert(trans == 'N' || trans == 'T');
+  if (!isRk()) {
+    if (trans == 'N') {
+      const FullMatrix<sp_t> sub(a_->m + start, y->rows, a_->cols, a_->lda);
+      chunkedProduct(&sub, 'N', alpha, x, y);
+    } else {
+      const FullMatrix<sp_t> sub(a_->m + ((size_t) start) * a_->lda, a_->rows, y->rows, a_->lda);
+      chunkedProduct(&sub, 'T', alpha, x, y);
+    }
+    return;
+  }
+  // op(A B^t) x = A (B^t x) or B (A^t x), with only a part of the rows of A or B
+  FullMatrix<T> z(a_->cols, x->cols);
+  gemvProject(trans, x, &z);
+  gemvExpand(trans, alpha, &z, y, start);
+}
+
+template<typename T>
+void LowPrecisionBlock<T>::gemvProject(char trans, const FullMatrix<T>* x, FullMatrix<T>* z) const {
+  assert(isRk());
+  chunkedProduct(trans == 'N' ? b_ : a_, 'T', Constants<T>::pone, x, z);
+}
+
+template<typename T>
+void LowPrecisionBlock<T>::gemvExpand(char trans, T alpha, const FullMatrix<T>* z, FullMatrix<T>* y,
+                                      int start) const {
+  assert(isRk());
+  const FullMatrix<sp_t>* left = trans == 'N' ? a_ : b_;
+  const FullMatrix<sp_t> subLeft(left->m + start, y->rows, left->cols, left->lda);
+  chunkedProduct(&subLeft, 'N', alpha, z, y);
+}
+
+template<typename T>
+size_t LowPrecisionBlock<T>::storedZeros() const {
+  return isRk() ? 0 : a_->storedZeros();
+}
+
+template<typename T>
+bool LowPrecisionBlock<T>::isAccurate(const RkMatrix<T>* rk, double epsilon) {
+  if (rk->rank() == 0)
+    return false;
+  // The rounding of A and B changes A B^t by 2 u |A| |B| at most
+  const double norm = sqrt(rk->normSqr());
+  return 2 * SINGLE_ROUNDOFF * rk->a->norm() * rk->b->norm() <= ROUNDOFF_MARGIN * epsilon * norm;
+}
+
+template<typename T>
+bool LowPrecisionBlock<T>::isAccurate(const FullMatrix<T>*, double epsilon) {
+  return SINGLE_ROUNDOFF <= ROUNDOFF_MARGIN * epsilon;
+}
+
+// Templates declaration
+template class LowPrecisionBlock<S_t>;
+template class LowPrecisionBlock<D_t>;
+template class LowPrecisionBlock<C_t>;
+template class LowPrecisionBlock<Z_t>;
+
+}  // end namespace hmat
@@ -0,0 +1,113 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Leaves of an HMatrix stored in single precision.
+*/
+#ifndef _LOW_PRECISION_BLOCK_HPP
+#define _LOW_PRECISION_BLOCK_HPP
+
+#include "data_types.hpp"
+#include "full_matrix.hpp"
+#include "rk_matrix.hpp"
+
+namespace hmat {
+
+/*! \brief A leaf of a double precision HMatrix kept in single precision.
+
+  It holds either the factors A and B of an RkMatrix, or a full block. The
+  products with a vector convert the block to T by chunks of columns, so that
+  the memory of the leaf is never doubled. The other operations use the
+  RkMatrix or FullMatrix rebuilt by \a unpackRk() and \a unpackFull().
+ */
+template<typename T> class LowPrecisionBlock {
+public:
+  typedef typename Types<T>::sp sp_t;
+
+  /** Pack the factors of rk, which is not modified. */
+  explicit LowPrecisionBlock(const RkMatrix<T>* rk);
+  /** Pack a full block, which is not modified. */
+  explicit LowPrecisionBlock(const FullMatrix<T>* f);
+  ~LowPrecisionBlock();
+
+  /** True if this holds an Rk block. */
+  bool isRk() const { return b_ != NULL; }
+  /** Return a new RkMatrix in precision T. */
+  RkMatrix<T>* unpackRk() const;
+  /** Return a new FullMatrix in precision T. */
+  FullMatrix<T>* unpackFull() const;
+  /** Return a copy of an Rk block in single precision. */
+  RkMatrix<sp_t>* copyRk() const;
+  /** Return a copy of a full block in single precision. */
+  FullMatrix<sp_t>* copyFull() const;
+  /** Return a view on the rows [rowOffset, rowOffset + subRows->size()) and
+      the columns [colOffset, colOffset + subCols->size()) of this block,
+      which shares its data.
+   */
+  LowPrecisionBlock<T>* subset(int rowOffset, const IndexSet* subRows,
+                               int colOffset, const IndexSet* subCols) const;
+
+  /** y <- y + alpha * op(this) * x, with op = 'N' or 'T' as in BLAS.
+
+      y may hold only the rows [start, start + y->rows) of op(this) * x.
+   */
+  void gemv(char trans, T alpha, const FullMatrix<T>* x, FullMatrix<T>* y, int start = 0) const;
+  /** z <- z + B^t x for trans = 'N', or A^t x for 'T': the first half of
+      \a gemv() for an Rk block, z having rank() rows.
+   */
+  void gemvProject(char trans, const FullMatrix<T>* x, FullMatrix<T>* z) const;
+  /** y <- y + alpha * A z for trans = 'N', or B z for 'T': the second half
+      of \a gemv() for an Rk block, with the same start as \a gemv().
+   */
+  void gemvExpand(char trans, T alpha, const FullMatrix<T>* z, FullMatrix<T>* y, int start = 0) const;
+  /** Rank of an Rk block. */
+  int rank() const { return a_->cols; }
+
+  /** Number of zeros stored in a full block. */
+  size_t storedZeros() const;
+
+  /** True if the single precision rounding of the factors of rk is far
+      below epsilon, relatively to the norm of rk.
+   */
+  static bool isAccurate(const RkMatrix<T>* rk, double epsilon);
+  /** True if the single precision rounding of a full block is far below epsilon. */
+  static bool isAccurate(const FullMatrix<T>* f, double epsilon);
+
+private:
+  /// Full block, or factor A of an Rk block
+  FullMatrix<sp_t>* a_;
+  /// Factor B of an Rk block, NULL for a full block
+  FullMatrix<sp_t>* b_;
+  const IndexSet* rows_;
+  const IndexSet* cols_;
+  CompressionMethod method_;
+
+  LowPrecisionBlock(FullMatrix<sp_t>* a, FullMatrix<sp_t>* b, const IndexSet* rows,
+                    const IndexSet* cols, CompressionMethod method)
+    : a_(a), b_(b), rows_(rows), cols_(cols), method_(method) {}
+  LowPrecisionBlock(const LowPrecisionBlock&);
+  void operator=(const LowPrecisionBlock&);
+};
+
+}  // end namespace hmat
+#endif
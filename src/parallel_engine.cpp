@@ -0,0 +1,95 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "parallel_engine.hpp"
+#include "hmat_cpp_interface.hpp"
+#include "task_pool.hpp"
+#include "cluster_tree.hpp"
+#include "common/context.hpp"
+#include "common/my_assert.h"
+
+namespace hmat {
+
+template<typename T>
+size_t ParallelEngine<T>::assembly(Assembly<T>& f, SymmetryFlag sym, bool ownAssembly) {
+  HMatrix<T>* hmat = this->hmat;
+  const int nbThreads = TaskPool::defaultThreadCount();
+  size_t saved;
+  if (sym == kLowerSymmetric || hmat->isLower || hmat->isUpper) {
+    saved = hmat->assembleSymmetric(f, NULL, hmat->isLower || hmat->isUpper, AllocationObserver(), nbThreads);
+  } else {
+    saved = hmat->assemble(f, AllocationObserver(), nbThreads);
+  }
+  if(ownAssembly)
+      delete &f;
+  return saved;
+}
+
+template<typename T>
+void ParallelEngine<T>::factorization(hmat_factorization_t t) {
+  HMatrix<T>* hmat = this->hmat;
+  const int nbThreads = TaskPool::defaultThreadCount();
+  switch(t)
+  {
+  case hmat_factorization_lu:
+      hmat->luDecomposition(nbThreads);
+      break;
+  case hmat_factorization_ldlt:
+      hmat->ldltDecomposition(nbThreads);
+      break;
+  case hmat_factorization_llt:
+      hmat->lltDecomposition(nbThreads);
+      break;
+  default:
+      HMAT_ASSERT(false);
+  }
+}
+
+template<typename T>
+void ParallelEngine<T>::gemv(char trans, T alpha, FullMatrix<T>& x,
+                             T beta, FullMatrix<T>& y) const {
+  this->hmat->gemv(trans, alpha, &x, beta, &y, TaskPool::defaultThreadCount());
+}
+
+template<typename T>
+void ParallelEngine<T>::solve(FullMatrix<T>& b, hmat_factorization_t t) const {
+  this->hmat->solve(&b, t, TaskPool::defaultThreadCount());
+}
+
+}  // end namespace hmat
+
+#include "hmat_cpp_interface.cpp"
+
+namespace hmat {
+
+// Explicit template instantiation
+template class ParallelEngine<S_t>;
+template class ParallelEngine<D_t>;
+template class ParallelEngine<C_t>;
+template class ParallelEngine<Z_t>;
+
+template class HMatInterface<S_t, ParallelEngine>;
+template class HMatInterface<D_t, ParallelEngine>;
+template class HMatInterface<C_t, ParallelEngine>;
+template class HMatInterface<Z_t, ParallelEngine>;
+
+}  // end namespace hmat
@@ -0,0 +1,51 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#ifndef _PARALLEL_ENGINE_HPP
+#define _PARALLEL_ENGINE_HPP
+#include "default_engine.hpp"
+
+namespace hmat {
+
+/*! \brief Shared memory engine, running the HMatrix algorithms on a \a TaskPool.
+
+  The number of threads is \a HMatSettings::nbThreads. Assembly, LU, LDLt and
+  LLt factorizations, gemv and the solves with several right-hand sides are
+  split into tasks, the other operations are those of \a DefaultEngine.
+
+  \warning The assembly functions are called concurrently from several
+  threads, so they must be thread safe.
+ */
+template<typename T> class ParallelEngine : public DefaultEngine<T>
+{
+public:
+  explicit ParallelEngine(HMatrix<T>* m = NULL): DefaultEngine<T>(m) {}
+  size_t assembly(Assembly<T>& f, SymmetryFlag sym, bool ownAssembly);
+  void factorization(hmat_factorization_t);
+  void gemv(char trans, T alpha, FullMatrix<T>& x, T beta, FullMatrix<T>& y) const;
+  using DefaultEngine<T>::solve;
+  void solve(FullMatrix<T>& b, hmat_factorization_t) const;
+};
+
+}  // end namespace hmat
+
+#endif
@@ -29,6 +29,7 @@
 
 #include "recursion.hpp"
 #include "h_matrix.hpp"
+#include "task_pool.hpp"
 #include "common/context.hpp"
 
 namespace hmat {
@@ -308,4 +309,286 @@ namespace hmat {
 
   }
 
+  namespace {
+  /** One block operation of a RecursionGraph. */
+  template <typename T, typename Mat> class BlockTask : public Task {
+  public:
+    enum Operation {
+      LU, LDLT, LLT,
+      // Tag a lower symmetric matrix as factorized, once its children are
+      FACTORIZED_LOWER,
+      SOLVE_LOWER_LEFT, SOLVE_UPPER_RIGHT, MULTIPLY_DIAG,
+      GEMM, MDMT, MDNT
+    };
+    BlockTask(Operation op, Mat* c, const Mat* a = NULL, const Mat* b = NULL, const Mat* d = NULL)
+      : op_(op), c_(c), a_(a), b_(b), d_(d), transA_('N'), transB_('N'),
+        unitriangular_(false), lowerStored_(false) {
+      // Factorizations and solves are on the critical path
+      setPriority(op < SOLVE_LOWER_LEFT ? 2 : (op < GEMM ? 1 : 0));
+    }
+    BlockTask* trans(char transA, char transB) {
+      transA_ = transA;
+      transB_ = transB;
+      return this;
+    }
+    BlockTask* triangular(bool unitriangular, bool lowerStored) {
+      unitriangular_ = unitriangular;
+      lowerStored_ = lowerStored;
+      return this;
+    }
+    void run() {
+      switch (op_) {
+      case LU: c_->luDecomposition(); break;
+      case LDLT: c_->ldltDecomposition(); break;
+      case LLT: c_->lltDecomposition(); break;
+      case FACTORIZED_LOWER:
+        c_->isTriLower = true;
+        c_->isLower = false;
+        break;
+      case SOLVE_LOWER_LEFT: a_->solveLowerTriangularLeft(c_, unitriangular_); break;
+      case SOLVE_UPPER_RIGHT: a_->solveUpperTriangularRight(c_, unitriangular_, lowerStored_); break;
+      case MULTIPLY_DIAG: c_->multiplyWithDiag(d_, false, true); break;
+      case GEMM: c_->gemm(transA_, transB_, Constants<T>::mone, a_, b_, Constants<T>::pone); break;
+      case MDMT: c_->mdmtProduct(a_, d_); break;
+      case MDNT: c_->mdntProduct(a_, d_, b_); break;
+      }
+    }
+  private:
+    Operation op_;
+    Mat* c_;
+    const Mat* a_;
+    const Mat* b_;
+    const Mat* d_;
+    char transA_, transB_;
+    bool unitriangular_, lowerStored_;
+  };
+  }  // end anonymous namespace
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::addHandles(const Mat* m, std::vector<const void*>& handles) const {
+    if (!m)
+      return;
+    // Below the cut, a node is part of its ancestor at depth_
+    while (m->depth > depth_)
+      m = m->father;
+    if (!expand(m)) {
+      handles.push_back(m);
+      return;
+    }
+    for (int i = 0; i < m->nrChild(); i++)
+      addHandles(m->getChild(i), handles);
+  }
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::submit(Task* task, const Mat* write, const Mat* read1,
+                                      const Mat* read2, const Mat* read3) {
+    std::vector<const void*> reads, writes;
+    addHandles(read1, reads);
+    addHandles(read2, reads);
+    addHandles(read3, reads);
+    addHandles(write, writes);
+    pool_.submit(task, reads, writes);
+  }
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::luDecomposition(Mat* m) {
+    typedef BlockTask<T, Mat> BT;
+    if (m->rows()->size() == 0 || m->cols()->size() == 0) return;
+    if (!expand(m)) {
+      submit(new BT(BT::LU, m), m);
+      return;
+    }
+    // Same loops as RecursionMatrix::recursiveLuDecomposition()
+    for (int k=0 ; k<m->nrChildRow() ; k++) {
+      Mat* kk = m->get(k,k);
+      if (!kk) continue;
+      luDecomposition(kk);
+      for (int i=k+1 ; i<m->nrChildRow() ; i++)
+        if (m->get(k,i))
+          solveLowerTriangularLeft(kk, m->get(k,i), true);
+      for (int i=k+1 ; i<m->nrChildRow() ; i++)
+        if (m->get(i,k))
+          solveUpperTriangularRight(kk, m->get(i,k), false, false);
+      for (int i=k+1 ; i<m->nrChildRow() ; i++)
+        for (int j=k+1 ; j<m->nrChildRow() ; j++)
+          if (m->get(i,j) && m->get(i,k) && m->get(k,j))
+            gemm(m->get(i,j), 'N', 'N', m->get(i,k), m->get(k,j));
+    }
+  }
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::ldltDecomposition(Mat* m) {
+    typedef BlockTask<T, Mat> BT;
+    if (m->rows()->size() == 0 || m->cols()->size() == 0) return;
+    if (!expand(m)) {
+      submit(new BT(BT::LDLT, m), m);
+      return;
+    }
+    // Same loops as RecursionMatrix::recursiveLdltDecomposition()
+    for (int k=0 ; k<m->nrChildRow() ; k++) {
+      Mat* kk = m->get(k,k);
+      ldltDecomposition(kk);
+      for (int i=k+1 ; i<m->nrChildRow() ; i++) {
+        solveUpperTriangularRight(kk, m->get(i,k), false, true);
+        multiplyWithDiag(m->get(i,k), kk);
+      }
+      for (int i=k+1 ; i<m->nrChildRow() ; i++)
+        for (int j=k+1 ; j<=i ; j++)
+          if (i==j)
+            mdmtProduct(m->get(i,i), m->get(i,k), kk);
+          else
+            mdntProduct(m->get(i,j), m->get(i,k), kk, m->get(j,k));
+    }
+    submit(new BT(BT::FACTORIZED_LOWER, m), m);
+  }
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::lltDecomposition(Mat* m) {
+    typedef BlockTask<T, Mat> BT;
+    if (m->rows()->size() == 0 || m->cols()->size() == 0) return;
+    if (!expand(m)) {
+      submit(new BT(BT::LLT, m), m);
+      return;
+    }
+    HMAT_ASSERT(m->isLower);
+    // Same loops as RecursionMatrix::recursiveLltDecomposition()
+    for (int k=0 ; k<m->nrChildRow() ; k++) {
+      Mat* kk = m->get(k,k);
+      lltDecomposition(kk);
+      for (int i=k+1 ; i<m->nrChildRow() ; i++)
+        solveUpperTriangularRight(kk, m->get(i,k), false, true);
+      for (int i=k+1 ; i<m->nrChildRow() ; i++)
+        for (int j=k+1 ; j<=i ; j++)
+          gemm(m->get(i,j), 'N', 'T', m->get(i,k), m->get(j,k));
+    }
+    submit(new BT(BT::FACTORIZED_LOWER, m), m);
+  }
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::solveLowerTriangularLeft(const Mat* l, Mat* b, bool unitriangular) {
+    typedef BlockTask<T, Mat> BT;
+    if (l->rows()->size() == 0 || l->cols()->size() == 0) return;
+    if (!expand(l) || !expand(b)) {
+      submit((new BT(BT::SOLVE_LOWER_LEFT, b, l))->triangular(unitriangular, false), b, l);
+      return;
+    }
+    // Same loops as RecursionMatrix::recursiveSolveLowerTriangularLeft()
+    for (int k=0 ; k<b->nrChildCol() ; k++)
+      for (int i=0 ; i<l->nrChildRow() ; i++) {
+        if (!b->get(i, k)) continue;
+        for (int j=0 ; j<i ; j++)
+          if (l->get(i,j) && b->get(j,k))
+            gemm(b->get(i, k), 'N', 'N', l->get(i, j), b->get(j,k));
+        solveLowerTriangularLeft(l->get(i, i), b->get(i,k), unitriangular);
+      }
+  }
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::solveUpperTriangularRight(const Mat* u, Mat* b, bool unitriangular, bool lowerStored) {
+    typedef BlockTask<T, Mat> BT;
+    if (u->rows()->size() == 0 || u->cols()->size() == 0) return;
+    if (!expand(u) || !expand(b)) {
+      submit((new BT(BT::SOLVE_UPPER_RIGHT, b, u))->triangular(unitriangular, lowerStored), b, u);
+      return;
+    }
+    // Same loops as RecursionMatrix::recursiveSolveUpperTriangularRight()
+    for (int k=0 ; k<b->nrChildRow() ; k++)
+      for (int i=0 ; i<u->nrChildRow() ; i++) {
+        if (!b->get(k, i)) continue;
+        for (int j=0 ; j<i ; j++)
+          if (b->get(k, j) && (lowerStored ? u->get(i,j) : u->get(j,i)))
+            gemm(b->get(k, i), 'N', lowerStored ? 'T' : 'N', b->get(k, j), lowerStored ? u->get(i,j) : u->get(j,i));
+        solveUpperTriangularRight(u->get(i, i), b->get(k,i), unitriangular, lowerStored);
+      }
+  }
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::multiplyWithDiag(Mat* b, const Mat* d) {
+    typedef BlockTask<T, Mat> BT;
+    if (b->rows()->size() == 0 || b->cols()->size() == 0) return;
+    if (!expand(b) || !expand(d)) {
+      submit(new BT(BT::MULTIPLY_DIAG, b, NULL, NULL, d), b, d);
+      return;
+    }
+    // Same loops as HMatrix::multiplyWithDiag(), with left = false and inverse = true
+    for (int i=0 ; i<b->nrChildRow() ; i++)
+      multiplyWithDiag(b->get(i,i), d->get(i,i));
+    for (int i=0 ; i<b->nrChildRow() ; i++)
+      for (int j=0 ; j<b->nrChildCol() ; j++)
+        if (i!=j && b->get(i,j))
+          multiplyWithDiag(b->get(i,j), d->get(j,j));
+  }
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::gemm(Mat* c, char transA, char transB, const Mat* a, const Mat* b) {
+    typedef BlockTask<T, Mat> BT;
+    if (c->rows()->size() == 0 || c->cols()->size() == 0) return;
+    if (!expand(c) || !expand(a) || !expand(b)) {
+      submit((new BT(BT::GEMM, c, a, b))->trans(transA, transB), c, a, b);
+      return;
+    }
+    if (a->rows()->size() == 0 || a->cols()->size() == 0) return;
+    // Same loops as HMatrix::recursiveGemm()
+    for (int i = 0; i < c->nrChildRow(); i++) {
+      for (int j = 0; j < c->nrChildCol(); j++) {
+        Mat* child = c->get(i, j);
+        if (!child) continue;
+        if (child->rows()->size() == 0 || child->cols()->size() == 0) continue;
+        char tA = transA, tB = transB;
+        for (int k = 0; k < (tA=='N' ? a->nrChildCol() : a->nrChildRow()) ; k++) {
+          const Mat* childA = (tA == 'N' ? a->get(i, k) : a->get(k, i));
+          const Mat* childB = (tB == 'N' ? b->get(k, j) : b->get(j, k));
+          if (!childA && (a->isTriUpper || a->isTriLower)) continue;
+          if (!childB && (b->isTriUpper || b->isTriLower)) continue;
+          if ((a->isUpper &&  i>k) || (a->isLower &&  i<k)) {
+            tA = (tA == 'N' ? 'T' : 'N');
+            childA = (tA == 'N' ? a->get(i, k) : a->get(k, i));
+          }
+          if ((b->isUpper &&  j<k) || (b->isLower &&  j<k)) {
+            tB = (tB == 'N' ? 'T' : 'N');
+            childB = (tB == 'N' ? b->get(k, j) : b->get(j, k));
+          }
+          if (!childA || !childB) continue;
+          gemm(child, tA, tB, childA, childB);
+        }
+      }
+    }
+  }
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::mdmtProduct(Mat* c, const Mat* m, const Mat* d) {
+    typedef BlockTask<T, Mat> BT;
+    if (c->rows()->size() == 0 || c->cols()->size() == 0) return;
+    if (!expand(c) || !expand(m) || !expand(d)) {
+      submit(new BT(BT::MDMT, c, m, NULL, d), c, m, d);
+      return;
+    }
+    if (m->rows()->size() == 0 || m->cols()->size() == 0) return;
+    // Same loops as RecursionMatrix::recursiveMdmtProduct()
+    for (int i=0 ; i<c->nrChildRow() ; i++)
+      for (int j=0 ; j<=i ; j++)
+        for (int k=0 ; k<c->nrChildRow() ; k++)
+          if (i==j)
+            mdmtProduct(c->get(i,i), m->get(i,k), d->get(k,k));
+          else
+            mdntProduct(c->get(i,j), m->get(i,k), d->get(k,k), m->get(j,k));
+  }
+
+  template<typename T, typename Mat>
+  void RecursionGraph<T, Mat>::mdntProduct(Mat* c, const Mat* m, const Mat* d, const Mat* n) {
+    typedef BlockTask<T, Mat> BT;
+    if (c->rows()->size() == 0 || c->cols()->size() == 0) return;
+    if (!expand(c) || !expand(m) || !expand(d) || !expand(n)
+        || m->nrChildCol() != d->nrChildRow() || n->nrChildCol() != d->nrChildRow()) {
+      submit(new BT(BT::MDNT, c, m, n, d), c, m, n, d);
+      return;
+    }
+    // c_ij -= sum_k m_ik d_k n_jk^T
+    for (int i=0 ; i<c->nrChildRow() ; i++)
+      for (int j=0 ; j<c->nrChildCol() ; j++)
+        for (int k=0 ; k<d->nrChildRow() ; k++)
+          if (c->get(i,j) && m->get(i,k) && n->get(j,k))
+            mdntProduct(c->get(i,j), m->get(i,k), d->get(k,k), n->get(j,k));
+  }
+
 }  // end namespace hmat
@@ -27,8 +27,14 @@
 #ifndef RECURSION_HPP
 #define RECURSION_HPP
 
+#include <cstddef>
+#include <vector>
+
 namespace hmat {
 
+  class Task;
+  class TaskPool;
+
   /*! \brief Templated hierarchical matrix class.
 
   This class defines recursive algorithms used by H-Matrix.
@@ -59,6 +65,47 @@ namespace hmat {
     }
   };
 
+  /*! \brief Task graph of the recursive factorizations.
+
+    The loops of RecursionMatrix are unrolled down to a given depth of the
+    tree: a block operation on nodes above this depth is replaced by the
+    operations on their children, the other ones are submitted as tasks to a
+    TaskPool. Tasks read and write the nodes at this depth, or the leaves above
+    it, so that each task starts as soon as the blocks it uses are final.
+    Tasks are submitted in the order of the recursive algorithm, so the result
+    is the one of RecursionMatrix.
+   */
+  template <typename T, typename Mat>
+  class RecursionGraph {
+  public:
+    /** \param depth depth of the tree (as in Tree::depth) below which the operations are tasks */
+    RecursionGraph(TaskPool& pool, int depth) : pool_(pool), depth_(depth) {}
+    void luDecomposition(Mat* m);
+    void ldltDecomposition(Mat* m);
+    void lltDecomposition(Mat* m);
+    void solveLowerTriangularLeft(const Mat* l, Mat* b, bool unitriangular);
+    void solveUpperTriangularRight(const Mat* u, Mat* b, bool unitriangular, bool lowerStored);
+    /** b <- b * d^-1, d being the result of an LDLt factorization */
+    void multiplyWithDiag(Mat* b, const Mat* d);
+    /** c <- c - op(a) * op(b) */
+    void gemm(Mat* c, char transA, char transB, const Mat* a, const Mat* b);
+    /** c <- c - m * d * m^T */
+    void mdmtProduct(Mat* c, const Mat* m, const Mat* d);
+    /** c <- c - m * d * n^T */
+    void mdntProduct(Mat* c, const Mat* m, const Mat* d, const Mat* n);
+
+  private:
+    bool expand(const Mat* m) const {
+      return !m->isLeaf() && m->depth < depth_;
+    }
+    /** Add the data handles covering m */
+    void addHandles(const Mat* m, std::vector<const void*>& handles) const;
+    void submit(Task* task, const Mat* write, const Mat* read1 = NULL,
+                const Mat* read2 = NULL, const Mat* read3 = NULL);
+    TaskPool& pool_;
+    int depth_;
+  };
+
 }  // end namespace hmat
 
 #endif // RECURSION_HPP
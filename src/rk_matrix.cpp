@@ -31,9 +31,16 @@
 #include "lapack_overloads.hpp"
 #include "common/context.hpp"
 #include "common/my_assert.h"
+#include "common/block_allocator.hpp"
+#include "common/memory_instrumentation.hpp"
 
 namespace hmat {
 
+// Below this rank, truncate() uses the QR factorizations even with the RandomSvd method
+static const int RANDOM_SVD_TRUNCATE_MIN_RANK = 16;
+// accumulate() does not recompress below this number of appended columns
+static const int ACCUMULATE_MIN_PENDING_RANK = 16;
+
 /** RkApproximationControl */
 template<typename T> RkApproximationControl RkMatrix<T>::approx;
 int RkApproximationControl::findK(double *sigma, int maxK, double epsilon) {
@@ -63,7 +70,10 @@ int RkApproximationControl::findK(double *sigma, int maxK, double epsilon) {
 template<typename T> RkMatrix<T>::RkMatrix(FullMatrix<T>* _a, const IndexSet* _rows,
                                            FullMatrix<T>* _b, const IndexSet* _cols,
                                            CompressionMethod _method)
-  : rows(_rows),
+  : storage_(NULL),
+    storageSize_(0),
+    pendingRank_(0),
+    rows(_rows),
     cols(_cols),
     a(_a),
     b(_b),
@@ -78,6 +88,28 @@ template<typename T> RkMatrix<T>::RkMatrix(FullMatrix<T>* _a, const IndexSet* _r
   assert(b->rows == cols->size());
 }
 
+template<typename T> RkMatrix<T>::RkMatrix(const IndexSet* _rows, const IndexSet* _cols,
+                                           int k, CompressionMethod _method)
+  : storage_(NULL),
+    storageSize_(0),
+    pendingRank_(0),
+    rows(_rows),
+    cols(_cols),
+    a(NULL),
+    b(NULL),
+    method(_method)
+{
+  if (k == 0) {
+    return;
+  }
+  const size_t aSize = ((size_t) rows->size()) * k;
+  storageSize_ = (aSize + ((size_t) cols->size()) * k) * sizeof(T);
+  storage_ = (T*) BlockAllocator::allocate(storageSize_);
+  MemoryInstrumenter::instance().alloc(storageSize_, MemoryInstrumenter::FULL_MATRIX);
+  a = new FullMatrix<T>(storage_, rows->size(), k);
+  b = new FullMatrix<T>(storage_ + aSize, cols->size(), k);
+}
+
 template<typename T> RkMatrix<T>::~RkMatrix() {
   clear();
 }
@@ -122,6 +154,41 @@ template<typename T> void RkMatrix<T>::clear() {
   delete b;
   a = NULL;
   b = NULL;
+  pendingRank_ = 0;
+  if (storage_) {
+    MemoryInstrumenter::instance().free(storageSize_, MemoryInstrumenter::FULL_MATRIX);
+    BlockAllocator::free(storage_);
+    storage_ = NULL;
+    storageSize_ = 0;
+  }
+}
+
+template<typename T> void RkMatrix<T>::resize(int newK) {
+  const int k = rank();
+  HMAT_ASSERT(newK >= 0 && newK <= k);
+  if (newK == k) {
+    return;
+  }
+  if (newK == 0) {
+    clear();
+    return;
+  }
+  if (storage_ && a->m == storage_ && a->lda == a->rows &&
+      b->m == storage_ + ((size_t) a->rows) * k && b->lda == b->rows) {
+    // The first columns of A stay in place, B is moved right after them
+    T* newB = storage_ + ((size_t) a->rows) * newK;
+    memmove(newB, b->m, ((size_t) b->rows) * newK * sizeof(T));
+    a->cols = newK;
+    b->m = newB;
+    b->cols = newK;
+    return;
+  }
+  RkMatrix<T> tmp(rows, cols, newK, method);
+  FullMatrix<T> subA(a->m, a->rows, newK, a->lda);
+  FullMatrix<T> subB(b->m, b->rows, newK, b->lda);
+  tmp.a->copyMatrixAtOffset(&subA, 0, 0);
+  tmp.b->copyMatrixAtOffset(&subB, 0, 0);
+  swap(tmp);
 }
 
 template<typename T>
@@ -171,6 +238,7 @@ template<typename T> size_t RkMatrix<T>::uncompressedSize() {
 
 template<typename T> void RkMatrix<T>::truncate(double epsilon) {
   DECLARE_CONTEXT;
+  pendingRank_ = 0;
 
   if (rank() == 0) {
     assert(!(a || b));
@@ -178,6 +246,16 @@ template<typename T> void RkMatrix<T>::truncate(double epsilon) {
   }
 
   assert(rows->size() >= rank());
+  // The randomized SVD only needs products by A and B^t, it is cheaper than
+  // the QR factorizations below when the rank is large and mostly redundant,
+  // as after the sum of several Rk-matrices.
+  if (approx.method == RandomSvd && rank() > RANDOM_SVD_TRUNCATE_MIN_RANK) {
+    RkMatrix<T>* rk = randomizedSvd<T>(a, b, rows, cols, epsilon);
+    rk->method = method;
+    swap(*rk);
+    delete rk;
+    return;
+  }
   // Case: more columns than one dimension of the matrix.
   // In this case, the calculation of the SVD of the matrix "R_a R_b^t" is more
   // expensive than computing the full SVD matrix. We make then a full matrix conversion,
@@ -259,10 +337,7 @@ template<typename T> void RkMatrix<T>::truncate(double epsilon) {
     delete sigma;
     free(tauA);
     free(tauB);
-    delete a;
-    a = NULL;
-    delete b;
-    b = NULL;
+    clear();
     return;
   }
 
@@ -271,39 +346,43 @@ template<typename T> void RkMatrix<T>::truncate(double epsilon) {
     sigma->v[i] = sqrt(sigma->v[i]);
   }
 
-  // We need to calculate Qa * Utilde * SQRT (SigmaTilde)
-  // For that we first calculated Utilde * SQRT (SigmaTilde)
-  FullMatrix<T>* newA = FullMatrix<T>::Zero(rows->size(), newK);
-  for (int col = 0; col < newK; col++) {
-    T alpha = sigma->v[col];
-    for (int row = 0; row < rank(); row++) {
-      newA->get(row, col) = u->get(row, col) * alpha;
+  // The new factors are written over the first newK columns of the old
+  // ones, A then B, so that only one of them needs a temporary array.
+  const int k = rank();
+  {
+    // We need to calculate Qa * Utilde * SQRT (SigmaTilde)
+    // For that we first calculated Utilde * SQRT (SigmaTilde)
+    FullMatrix<T> newA(rows->size(), newK);
+    for (int col = 0; col < newK; col++) {
+      T alpha = sigma->v[col];
+      for (int row = 0; row < k; row++) {
+        newA.get(row, col) = u->get(row, col) * alpha;
+      }
     }
+    delete u;
+    u = NULL;
+    // newA <- Qa * newA (et newA = Utilde * SQRT(SigmaTilde))
+    productQ<T>('L', 'N', a, tauA, &newA);
+    free(tauA);
+    a->copyMatrixAtOffset(&newA, 0, 0);
   }
-  delete u;
-  u = NULL;
-  // newA <- Qa * newA (et newA = Utilde * SQRT(SigmaTilde))
-  productQ<T>('L', 'N', a, tauA, newA);
-  free(tauA);
-
-  // newB = Qb * VTilde * SQRT(SigmaTilde)
-  FullMatrix<T>* newB = FullMatrix<T>::Zero(cols->size(), newK);
-  // Copy with transposing
-  for (int col = 0; col < newK; col++) {
-    T alpha = sigma->v[col];
-    for (int row = 0; row < rank(); row++) {
-      newB->get(row, col) = vt->get(col, row) * alpha;
+  {
+    // newB = Qb * VTilde * SQRT(SigmaTilde)
+    FullMatrix<T> newB(cols->size(), newK);
+    // Copy with transposing
+    for (int col = 0; col < newK; col++) {
+      T alpha = sigma->v[col];
+      for (int row = 0; row < k; row++) {
+        newB.get(row, col) = vt->get(col, row) * alpha;
+      }
     }
+    delete vt;
+    delete sigma;
+    productQ<T>('L', 'N', b, tauB, &newB);
+    free(tauB);
+    b->copyMatrixAtOffset(&newB, 0, 0);
   }
-  delete vt;
-  delete sigma;
-  productQ<T>('L', 'N', b, tauB, newB);
-  free(tauB);
-
-  delete a;
-  a = newA;
-  delete b;
-  b = newB;
+  resize(newK);
 }
 
 // Swap members with members from another instance.
@@ -314,6 +393,9 @@ template<typename T> void RkMatrix<T>::swap(RkMatrix<T>& other)
   assert(cols == other.cols);
   std::swap(a, other.a);
   std::swap(b, other.b);
+  std::swap(storage_, other.storage_);
+  std::swap(storageSize_, other.storageSize_);
+  std::swap(pendingRank_, other.pendingRank_);
   std::swap(method, other.method);
 }
 
@@ -352,7 +434,6 @@ RkMatrix<T>* RkMatrix<T>::formattedAddParts(T* alpha, const RkMatrix<T>** parts,
   // get exactly the same result.
   int notNullParts = (rank() == 0 ? 0 : 1);
   int kTotal = rank();
-  CompressionMethod minMethod = method;
   for (int i = 0; i < n; i++) {
     // Check that partial RkMatrix indices are subsets of their global indices set.
     // According to the indices organization, it is necessary to check that the indices
@@ -364,7 +445,6 @@ RkMatrix<T>* RkMatrix<T>::formattedAddParts(T* alpha, const RkMatrix<T>** parts,
     assert(parts[i]->rows->isSubset(*rows));
     assert(parts[i]->cols->isSubset(*cols));
     kTotal += parts[i]->rank();
-    minMethod = std::min(minMethod, parts[i]->method);
     if (parts[i]->rank() != 0) {
       notNullParts += 1;
     }
@@ -391,10 +471,24 @@ RkMatrix<T>* RkMatrix<T>::formattedAddParts(T* alpha, const RkMatrix<T>** parts,
     return result;
   }
 
-  FullMatrix<T>* resultA = new FullMatrix<T>(rows->size(), kTotal);
-  resultA->clear();
-  FullMatrix<T>* resultB = new FullMatrix<T>(cols->size(), kTotal);
-  resultB->clear();
+  RkMatrix<T>* rk = concatenateParts(alpha, parts, n);
+  if (notNullParts > 1) {
+    rk->truncate(approx.recompressionEpsilon);
+  }
+  return rk;
+}
+
+template<typename T>
+RkMatrix<T>* RkMatrix<T>::concatenateParts(T* alpha, const RkMatrix<T>** parts, int n) const {
+  int kTotal = rank();
+  CompressionMethod minMethod = method;
+  for (int i = 0; i < n; i++) {
+    kTotal += parts[i]->rank();
+    minMethod = std::min(minMethod, parts[i]->method);
+  }
+  RkMatrix<T>* rk = new RkMatrix<T>(rows, cols, kTotal, minMethod);
+  FullMatrix<T>* resultA = rk->a;
+  FullMatrix<T>* resultB = rk->b;
   // Special case if the original matrix is not empty.
   if (rank() > 0) {
     resultA->copyMatrixAtOffset(a, 0, 0);
@@ -427,12 +521,34 @@ RkMatrix<T>* RkMatrix<T>::formattedAddParts(T* alpha, const RkMatrix<T>** parts,
     resultB->copyMatrixAtOffset(parts[i]->b, rowOffset, kOffset);
     kOffset += parts[i]->rank();
   }
-  RkMatrix<T>* rk = new RkMatrix<T>(resultA, rows, resultB, cols, minMethod);
-  if (notNullParts > 1) {
-    rk->truncate(approx.recompressionEpsilon);
-  }
   return rk;
 }
+
+template<typename T> void RkMatrix<T>::accumulate(T alpha, const RkMatrix<T>* mat) {
+  assert(mat->rows->isSubset(*rows));
+  assert(mat->cols->isSubset(*cols));
+  if (mat->rank() == 0) {
+    return;
+  }
+  // An empty matrix takes the factors of mat, which need no recompression
+  const int pending = rank() == 0 ? 0 : pendingRank_ + mat->rank();
+  RkMatrix<T>* tmp = concatenateParts(&alpha, &mat, 1);
+  swap(*tmp);
+  delete tmp;
+  pendingRank_ = pending;
+  const int recompressed = rank() - pendingRank_;
+  const size_t fullSize = ((size_t) rows->size()) * cols->size();
+  if (pendingRank_ > std::max(recompressed, ACCUMULATE_MIN_PENDING_RANK) ||
+      ((size_t) rank()) * (rows->size() + cols->size()) >= fullSize) {
+    flush();
+  }
+}
+
+template<typename T> void RkMatrix<T>::flush() {
+  if (pendingRank_ > 0) {
+    truncate(approx.recompressionEpsilon);
+  }
+}
 template<typename T>
 RkMatrix<T>* RkMatrix<T>::formattedAddParts(T* alpha, const FullMatrix<T>** parts,
                                             const IndexSet **rowsList,
@@ -471,34 +587,26 @@ template<typename T> RkMatrix<T>* RkMatrix<T>::multiplyRkFull(char transR, char
   assert((transR == 'N') || (transM == 'N'));// we do not manage the case R^T*M^T
   assert(((transR == 'N') ? rk->cols->size() : rk->rows->size()) == ((transM == 'N') ? m->rows : m->cols));
 
-  if(rk->rank() == 0) {
-      return new RkMatrix<T>(NULL, transR ? rk->cols : rk->rows,
-                             NULL, mCols, NoCompression);
+  const IndexSet* rkRows = (transR == 'N' ? rk->rows : rk->cols);
+  RkMatrix<T>* result = new RkMatrix<T>(rkRows, mCols, rk->rank(), rk->method);
+  if (rk->rank() == 0) {
+    result->method = NoCompression;
+    return result;
   }
-  RkMatrix<T>* rkCopy = (transR == 'N' ? new RkMatrix<T>(rk->a, rk->rows, rk->b, rk->cols, rk->method)
-                         : new RkMatrix<T>(rk->b, rk->cols, rk->a, rk->rows, rk->method));
+  const FullMatrix<T>* a = (transR == 'N' ? rk->a : rk->b);
+  const FullMatrix<T>* b = (transR == 'N' ? rk->b : rk->a);
 
-  FullMatrix<T>* newB = new FullMatrix<T>((transM == 'N')? m->cols : m->rows, rkCopy->b->cols);
+  /* R M = A B^t M = A (B^t M) = A (M^t B)^t */
+  result->a->copyMatrixAtOffset(a, 0, 0);
   if (transM == 'N') {
-    assert(m->rows == rkCopy->b->rows);
-    assert(newB->rows == m->cols);
-    assert(newB->cols == rkCopy->b->cols);
-    newB->gemm('T', 'N', Constants<T>::pone, m, rkCopy->b, Constants<T>::zero);
+    assert(m->rows == b->rows);
+    assert(result->b->rows == m->cols);
+    result->b->gemm('T', 'N', Constants<T>::pone, m, b, Constants<T>::zero);
   } else {
-    assert(m->cols == rkCopy->b->rows);
-    assert(newB->rows == m->rows);
-    assert(newB->cols == rkCopy->b->cols);
-    newB->gemm('N','N',Constants<T>::pone, m, rkCopy->b, Constants<T>::zero);
+    assert(m->cols == b->rows);
+    assert(result->b->rows == m->rows);
+    result->b->gemm('N', 'N', Constants<T>::pone, m, b, Constants<T>::zero);
   }
-
-  FullMatrix<T>* newA = rkCopy->a->copy();
-  RkMatrix<T>* result =  new RkMatrix<T>(newA, rkCopy->rows, newB, mCols, rkCopy->method);
-  rkCopy->a = NULL;
-  rkCopy->b = NULL;
-  delete rkCopy;
-
-  /* R M = A B^t M = A (B^t M) = A (M^t B)^t */
-  // MatrixXd b((rk->b.transpose() * (*m)).transpose());
   return result;
 }
 
@@ -518,14 +626,12 @@ RkMatrix<T>* RkMatrix<T>::multiplyFullRk(char transM, char transR,
 
   /* M R = M (A B^t) = (MA) B^t */
   assert(((transM == 'N') ? m->rows : m->cols) == mRows->size());
-  FullMatrix<T>* newA = new FullMatrix<T>((transM == 'N')? m->rows:m->cols,(transR == 'N')? a->cols:b->cols);
-  if (transM == 'N') {
-    newA->gemm('N', 'N', Constants<T>::pone, m, a, Constants<T>::zero);
-  } else {
-    newA->gemm('T', 'N',Constants<T>::pone, m, a, Constants<T>::zero);
-  }
-  FullMatrix<T>* newB = b->copy();
-  return new RkMatrix<T>(newA, mRows, newB, rkCols, rk->method);
+  RkMatrix<T>* result = new RkMatrix<T>(mRows, rkCols, rk->rank(), rk->method);
+  if (rk->rank() == 0)
+    return result;
+  result->a->gemm(transM == 'N' ? 'N' : 'T', 'N', Constants<T>::pone, m, a, Constants<T>::zero);
+  result->b->copyMatrixAtOffset(b, 0, 0);
+  return result;
 }
 
 template<typename T>
@@ -538,20 +644,21 @@ RkMatrix<T>* RkMatrix<T>::multiplyRkH(char transRk, char transH,
   FullMatrix<T>* a = (transRk == 'N')? rk->a : rk->b;
   FullMatrix<T>* b = (transRk == 'N')? rk->b : rk->a;
   const IndexSet* rkRows = ((transRk == 'N')? rk->rows : rk->cols);
+  const IndexSet *newCols = ((transH == 'N' )? h->cols() : h->rows());
 
   // R M = A (M^t B)^t
   // Size of the HMatrix is n x m,
   // So H^t size is m x n and the product is m x cols(B)
   // and the number of columns of B is k.
   int p = rk->rank();
+  RkMatrix<T>* result = new RkMatrix<T>(rkRows, newCols, p, rk->method);
+  if (p == 0)
+    return result;
 
   assert(b->cols == p);
-  FullMatrix<T>* resB = new FullMatrix<T>(transH == 'N' ? h->cols()->size() : h->rows()->size(), p);
-  resB->clear();
-  h->gemv(transH == 'N' ? 'T' : 'N', Constants<T>::pone, b, Constants<T>::zero, resB);
-  FullMatrix<T>* newA = a->copy();
-  const IndexSet *newCols = ((transH == 'N' )? h->cols() : h->rows());
-  return new RkMatrix<T>(newA, rkRows, resB, newCols, rk->method);
+  h->gemv(transH == 'N' ? 'T' : 'N', Constants<T>::pone, b, Constants<T>::zero, result->b);
+  result->a->copyMatrixAtOffset(a, 0, 0);
+  return result;
 }
 
 template<typename T>
@@ -559,10 +666,11 @@ RkMatrix<T>* RkMatrix<T>::multiplyHRk(char transH, char transR,
                                       const HMatrix<T>* h, const RkMatrix<T>* rk) {
 
   DECLARE_CONTEXT;
+  const IndexSet* newRows = ((transH == 'N') ? h-> rows() : h->cols());
+  const IndexSet* rkCols = ((transR == 'N') ? rk->cols : rk->rows);
+  RkMatrix<T>* result = new RkMatrix<T>(newRows, rkCols, rk->rank(), rk->method);
   if (rk->rank() == 0) {
-    const IndexSet* newRows = ((transH == 'N') ? h-> rows() : h->cols());
-    const IndexSet* newCols = ((transR == 'N') ? rk->cols : rk->rows);
-    return new RkMatrix<T>(NULL, newRows, NULL, newCols, rk->method);
+    return result;
   }
   // M R = (M A) B^t
   // The size of the HMatrix is n x m
@@ -571,25 +679,11 @@ RkMatrix<T>* RkMatrix<T>::multiplyHRk(char transH, char transR,
   // Therefore the product is n x cols(A)
   // and the number of columns of A is k.
   assert((transR == 'N') || (transH == 'N')); // we do not manage the case of product transposee*transposee
-  FullMatrix<T>* a = rk->a;
-  FullMatrix<T>* b = rk->b;
-  if (transR == 'T') { // permutation of a and b to transpose the matrix Rk
-    std::swap(a, b);
-  }
-  const IndexSet *rkCols = ((transR == 'N' )? rk->cols : rk->rows);
-  int n = ((transH == 'N')? h->rows()->size() : h->cols()->size());
-  int p = rk->rank();
-  FullMatrix<T>* resA = new FullMatrix<T>(n, p);
-  resA->clear();
-  h->gemv(transH, Constants<T>::pone, a, Constants<T>::zero, resA);
-  FullMatrix<T>* newB = b->copy();
-  const IndexSet* newRows = ((transH == 'N')? h-> rows() : h->cols());
-  // If this base been transposed earlier, back in the right direction.
-
-  if (transR == 'T') {
-    std::swap(a, b);
-  }
-  return new RkMatrix<T>(resA, newRows, newB, rkCols, rk->method);
+  const FullMatrix<T>* a = (transR == 'N' ? rk->a : rk->b);
+  const FullMatrix<T>* b = (transR == 'N' ? rk->b : rk->a);
+  h->gemv(transH, Constants<T>::pone, a, Constants<T>::zero, result->a);
+  result->b->copyMatrixAtOffset(b, 0, 0);
+  return result;
 }
 
 template<typename T>
@@ -597,6 +691,11 @@ RkMatrix<T>* RkMatrix<T>::multiplyRkRk(char transA, char transB,
                                        const RkMatrix<T>* a, const RkMatrix<T>* b) {
   DECLARE_CONTEXT;
   assert(((transA == 'N') ? *a->cols : *a->rows) == ((transB == 'N') ? *b->rows : *b->cols));
+  CompressionMethod combined = std::min(a->method, b->method);
+  const IndexSet* newRows = ((transA == 'N') ? a->rows : a->cols);
+  const IndexSet* newCols = ((transB == 'N') ? b->cols : b->rows);
+  if (a->rank() == 0 || b->rank() == 0)
+    return new RkMatrix<T>(newRows, newCols, 0, combined);
   // It is possible to do the computation differently, yielding a
   // different rank and a different amount of computation.
   // TODO: choose the best order.
@@ -614,20 +713,15 @@ RkMatrix<T>* RkMatrix<T>::multiplyRkRk(char transA, char transB,
   // - compute tmp.Bb : the cost is rank_a.rank_b.col_b, the resulting Rk has rank rank_a
   // the best choice depends on the ranks & dimensions, and also on our priority (flops or resulting rank)
 
-  FullMatrix<T>* tmp = new FullMatrix<T>(a->rank(), b->rank());
-  FullMatrix<T>* newA = new FullMatrix<T>(Aa->rows, b->rank());
-
-  assert(tmp->rows == Ab->cols);
-  assert(tmp->cols == Ba->cols);
-  assert(Ab->rows == Ba->rows);
-  tmp->gemm('T', 'N', Constants<T>::pone, Ab, Ba, Constants<T>::zero);
-  assert(Ab->cols == tmp->rows);
-  newA->gemm('N', 'N', Constants<T>::pone, Aa, tmp, Constants<T>::zero);
-  delete tmp;
-  FullMatrix<T>* newB = Bb->copy();
+  RkMatrix<T>* result = new RkMatrix<T>(newRows, newCols, b->rank(), combined);
+  FullMatrix<T> tmp(a->rank(), b->rank());
 
-  CompressionMethod combined = std::min(a->method, b->method);
-  return new RkMatrix<T>(newA, ((transA == 'N') ? a->rows : a->cols), newB, ((transB == 'N') ? b->cols : b->rows), combined);
+  assert(tmp.rows == Ab->cols);
+  assert(tmp.cols == Ba->cols);
+  tmp.gemm('T', 'N', Constants<T>::pone, Ab, Ba, Constants<T>::zero);
+  result->a->gemm('N', 'N', Constants<T>::pone, Aa, &tmp, Constants<T>::zero);
+  result->b->copyMatrixAtOffset(Bb, 0, 0);
+  return result;
 }
 
 template<typename T>
@@ -765,13 +859,17 @@ template<typename T> void RkMatrix<T>::gemmRk(char transHA, char transHB,
   }
 }
 
-template<typename T> void RkMatrix<T>::copy(RkMatrix<T>* o) {
-  delete a;
-  delete b;
+template<typename T> void RkMatrix<T>::copy(const RkMatrix<T>* o) {
+  clear();
   rows = o->rows;
   cols = o->cols;
-  a = (o->a ? o->a->copy() : NULL);
-  b = (o->b ? o->b->copy() : NULL);
+  if (o->rank() > 0) {
+    RkMatrix<T> tmp(rows, cols, o->rank(), method);
+    tmp.a->copyMatrixAtOffset(o->a, 0, 0);
+    tmp.b->copyMatrixAtOffset(o->b, 0, 0);
+    swap(tmp);
+    pendingRank_ = o->pendingRank_;
+  }
 }
 
 
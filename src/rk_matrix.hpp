@@ -51,11 +51,13 @@ public:
   double recompressionEpsilon; /// Tolerance for the recompressions
   CompressionMethod method;
   int compressionMinLeafSize;
+  int powerIterations; /// Power iterations of the RandomSvd method
 
   /** Initialization with impossible values by default
    */
   RkApproximationControl() : k(0), assemblyEpsilon(-1.),
-                             recompressionEpsilon(-1.), method(Svd), compressionMinLeafSize(100) {}
+                             recompressionEpsilon(-1.), method(Svd), compressionMinLeafSize(100),
+                             powerIterations(0) {}
   /** Returns the number of singular values to keep.
 
        The stop criterion is (assuming that the singular value
@@ -83,6 +85,15 @@ template<typename T> class RkMatrix {
   */
   void swap(RkMatrix<T>& other);
 
+  /// Single array holding A followed by B, NULL if they were allocated separately
+  T* storage_;
+  /// Size in bytes of storage_
+  size_t storageSize_;
+  /// Number of the last columns of A and B added by accumulate() and not recompressed yet
+  int pendingRank_;
+  /** Juxtaposition of the factors of this and alpha[i] * parts[i], without recompression. */
+  RkMatrix<T>* concatenateParts(T* alpha, const RkMatrix<T>** parts, int n) const;
+
 public:
   const IndexSet *rows;
   const IndexSet *cols;
@@ -113,6 +124,17 @@ public:
   RkMatrix(FullMatrix<T>* _a, const IndexSet* _rows,
            FullMatrix<T>* _b, const IndexSet* _cols,
            CompressionMethod _method);
+  /** Construction of a RkMatrix of rank k, with A and B set to 0.
+
+      A and B are stored one after the other in a single array, so that the
+      rank can be reduced in place with resize().
+
+       \param _rows indices of the rows
+       \param _cols indices of the columns
+       \param k rank, the matrix is empty if k is 0
+   */
+  RkMatrix(const IndexSet* _rows, const IndexSet* _cols, int k,
+           CompressionMethod _method);
   ~RkMatrix();
 
   int rank() const {
@@ -141,6 +163,11 @@ public:
       @warning The previous rk->a and rk->b are no longer valid after this function.
    */
   void truncate(double epsilon);
+  /** Reduce the rank to newK, keeping the first newK columns of A and B.
+
+      This is done in place when A and B are stored in a single array.
+   */
+  void resize(int newK);
   /*! \brief Return square of the Frobenius norm of the matrix.
 
     \return the matrix norm.
@@ -216,6 +243,21 @@ public:
   RkMatrix<T>* formattedAddParts(T* alpha, const FullMatrix<T>** parts,
                                  const IndexSet** rowsList,
                                  const IndexSet** colsList, int n) const;
+  /** this <- this + alpha * mat, without recompression.
+
+      The factors of mat, which may be on a subset of the indices of this, are
+      appended to the ones of this. They are recompressed together with the
+      next updates by \a flush(), which is done here once the appended columns
+      outnumber the recompressed ones, or once the factors take as much memory
+      as the full block.
+   */
+  void accumulate(T alpha, const RkMatrix<T>* mat);
+  /** Recompress the updates added by \a accumulate(), if any. */
+  void flush();
+  /** Number of columns of A and B added by \a accumulate() since the last recompression. */
+  int pendingRank() const {
+    return pendingRank_;
+  }
   void gemmRk(char transA, char transB, T alpha, const HMatrix<T>* a, const HMatrix<T>* b, T beta);
 
   /** Multiplication by a scalar.
@@ -226,7 +268,7 @@ public:
   void clear();
   /** Copy  RkMatrix into this.
    */
-  void copy(RkMatrix<T>* o);
+  void copy(const RkMatrix<T>* o);
 
   /** Compute y <- alpha * op(A) * y + beta * y.
 
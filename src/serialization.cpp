@@ -0,0 +1,540 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Binary file format of a complete HMatrix.
+*/
+#include "config.h"
+
+#include "serialization.hpp"
+#include "h_matrix.hpp"
+#include "rk_matrix.hpp"
+#include "full_matrix.hpp"
+#include "cluster_tree.hpp"
+#include "coordinates.hpp"
+#include "data_types.hpp"
+#include "common/context.hpp"
+#include "common/my_assert.h"
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/mman.h> // mmap
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[8] = "HMATBIN";
+/// Increment when the layout changes, older files are then rejected
+const int FORMAT_VERSION = 1;
+/// Written as is, so that a file from a machine with another byte order is detected
+const int BYTE_ORDER_MARK = 0x01020304;
+/// Alignment of the payload section in the file
+const uint64_t PAGE_ALIGNMENT = 4096;
+/// Alignment of each array of the payload
+const uint64_t ARRAY_ALIGNMENT = 64;
+
+/// Kind of an HMatrix node, the values of DefaultRank are used for the non Rk nodes
+const int RK_NODE = 0;
+
+/// Flags of an HMatrix node
+enum NodeFlag {
+  FLAG_UPPER = 1, FLAG_LOWER = 2, FLAG_TRI_UPPER = 4, FLAG_TRI_LOWER = 8,
+  FLAG_ROWS_ADMISSIBLE = 16, FLAG_COLS_ADMISSIBLE = 32, FLAG_COMPRESSIBLE = 64
+};
+
+inline uint64_t alignUp(uint64_t n, uint64_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+/** Growable byte array holding the header and the structure section. */
+class Buffer {
+public:
+  template<typename V> void put(const V& v) {
+    putArray(&v, 1);
+  }
+  template<typename V> void putArray(const V* v, size_t n) {
+    const char* p = (const char*) v;
+    data_.insert(data_.end(), p, p + n * sizeof(V));
+  }
+  /** Overwrite a value written earlier at position pos. */
+  template<typename V> void set(size_t pos, const V& v) {
+    memcpy(&data_[pos], &v, sizeof(V));
+  }
+  size_t size() const { return data_.size(); }
+  const char* data() const { return &data_[0]; }
+private:
+  std::vector<char> data_;
+};
+
+/** Array of the payload section, with its column-major layout in memory. */
+template<typename T> struct PayloadArray {
+  const T* m;
+  int rows, cols, lda;
+  uint64_t offset;
+};
+
+template<typename T> class Writer {
+public:
+  Writer() : payloadSize_(0) {}
+
+  void writeClusterTrees(const hmat::ClusterTree* rows, const hmat::ClusterTree* cols) {
+    const bool same = (rows == cols);
+    buffer_.put<int>(same ? 1 : 2);
+    writeClusterTree(rows);
+    if (!same)
+      writeClusterTree(cols);
+  }
+
+  void writeNode(const hmat::HMatrix<T>* m) {
+    buffer_.put<int>(clusterId(m->rowsTree()));
+    buffer_.put<int>(clusterId(m->colsTree()));
+    int flags = 0;
+    if (m->isUpper) flags |= FLAG_UPPER;
+    if (m->isLower) flags |= FLAG_LOWER;
+    if (m->isTriUpper) flags |= FLAG_TRI_UPPER;
+    if (m->isTriLower) flags |= FLAG_TRI_LOWER;
+    if (m->rowsAdmissible) flags |= FLAG_ROWS_ADMISSIBLE;
+    if (m->colsAdmissible) flags |= FLAG_COLS_ADMISSIBLE;
+    if (m->isCompressible) flags |= FLAG_COMPRESSIBLE;
+    buffer_.put<int>(flags);
+    int kind;
+    if (!m->isAssembled())
+      kind = hmat::UNINITIALIZED_BLOCK;
+    else if (!m->isLeaf())
+      kind = hmat::NONLEAF_BLOCK;
+    else if (m->isRkMatrix())
+      kind = RK_NODE;
+    else
+      kind = hmat::FULL_BLOCK;
+    buffer_.put<int>(kind);
+    buffer_.put<int>(m->nrChild());
+    for (int i = 0; i < m->nrChild(); i++) {
+      const hmat::HMatrix<T>* child = m->getChild(i);
+      buffer_.put<int>(child ? 1 : 0);
+      if (child)
+        writeNode(child);
+    }
+    if (!m->isLeaf() || kind == hmat::UNINITIALIZED_BLOCK)
+      return;
+    if (kind == RK_NODE) {
+      const hmat::RkMatrix<T>* rk = m->rk();
+      buffer_.put<int>(rk ? 1 : 0);
+      if (!rk)
+        return;
+      const int k = rk->rank();
+      buffer_.put<int>(rk->method);
+      buffer_.put<int>(k);
+      if (k > 0) {
+        buffer_.put<uint64_t>(addArray(rk->a));
+        buffer_.put<uint64_t>(addArray(rk->b));
+      }
+    } else {
+      const hmat::FullMatrix<T>* full = m->full();
+      buffer_.put<int>(full ? 1 : 0);
+      if (!full)
+        return;
+      buffer_.put<int>(full->rows);
+      buffer_.put<int>(full->cols);
+      buffer_.put<uint64_t>(addArray(full));
+      buffer_.put<int>(full->pivots ? 1 : 0);
+      if (full->pivots)
+        buffer_.putArray(full->pivots, full->rows);
+      buffer_.put<int>(full->diagonal ? 1 : 0);
+      if (full->diagonal) {
+        hmat::FullMatrix<T> diagonal(full->diagonal->v, full->diagonal->rows, 1);
+        buffer_.put<uint64_t>(addArray(&diagonal));
+      }
+    }
+  }
+
+  /** Write the header, the structure and the payload. */
+  void writeFile(const char* filename, hmat_factorization_t factorization) {
+    Buffer header;
+    header.putArray(MAGIC, sizeof(MAGIC));
+    header.put<int>(FORMAT_VERSION);
+    header.put<int>(BYTE_ORDER_MARK);
+    header.put<int>(hmat::Constants<T>::code);
+    header.put<int>(sizeof(T));
+    header.put<int>(factorization);
+    const uint64_t structureOffset = header.size() + 3 * sizeof(uint64_t);
+    const uint64_t payloadOffset = alignUp(structureOffset + buffer_.size(), PAGE_ALIGNMENT);
+    header.put<uint64_t>(buffer_.size());
+    header.put<uint64_t>(payloadOffset);
+    header.put<uint64_t>(payloadSize_);
+
+    FILE* f = fopen(filename, "wb");
+    HMAT_ASSERT_MSG(f, "Cannot open %s", filename);
+    bool ok = fwrite(header.data(), header.size(), 1, f) == 1;
+    ok = ok && fwrite(buffer_.data(), buffer_.size(), 1, f) == 1;
+    uint64_t position = structureOffset + buffer_.size();
+    std::vector<char> zeros(PAGE_ALIGNMENT, 0);
+    for (size_t i = 0; ok && i < arrays_.size(); i++) {
+      const PayloadArray<T>& a = arrays_[i];
+      const uint64_t start = payloadOffset + a.offset;
+      ok = pad(f, zeros, start - position);
+      for (int col = 0; ok && col < a.cols; col++)
+        ok = fwrite(a.m + ((size_t) a.lda) * col, sizeof(T), a.rows, f) == (size_t) a.rows;
+      position = start + ((uint64_t) a.rows) * a.cols * sizeof(T);
+    }
+    // The file always extends to the end of the payload section
+    ok = ok && pad(f, zeros, payloadOffset + payloadSize_ - position);
+    ok = (fclose(f) == 0) && ok;
+    HMAT_ASSERT_MSG(ok, "Error while writing %s", filename);
+  }
+
+private:
+  Buffer buffer_;
+  std::vector<PayloadArray<T> > arrays_;
+  uint64_t payloadSize_;
+  std::map<const hmat::ClusterTree*, int> clusterIds_;
+
+  static bool pad(FILE* f, const std::vector<char>& zeros, uint64_t n) {
+    while (n > 0) {
+      size_t chunk = n < zeros.size() ? (size_t) n : zeros.size();
+      if (fwrite(&zeros[0], 1, chunk, f) != chunk)
+        return false;
+      n -= chunk;
+    }
+    return true;
+  }
+
+  uint64_t addArray(const hmat::FullMatrix<T>* m) {
+    PayloadArray<T> a;
+    a.m = m->m;
+    a.rows = m->rows;
+    a.cols = m->cols;
+    a.lda = m->lda;
+    a.offset = payloadSize_;
+    arrays_.push_back(a);
+    payloadSize_ = alignUp(payloadSize_ + ((uint64_t) a.rows) * a.cols * sizeof(T), ARRAY_ALIGNMENT);
+    return a.offset;
+  }
+
+  int clusterId(const hmat::ClusterTree* t) const {
+    std::map<const hmat::ClusterTree*, int>::const_iterator it = clusterIds_.find(t);
+    HMAT_ASSERT_MSG(it != clusterIds_.end(), "Cluster tree node not found while writing an HMatrix");
+    return it->second;
+  }
+
+  void writeClusterTree(const hmat::ClusterTree* root) {
+    const hmat::ClusterData& data = root->data;
+    const hmat::DofCoordinates* coordinates = data.coordinates();
+    const int n = coordinates->size();
+    const int dim = coordinates->dimension();
+    buffer_.put<int>(n);
+    buffer_.put<int>(dim);
+    if (n > 0)
+      buffer_.putArray(&coordinates->get(0, 0), ((size_t) n) * dim);
+    buffer_.putArray(data.indices(), n);
+    buffer_.putArray(data.indices_rev(), n);
+    buffer_.put<int>(data.group_index() ? 1 : 0);
+    if (data.group_index())
+      buffer_.putArray(data.group_index(), n);
+    writeClusterNode(root);
+  }
+
+  void writeClusterNode(const hmat::ClusterTree* t) {
+    const int id = clusterIds_.size();
+    clusterIds_[t] = id;
+    buffer_.put<int>(t->data.offset());
+    buffer_.put<int>(t->data.size());
+    buffer_.put<int>(t->nrChild());
+    for (int i = 0; i < t->nrChild(); i++) {
+      const hmat::ClusterTree* child = t->getChild(i);
+      buffer_.put<int>(child ? 1 : 0);
+      if (child)
+        writeClusterNode(child);
+    }
+  }
+};
+
+/** Root of the cluster tree holding a node. */
+const hmat::ClusterTree* treeRoot(const hmat::ClusterTree* t) {
+  // Temporary slices are their own father
+  while (t->father && t->father != t)
+    t = t->father;
+  return t;
+}
+
+}  // end anonymous namespace
+
+namespace hmat {
+
+/** Parsing state of a mapped HMatrix file. */
+class HMatrixFileReader {
+public:
+  HMatrixFileReader(const char* begin, const char* end, char* payload, uint64_t payloadSize,
+                    const MatrixSettings* settings)
+    : p_(begin), end_(end), payload_(payload), payloadSize_(payloadSize), settings_(settings) {}
+
+  template<typename V> V get() {
+    V v;
+    getArray(&v, 1);
+    return v;
+  }
+  template<typename V> void getArray(V* v, size_t n) {
+    HMAT_ASSERT_MSG(n * sizeof(V) <= (size_t) (end_ - p_), "Truncated HMatrix file");
+    memcpy(v, p_, n * sizeof(V));
+    p_ += n * sizeof(V);
+  }
+  int getCount(int max) {
+    int n = get<int>();
+    HMAT_ASSERT_MSG(n >= 0 && n <= max, "Corrupted HMatrix file");
+    return n;
+  }
+
+  /** Pointer to an array of the payload, checking that it lies in the file. */
+  template<typename T> T* array(int rows, int cols) {
+    uint64_t offset = get<uint64_t>();
+    HMAT_ASSERT(rows >= 0 && cols >= 0);
+    HMAT_ASSERT_MSG(offset % sizeof(T) == 0 &&
+                    offset + ((uint64_t) rows) * cols * sizeof(T) <= payloadSize_,
+                    "Corrupted HMatrix file");
+    return (T*) (payload_ + offset);
+  }
+
+  void readClusterTrees() {
+    const int count = get<int>();
+    HMAT_ASSERT_MSG(count == 1 || count == 2, "Corrupted HMatrix file");
+    for (int i = 0; i < count; i++)
+      roots_.push_back(readClusterTree());
+  }
+
+  ClusterTree* cluster() {
+    const int id = getCount(clusters_.size() - 1);
+    return clusters_[id];
+  }
+
+  const MatrixSettings* settings() const { return settings_; }
+  bool sameTrees() const { return roots_.size() == 1; }
+  ClusterTree* rowsRoot() const { return roots_.front(); }
+  ClusterTree* colsRoot() const { return roots_.back(); }
+
+private:
+  const char* p_;
+  const char* end_;
+  char* payload_;
+  uint64_t payloadSize_;
+  const MatrixSettings* settings_;
+  std::vector<ClusterTree*> clusters_;
+  std::vector<ClusterTree*> roots_;
+
+  ClusterTree* readClusterTree() {
+    const int n = getCount(0x7fffffff);
+    const int dim = getCount(0x7fffffff);
+    std::vector<double> coord(((size_t) n) * dim + 1);
+    getArray(&coord[0], ((size_t) n) * dim);
+    std::vector<int> perm(2 * ((size_t) n) + 1);
+    getArray(&perm[0], 2 * (size_t) n);
+    std::vector<int> group;
+    if (get<int>()) {
+      group.resize(n + 1);
+      getArray(&group[0], n);
+    }
+    DofCoordinates coordinates(&coord[0], dim, n);
+    DofData* dofData = new DofData(coordinates, group.empty() ? NULL : &group[0]);
+    ClusterTree* root = new ClusterTree(dofData);
+    memcpy(root->data.indices(), &perm[0], sizeof(int) * n);
+    memcpy(root->data.indices_rev(), &perm[n], sizeof(int) * n);
+    const int offset = get<int>();
+    const int size = get<int>();
+    HMAT_ASSERT_MSG(offset == 0 && size == n, "Corrupted HMatrix file");
+    clusters_.push_back(root);
+    readClusterChildren(root, root);
+    return root;
+  }
+
+  void readClusterChildren(ClusterTree* root, ClusterTree* node) {
+    const int nrChild = getCount(0x7fffffff);
+    for (int i = 0; i < nrChild; i++) {
+      if (!get<int>())
+        continue;
+      const int offset = get<int>();
+      const int size = get<int>();
+      HMAT_ASSERT_MSG(offset >= 0 && size >= 0 && offset + size <= root->data.size(),
+                      "Corrupted HMatrix file");
+      ClusterTree* child = root->slice(offset, size);
+      node->insertChild(i, child);
+      clusters_.push_back(child);
+      readClusterChildren(root, child);
+    }
+  }
+};
+
+MappedFile::MappedFile(const char* filename) : address_(NULL), size_(0) {
+#ifdef _WIN32
+  HMAT_ASSERT(false); // no mmap() on Windows
+#else
+  int fd = open(filename, O_RDONLY);
+  HMAT_ASSERT_MSG(fd != -1, "Cannot open %s", filename);
+  struct stat fileStat;
+  int ierr = fstat(fd, &fileStat);
+  HMAT_ASSERT(!ierr);
+  size_ = fileStat.st_size;
+  HMAT_ASSERT_MSG(size_ > 0, "Empty HMatrix file %s", filename);
+  // Private mapping: the loaded matrix may be modified (factorized, scaled...)
+  // in memory without changing the file.
+  address_ = mmap(0, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid once the file is closed
+  close(fd);
+  HMAT_ASSERT_MSG(address_ != MAP_FAILED, "Cannot map %s", filename);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (address_)
+    munmap(address_, size_);
+#endif
+}
+
+template<typename T>
+void HMatrixFile<T>::write(const HMatrix<T>* m, hmat_factorization_t factorization,
+                           const char* filename) {
+  DECLARE_CONTEXT;
+  Writer<T> writer;
+  writer.writeClusterTrees(treeRoot(m->rowsTree()), treeRoot(m->colsTree()));
+  writer.writeNode(m);
+  writer.writeFile(filename, factorization);
+}
+
+template<typename T>
+HMatrix<T>* HMatrixFile<T>::read(MappedFile& file, const MatrixSettings* settings,
+                                 hmat_factorization_t* factorization) {
+  DECLARE_CONTEXT;
+  HMatrixFileReader header(file.data(), file.data() + file.size(), NULL, 0, settings);
+  char magic[sizeof(MAGIC)];
+  header.getArray(magic, sizeof(MAGIC));
+  HMAT_ASSERT_MSG(memcmp(magic, MAGIC, sizeof(MAGIC)) == 0, "Not an HMatrix file");
+  const int version = header.get<int>();
+  HMAT_ASSERT_MSG(version == FORMAT_VERSION, "Unsupported HMatrix file version %d", version);
+  HMAT_ASSERT_MSG(header.get<int>() == BYTE_ORDER_MARK, "HMatrix file with a different byte order");
+  HMAT_ASSERT_MSG(header.get<int>() == Constants<T>::code, "HMatrix file with a different scalar type");
+  HMAT_ASSERT(header.get<int>() == (int) sizeof(T));
+  *factorization = (hmat_factorization_t) header.get<int>();
+  const uint64_t structureSize = header.get<uint64_t>();
+  const uint64_t payloadOffset = header.get<uint64_t>();
+  const uint64_t payloadSize = header.get<uint64_t>();
+  const uint64_t structureOffset = sizeof(MAGIC) + 5 * sizeof(int) + 3 * sizeof(uint64_t);
+  HMAT_ASSERT_MSG(structureOffset + structureSize <= payloadOffset &&
+                  payloadOffset % PAGE_ALIGNMENT == 0 &&
+                  payloadOffset + payloadSize <= file.size(), "Corrupted HMatrix file");
+
+  HMatrixFileReader reader(file.data() + structureOffset,
+                           file.data() + structureOffset + structureSize,
+                           file.data() + payloadOffset, payloadSize, settings);
+  reader.readClusterTrees();
+  HMatrix<T>* m = readNode(reader);
+  // The loaded matrix owns its cluster trees
+  HMAT_ASSERT_MSG(m->rowsTree() == reader.rowsRoot() && m->colsTree() == reader.colsRoot(),
+                  "Corrupted HMatrix file");
+  m->ownClusterTree_ = true;
+  return m;
+}
+
+template<typename T>
+HMatrix<T>* HMatrixFile<T>::readNode(HMatrixFileReader& reader) {
+  HMatrix<T>* m = new HMatrix<T>(reader.settings());
+  m->rows_ = reader.cluster();
+  m->cols_ = reader.cluster();
+  const int flags = reader.get<int>();
+  m->isUpper = (flags & FLAG_UPPER) != 0;
+  m->isLower = (flags & FLAG_LOWER) != 0;
+  m->isTriUpper = (flags & FLAG_TRI_UPPER) != 0;
+  m->isTriLower = (flags & FLAG_TRI_LOWER) != 0;
+  m->rowsAdmissible = (flags & FLAG_ROWS_ADMISSIBLE) != 0;
+  m->colsAdmissible = (flags & FLAG_COLS_ADMISSIBLE) != 0;
+  m->isCompressible = (flags & FLAG_COMPRESSIBLE) != 0;
+  const int kind = reader.get<int>();
+  const int nrChild = reader.getCount(0x7fffffff);
+  for (int i = 0; i < nrChild; i++) {
+    if (reader.get<int>())
+      m->insertChild(i, readNode(reader));
+  }
+  // Keep the trailing empty children
+  if (m->nrChild() < nrChild)
+    m->children.resize(nrChild, (HMatrix<T>*) NULL);
+
+  if (kind == UNINITIALIZED_BLOCK)
+    return m;
+  if (!m->isLeaf()) {
+    HMAT_ASSERT_MSG(kind == NONLEAF_BLOCK, "Corrupted HMatrix file");
+    m->assembled();
+    return m;
+  }
+  const int rows = m->rows()->size();
+  const int cols = m->cols()->size();
+  if (kind == RK_NODE) {
+    if (!reader.get<int>()) {
+      m->rk(NULL);
+      return m;
+    }
+    const CompressionMethod method = (CompressionMethod) reader.getCount(NoCompression);
+    const int k = reader.getCount(0x7fffffff);
+    FullMatrix<T>* a = NULL;
+    FullMatrix<T>* b = NULL;
+    if (k > 0) {
+      a = new FullMatrix<T>(reader.template array<T>(rows, k), rows, k);
+      b = new FullMatrix<T>(reader.template array<T>(cols, k), cols, k);
+    }
+    m->rk(new RkMatrix<T>(a, m->rows(), b, m->cols(), method));
+  } else {
+    HMAT_ASSERT_MSG(kind == FULL_BLOCK, "Corrupted HMatrix file");
+    if (!reader.get<int>()) {
+      m->full(NULL);
+      return m;
+    }
+    HMAT_ASSERT_MSG(reader.get<int>() == rows && reader.get<int>() == cols,
+                    "Corrupted HMatrix file");
+    FullMatrix<T>* full = new FullMatrix<T>(reader.template array<T>(rows, cols), rows, cols);
+    if (reader.get<int>()) {
+      full->pivots = (int*) calloc(rows, sizeof(int));
+      HMAT_ASSERT(full->pivots || rows == 0);
+      reader.getArray(full->pivots, rows);
+    }
+    if (reader.get<int>())
+      full->diagonal = new Vector<T>(reader.template array<T>(rows, 1), rows);
+    m->full(full);
+  }
+  return m;
+}
+
+// Explicit template instantiation
+template class HMatrixFile<S_t>;
+template class HMatrixFile<D_t>;
+template class HMatrixFile<C_t>;
+template class HMatrixFile<Z_t>;
+
+}  // end namespace hmat
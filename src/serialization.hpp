@@ -0,0 +1,96 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Binary file format of a complete HMatrix.
+*/
+#ifndef _SERIALIZATION_HPP
+#define _SERIALIZATION_HPP
+
+#include "hmat/hmat.h"
+#include <cstddef>
+
+namespace hmat {
+
+template<typename T> class HMatrix;
+struct MatrixSettings;
+class HMatrixFileReader;
+
+/*! \brief Private memory mapping of a whole file.
+
+  The mapping is copy-on-write: pages may be modified in memory, the file is
+  never changed.
+ */
+class MappedFile {
+public:
+  explicit MappedFile(const char* filename);
+  ~MappedFile();
+  const char* data() const { return (const char*) address_; }
+  char* data() { return (char*) address_; }
+  size_t size() const { return size_; }
+private:
+  void* address_;
+  size_t size_;
+  MappedFile(const MappedFile&);
+  void operator=(const MappedFile&);
+};
+
+/*! \brief Write and read an HMatrix with its cluster trees.
+
+  The file starts with a header and a structure section holding the cluster
+  trees (permutation, coordinates, group indices and nodes), the block tree,
+  and the description of each leaf. It is followed by a page aligned payload
+  section holding the arrays of the full blocks, of the Rk factors A and B,
+  and the diagonals of LDL^t factored blocks, each aligned on a cache line.
+
+  The payload is not copied at load time: the leaves of the loaded HMatrix
+  are views on a \a MappedFile, so that pages are only read when needed and
+  are shared with the page cache.
+ */
+template<typename T> class HMatrixFile {
+public:
+  /** Write a matrix to a file.
+
+      \param m the root of the matrix, its cluster trees are also saved
+      \param factorization the factorization done on m, if any
+      \param filename output filename
+   */
+  static void write(const HMatrix<T>* m, hmat_factorization_t factorization, const char* filename);
+
+  /** Build the matrix stored in a mapped file.
+
+      The returned matrix owns its cluster trees, its leaves reference the
+      memory of file, which must outlive it.
+
+      \param file a file written by \a write()
+      \param settings settings of the returned matrix
+      \param factorization set to the factorization done on the matrix
+   */
+  static HMatrix<T>* read(MappedFile& file, const MatrixSettings* settings,
+                          hmat_factorization_t* factorization);
+private:
+  static HMatrix<T>* readNode(HMatrixFileReader& reader);
+};
+
+}  // end namespace hmat
+#endif
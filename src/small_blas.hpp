@@ -0,0 +1,151 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Products of small matrices, without the overhead of a BLAS call.
+*/
+#ifndef _SMALL_BLAS_HPP
+#define _SMALL_BLAS_HPP
+
+#include "data_types.hpp"
+
+namespace hmat {
+namespace small_blas {
+
+/// Products with more terms in op(A) are left to BLAS
+const double MAX_SIZE = 256. * 256.;
+
+/** c += alpha * a * b, for an m x k matrix a and one column b.
+
+    Columns of a are processed 4 at a time, so that c is loaded and stored
+    once for 4 of them, and the loop on the rows is vectorized.
+ */
+template<typename T>
+void gemvN(int m, int k, T alpha, const T* a, int lda, const T* b, T* c) {
+  int p = 0;
+  for (; p + 4 <= k; p += 4) {
+    const T s0 = alpha * b[p], s1 = alpha * b[p + 1];
+    const T s2 = alpha * b[p + 2], s3 = alpha * b[p + 3];
+    const T* a0 = a + ((size_t) p) * lda;
+    const T* a1 = a0 + lda;
+    const T* a2 = a1 + lda;
+    const T* a3 = a2 + lda;
+    for (int i = 0; i < m; i++)
+      c[i] += (a0[i] * s0 + a1[i] * s1) + (a2[i] * s2 + a3[i] * s3);
+  }
+  for (; p < k; p++) {
+    const T s = alpha * b[p];
+    const T* a0 = a + ((size_t) p) * lda;
+    for (int i = 0; i < m; i++)
+      c[i] += a0[i] * s;
+  }
+}
+
+/** c += alpha * a^T * b, for a k x m matrix a and one column b.
+
+    Each element of c is a dot product, 4 of them are computed together.
+ */
+template<typename T>
+void gemvT(int m, int k, T alpha, const T* a, int lda, const T* b, T* c) {
+  int i = 0;
+  for (; i + 4 <= m; i += 4) {
+    const T* a0 = a + ((size_t) i) * lda;
+    const T* a1 = a0 + lda;
+    const T* a2 = a1 + lda;
+    const T* a3 = a2 + lda;
+    T s0 = Constants<T>::zero, s1 = Constants<T>::zero;
+    T s2 = Constants<T>::zero, s3 = Constants<T>::zero;
+    for (int p = 0; p < k; p++) {
+      s0 += a0[p] * b[p];
+      s1 += a1[p] * b[p];
+      s2 += a2[p] * b[p];
+      s3 += a3[p] * b[p];
+    }
+    c[i] += alpha * s0;
+    c[i + 1] += alpha * s1;
+    c[i + 2] += alpha * s2;
+    c[i + 3] += alpha * s3;
+  }
+  for (; i < m; i++) {
+    const T* a0 = a + ((size_t) i) * lda;
+    T s = Constants<T>::zero;
+    for (int p = 0; p < k; p++)
+      s += a0[p] * b[p];
+    c[i] += alpha * s;
+  }
+}
+
+/** c = alpha * op(a) * b + beta * c, op(a) being a (TransA false) or a^T (TransA true).
+
+    The arguments are the ones of the BLAS gemm with transB = 'N'.
+ */
+template<typename T, bool TransA>
+void gemm(int m, int n, int k, T alpha, const T* a, int lda, const T* b, int ldb,
+          T beta, T* c, int ldc) {
+  for (int j = 0; j < n; j++) {
+    T* cj = c + ((size_t) j) * ldc;
+    if (beta == Constants<T>::zero) {
+      for (int i = 0; i < m; i++)
+        cj[i] = Constants<T>::zero;
+    } else if (beta != Constants<T>::pone) {
+      for (int i = 0; i < m; i++)
+        cj[i] = beta * cj[i];
+    }
+    if (TransA)
+      gemvT(m, k, alpha, a, lda, b + ((size_t) j) * ldb, cj);
+    else
+      gemvN(m, k, alpha, a, lda, b + ((size_t) j) * ldb, cj);
+  }
+}
+
+/** True for the types the kernels are faster than BLAS for, the real ones. */
+template<typename T> struct Enabled { static const bool value = false; };
+template<> struct Enabled<S_t> { static const bool value = true; };
+template<> struct Enabled<D_t> { static const bool value = true; };
+
+/** Tell whether gemm() handles this product and is faster than BLAS for it.
+
+    This is the case of the products of a real matrix by a single column:
+    BLAS gemm has a large overhead for them, from 2 times the cost of gemm().
+    With more columns or complex types, BLAS gemm is as fast or faster.
+ */
+template<typename T>
+bool applies(char transA, char transB, int m, int n, int k) {
+  return Enabled<T>::value && n == 1 && transB == 'N' && (transA == 'N' || transA == 'T')
+    && ((double) m) * k <= MAX_SIZE;
+}
+
+/** c = alpha * op(a) * b + beta * c, with transA 'N' or 'T', see applies(). */
+template<typename T>
+void gemm(char transA, int m, int n, int k, T alpha, const T* a, int lda, const T* b, int ldb,
+          T beta, T* c, int ldc) {
+  if (transA == 'N')
+    gemm<T, false>(m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+  else
+    gemm<T, true>(m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+
+}  // end namespace small_blas
+}  // end namespace hmat
+
+#endif
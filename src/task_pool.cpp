@@ -0,0 +1,337 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+#include "config.h"
+
+#include "task_pool.hpp"
+#include "lapack_exception.hpp"
+#include "common/context.hpp"
+#include "common/my_assert.h"
+
+#include <algorithm>
+#include <deque>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <time.h>
+#endif
+
+namespace hmat {
+
+int TaskPool::defaultThreadCount_ = 1;
+
+void TaskPool::setDefaultThreadCount(int n) {
+  HMAT_ASSERT(n >= 0);
+  defaultThreadCount_ = n;
+}
+
+int TaskPool::defaultThreadCount() {
+  if (defaultThreadCount_ > 0)
+    return defaultThreadCount_;
+#ifdef _OPENMP
+  return omp_get_num_procs();
+#else
+  return 1;
+#endif
+}
+
+int TaskPool::workerIndex() {
+#ifdef _OPENMP
+  return omp_in_parallel() ? omp_get_thread_num() : 0;
+#else
+  return 0;
+#endif
+}
+
+TaskPool::TaskPool(int nbThreads)
+  : nbThreads_(nbThreads > 0 ? nbThreads : defaultThreadCount()) {
+#ifndef _OPENMP
+  nbThreads_ = 1;
+#endif
+}
+
+TaskPool::~TaskPool() {
+  // Tasks which were submitted but never run
+  for (size_t i = 0; i < tasks_.size(); i++)
+    delete tasks_[i];
+}
+
+void TaskPool::addEdge(Task* from, Task* to) {
+  if (from == to)
+    return;
+  // Edges toward a given task are all created while it is submitted, so a
+  // duplicate can only be the last one.
+  if (!from->successors_.empty() && from->successors_.back() == to)
+    return;
+  from->successors_.push_back(to);
+  to->pending_++;
+}
+
+void TaskPool::submit(Task* task, const std::vector<const void*>& reads,
+                      const std::vector<const void*>& writes) {
+  for (size_t i = 0; i < reads.size(); i++) {
+    Handle& h = handles_[reads[i]];
+    if (h.lastWriter)
+      addEdge(h.lastWriter, task);
+    h.readers.push_back(task);
+  }
+  for (size_t i = 0; i < writes.size(); i++) {
+    Handle& h = handles_[writes[i]];
+    if (h.lastWriter)
+      addEdge(h.lastWriter, task);
+    for (size_t j = 0; j < h.readers.size(); j++)
+      addEdge(h.readers[j], task);
+    h.readers.clear();
+    h.lastWriter = task;
+  }
+  tasks_.push_back(task);
+}
+
+void TaskPool::submit(Task* task) {
+  tasks_.push_back(task);
+}
+
+void TaskPool::run() {
+  DECLARE_CONTEXT;
+  handles_.clear();
+  if (nbThreads_ <= 1 || tasks_.size() <= 1)
+    runSequential();
+  else
+    runParallel();
+  tasks_.clear();
+}
+
+void TaskPool::runSequential() {
+  for (size_t i = 0; i < tasks_.size(); i++) {
+    Task* t = tasks_[i];
+    tasks_[i] = NULL;
+    try {
+      t->run();
+    } catch (...) {
+      delete t;
+      throw;
+    }
+    delete t;
+  }
+}
+
+#ifdef _OPENMP
+namespace {
+
+/** Double ended queue of ready tasks, owned by a worker. */
+class WorkQueue {
+public:
+  WorkQueue() { omp_init_lock(&lock_); }
+  ~WorkQueue() { omp_destroy_lock(&lock_); }
+  void push(Task* t) {
+    omp_set_lock(&lock_);
+    tasks_.push_back(t);
+    omp_unset_lock(&lock_);
+  }
+  /** Most recent task, for the owner. */
+  Task* pop() {
+    Task* t = NULL;
+    omp_set_lock(&lock_);
+    if (!tasks_.empty()) {
+      t = tasks_.back();
+      tasks_.pop_back();
+    }
+    omp_unset_lock(&lock_);
+    return t;
+  }
+  /** Oldest task, for the thieves. */
+  Task* steal() {
+    Task* t = NULL;
+    omp_set_lock(&lock_);
+    if (!tasks_.empty()) {
+      t = tasks_.front();
+      tasks_.pop_front();
+    }
+    omp_unset_lock(&lock_);
+    return t;
+  }
+private:
+  std::deque<Task*> tasks_;
+  omp_lock_t lock_;
+  WorkQueue(const WorkQueue&);
+  void operator=(const WorkQueue&);
+};
+
+bool higherPriority(const Task* a, const Task* b) {
+  return a->priority() > b->priority();
+}
+
+/** Wait before looking for a ready task again, so that the idle workers
+    leave the processors to the busy ones.
+
+    \param idleRounds number of consecutive rounds without finding a task
+ */
+void backoff(int idleRounds) {
+#ifdef _WIN32
+  Sleep(idleRounds < 64 ? 0 : 1);
+#else
+  if (idleRounds < 64) {
+    sched_yield();
+  } else {
+    struct timespec delay = { 0, 50000 };
+    nanosleep(&delay, NULL);
+  }
+#endif
+}
+
+/** First exception thrown by a task.
+
+    Exceptions cannot leave an OpenMP parallel region, so it is kept and
+    thrown again after the region. Without std::exception_ptr, only its type
+    is kept for the LapackException and std::bad_alloc, and its message for
+    the other ones.
+ */
+class TaskError {
+public:
+  TaskError() : kind_(NONE) {}
+  bool failed() const { return kind_ != NONE; }
+  void set(const LapackException& e) { kind_ = LAPACK; lapack_ = e; }
+  void set(const std::bad_alloc&) { kind_ = BAD_ALLOC; }
+  void set(const std::exception& e) { kind_ = OTHER; message_ = e.what(); }
+  void setUnknown() { kind_ = OTHER; message_ = "unknown exception in a task"; }
+  void rethrow() const {
+    switch (kind_) {
+    case NONE: return;
+    case LAPACK: throw lapack_;
+    case BAD_ALLOC: throw std::bad_alloc();
+    default: throw std::runtime_error(message_);
+    }
+  }
+private:
+  enum Kind { NONE, LAPACK, BAD_ALLOC, OTHER } kind_;
+  LapackException lapack_;
+  std::string message_;
+};
+
+}  // end anonymous namespace
+
+void TaskPool::runParallel() {
+  const int n = nbThreads_;
+  std::vector<Task*> ready;
+  for (size_t i = 0; i < tasks_.size(); i++)
+    if (tasks_[i]->pending_ == 0)
+      ready.push_back(tasks_[i]);
+  HMAT_ASSERT(!ready.empty());
+  std::stable_sort(ready.begin(), ready.end(), higherPriority);
+
+  // Queues are popped from their back, so the most expensive tasks are pushed last
+  std::vector<WorkQueue*> queues(n);
+  for (int i = 0; i < n; i++)
+    queues[i] = new WorkQueue();
+  for (int i = (int) ready.size() - 1; i >= 0; i--)
+    queues[i % n]->push(ready[i]);
+
+  int remaining = tasks_.size();
+  int failed = 0;
+  TaskError error;
+
+  // Outside of the parallel region, TaskPool::workerIndex() returns 0 instead
+  // of -1 for the root of the traces, but no context is entered or left
+  // there while it is set.
+  tracing_set_worker_index_func(TaskPool::workerIndex);
+#pragma omp parallel num_threads(n)
+  {
+    const int me = omp_get_thread_num() % n;
+    int idleRounds = 0;
+    while (true) {
+      int left;
+#pragma omp atomic read
+      left = remaining;
+      if (left == 0)
+        break;
+      Task* t = queues[me]->pop();
+      for (int v = 1; t == NULL && v < n; v++)
+        t = queues[(me + v) % n]->steal();
+      if (t == NULL) {
+        backoff(idleRounds++);
+        continue;
+      }
+      idleRounds = 0;
+      int skip;
+#pragma omp atomic read
+      skip = failed;
+      // After an error, the remaining tasks are only released, not executed
+      if (!skip) {
+        TaskError e;
+        try {
+          t->run();
+        } catch (LapackException& ex) {
+          e.set(ex);
+        } catch (std::bad_alloc& ex) {
+          e.set(ex);
+        } catch (std::exception& ex) {
+          e.set(ex);
+        } catch (...) {
+          e.setUnknown();
+        }
+        if (e.failed()) {
+#pragma omp critical (hmat_task_pool_error)
+          {
+            if (!failed)
+              error = e;
+#pragma omp atomic write
+            failed = 1;
+          }
+        }
+      }
+#pragma omp flush
+      for (size_t i = 0; i < t->successors_.size(); i++) {
+        Task* s = t->successors_[i];
+        int p;
+#pragma omp atomic capture
+        p = --s->pending_;
+        if (p == 0)
+          queues[me]->push(s);
+      }
+      delete t;
+#pragma omp atomic
+      remaining--;
+    }
+  }
+  tracing_set_worker_index_func(NULL);
+
+  for (int i = 0; i < n; i++)
+    delete queues[i];
+  // All the tasks were deleted, even after an error
+  tasks_.clear();
+  error.rethrow();
+}
+#else
+void TaskPool::runParallel() {
+  runSequential();
+}
+#endif
+
+}  // end namespace hmat
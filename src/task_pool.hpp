@@ -0,0 +1,134 @@
+/*
+  HMat-OSS (HMatrix library, open source software)
+
+  Copyright (C) 2014-2015 Airbus Group SAS
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+  http://github.com/jeromerobert/hmat-oss
+*/
+
+/*! \file
+  \ingroup HMatrix
+  \brief Work-stealing pool of tasks with data dependencies.
+*/
+#ifndef _TASK_POOL_HPP
+#define _TASK_POOL_HPP
+
+#include <vector>
+#include <map>
+#include <cstddef>
+
+namespace hmat {
+
+/*! \brief A unit of work executed by a \a TaskPool.
+
+  Subclasses implement \a run(). A task is owned by the pool once submitted,
+  and deleted after its execution.
+ */
+class Task {
+public:
+  Task() : pending_(0), priority_(0.) {}
+  virtual ~Task() {}
+  virtual void run() = 0;
+  /** Tasks with a higher priority are started first among the ready ones. */
+  void setPriority(double p) { priority_ = p; }
+  double priority() const { return priority_; }
+private:
+  friend class TaskPool;
+  /// Tasks which cannot start before this one is done
+  std::vector<Task*> successors_;
+  /// Number of predecessors not yet executed
+  int pending_;
+  double priority_;
+};
+
+/*! \brief Pool of worker threads executing a graph of tasks.
+
+  Tasks are submitted in a sequential order, together with the data they read
+  and write. Data are identified by an opaque pointer (a "handle"), typically
+  an HMatrix node. As with a sequential execution, a task which reads a
+  handle waits for the previous writer, and a task which writes a handle waits
+  for the previous readers and writer. Nothing is executed before \a run()
+  is called.
+
+  The tasks which are ready are distributed on per-thread queues. A worker
+  first takes the most recent task of its own queue, and steals the oldest one
+  of another queue when it runs out of work.
+
+  Workers are OpenMP threads. Without OpenMP, or with a single thread, tasks
+  are executed in their submission order, which is a valid order by
+  construction.
+ */
+class TaskPool {
+public:
+  /** Create a pool.
+
+      \param nbThreads number of worker threads, 0 for \a defaultThreadCount()
+   */
+  explicit TaskPool(int nbThreads = 0);
+  ~TaskPool();
+  /** Submit a task.
+
+      \param task the task, owned by the pool from now on
+      \param reads the handles read by the task
+      \param writes the handles modified by the task
+   */
+  void submit(Task* task, const std::vector<const void*>& reads,
+              const std::vector<const void*>& writes);
+  /** Submit a task without any dependency. */
+  void submit(Task* task);
+  /** Execute all the submitted tasks and wait for their completion.
+
+      The dependency information is reset, so the pool can be reused.
+   */
+  void run();
+  /** Number of worker threads of this pool. */
+  int nbThreads() const { return nbThreads_; }
+
+  /** Number of threads used when none is given, set from \a HMatSettings::nbThreads.
+
+      0 means the number of available processors.
+   */
+  static void setDefaultThreadCount(int n);
+  static int defaultThreadCount();
+  /** Index of the worker running the current task, in [0, nbThreads()).
+
+      Tasks may use it to select per-thread buffers.
+   */
+  static int workerIndex();
+
+private:
+  struct Handle {
+    Task* lastWriter;
+    std::vector<Task*> readers;
+    Handle() : lastWriter(NULL) {}
+  };
+  static void addEdge(Task* from, Task* to);
+  void runSequential();
+  void runParallel();
+
+  int nbThreads_;
+  std::vector<Task*> tasks_;
+  std::map<const void*, Handle> handles_;
+  static int defaultThreadCount_;
+
+  // Disable the copy.
+  TaskPool(const TaskPool&);
+  void operator=(const TaskPool&);
+};
+
+}  // end namespace hmat
+#endif